@@ -98,6 +98,10 @@ int main(int argc, char** argv) {
     // NanoLog::setLogFile("/tmp/logFile");
     NanoLog::setLogFile(BENCHMARK_OUTPUT_FILE);
 
+#ifdef BENCHMARK_BLOCK_COMPRESSION
+    NanoLog::setBlockCompression(NanoLog::LZ_BLOCK_COMPRESSION);
+#endif
+
     printf("BENCH_OP = %s\r\n", BENCH_OPS_AS_A_STR);
 
 #ifdef PREPROCESSOR_NANOLOG
@@ -42,8 +42,9 @@ Options:
                                     (default "NANO_LOG("Simple log message with 0 parameters");)
                                     Note: variable int 'i' is accessible here
 
-    --useSnappy                     Enable the logic to compress the NanoLog
-                                    output with snappy https://github.com/google/snappy
+    --blockCompression              Compress the NanoLog output buffers with
+                                    the built-in LZ block codec on a helper
+                                    thread (see NanoLog::setBlockCompression)
 
 Examples:
 
@@ -208,7 +209,7 @@ def main(argv):
 
 
     try:
-      opts, args = getopt.getopt(argv,"hs:o:r:p:i:t:b:",["disableOutput", "disableCompaction", "discardEntriesAtStagingBuffer", "stagingBufferExp=","outputBufferExp=", "releaseThresholdExp=", "pollInterval=", "threads=", "iterations=","benchOp=","useSnappy"])
+      opts, args = getopt.getopt(argv,"hs:o:r:p:i:t:b:",["disableOutput", "disableCompaction", "discardEntriesAtStagingBuffer", "stagingBufferExp=","outputBufferExp=", "releaseThresholdExp=", "pollInterval=", "threads=", "iterations=","benchOp=","blockCompression"])
     except getopt.GetoptError:
       printHelp()
       sys.exit(2)
@@ -234,8 +235,8 @@ def main(argv):
          iterations = int(arg)
       elif opt in ("-b", "--benchOp"):
          benchOp = str(arg)
-      elif opt in ("--useSnappy"):
-        extraDefines += "\r\n#define USE_SNAPPY"
+      elif opt in ("--blockCompression"):
+        extraDefines += "\r\n#define BENCHMARK_BLOCK_COMPRESSION"
       elif opt in ("--discardEntriesAtStagingBuffer"):
         extraDefines += "\r\n#define BENCHMARK_DISCARD_ENTRIES_AT_STAGINGBUFFER"
 
@@ -442,6 +442,14 @@ void testAllTheTypes() {
         (long double)12.0,
         (long double)13.0,
         (long double)14.0);
+
+    const char blob[] = "\x01\x02\xab\xcdNanoLog";
+    NANO_LOG(WARNING,
+        "B=%B %.2B %8.1B %.*B",
+        NanoLog::bytes(blob, 4),
+        NanoLog::bytesAsBase64(blob + 4, 7),
+        NanoLog::bytes(blob, sizeof(blob)),
+        3, NanoLog::bytes(blob, sizeof(blob)));
 }
 
 
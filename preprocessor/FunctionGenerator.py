@@ -32,12 +32,20 @@ RECORD_PRIMITIVE_FN = "NanoLogInternal::Log::recordPrimitive"
 NIBBLE_OBJ = "BufferUtils::TwoNibbles"
 LOG_LEVEL_ENUM = "NanoLog::LogLevel"
 
-LOG_LEVEL_GET_FN = "NanoLog::getLogLevel"
+LOG_LEVEL_CHECK_FN = "NanoLogInternal::RuntimeLogger::isRecorded"
 ALLOC_FN = "NanoLogInternal::RuntimeLogger::reserveAlloc"
 FINISH_ALLOC_FN = "NanoLogInternal::RuntimeLogger::finishAlloc"
 
 PACK_FN = "BufferUtils::pack"
 UNPACK_FN = "BufferUtils::unpack"
+PACK_XOR_FN = "BufferUtils::packXor"
+UNPACK_XOR_FN = "BufferUtils::unpackXor"
+DELTA_BASES = "NanoLogInternal::Log::DeltaBases"
+
+BLOB_TYPE = "NanoLog::Bytes"
+GET_BLOB_BYTES_FN = "NanoLogInternal::Log::getBlobBytes"
+RECORD_BLOB_FN = "NanoLogInternal::Log::recordBlob"
+FORMAT_BLOB_FN = "NanoLogInternal::Log::formatBlob"
 
 GENERATED_CODE_NAMESPACE = "GeneratedFunctions"
 
@@ -253,7 +261,8 @@ struct LogMetadata logId2Metadata[{count}] =
 
 // Map of numerical ids to compression functions
 ssize_t
-(*compressFnArray[{count}]) ({Entry} *re, char* out)
+(*compressFnArray[{count}]) ({Entry} *re, char* out,
+                             {DeltaBases} *deltaBases)
 {{
     {listOfCompressFnNames}
 }};
@@ -262,7 +271,8 @@ ssize_t
 void
 (*decompressAndPrintFnArray[{count}]) (const char **in,
                                         FILE *outputFd,
-                                        void (*aggFn)(const char*, ...))
+                                        void (*aggFn)(const char*, ...),
+                                        {DeltaBases} *deltaBases)
 {{
     {listOfDecompressionFnNames}
 }};
@@ -287,6 +297,7 @@ size_t numLogIds = {count};
 #endif /* BUFFER_STUFFER */
 """.format(count=count,
            Entry=RECORD_ENTRY,
+           DeltaBases=DELTA_BASES,
            listOfLogId2Metadata=",\n".join(logId2Metadata),
            listOfCompressFnNames=",\n".join(compressFnNameArray),
            listOfDecompressionFnNames=",\n".join(decompressFnNameArray),
@@ -356,20 +367,39 @@ size_t numLogIds = {count};
         # Build a list of argument types that the printf-function
         # corresponding to the format string would actually take in.
         argList = []
+
+        # Arguments to pass to printf when decompressing. This differs from
+        # the argList for blobs (%B), which are rendered to strings first and
+        # have already had their precision applied.
+        printfArgList = []
         for fmtSpecifier in fmtSpecifiers:
             if not fmtSpecifier.type:
                 continue
 
+            isBlob = isBlobType(fmtSpecifier.type)
+
             # In addition to the parameter for the specifier, variable
             # variable width/preicsion requires extra parameters.
             if fmtSpecifier.width == '*':
+                printfArgList.append("arg%d" % len(argList))
                 argList.append("int")
 
             if fmtSpecifier.precision == '*':
+                if not isBlob:
+                    printfArgList.append("arg%d" % len(argList))
                 argList.append("int")
 
+            if isBlob:
+                printfArgList.append("arg%dStr.c_str()" % len(argList))
+            else:
+                printfArgList.append("arg%d" % len(argList))
             argList.append(fmtSpecifier.type)
 
+        # The format string printed by the decompressor (blob specifiers
+        # are rewritten to %s's by splitAndParseTypesInFmtString)
+        printFmtString = "".join([fmtSpecifier.substring
+                                  for fmtSpecifier in fmtSpecifiers])
+
         functionParametersString = "".join([", %s arg%d" % (type, idx)
                                           for idx, type in enumerate(argList)])
 
@@ -388,9 +418,10 @@ size_t numLogIds = {count};
         # Generate Record function
         ###
 
-        # Create lists identifying which argument indexes are (not) strings
+        # Create lists identifying which argument indexes are (not) strings.
+        # Blobs are variable length as well, so they're stored as strings.
         stringArgsIdx = [idx for idx, fmt in enumerate(argList)
-                                                if isStringType(fmt)]
+                                    if isStringType(fmt) or isBlobType(fmt)]
         nonStringArgsIdx = [idx for idx, fmt in enumerate(argList)
                                                 if idx not in stringArgsIdx]
 
@@ -406,6 +437,20 @@ size_t numLogIds = {count};
             if fmtSpecifier.width == '*':
                 argNum += 1
 
+            if isBlobType(fmtSpecifier.type):
+                if precision is None:
+                    maxBytes = "-1"
+                elif precision == '*':
+                    maxBytes = "arg%d" % (argNum - 1)
+                else:
+                    maxBytes = str(precision)
+
+                strlenDeclarations.append(
+                    "size_t str{0}Len = sizeof(uint32_t) + {1}(arg{0}.length, "
+                    "{2});".format(argNum, GET_BLOB_BYTES_FN, maxBytes))
+                argNum += 1
+                continue
+
             if not isStringType(fmtSpecifier.type):
                 argNum += 1
                 continue
@@ -451,10 +496,19 @@ size_t numLogIds = {count};
         recordNonStringArgsCode = "".join(["\t%s(buffer, arg%d);\n" % \
                 (RECORD_PRIMITIVE_FN, idx) for idx in nonStringArgsIdx])
 
-        recordStringsArgsCode = ["memcpy(buffer, arg{0}, str{0}Len); "
+        recordStringsArgsCode = []
+        for idx in stringArgsIdx:
+            if isBlobType(argList[idx]):
+                recordStringsArgsCode.append(
+                    "{1}(buffer, arg{0}.data, static_cast<uint32_t>(str{0}Len "
+                    "- sizeof(uint32_t)), arg{0}.base64);".format(idx,
+                                                            RECORD_BLOB_FN))
+                continue
+
+            recordStringsArgsCode.append("memcpy(buffer, arg{0}, str{0}Len); "
                "buffer += str{0}Len;"
                "*(reinterpret_cast<std::remove_const<typename std::remove_pointer<decltype(arg{0})>::type>::type*>(buffer) - 1) = L'\\0';".format(
-                                               idx) for idx in stringArgsIdx]
+                                               idx))
 
         # Start Generating the record code
         recordCode = \
@@ -462,13 +516,16 @@ size_t numLogIds = {count};
 inline {function_declaration} {{
     extern const uint32_t {idVariableName};
 
-    if (level > {getLogLevelFn}())
+    if (!{isRecordedFn}(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     {strlen_declaration};
     size_t allocSize = {primitive_size_sum} {strlen_sum} sizeof({entry});
-    {entry} *re = reinterpret_cast<{entry}*>({alloc_fn}(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    {entry} *re = reinterpret_cast<{entry}*>({alloc_fn}(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = {idVariableName};
     re->timestamp = timestamp;
@@ -483,10 +540,10 @@ inline {function_declaration} {{
     {recordStringsArgsCode}
 
     // Make the entry visible
-    {finishAlloc_fn}(allocSize);
+    {finishAlloc_fn}(allocSize, level, lane);
 }}
 """.format(function_declaration = recordDeclaration,
-       getLogLevelFn=LOG_LEVEL_GET_FN,
+       isRecordedFn=LOG_LEVEL_CHECK_FN,
        strlen_declaration = "\r\n\t".join(strlenDeclarations),
        primitive_size_sum = nonStringSizeOfPartialSum,
        strlen_sum = stringLenPartialSum,
@@ -514,10 +571,25 @@ inline {function_declaration} {{
                     "std::memcpy(&arg{id}, args, sizeof({type})); " \
                 "args +=sizeof({type});\n".format(type=argList[idx], id=idx)
 
+        # Doubles are packed relative to their value in the previous log
+        # message of this invocation site (see BufferUtils::packXor)
+        xorArgsIdx = [idx for idx in nonStringArgsIdx
+                            if isXorEncodedType(argList[idx])]
+        getDeltaBasesCode = ""
+        if xorArgsIdx:
+            getDeltaBasesCode = "uint64_t *bases = deltaBases->getCurrent(%d);" \
+                                "\n    " % len(argList)
+
         packNonStringArgsCode = ""
         for i, idx in enumerate(nonStringArgsIdx):
             mem = "first" if (i % 2 == 0) else "second"
             arrIndex = i / 2
+            if idx in xorArgsIdx:
+                packNonStringArgsCode += \
+                    "\tnib[%d].%s = 0x0f & static_cast<uint8_t>(%s(&out, arg%d, &bases[%d]));\n" \
+                        % (arrIndex, mem, PACK_XOR_FN, idx, idx)
+                continue
+
             packNonStringArgsCode += \
                 "\tnib[%d].%s = 0x0f & static_cast<uint8_t>(%s(&out, arg%d));\n" \
                     % (arrIndex, mem, PACK_FN, idx)
@@ -526,11 +598,11 @@ inline {function_declaration} {{
         compressionCode = \
 """
 inline ssize_t
-{compressFnName}({Entry} *re, char* out) {{
+{compressFnName}({Entry} *re, char* out, {DeltaBases} *deltaBases) {{
     char *originalOutPtr = out;
 
     // Allocate nibbles
-    {Nibble} *nib = reinterpret_cast<{Nibble}*>(out);
+    {getDeltaBasesCode}{Nibble} *nib = reinterpret_cast<{Nibble}*>(out);
     out += {nibbleBytes};
 
     char *args = re->argData;
@@ -555,6 +627,8 @@ inline ssize_t
 }}
 """.format(compressFnName=compressFnName,
         Entry=RECORD_ENTRY,
+        DeltaBases=DELTA_BASES,
+        getDeltaBasesCode=getDeltaBasesCode,
         Nibble=NIBBLE_OBJ,
         nibbleBytes=nibbleByteSizes,
         readBackNonStringArgsCode=readBackNonStringArgsCode,
@@ -573,6 +647,12 @@ inline ssize_t
             type = argList[idx]
             member = "first" if (i%2 == 0) else "second"
 
+            if idx in xorArgsIdx:
+                unpackNonStringArgsCode += \
+                    "\t%s arg%d = %s(in, nib[%d].%s, &bases[%d]);\n" % (
+                                type, idx, UNPACK_XOR_FN, i/2, member, idx)
+                continue
+
             unpackNonStringArgsCode += "\t%s arg%d = %s<%s>(in, nib[%d].%s);\n" % (
                                         type, idx, UNPACK_FN, type, i/2, member)
 
@@ -581,6 +661,19 @@ inline ssize_t
         for idx in stringArgsIdx:
             type = argList[idx]
 
+            if isBlobType(type):
+                readbackStringCode += \
+                """
+                uint32_t arg{idx}Length;
+                std::memcpy(&arg{idx}Length, *in, sizeof(uint32_t));
+                (*in) += sizeof(uint32_t);
+                uint32_t arg{idx}Bytes = arg{idx}Length & NanoLogInternal::MAX_BLOB_BYTES;
+                std::string arg{idx}Str = {formatFn}(*in, arg{idx}Bytes,
+                        arg{idx}Length & NanoLogInternal::BLOB_BASE64_FLAG);
+                (*in) += arg{idx}Bytes;
+            """.format(idx=idx, formatFn=FORMAT_BLOB_FN)
+                continue
+
             strlenFn = "strlen" if not isWideString(type) else "wcslen"
             readbackStringCode += \
             """
@@ -595,8 +688,9 @@ inline ssize_t
 inline void
 {decompressFnName} (const char **in,
                         FILE *outputFd,
-                        void (*aggFn)(const char*, ...)) {{
-    {Nibble} nib[{nibbleBytes}];
+                        void (*aggFn)(const char*, ...),
+                        {DeltaBases} *deltaBases) {{
+    {getDeltaBasesCode}{Nibble} nib[{nibbleBytes}];
     memcpy(&nib, (*in), {nibbleBytes});
     (*in) += {nibbleBytes};
 
@@ -612,22 +706,25 @@ inline void
     const {logLevelEnum} logLevel = {logLevel};
 
     if (outputFd)
-        fprintf(outputFd, "{fmtString}" "\\r\\n" {printfArgs});
+        fprintf(outputFd, "{printFmtString}" "\\r\\n" {printfArgs});
 
     if (aggFn)
-        (*aggFn)("{fmtString}" {printfArgs});
+        (*aggFn)("{printFmtString}" {printfArgs});
 }}
 """.format(decompressFnName=decompressFnName,
+        DeltaBases=DELTA_BASES,
+        getDeltaBasesCode=getDeltaBasesCode,
         Nibble=NIBBLE_OBJ,
         nibbleBytes=nibbleByteSizes,
         unpackNonStringArgsCode=unpackNonStringArgsCode,
         readbackStringCode=readbackStringCode,
         fmtString=fmtString,
+        printFmtString=printFmtString,
         filename=filename,
         linenum=linenum,
         logLevelEnum=LOG_LEVEL_ENUM,
         logLevel=logLevel,
-        printfArgs="".join([", arg%d" % i for i, type in enumerate(argList)])
+        printfArgs="".join([", " + arg for arg in printfArgList])
 )
         dictionaryFragment = """
 {{
@@ -658,16 +755,27 @@ inline void
 
         count = 0
         for (type, width, precision, substring) in fmtSpecifiers:
-            if type:
+            if isBlobType(type):
+                enumType = "blob_t"
+            elif type:
                 enumType = type.replace(" ", "_") + "_t"
                 enumType = enumType.replace("*", "_ptr")
             else:
                 enumType = "NONE"
 
+            # Delta encoded fragments are prefixed with their actual type
+            fragmentLength = 'sizeof("%s")/sizeof(char)' % substring
+            prefixCode = ""
+            if type and isXorEncodedType(type):
+                fragmentLength = "1 + " + fragmentLength
+                prefixCode = "*buffer++ = static_cast<char>(%s);\n" \
+                             "            " % enumType
+                enumType = "delta_t"
+
             dictionaryFragment += """
             // Fragment {count}
             if (buffer + sizeof(PrintFragment)
-                        + sizeof("{substring}")/sizeof(char) >= endOfBuffer)
+                        + {fragmentLength} >= endOfBuffer)
                 return -1;
 
             pf = reinterpret_cast<PrintFragment*>(buffer);
@@ -676,13 +784,16 @@ inline void
             pf->argType = {type};
             pf->hasDynamicWidth = {width};
             pf->hasDynamicPrecision = {precision};
-            pf->fragmentLength = sizeof("{substring}")/sizeof(char);
+            pf->hasFieldName = false;
+            pf->fragmentLength = {fragmentLength};
 
-            buffer = stpcpy(buffer, "{substring}") + 1;
+            {prefixCode}buffer = stpcpy(buffer, "{substring}") + 1;
 """.format(count=count,
            type=enumType,
            width="true" if width == '*' else "false",
            precision="true" if precision == '*' else "false",
+           fragmentLength=fragmentLength,
+           prefixCode=prefixCode,
            substring=substring
             )
             count += 1
@@ -765,7 +876,7 @@ def splitAndParseTypesInFmtString(fmtString):
                                  "(?P<width>[\\d]+|\\*)?"
                                  "(\\.(?P<precision>\\d+|\\*))?"
                                  "(?P<length>hh|h|l|ll|j|z|Z|t|L)?"
-                                 "(?P<specifier>[diuoxXfFeEgGaAcspn])",
+                                 "(?P<specifier>[diuoxXfFeEgGaAcspnB])",
                                  fmtString[charIndex:])
 
                 if match:
@@ -773,6 +884,15 @@ def splitAndParseTypesInFmtString(fmtString):
                     substring = fmtString[startOfNextSpecifierSubstring:endPos]
                     startOfNextSpecifierSubstring = endPos
 
+                    # Blobs (%B) are rendered to strings by the decompressor
+                    # so their specifier is printed as a %s with the same
+                    # width (the precision limits the bytes recorded instead)
+                    if match.group('specifier') == 'B':
+                        flags = match.group('flags') or ""
+                        substring = substring[:-len(match.group(0))] + "%" + \
+                                    ("-" if "-" in flags else "") + \
+                                    (match.group('width') or "") + "s"
+
                     matches.append((match, substring))
                 elif not re.match("%%", fmtString[charIndex:]):
                     raise ValueError("Unrecognized Format Specifier: \"%s\"" %
@@ -857,6 +977,12 @@ def splitAndParseTypesInFmtString(fmtString):
             else:
                 raise ValueError("Invalid arguments for format specifier "
                                     + fmt.group())
+        elif specifier == "B":
+            if not length:
+                types.append(FmtType(BLOB_TYPE, width, precision, substring))
+            else:
+                raise ValueError("Invalid arguments for format specifier "
+                                 + fmt.group())
         elif specifier == "c":
             if not length:
                 types.append(FmtType("int", width, precision, substring))
@@ -880,6 +1006,21 @@ def isStringType(typeStr):
             -1 != typeStr.find("char*") or
             -1 != typeStr.find("wchar_t*"))
 
+# Given a C++ type (such as 'int') as identified by parseTypesInFmtString,
+# determine whether that type is a binary blob (i.e. %B) or not.
+#
+# \param typeStr - Whether a FmtType is a blob or not in C/C++ land
+def isBlobType(typeStr):
+    return typeStr == BLOB_TYPE
+
+# Given a C++ type (such as 'int') as identified by parseTypesInFmtString,
+# determine whether that type is packed relative to its previous value (i.e.
+# with BufferUtils::packXor) or not.
+#
+# \param typeStr - Whether a FmtType is XOR encoded or not in C/C++ land
+def isXorEncodedType(typeStr):
+    return typeStr == "double"
+
 # Given a C++ type (such as 'int') as identified by parseTypesInFmtString,
 # determine whether that type is a wide string or not.
 #
@@ -438,6 +438,36 @@ class FunctionGeneratorTestCase(unittest.TestCase):
                            FmtType('double', '*', '*', " %0*.*lf")
                          ])
 
+    def test_parseTypesInFmtString_blobs(self):
+        self.assertEqual(splitAndParseTypesInFmtString("pkt %B %-8.16B %*.*B!"),
+                         [FmtType('NanoLog::Bytes', None, None, "pkt %s"),
+                          FmtType('NanoLog::Bytes', 8, 16, " %-8s"),
+                          FmtType('NanoLog::Bytes', '*', '*', " %*s!")])
+
+        self.assertEqual(splitAndParseTypesInFmtString("100%%B %B"),
+                         [FmtType('NanoLog::Bytes', None, None, "100%%B %s")])
+
+        with self.assertRaisesRegex(ValueError, "Invalid arguments"):
+            splitAndParseTypesInFmtString("%lB")
+
+    def test_generateLogFunctions_blobs(self):
+        fg = FunctionGenerator()
+
+        fmtStr = "pkt %.*B from %s"
+        ret = fg.generateLogFunctions("ERROR", fmtStr, "testFile.cc",
+                                            "testFile.cc", 100)
+        logId = generateLogIdStr(fmtStr, "testFile.cc", 100)
+        self.assertIn("int arg0, NanoLog::Bytes arg1, const char* arg2", ret[0])
+
+        code = fg.logId2Code[logId]
+        self.assertIn("getBlobBytes(arg1.length, arg0)", code["recordFnDef"])
+        self.assertIn("recordBlob(buffer, arg1.data", code["recordFnDef"])
+
+        # The precision is applied at record time, so it's not printed
+        self.assertIn('"pkt %s from %s" "\\r\\n" , arg1Str.c_str(), arg2',
+                      code["decompressFnDef"])
+        self.assertIn("pf->argType = blob_t", code["dictionaryFragment"])
+
     def test_lengthModifiers(self):
         self.assertEqual(splitAndParseTypesInFmtString("%hhd %hd %ld %lld %jd %zd %09.2td"),
                          [FmtType("signed char", None, None, "%hhd"),
@@ -551,13 +581,16 @@ class FunctionGeneratorTestCase(unittest.TestCase):
 inline void __syang0__fl{logId}(NanoLog::LogLevel level, const char* fmtStr ) {{
     extern const uint32_t __fmtId{logId};
 
-    if (level > NanoLog::getLogLevel())
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     ;
     size_t allocSize =   sizeof(NanoLogInternal::Log::UncompressedEntry);
-    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = __fmtId{logId};
     re->timestamp = timestamp;
@@ -572,7 +605,7 @@ inline void __syang0__fl{logId}(NanoLog::LogLevel level, const char* fmtStr ) {{
     %s
 
     // Make the entry visible
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize, level, lane);
 }}
 """ % ("", "")
         fg = FunctionGenerator()
@@ -683,6 +716,9 @@ inline void __syang0__fl{logId}(NanoLog::LogLevel level, const char* fmtStr ) {{
         self.assertFalse(isStringType("void*"))
         self.assertFalse(isStringType(None))
 
+        self.assertTrue(isBlobType("NanoLog::Bytes"))
+        self.assertFalse(isBlobType("const char*"))
+
     def test_isStringType_integration(self):
         fmtSpecifiers = splitAndParseTypesInFmtString("%d %lf %0.2lf %s %ls")
 
@@ -34,13 +34,16 @@ using namespace NanoLog::LogLevels;
 inline void __syang0__fl__A__mar46cc__293__(NanoLog::LogLevel level, const char* fmtStr ) {
     extern const uint32_t __fmtId__A__mar46cc__293__;
 
-    if (level > NanoLog::getLogLevel())
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     ;
     size_t allocSize =   sizeof(NanoLogInternal::Log::UncompressedEntry);
-    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = __fmtId__A__mar46cc__293__;
     re->timestamp = timestamp;
@@ -55,12 +58,12 @@ inline void __syang0__fl__A__mar46cc__293__(NanoLog::LogLevel level, const char*
     
 
     // Make the entry visible
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize, level, lane);
 }
 
 
 inline ssize_t
-compressArgs__A__mar46cc__293__(NanoLogInternal::Log::UncompressedEntry *re, char* out) {
+compressArgs__A__mar46cc__293__(NanoLogInternal::Log::UncompressedEntry *re, char* out, NanoLogInternal::Log::DeltaBases *deltaBases) {
     char *originalOutPtr = out;
 
     // Allocate nibbles
@@ -92,7 +95,8 @@ compressArgs__A__mar46cc__293__(NanoLogInternal::Log::UncompressedEntry *re, cha
 inline void
 decompressPrintArgs__A__mar46cc__293__ (const char **in,
                         FILE *outputFd,
-                        void (*aggFn)(const char*, ...)) {
+                        void (*aggFn)(const char*, ...),
+                        NanoLogInternal::Log::DeltaBases *deltaBases) {
     BufferUtils::TwoNibbles nib[0];
     memcpy(&nib, (*in), 0);
     (*in) += 0;
@@ -119,13 +123,16 @@ decompressPrintArgs__A__mar46cc__293__ (const char **in,
 inline void __syang0__fl__A__mar46h__1__(NanoLog::LogLevel level, const char* fmtStr ) {
     extern const uint32_t __fmtId__A__mar46h__1__;
 
-    if (level > NanoLog::getLogLevel())
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     ;
     size_t allocSize =   sizeof(NanoLogInternal::Log::UncompressedEntry);
-    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = __fmtId__A__mar46h__1__;
     re->timestamp = timestamp;
@@ -140,12 +147,12 @@ inline void __syang0__fl__A__mar46h__1__(NanoLog::LogLevel level, const char* fm
     
 
     // Make the entry visible
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize, level, lane);
 }
 
 
 inline ssize_t
-compressArgs__A__mar46h__1__(NanoLogInternal::Log::UncompressedEntry *re, char* out) {
+compressArgs__A__mar46h__1__(NanoLogInternal::Log::UncompressedEntry *re, char* out, NanoLogInternal::Log::DeltaBases *deltaBases) {
     char *originalOutPtr = out;
 
     // Allocate nibbles
@@ -177,7 +184,8 @@ compressArgs__A__mar46h__1__(NanoLogInternal::Log::UncompressedEntry *re, char*
 inline void
 decompressPrintArgs__A__mar46h__1__ (const char **in,
                         FILE *outputFd,
-                        void (*aggFn)(const char*, ...)) {
+                        void (*aggFn)(const char*, ...),
+                        NanoLogInternal::Log::DeltaBases *deltaBases) {
     BufferUtils::TwoNibbles nib[0];
     memcpy(&nib, (*in), 0);
     (*in) += 0;
@@ -204,13 +212,16 @@ decompressPrintArgs__A__mar46h__1__ (const char **in,
 inline void __syang0__fl__B__mar46cc__294__(NanoLog::LogLevel level, const char* fmtStr ) {
     extern const uint32_t __fmtId__B__mar46cc__294__;
 
-    if (level > NanoLog::getLogLevel())
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     ;
     size_t allocSize =   sizeof(NanoLogInternal::Log::UncompressedEntry);
-    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = __fmtId__B__mar46cc__294__;
     re->timestamp = timestamp;
@@ -225,12 +236,12 @@ inline void __syang0__fl__B__mar46cc__294__(NanoLog::LogLevel level, const char*
     
 
     // Make the entry visible
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize, level, lane);
 }
 
 
 inline ssize_t
-compressArgs__B__mar46cc__294__(NanoLogInternal::Log::UncompressedEntry *re, char* out) {
+compressArgs__B__mar46cc__294__(NanoLogInternal::Log::UncompressedEntry *re, char* out, NanoLogInternal::Log::DeltaBases *deltaBases) {
     char *originalOutPtr = out;
 
     // Allocate nibbles
@@ -262,7 +273,8 @@ compressArgs__B__mar46cc__294__(NanoLogInternal::Log::UncompressedEntry *re, cha
 inline void
 decompressPrintArgs__B__mar46cc__294__ (const char **in,
                         FILE *outputFd,
-                        void (*aggFn)(const char*, ...)) {
+                        void (*aggFn)(const char*, ...),
+                        NanoLogInternal::Log::DeltaBases *deltaBases) {
     BufferUtils::TwoNibbles nib[0];
     memcpy(&nib, (*in), 0);
     (*in) += 0;
@@ -289,13 +301,16 @@ decompressPrintArgs__B__mar46cc__294__ (const char **in,
 inline void __syang0__fl__C__mar46cc__200__(NanoLog::LogLevel level, const char* fmtStr ) {
     extern const uint32_t __fmtId__C__mar46cc__200__;
 
-    if (level > NanoLog::getLogLevel())
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     ;
     size_t allocSize =   sizeof(NanoLogInternal::Log::UncompressedEntry);
-    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = __fmtId__C__mar46cc__200__;
     re->timestamp = timestamp;
@@ -310,12 +325,12 @@ inline void __syang0__fl__C__mar46cc__200__(NanoLog::LogLevel level, const char*
     
 
     // Make the entry visible
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize, level, lane);
 }
 
 
 inline ssize_t
-compressArgs__C__mar46cc__200__(NanoLogInternal::Log::UncompressedEntry *re, char* out) {
+compressArgs__C__mar46cc__200__(NanoLogInternal::Log::UncompressedEntry *re, char* out, NanoLogInternal::Log::DeltaBases *deltaBases) {
     char *originalOutPtr = out;
 
     // Allocate nibbles
@@ -347,7 +362,8 @@ compressArgs__C__mar46cc__200__(NanoLogInternal::Log::UncompressedEntry *re, cha
 inline void
 decompressPrintArgs__C__mar46cc__200__ (const char **in,
                         FILE *outputFd,
-                        void (*aggFn)(const char*, ...)) {
+                        void (*aggFn)(const char*, ...),
+                        NanoLogInternal::Log::DeltaBases *deltaBases) {
     BufferUtils::TwoNibbles nib[0];
     memcpy(&nib, (*in), 0);
     (*in) += 0;
@@ -374,13 +390,16 @@ decompressPrintArgs__C__mar46cc__200__ (const char **in,
 inline void __syang0__fl__D3237d__s46cc__100__(NanoLog::LogLevel level, const char* fmtStr , int arg0) {
     extern const uint32_t __fmtId__D3237d__s46cc__100__;
 
-    if (level > NanoLog::getLogLevel())
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     ;
     size_t allocSize = sizeof(arg0) +   sizeof(NanoLogInternal::Log::UncompressedEntry);
-    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = __fmtId__D3237d__s46cc__100__;
     re->timestamp = timestamp;
@@ -396,12 +415,12 @@ inline void __syang0__fl__D3237d__s46cc__100__(NanoLog::LogLevel level, const ch
     
 
     // Make the entry visible
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize, level, lane);
 }
 
 
 inline ssize_t
-compressArgs__D3237d__s46cc__100__(NanoLogInternal::Log::UncompressedEntry *re, char* out) {
+compressArgs__D3237d__s46cc__100__(NanoLogInternal::Log::UncompressedEntry *re, char* out, NanoLogInternal::Log::DeltaBases *deltaBases) {
     char *originalOutPtr = out;
 
     // Allocate nibbles
@@ -435,7 +454,8 @@ compressArgs__D3237d__s46cc__100__(NanoLogInternal::Log::UncompressedEntry *re,
 inline void
 decompressPrintArgs__D3237d__s46cc__100__ (const char **in,
                         FILE *outputFd,
-                        void (*aggFn)(const char*, ...)) {
+                        void (*aggFn)(const char*, ...),
+                        NanoLogInternal::Log::DeltaBases *deltaBases) {
     BufferUtils::TwoNibbles nib[1];
     memcpy(&nib, (*in), 1);
     (*in) += 1;
@@ -463,13 +483,16 @@ decompressPrintArgs__D3237d__s46cc__100__ (const char **in,
 inline void __syang0__fl__E32374s3237424642lf__s46cc__100__(NanoLog::LogLevel level, const char* fmtStr , const char* arg0, int arg1, int arg2, double arg3) {
     extern const uint32_t __fmtId__E32374s3237424642lf__s46cc__100__;
 
-    if (level > NanoLog::getLogLevel())
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     size_t str0Len = 1 + strlen(arg0);;
     size_t allocSize = sizeof(arg1) + sizeof(arg2) + sizeof(arg3) +  str0Len +  sizeof(NanoLogInternal::Log::UncompressedEntry);
-    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = __fmtId__E32374s3237424642lf__s46cc__100__;
     re->timestamp = timestamp;
@@ -487,15 +510,16 @@ inline void __syang0__fl__E32374s3237424642lf__s46cc__100__(NanoLog::LogLevel le
     memcpy(buffer, arg0, str0Len); buffer += str0Len;*(reinterpret_cast<std::remove_const<typename std::remove_pointer<decltype(arg0)>::type>::type*>(buffer) - 1) = L'\0';
 
     // Make the entry visible
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize, level, lane);
 }
 
 
 inline ssize_t
-compressArgs__E32374s3237424642lf__s46cc__100__(NanoLogInternal::Log::UncompressedEntry *re, char* out) {
+compressArgs__E32374s3237424642lf__s46cc__100__(NanoLogInternal::Log::UncompressedEntry *re, char* out, NanoLogInternal::Log::DeltaBases *deltaBases) {
     char *originalOutPtr = out;
 
     // Allocate nibbles
+    uint64_t *bases = deltaBases->getCurrent(4);
     BufferUtils::TwoNibbles *nib = reinterpret_cast<BufferUtils::TwoNibbles*>(out);
     out += 2;
 
@@ -510,7 +534,7 @@ compressArgs__E32374s3237424642lf__s46cc__100__(NanoLogInternal::Log::Uncompress
     // Pack all the primitives
     	nib[0].first = 0x0f & static_cast<uint8_t>(BufferUtils::pack(&out, arg1));
 	nib[0].second = 0x0f & static_cast<uint8_t>(BufferUtils::pack(&out, arg2));
-	nib[1].first = 0x0f & static_cast<uint8_t>(BufferUtils::pack(&out, arg3));
+	nib[1].first = 0x0f & static_cast<uint8_t>(BufferUtils::packXor(&out, arg3, &bases[3]));
 
 
     if (true) {
@@ -530,7 +554,9 @@ compressArgs__E32374s3237424642lf__s46cc__100__(NanoLogInternal::Log::Uncompress
 inline void
 decompressPrintArgs__E32374s3237424642lf__s46cc__100__ (const char **in,
                         FILE *outputFd,
-                        void (*aggFn)(const char*, ...)) {
+                        void (*aggFn)(const char*, ...),
+                        NanoLogInternal::Log::DeltaBases *deltaBases) {
+    uint64_t *bases = deltaBases->getCurrent(4);
     BufferUtils::TwoNibbles nib[2];
     memcpy(&nib, (*in), 2);
     (*in) += 2;
@@ -538,7 +564,7 @@ decompressPrintArgs__E32374s3237424642lf__s46cc__100__ (const char **in,
     // Unpack all the non-string argments
     	int arg1 = BufferUtils::unpack<int>(in, nib[0].first);
 	int arg2 = BufferUtils::unpack<int>(in, nib[0].second);
-	double arg3 = BufferUtils::unpack<double>(in, nib[1].first);
+	double arg3 = BufferUtils::unpackXor(in, nib[1].first, &bases[3]);
 
 
     // Find all the strings
@@ -563,13 +589,16 @@ decompressPrintArgs__E32374s3237424642lf__s46cc__100__ (const char **in,
 inline void __syang0__fl__E__del46cc__199__(NanoLog::LogLevel level, const char* fmtStr ) {
     extern const uint32_t __fmtId__E__del46cc__199__;
 
-    if (level > NanoLog::getLogLevel())
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(level))
         return;
 
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     ;
     size_t allocSize =   sizeof(NanoLogInternal::Log::UncompressedEntry);
-    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize));
+    NanoLogInternal::RuntimeLogger::StagingLane lane;
+    NanoLogInternal::Log::UncompressedEntry *re = reinterpret_cast<NanoLogInternal::Log::UncompressedEntry*>(NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize, level, lane));
+    if (re == nullptr)
+        return;
 
     re->fmtId = __fmtId__E__del46cc__199__;
     re->timestamp = timestamp;
@@ -584,12 +613,12 @@ inline void __syang0__fl__E__del46cc__199__(NanoLog::LogLevel level, const char*
     
 
     // Make the entry visible
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize, level, lane);
 }
 
 
 inline ssize_t
-compressArgs__E__del46cc__199__(NanoLogInternal::Log::UncompressedEntry *re, char* out) {
+compressArgs__E__del46cc__199__(NanoLogInternal::Log::UncompressedEntry *re, char* out, NanoLogInternal::Log::DeltaBases *deltaBases) {
     char *originalOutPtr = out;
 
     // Allocate nibbles
@@ -621,7 +650,8 @@ compressArgs__E__del46cc__199__(NanoLogInternal::Log::UncompressedEntry *re, cha
 inline void
 decompressPrintArgs__E__del46cc__199__ (const char **in,
                         FILE *outputFd,
-                        void (*aggFn)(const char*, ...)) {
+                        void (*aggFn)(const char*, ...),
+                        NanoLogInternal::Log::DeltaBases *deltaBases) {
     BufferUtils::TwoNibbles nib[0];
     memcpy(&nib, (*in), 0);
     (*in) += 0;
@@ -673,7 +703,8 @@ struct LogMetadata logId2Metadata[7] =
 
 // Map of numerical ids to compression functions
 ssize_t
-(*compressFnArray[7]) (NanoLogInternal::Log::UncompressedEntry *re, char* out)
+(*compressFnArray[7]) (NanoLogInternal::Log::UncompressedEntry *re, char* out,
+                             NanoLogInternal::Log::DeltaBases *deltaBases)
 {
     compressArgs__A__mar46cc__293__,
 compressArgs__A__mar46h__1__,
@@ -688,7 +719,8 @@ compressArgs__E__del46cc__199__
 void
 (*decompressAndPrintFnArray[7]) (const char **in,
                                         FILE *outputFd,
-                                        void (*aggFn)(const char*, ...))
+                                        void (*aggFn)(const char*, ...),
+                                        NanoLogInternal::Log::DeltaBases *deltaBases)
 {
     decompressPrintArgs__A__mar46cc__293__,
 decompressPrintArgs__A__mar46h__1__,
@@ -734,6 +766,7 @@ long int writeDictionary(char *buffer, char *endOfBuffer) {
             pf->argType = NONE;
             pf->hasDynamicWidth = false;
             pf->hasDynamicPrecision = false;
+            pf->hasFieldName = false;
             pf->fragmentLength = sizeof("A")/sizeof(char);
 
             buffer = stpcpy(buffer, "A") + 1;
@@ -771,6 +804,7 @@ long int writeDictionary(char *buffer, char *endOfBuffer) {
             pf->argType = NONE;
             pf->hasDynamicWidth = false;
             pf->hasDynamicPrecision = false;
+            pf->hasFieldName = false;
             pf->fragmentLength = sizeof("A")/sizeof(char);
 
             buffer = stpcpy(buffer, "A") + 1;
@@ -808,6 +842,7 @@ long int writeDictionary(char *buffer, char *endOfBuffer) {
             pf->argType = NONE;
             pf->hasDynamicWidth = false;
             pf->hasDynamicPrecision = false;
+            pf->hasFieldName = false;
             pf->fragmentLength = sizeof("B")/sizeof(char);
 
             buffer = stpcpy(buffer, "B") + 1;
@@ -845,6 +880,7 @@ long int writeDictionary(char *buffer, char *endOfBuffer) {
             pf->argType = NONE;
             pf->hasDynamicWidth = false;
             pf->hasDynamicPrecision = false;
+            pf->hasFieldName = false;
             pf->fragmentLength = sizeof("C")/sizeof(char);
 
             buffer = stpcpy(buffer, "C") + 1;
@@ -882,6 +918,7 @@ long int writeDictionary(char *buffer, char *endOfBuffer) {
             pf->argType = int_t;
             pf->hasDynamicWidth = false;
             pf->hasDynamicPrecision = false;
+            pf->hasFieldName = false;
             pf->fragmentLength = sizeof("D %d")/sizeof(char);
 
             buffer = stpcpy(buffer, "D %d") + 1;
@@ -919,23 +956,26 @@ long int writeDictionary(char *buffer, char *endOfBuffer) {
             pf->argType = const_char_ptr_t;
             pf->hasDynamicWidth = false;
             pf->hasDynamicPrecision = false;
+            pf->hasFieldName = false;
             pf->fragmentLength = sizeof("E %4s")/sizeof(char);
 
             buffer = stpcpy(buffer, "E %4s") + 1;
 
             // Fragment 1
             if (buffer + sizeof(PrintFragment)
-                        + sizeof(" %*.*lf")/sizeof(char) >= endOfBuffer)
+                        + 1 + sizeof(" %*.*lf")/sizeof(char) >= endOfBuffer)
                 return -1;
 
             pf = reinterpret_cast<PrintFragment*>(buffer);
             buffer += sizeof(PrintFragment);
 
-            pf->argType = double_t;
+            pf->argType = delta_t;
             pf->hasDynamicWidth = true;
             pf->hasDynamicPrecision = true;
-            pf->fragmentLength = sizeof(" %*.*lf")/sizeof(char);
+            pf->hasFieldName = false;
+            pf->fragmentLength = 1 + sizeof(" %*.*lf")/sizeof(char);
 
+            *buffer++ = static_cast<char>(double_t);
             buffer = stpcpy(buffer, " %*.*lf") + 1;
 }
 
@@ -971,6 +1011,7 @@ long int writeDictionary(char *buffer, char *endOfBuffer) {
             pf->argType = NONE;
             pf->hasDynamicWidth = false;
             pf->hasDynamicPrecision = false;
+            pf->hasFieldName = false;
             pf->fragmentLength = sizeof("E")/sizeof(char);
 
             buffer = stpcpy(buffer, "E") + 1;
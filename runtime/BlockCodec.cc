@@ -0,0 +1,306 @@
+/* Copyright (c) 2016-2020 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstring>
+
+#include "BlockCodec.h"
+
+namespace NanoLogInternal {
+namespace BlockCodec {
+
+// Shortest match the LZ codec encodes
+static const size_t MIN_MATCH = 4;
+
+// Farthest back a match can be (limited by the 2 byte offsets)
+static const size_t MAX_OFFSET = 65535;
+
+// The LZ compressor finds matches through a table of the last position at
+// which each hash of MIN_MATCH bytes was seen.
+static const uint32_t HASH_BITS = 14;
+
+static inline uint32_t
+read32(const uint8_t *in) {
+    uint32_t value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+static inline uint64_t
+read64(const uint8_t *in) {
+    uint64_t value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+static inline uint32_t
+hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/**
+ * Writes the continuation of a length whose nibble in the token is 15.
+ */
+static inline void
+writeLength(uint8_t **out, size_t length) {
+    for (length -= 15; length >= 255; length -= 255)
+        *(*out)++ = 255;
+    *(*out)++ = static_cast<uint8_t>(length);
+}
+
+/**
+ * Reads the continuation of a length whose nibble in the token is 15.
+ *
+ * \return
+ *      False if the length runs past the end of the input or exceeds limit
+ */
+static inline bool
+readLength(const uint8_t **in, const uint8_t *inEnd, size_t limit,
+           size_t *length) {
+    uint8_t byte;
+    do {
+        if (*in >= inEnd || *length > limit)
+            return false;
+
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+/**
+ * Encodes a sequence of literals followed by a match (if matchLength is
+ * non-zero) into out.
+ */
+static inline void
+writeSequence(uint8_t **out, const uint8_t *literals, size_t numLiterals,
+              size_t offset, size_t matchLength) {
+    uint8_t *token = (*out)++;
+    size_t matchNibble = (matchLength > 0) ? matchLength - MIN_MATCH : 0;
+
+    *token = static_cast<uint8_t>(((numLiterals < 15) ? numLiterals : 15) << 4
+                                | ((matchNibble < 15) ? matchNibble : 15));
+    if (numLiterals >= 15)
+        writeLength(out, numLiterals);
+
+    std::memcpy(*out, literals, numLiterals);
+    *out += numLiterals;
+
+    if (matchLength == 0)
+        return;
+
+    *(*out)++ = static_cast<uint8_t>(offset);
+    *(*out)++ = static_cast<uint8_t>(offset >> 8);
+    if (matchNibble >= 15)
+        writeLength(out, matchNibble);
+}
+
+/**
+ * Compresses a block with the LZ codec (see BlockCodec.h).
+ */
+static size_t
+compressLz(const uint8_t *in, size_t length, uint8_t *out) {
+    const uint8_t *inEnd = in + length;
+    const uint8_t *anchor = in;
+    const uint8_t *pos = in;
+    uint8_t *outStart = out;
+
+    uint32_t positions[1 << HASH_BITS];
+    std::memset(positions, 0, sizeof(positions));
+
+    // Incompressible stretches are skipped through with growing strides
+    uint32_t misses = 0;
+
+    while (length >= MIN_MATCH && pos <= inEnd - MIN_MATCH) {
+        uint32_t sequence = read32(pos);
+        uint32_t &position = positions[hash(sequence)];
+        const uint8_t *candidate = in + position;
+        position = static_cast<uint32_t>(pos - in);
+
+        if (candidate >= pos || static_cast<size_t>(pos - candidate) > MAX_OFFSET
+                || read32(candidate) != sequence) {
+            pos += 1 + (misses++ >> 5);
+            continue;
+        }
+
+        const uint8_t *matchEnd = pos + MIN_MATCH;
+        const uint8_t *ref = candidate + MIN_MATCH;
+        while (matchEnd + sizeof(uint64_t) <= inEnd) {
+            uint64_t diff = read64(matchEnd) ^ read64(ref);
+            if (diff != 0) {
+                matchEnd += __builtin_ctzll(diff) >> 3;
+                break;
+            }
+
+            matchEnd += sizeof(uint64_t);
+            ref += sizeof(uint64_t);
+        }
+
+        if (matchEnd + sizeof(uint64_t) > inEnd) {
+            while (matchEnd < inEnd && *matchEnd == *ref) {
+                ++matchEnd;
+                ++ref;
+            }
+        }
+
+        writeSequence(&out, anchor, pos - anchor, pos - candidate,
+                      matchEnd - pos);
+        anchor = pos = matchEnd;
+        misses = 0;
+    }
+
+    writeSequence(&out, anchor, inEnd - anchor, 0, 0);
+    return out - outStart;
+}
+
+/**
+ * Decompresses a block compressed with the LZ codec (see BlockCodec.h),
+ * checking that it neither reads nor writes out of bounds.
+ */
+static bool
+decompressLz(const uint8_t *in, size_t length, uint8_t *out,
+             size_t outLength) {
+    const uint8_t *inEnd = in + length;
+    uint8_t *outStart = out;
+    uint8_t *outEnd = out + outLength;
+
+    while (in < inEnd) {
+        uint8_t token = *in++;
+
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15 && !readLength(&in, inEnd, outLength,
+                                             &numLiterals))
+            return false;
+
+        if (numLiterals > static_cast<size_t>(inEnd - in)
+                || numLiterals > static_cast<size_t>(outEnd - out))
+            return false;
+
+        std::memcpy(out, in, numLiterals);
+        in += numLiterals;
+        out += numLiterals;
+
+        // The last sequence only holds literals
+        if (in == inEnd)
+            return out == outEnd;
+
+        if (inEnd - in < 2)
+            return false;
+
+        size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - outStart))
+            return false;
+
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !readLength(&in, inEnd, outLength,
+                                             &matchLength))
+            return false;
+
+        matchLength += MIN_MATCH;
+        if (matchLength > static_cast<size_t>(outEnd - out))
+            return false;
+
+        const uint8_t *ref = out - offset;
+        if (offset >= matchLength) {
+            std::memcpy(out, ref, matchLength);
+        } else {
+            for (size_t i = 0; i < matchLength; ++i)
+                out[i] = ref[i];
+        }
+
+        out += matchLength;
+    }
+
+    return false;
+}
+
+/**
+ * Returns the largest number of bytes that compress() can output for a block
+ * of the given length, for any codec.
+ *
+ * \param length
+ *      Length of the block to compress
+ */
+size_t
+maxCompressedSize(size_t length) {
+    return length + length/255 + 16;
+}
+
+/**
+ * Compresses a block with a codec.
+ *
+ * \param codec
+ *      Codec to compress the block with
+ * \param in
+ *      Block to compress
+ * \param length
+ *      Length of the block
+ * \param[out] out
+ *      Buffer to output the compressed block to; it must hold at least
+ *      maxCompressedSize(length) bytes.
+ *
+ * \return
+ *      Length of the compressed block
+ */
+size_t
+compress(Codec codec, const char *in, size_t length, char *out) {
+    if (codec == LZ)
+        return compressLz(reinterpret_cast<const uint8_t*>(in), length,
+                          reinterpret_cast<uint8_t*>(out));
+
+    std::memcpy(out, in, length);
+    return length;
+}
+
+/**
+ * Decompresses a block produced by compress().
+ *
+ * \param codec
+ *      Codec the block was compressed with
+ * \param in
+ *      Compressed block
+ * \param length
+ *      Length of the compressed block
+ * \param[out] out
+ *      Buffer to output the decompressed block to
+ * \param outLength
+ *      Length of the block before it was compressed
+ *
+ * \return
+ *      True if the block decompressed to exactly outLength bytes; false if
+ *      it's corrupt or the codec is unknown
+ */
+bool
+decompress(Codec codec, const char *in, size_t length,
+           char *out, size_t outLength) {
+    switch (codec) {
+        case STORED:
+            if (length != outLength)
+                return false;
+
+            std::memcpy(out, in, length);
+            return true;
+
+        case LZ:
+            return decompressLz(reinterpret_cast<const uint8_t*>(in), length,
+                                reinterpret_cast<uint8_t*>(out), outLength);
+    }
+
+    return false;
+}
+
+}; /* namespace BlockCodec */
+}; /* namespace NanoLogInternal */
@@ -0,0 +1,69 @@
+/* Copyright (c) 2016-2020 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BLOCKCODEC_H
+#define BLOCKCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * This file contains the general purpose codecs that the runtime can apply
+ * to whole output buffers after the Encoder (see Log::CompressedBlock), as a
+ * second compression stage for the content the Encoder stores verbatim
+ * (i.e. strings and format-less text).
+ *
+ * ** LZ **
+ *
+ * The LZ codec is a byte-oriented LZ77 variant that favors speed over ratio,
+ * in the same vein as LZ4. The compressed block is a series of sequences,
+ * each consisting of
+ *      (1 byte)    token; the upper nibble is the number of literals and the
+ *                  lower the match length minus MIN_MATCH. A nibble of 15
+ *                  indicates that the value continues in the bytes that
+ *                  follow, each adding 0-255 until one is less than 255.
+ *      (0-n bytes) the literals, copied verbatim
+ *      (2 bytes)   little-endian offset of the match, counting back from
+ *                  the current output position (absent from the last
+ *                  sequence, which only holds literals)
+ *      (0-n bytes) continuation of the match length
+ * Matches may overlap the bytes they produce (i.e. an offset of 1 repeats
+ * the last byte).
+ */
+
+namespace NanoLogInternal {
+namespace BlockCodec {
+
+/**
+ * Identifies how a block is compressed. The values are persisted in the
+ * compressed log and shall not change.
+ */
+enum Codec : uint8_t {
+    // The block is stored verbatim (i.e. when compressing didn't help)
+    STORED = 0,
+
+    // The block is compressed with the LZ codec described above
+    LZ = 1
+};
+
+size_t maxCompressedSize(size_t length);
+size_t compress(Codec codec, const char *in, size_t length, char *out);
+bool decompress(Codec codec, const char *in, size_t length,
+                char *out, size_t outLength);
+
+}; /* namespace BlockCodec */
+}; /* namespace NanoLogInternal */
+
+#endif /* BLOCKCODEC_H */
@@ -0,0 +1,183 @@
+/* Copyright (c) 2016-2020 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "BlockCodec.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace NanoLogInternal::BlockCodec;
+namespace {
+
+class BlockCodecTest : public ::testing::Test {
+    protected:
+    BlockCodecTest()
+        : compressed()
+        , decompressed()
+    {
+    }
+
+    virtual ~BlockCodecTest() {
+    }
+
+    /**
+     * Compresses input with codec and checks that it decompresses back to
+     * the input.
+     *
+     * \return
+     *      Length of the compressed input
+     */
+    size_t
+    roundTrip(Codec codec, const string &input) {
+        compressed.assign(maxCompressedSize(input.size()), '\0');
+        size_t length = compress(codec, input.data(), input.size(),
+                                 compressed.data());
+        EXPECT_LE(length, maxCompressedSize(input.size()));
+        compressed.resize(length);
+
+        decompressed.assign(input.size(), '\0');
+        EXPECT_TRUE(decompress(codec, compressed.data(), length,
+                               decompressed.data(), decompressed.size()));
+        EXPECT_EQ(input, string(decompressed.data(), decompressed.size()));
+        return length;
+    }
+
+    vector<char> compressed;
+    vector<char> decompressed;
+};
+
+TEST_F(BlockCodecTest, stored)
+{
+    EXPECT_EQ(0U, roundTrip(STORED, ""));
+    EXPECT_EQ(5U, roundTrip(STORED, "Hello"));
+
+    char out[5];
+    EXPECT_FALSE(decompress(STORED, "Hello", 5, out, 4));
+}
+
+TEST_F(BlockCodecTest, lz_short)
+{
+    // Inputs too short to hold a match are output as literals
+    EXPECT_EQ(1U, roundTrip(LZ, ""));
+    EXPECT_EQ(2U, roundTrip(LZ, "a"));
+    EXPECT_EQ(5U, roundTrip(LZ, "abcd"));
+    roundTrip(LZ, "abcdabcd");
+}
+
+TEST_F(BlockCodecTest, lz_repetitive)
+{
+    string input;
+    for (int i = 0; i < 1000; ++i)
+        input += "Simple log message with 1 parameter\n";
+
+    EXPECT_GT(input.size()/50, roundTrip(LZ, input));
+}
+
+TEST_F(BlockCodecTest, lz_overlappingMatches)
+{
+    // Runs are encoded as a match overlapping the bytes it produces
+    EXPECT_GT(10U, roundTrip(LZ, string(1000, 'x')));
+    EXPECT_GT(20U, roundTrip(LZ, "x" + string(1000, 'y') + "z"));
+    EXPECT_GT(20U, roundTrip(LZ, string(500, 'a') + string(500, 'b')));
+}
+
+TEST_F(BlockCodecTest, lz_longLengths)
+{
+    // Literal and match lengths that continue past the token, right at and
+    // around the 15 and 15 + 255 boundaries.
+    srand(0);
+    for (size_t literals : {14, 15, 16, 269, 270, 271, 600}) {
+        for (size_t matchLength : {4, 18, 19, 20, 273, 274, 275, 1000}) {
+            string input;
+            for (size_t i = 0; i < literals; ++i)
+                input += static_cast<char>('a' + rand() % 26);
+
+            string match = input.substr(0, 4);
+            while (match.size() < matchLength)
+                match += match;
+            input += match.substr(0, matchLength);
+            input += "#";
+
+            roundTrip(LZ, input);
+        }
+    }
+}
+
+TEST_F(BlockCodecTest, lz_incompressible)
+{
+    srand(1);
+    string input;
+    for (int i = 0; i < 100000; ++i)
+        input += static_cast<char>(rand());
+
+    EXPECT_LE(input.size(), roundTrip(LZ, input));
+}
+
+TEST_F(BlockCodecTest, lz_farMatches)
+{
+    // Matches farther back than the 2 byte offsets reach aren't used
+    srand(2);
+    string noise;
+    for (int i = 0; i < 70000; ++i)
+        noise += static_cast<char>(rand());
+
+    roundTrip(LZ, "The same prefix" + noise + "The same prefix");
+}
+
+TEST_F(BlockCodecTest, lz_corrupt)
+{
+    string input;
+    for (int i = 0; i < 100; ++i)
+        input += "Log message number " + to_string(i) + "\n";
+    size_t length = roundTrip(LZ, input);
+
+    // Truncated
+    for (size_t i = 0; i < length; ++i) {
+        EXPECT_FALSE(decompress(LZ, compressed.data(), i,
+                                decompressed.data(), decompressed.size()));
+    }
+
+    // Wrong decompressed length
+    EXPECT_FALSE(decompress(LZ, compressed.data(), length,
+                            decompressed.data(), decompressed.size() - 1));
+    decompressed.resize(input.size() + 1);
+    EXPECT_FALSE(decompress(LZ, compressed.data(), length,
+                            decompressed.data(), decompressed.size()));
+
+    // Offset before the start of the output
+    const char badOffset[] = {0x10, 'a', 0x02, 0x00, 0x00};
+    EXPECT_FALSE(decompress(LZ, badOffset, sizeof(badOffset),
+                            decompressed.data(), 5));
+
+    const char zeroOffset[] = {0x10, 'a', 0x00, 0x00, 0x00};
+    EXPECT_FALSE(decompress(LZ, zeroOffset, sizeof(zeroOffset),
+                            decompressed.data(), 5));
+
+    // Literal length continuing past the end of the input
+    const char badLength[] = {static_cast<char>(0xF0), static_cast<char>(255)};
+    EXPECT_FALSE(decompress(LZ, badLength, sizeof(badLength),
+                            decompressed.data(), decompressed.size()));
+
+    // Unknown codec
+    EXPECT_FALSE(decompress(static_cast<Codec>(3), compressed.data(), length,
+                            decompressed.data(), input.size()));
+}
+
+};  // namespace
@@ -16,6 +16,7 @@
 #define CONFIG_H
 
 #include <fcntl.h>
+#include <signal.h>
 #include <cassert>
 #include <cstdint>
 
@@ -46,6 +47,22 @@ namespace NanoLogConfig {
         "OUTPUT_BUFFER_SIZE must be greater than or "
             "equal to the STAGING_BUFFER_SIZE");
 
+    // Determines the byte size of the segments of the flight recorder (see
+    // NanoLog::setFlightRecorder()). Each segment starts with a Checkpoint
+    // and the dictionary so that the oldest can be overwritten independently
+    // of the rest; larger segments amortize this overhead but overwrite more
+    // log messages at once.
+    static const uint32_t FLIGHT_RECORDER_SEGMENT_SIZE = 1<<22;
+
+    static_assert(STAGING_BUFFER_SIZE <= FLIGHT_RECORDER_SEGMENT_SIZE,
+        "FLIGHT_RECORDER_SEGMENT_SIZE must be greater than or "
+            "equal to the STAGING_BUFFER_SIZE");
+
+    // Signal that dumps the flight recorder to FLIGHT_RECORDER_DUMP_FILE
+    // while it's enabled.
+    static const int FLIGHT_RECORDER_DUMP_SIGNAL = SIGUSR2;
+    static const char FLIGHT_RECORDER_DUMP_FILE[] = "./flightRecorderLog";
+
     // The threshold at which the consumer should release space back to the
     // producer in the thread-local StagingBuffer. Due to the blocking nature
     // of the producer when it runs out of space, a low value will incur more
@@ -53,6 +70,77 @@ namespace NanoLogConfig {
     // the opposite effect.
     static const uint32_t RELEASE_THRESHOLD = STAGING_BUFFER_SIZE>>1;
 
+    // Controls how often the producer publishes its position in the
+    // StagingBuffer to the background compression thread. Rather than
+    // exposing every log statement as soon as it's recorded (which would
+    // bounce the cache line holding the position between the two cores on
+    // every log statement), the producer will only publish once it has
+    // accumulated this many log statements or bytes. Publication is also
+    // forced when the producer blocks, when the background thread rings the
+    // StagingBuffer's doorbell, on sync() and on thread exit. Setting
+    // PUBLISH_THRESHOLD_RECORDS to 1 restores per-log-statement publication.
+    static const uint32_t PUBLISH_THRESHOLD_RECORDS = 16;
+    static const uint32_t PUBLISH_THRESHOLD_BYTES = 1024;
+
+    // StagingBuffers holding at least this many bytes that have yet to be
+    // compressed are compressed ahead of the others, fullest first, as are
+    // those whose producers are blocked. Otherwise, the compression thread
+    // visits the StagingBuffers round-robin.
+    static const uint32_t URGENT_BACKLOG_BYTES = STAGING_BUFFER_SIZE>>1;
+
+    // Determines the byte size of the per-thread ring that retains the log
+    // messages less severe than the log level when a backtrace log level is
+    // set (see NanoLog::setBacktraceLogLevel()). The ring is only allocated
+    // for threads that log such messages.
+    static const uint32_t BACKTRACE_RING_SIZE = 1<<18;
+
+    // Determines the byte size of the per-thread ring that expedites the log
+    // messages at least as severe as the priority log level (see
+    // NanoLog::setPriorityLogLevel()). Log messages that don't fit are
+    // staged in the StagingBuffer as usual.
+    static const uint32_t PRIORITY_RING_SIZE = 1<<16;
+
+    // When a backtrace is triggered, the messages retained in the rings
+    // during this many milliseconds before the trigger are output to the log.
+    static const uint32_t BACKTRACE_WINDOW_MS = 100;
+
+    // Upper bound on the time the fatal signal handler (see
+    // NanoLog::setCrashHandler()) spends draining the StagingBuffers to the
+    // log file before letting the process die, so that a wedged disk or a
+    // stuck compression thread cannot hang the crash.
+    static const uint32_t CRASH_DRAIN_TIMEOUT_S = 2;
+
+    // Capacity of the shared memory region used by the agent process (see
+    // NanoLog::startAgent()) in number of concurrent logging threads (i.e.
+    // StagingBuffers) and of log invocation sites, respectively.
+    static const uint32_t AGENT_MAX_THREADS = 64;
+    static const uint32_t AGENT_MAX_LOG_SITES = 1<<14;
+
+    // The encoder interns up to MAX_INTERNED_STRINGS strings of at most
+    // MAX_INTERNED_STRING_LENGTH characters per string argument of a log
+    // invocation site and BufferExtent, so that repeats are encoded as 2 byte
+    // references rather than copies (see Log::InternedStrings). The former
+    // cannot exceed 255 since the references are encoded in a byte.
+    static const uint32_t MAX_INTERNED_STRINGS = 255;
+    static const uint32_t MAX_INTERNED_STRING_LENGTH = 128;
+
+    // NANO_LOG() copies 'const char*' string arguments while scanning them for
+    // their NULL terminator, so that they're read only once. Space for up to
+    // STRING_CAPTURE_BYTES bytes is reserved for each such string before its
+    // length is known; log messages with longer strings are instead sized
+    // before they're copied.
+    static const uint32_t STRING_CAPTURE_BYTES = 256;
+
+    // Loggers created with LoggerOptions::coarseTimestamps timestamp log
+    // messages in units of 2^COARSE_TIMESTAMP_SHIFT cycles rather than in
+    // cycles, which shrinks the differences between consecutive timestamps
+    // that are encoded in the log.
+    static const uint32_t COARSE_TIMESTAMP_SHIFT = 6;
+
+    // Maximum number of Loggers, including the default one that NANO_LOG()
+    // logs to (see NanoLog::createLogger()).
+    static const uint32_t MAX_LOGGERS = 8;
+
     // How often should the background compression thread wake up to check
     // for more log messages in the StagingBuffers to compress and output.
     // Due to overheads in the kernel, this number will a lower bound and
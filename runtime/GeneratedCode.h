@@ -61,12 +61,16 @@ extern struct LogMetadata logId2Metadata[];
  *          Pointer to an UncomrpessedLogEntry within a StagingBuffer.
  * \param[out] out
  *          An output buffer to write the compressed log entry to
+ * \param deltaBases
+ *          Previous values of the log message's doubles, with the log
+ *          message's invocation site selected
  *
  * \return
  *      The number of bytes written to *out
  */
 extern ssize_t
-(*compressFnArray[]) (NanoLogInternal::Log::UncompressedEntry *re, char *out);
+(*compressFnArray[]) (NanoLogInternal::Log::UncompressedEntry *re, char *out,
+                      NanoLogInternal::Log::DeltaBases *deltaBases);
 
 
 /**
@@ -89,11 +93,15 @@ extern ssize_t
  * \param[optional] aggFn
  *      Optional va_arg-style function used to aggregate the results.
  *      Note: This API is intended for benchmarking only
+ * \param deltaBases
+ *      Previous values of the log message's doubles, with the log message's
+ *      invocation site selected
  */
 extern void
 (*decompressAndPrintFnArray[]) (const char **in,
                                     FILE *outputFd,
-                                    void (*aggFn)(const char*, ...));
+                                    void (*aggFn)(const char*, ...),
+                                    NanoLogInternal::Log::DeltaBases *deltaBases);
 
 /***
  * Writes the metadata needed by the decompressor to interpret logs generated by
@@ -16,11 +16,13 @@
 #include <algorithm>
 
 #include <bits/algorithmfwd.h>
+#include <cmath>
 #include <regex>
 #include <vector>
 
 #include "Log.h"
 #include "GeneratedCode.h"
+#include "NanoLog.h"
 
 namespace NanoLogInternal {
 
@@ -31,6 +33,95 @@ namespace NanoLogInternal {
 static const char* logLevelNames[] = {"(none)", "ERROR", "WARNING",
                                        "NOTICE", "DEBUG"};
 
+/**
+ * Renders a binary blob logged via a %B specifier as a string.
+ *
+ * \param data
+ *      Start of the blob
+ * \param length
+ *      Number of bytes in the blob
+ * \param base64
+ *      true renders the blob in base64 (RFC 4648 with padding); false renders
+ *      it as lower case hex digits
+ * \return
+ *      The rendered blob
+ */
+std::string
+Log::formatBlob(const char *data, uint32_t length, bool base64)
+{
+    std::string out;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+
+    if (!base64) {
+        static const char hexDigits[] = "0123456789abcdef";
+        out.reserve(2*length);
+        for (uint32_t i = 0; i < length; ++i) {
+            out.push_back(hexDigits[bytes[i] >> 4]);
+            out.push_back(hexDigits[bytes[i] & 0xf]);
+        }
+        return out;
+    }
+
+    static const char base64Digits[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    out.reserve(4*((length + 2)/3));
+    for (uint32_t i = 0; i < length; i += 3) {
+        uint32_t remaining = length - i;
+        uint32_t group = static_cast<uint32_t>(bytes[i]) << 16;
+        if (remaining > 1)
+            group |= static_cast<uint32_t>(bytes[i + 1]) << 8;
+        if (remaining > 2)
+            group |= bytes[i + 2];
+
+        out.push_back(base64Digits[(group >> 18) & 0x3f]);
+        out.push_back(base64Digits[(group >> 12) & 0x3f]);
+        out.push_back((remaining > 1) ? base64Digits[(group >> 6) & 0x3f] : '=');
+        out.push_back((remaining > 2) ? base64Digits[group & 0x3f] : '=');
+    }
+    return out;
+}
+
+/**
+ * Compresses an output buffer with a BlockCodec and frames it as a
+ * CompressedBlock. The block is stored verbatim instead if the codec
+ * doesn't make it smaller.
+ *
+ * \param in
+ *      Output buffer to compress, which must hold complete entries
+ * \param length
+ *      Number of bytes in the output buffer
+ * \param[out] out
+ *      Where to write the CompressedBlock; it must hold at least
+ *      maxCompressedBlockSize(length) bytes.
+ * \param codec
+ *      Codec to compress the block with
+ *
+ * \return
+ *      Number of bytes written to out
+ */
+size_t
+Log::compressBlock(const char *in, size_t length, char *out,
+                   BlockCodec::Codec codec)
+{
+    CompressedBlock block;
+    block.entryType = EntryType::INVALID;
+    block.marker = CompressedBlock::BLOCK_MARKER;
+    block.uncompressedLength = downCast<uint32_t>(length);
+
+    char *payload = out + sizeof(CompressedBlock);
+    size_t compressedLength = BlockCodec::compress(codec, in, length, payload);
+    if (compressedLength >= length) {
+        codec = BlockCodec::STORED;
+        compressedLength = BlockCodec::compress(codec, in, length, payload);
+    }
+
+    block.codec = 0x03 & codec;
+    block.compressedLength = downCast<uint32_t>(compressedLength);
+    std::memcpy(out, &block, sizeof(CompressedBlock));
+
+    return sizeof(CompressedBlock) + compressedLength;
+}
+
 /**
  * Insert a checkpoint into an output buffer. This operation is fairly
  * expensive so it is typically performed once per new log file.
@@ -39,12 +130,19 @@ static const char* logLevelNames[] = {"(none)", "ERROR", "WARNING",
  *      Output array to insert the checkpoint into
  * \param outLimit
  *      Pointer to the end of out (i.e. first invalid byte to write to)
+ * \param writeDictionary
+ *      True if the dictionary of log messages should follow the checkpoint
+ * \param timestampShift
+ *      Number of least significant bits dropped from the timestamps of the
+ *      log messages that follow. The checkpoint's rdtsc and cyclesPerSecond
+ *      are scaled down to match, so that decoded times are unaffected.
  *
  * \return
  *      True if operation succeed, false if there's not enough space
  */
 bool
-Log::insertCheckpoint(char **out, char *outLimit, bool writeDictionary) {
+Log::insertCheckpoint(char **out, char *outLimit, bool writeDictionary,
+                      uint32_t timestampShift) {
     if (static_cast<uint64_t>(outLimit - *out) < sizeof(Checkpoint))
         return false;
 
@@ -52,9 +150,10 @@ Log::insertCheckpoint(char **out, char *outLimit, bool writeDictionary) {
     *out += sizeof(Checkpoint);
 
     ck->entryType = Log::EntryType::CHECKPOINT;
-    ck->rdtsc = PerfUtils::Cycles::rdtsc();
+    ck->rdtsc = PerfUtils::Cycles::rdtsc() >> timestampShift;
     ck->unixTime = std::time(nullptr);
-    ck->cyclesPerSecond = PerfUtils::Cycles::getCyclesPerSec();
+    ck->cyclesPerSecond = PerfUtils::Cycles::getCyclesPerSec()
+                                / static_cast<double>(1UL << timestampShift);
     ck->newMetadataBytes = ck->totalMetadataEntries = 0;
 
     if (!writeDictionary)
@@ -90,11 +189,18 @@ Log::insertCheckpoint(char **out, char *outLimit, bool writeDictionary) {
  *      Optional parameter to skip embedding metadata information at the
  *      beginning of the buffer. This parameter should never bet set except
  *      in unit tests.
+ * \param forceDictionaryOutput
+ *      Forces the dictionary to follow the checkpoint even in the C++17
+ *      version of NanoLog (mainly for unit tests)
+ * \param timestampShift
+ *      Number of least significant bits to drop from the timestamps of the
+ *      log messages encoded (i.e. 0 to encode them with cycle resolution)
  */
 Log::Encoder::Encoder(char *buffer,
                                 size_t bufferSize,
                                 bool skipCheckpoint,
-                                bool forceDictionaryOutput)
+                                bool forceDictionaryOutput,
+                                uint32_t timestampShift)
     : backing_buffer(buffer)
     , writePos(buffer)
     , endOfBuffer(buffer + bufferSize)
@@ -102,6 +208,11 @@ Log::Encoder::Encoder(char *buffer,
     , currentExtentSize(nullptr)
     , encodeMissDueToMetadata(0)
     , consecutiveEncodeMissesDueToMetadata(0)
+    , staticStrings()
+    , deltaBases()
+    , internedStrings()
+    , timestampShift(timestampShift)
+    , firstTimestamps()
 {
     assert(buffer);
 
@@ -117,7 +228,8 @@ Log::Encoder::Encoder(char *buffer,
 
     // In virtually all cases, our output buffer should have enough
     // space to store the dictionary. If not, we fail in place.
-    if (!insertCheckpoint(&writePos, endOfBuffer, writeDictionary)) {
+    if (!insertCheckpoint(&writePos, endOfBuffer, writeDictionary,
+                          timestampShift)) {
         fprintf(stderr, "Internal Error: Not enough space allocated for "
                         "dictionary file.\r\n");
 
@@ -139,7 +251,7 @@ Log::Encoder::Encoder(char *buffer,
  */
 uint32_t
 Log::Encoder::encodeNewDictionaryEntries(uint32_t& currentPosition,
-                                        std::vector<StaticLogInfo> allMetadata)
+                                const std::vector<StaticLogInfo> &allMetadata)
 {
     char *bufferStart = writePos;
 
@@ -150,14 +262,29 @@ Log::Encoder::encodeNewDictionaryEntries(uint32_t& currentPosition,
     DictionaryFragment *df = reinterpret_cast<DictionaryFragment*>(writePos);
     writePos += sizeof(DictionaryFragment);
     df->entryType = EntryType::LOG_MSGS_OR_DIC;
+    df->isStaticStringTable = false;
 
     while (currentPosition < allMetadata.size()) {
-        StaticLogInfo &curr = allMetadata.at(currentPosition);
+        const StaticLogInfo &curr = allMetadata.at(currentPosition);
         size_t filenameLength = strlen(curr.filename) + 1;
         size_t formatLength = strlen(curr.formatString) + 1;
+        size_t argEncodingsLength = 0;
+        if (curr.argEncodings) {
+            argEncodingsLength = curr.numParams;
+            for (int i = 0; i < curr.numParams; ++i) {
+                if (curr.argEncodings[i] == CODEC)
+                    argEncodingsLength += strlen(curr.codecNames[i]) + 1;
+            }
+        }
+        size_t fieldNamesLength = 0;
+        for (int i = 0; curr.fieldNames && i <= curr.numParams; ++i)
+            fieldNamesLength += strlen(curr.fieldNames[i]) + 1;
+
         size_t nextDictSize = sizeof(CompressedLogInfo)
                                     + filenameLength
-                                    + formatLength;
+                                    + formatLength
+                                    + argEncodingsLength
+                                    + fieldNamesLength;
 
         // Not enough space, break out!
         if (nextDictSize >= static_cast<uint32_t>(endOfBuffer - writePos))
@@ -170,14 +297,28 @@ Log::Encoder::encodeNewDictionaryEntries(uint32_t& currentPosition,
         cli->linenum = curr.lineNum;
         cli->filenameLength = static_cast<uint16_t>(filenameLength);
         cli->formatStringLength = static_cast<uint16_t>(formatLength);
+        cli->argEncodingsLength = static_cast<uint16_t>(argEncodingsLength);
+        cli->fieldNamesLength = static_cast<uint16_t>(fieldNamesLength);
 
         memcpy(writePos, curr.filename, filenameLength);
         memcpy(writePos + filenameLength, curr.formatString, formatLength);
         writePos += filenameLength + formatLength;
+
+        for (size_t i = 0; argEncodingsLength > 0
+                        && i < static_cast<size_t>(curr.numParams); ++i) {
+            *writePos++ = static_cast<char>(curr.argEncodings[i]);
+            if (curr.argEncodings[i] == CODEC)
+                writePos = stpcpy(writePos, curr.codecNames[i]) + 1;
+        }
+
+        // The event name comes first, followed by one name per parameter
+        for (int i = 0; fieldNamesLength > 0 && i <= curr.numParams; ++i)
+            writePos = stpcpy(writePos, curr.fieldNames[i]) + 1;
+
         ++currentPosition;
     }
 
-    df->newMetadataBytes = 0x3FFFFFFF & static_cast<uint32_t>(
+    df->newMetadataBytes = 0x1FFFFFFF & static_cast<uint32_t>(
                                                         writePos - bufferStart);
     df->totalMetadataEntries = currentPosition;
     return df->newMetadataBytes;
@@ -218,11 +359,17 @@ Log::Encoder::encodeLogMsgs(char *from,
     if (!encodeBufferExtentStart(bufferId, newPass))
         return 0;
 
-    uint64_t lastTimestamp = 0;
+    // The first log message is encoded relative to the first one in this
+    // StagingBuffer's previous extent; the rest to the message before them.
+    uint64_t &firstTimestamp = firstTimestamps[bufferId];
+    uint64_t lastTimestamp = firstTimestamp;
     long remaining = nbytes;
     long numEventsProcessed = 0;
     char *bufferStart = writePos;
 
+    // Unlike the timestamps, delta encoded arguments don't span BufferExtents
+    deltaBases.clear();
+
     while (remaining > 0) {
         auto *entry = reinterpret_cast<UncompressedEntry*>(from);
 
@@ -248,11 +395,15 @@ Log::Encoder::encodeLogMsgs(char *from,
         if (maxCompressedSize > (endOfBuffer - writePos))
             break;
 
-        compressLogHeader(entry, &writePos, lastTimestamp);
-        lastTimestamp = entry->timestamp;
+        compressLogHeader(entry, &writePos, lastTimestamp, timestampShift);
+        lastTimestamp = entry->timestamp >> timestampShift;
+        if (numEventsProcessed == 0)
+            firstTimestamp = lastTimestamp;
 
+        deltaBases.select(entry->fmtId);
         size_t argBytesWritten =
-            GeneratedFunctions::compressFnArray[entry->fmtId](entry, writePos);
+            GeneratedFunctions::compressFnArray[entry->fmtId](entry, writePos,
+                                                              &deltaBases);
         writePos += argBytesWritten;
 
         remaining -= entry->entrySize;
@@ -308,17 +459,26 @@ Log::Encoder::encodeLogMsgs(char *from,
                             uint64_t nbytes,
                             uint32_t bufferId,
                             bool newPass,
-                            std::vector<StaticLogInfo> dictionary,
+                            const std::vector<StaticLogInfo> &dictionary,
                             uint64_t *numEventsCompressed)
 {
+    char *extentStart = writePos;
     if (!encodeBufferExtentStart(bufferId, newPass))
         return 0;
 
-    uint64_t lastTimestamp = 0;
+    // The first log message is encoded relative to the first one in this
+    // StagingBuffer's previous extent; the rest to the message before them.
+    uint64_t &firstTimestamp = firstTimestamps[bufferId];
+    uint64_t lastTimestamp = firstTimestamp;
     long remaining = nbytes;
     long numEventsProcessed = 0;
     char *bufferStart = writePos;
 
+    // Unlike the timestamps, delta encoded arguments and interned strings
+    // don't span BufferExtents
+    deltaBases.clear();
+    internedStrings.clear();
+
     while (remaining > 0) {
         auto *entry = reinterpret_cast<UncompressedEntry*>(from);
 
@@ -353,7 +513,7 @@ Log::Encoder::encodeLogMsgs(char *from,
             if (entry->entrySize < (NanoLogConfig::STAGING_BUFFER_SIZE/2))
                 break;
 
-            StaticLogInfo &info = dictionary.at(entry->fmtId);
+            const StaticLogInfo &info = dictionary.at(entry->fmtId);
             fprintf(stderr, "NanoLog ERROR: Attempting to log a message that "
                             "is %u bytes while the maximum allowable size is "
                             "%u.\r\n This occurs for the log message %s:%u '%s'"
@@ -371,17 +531,36 @@ Log::Encoder::encodeLogMsgs(char *from,
         if (maxCompressedSize > (endOfBuffer - writePos))
             break;
 
-        compressLogHeader(entry, &writePos, lastTimestamp);
-        lastTimestamp = entry->timestamp;
+        char *entryStart = writePos;
+        size_t numStaticStrings = staticStrings.size();
+        compressLogHeader(entry, &writePos, lastTimestamp, timestampShift);
 
-        StaticLogInfo &info = dictionary.at(entry->fmtId);
+        const StaticLogInfo &info = dictionary.at(entry->fmtId);
 #ifdef ENABLE_DEBUG_PRINTING
         printf("\r\nCompressing \'%s\' with info.id=%d\r\n",
                 info.formatString, entry->fmtId);
 #endif
         char *argData = entry->argData;
+        deltaBases.select(entry->fmtId);
+        internedStrings.select(entry->fmtId);
         info.compressionFunction(info.numNibbles, info.paramTypes,
-                                        &argData, &writePos);
+                                        &argData, &writePos, &staticStrings,
+                                        &deltaBases, &internedStrings);
+
+        // Newly interned static strings will be persisted ahead of this
+        // extent, so undo the log message if there's no space for them.
+        if (numStaticStrings != staticStrings.size() &&
+                sizeof(DictionaryFragment) + staticStrings.getUnpersistedBytes()
+                    > static_cast<size_t>(endOfBuffer - writePos))
+        {
+            staticStrings.truncate(numStaticStrings);
+            writePos = entryStart;
+            break;
+        }
+
+        lastTimestamp = entry->timestamp >> timestampShift;
+        if (numEventsProcessed == 0)
+            firstTimestamp = lastTimestamp;
 
         remaining -= entry->entrySize;
         from += entry->entrySize;
@@ -395,12 +574,55 @@ Log::Encoder::encodeLogMsgs(char *from,
     currentSize += downCast<uint32_t>(writePos - bufferStart);
     std::memcpy(currentExtentSize, &currentSize, sizeof(uint32_t));
 
+    if (staticStrings.getNumPersisted() < staticStrings.size())
+        encodeStaticStringsAt(extentStart);
+
     if (numEventsCompressed)
         *numEventsCompressed += numEventsProcessed;
 
     return nbytes - remaining;
 }
 
+/**
+ * Internal function that persists the static strings interned since the last
+ * invocation as a DictionaryFragment. The fragment is inserted at an earlier
+ * position in the buffer (shifting everything after it back) so that the
+ * Decoder encounters the strings before the log messages that reference them.
+ * The caller must ensure there's enough free space for the fragment.
+ *
+ * \param insertionPoint
+ *      Position within the internal buffer to insert the fragment at; this
+ *      should be the start of the BufferExtent that first uses the strings.
+ */
+void
+Log::Encoder::encodeStaticStringsAt(char *insertionPoint)
+{
+    size_t fragmentBytes = sizeof(DictionaryFragment)
+                                + staticStrings.getUnpersistedBytes();
+    assert(fragmentBytes <= static_cast<size_t>(endOfBuffer - writePos));
+
+    memmove(insertionPoint + fragmentBytes, insertionPoint,
+                                                writePos - insertionPoint);
+    writePos += fragmentBytes;
+    if (currentExtentSize >= static_cast<void*>(insertionPoint))
+        currentExtentSize = static_cast<char*>(currentExtentSize)
+                                                            + fragmentBytes;
+
+    DictionaryFragment df;
+    df.entryType = EntryType::LOG_MSGS_OR_DIC;
+    df.isStaticStringTable = true;
+    df.newMetadataBytes = 0x1FFFFFFF & static_cast<uint32_t>(fragmentBytes);
+    df.totalMetadataEntries = static_cast<uint32_t>(staticStrings.size());
+    memcpy(insertionPoint, &df, sizeof(DictionaryFragment));
+
+    char *pos = insertionPoint + sizeof(DictionaryFragment);
+    for (size_t i = staticStrings.getNumPersisted();
+                                            i < staticStrings.size(); ++i)
+        pos = stpcpy(pos, staticStrings.get(i)) + 1;
+
+    staticStrings.markPersisted();
+}
+
 /**
  * Internal function that encodes a marker indicating that all log messages
  * after this point (but after the next marker) belong to a particular buffer.
@@ -458,6 +680,52 @@ Log::Encoder::getEncodedBytes() {
     return writePos - backing_buffer;
 }
 
+/**
+ * Retrieve the number of bytes that can still be encoded in the internal
+ * buffer
+ *
+ * \return
+ *      Number of free bytes in the internal buffer
+ */
+size_t
+Log::Encoder::getFreeBytes() {
+    return endOfBuffer - writePos;
+}
+
+/**
+ * Starts a new compressed log in a new buffer as if the Encoder had just been
+ * constructed, i.e. with a new Checkpoint and without references to static
+ * strings persisted in the previous buffers. This allows the buffer to be
+ * decoded independently of the others, provided the caller re-encodes the
+ * dictionary (see encodeNewDictionaryEntries()).
+ *
+ * \param buffer
+ *      Buffer to encode log messages and metadata to
+ * \param bufferSize
+ *      The number of bytes usable within the buffer
+ */
+void
+Log::Encoder::restart(char *buffer, size_t bufferSize)
+{
+    swapBuffer(buffer, bufferSize);
+    staticStrings.clear();
+    firstTimestamps.clear();
+
+#ifdef PREPROCESSOR_NANOLOG
+    bool writeDictionary = true;
+#else
+    bool writeDictionary = false;
+#endif
+
+    if (!insertCheckpoint(&writePos, endOfBuffer, writeDictionary,
+                          timestampShift)) {
+        fprintf(stderr, "Internal Error: Not enough space allocated for "
+                        "dictionary file.\r\n");
+
+        exit(-1);
+    }
+}
+
 /**
  * Releases the internal buffer and replaces it with a different one.
  *
@@ -499,6 +767,7 @@ Log::LogMessage::LogMessage()
         : metadata(nullptr)
         , logId(-1)
         , rdtsc(0)
+        , runtimeId(0)
         , numArgs(0)
         , totalCapacity(sizeof(rawArgs)/sizeof(uint64_t))
         , rawArgs()
@@ -564,11 +833,13 @@ Log::LogMessage::reserve(int nparams)
  *      Invocation time of the log message
  */
 void
-Log::LogMessage::reset(FormatMetadata *meta, uint32_t logId, uint64_t rdtsc)
+Log::LogMessage::reset(FormatMetadata *meta, uint32_t logId, uint64_t rdtsc,
+                       uint32_t runtimeId)
 {
     this->metadata = meta;
     this->rdtsc = rdtsc;
     this->logId = logId;
+    this->runtimeId = runtimeId;
     numArgs = 0;
 }
 
@@ -592,6 +863,62 @@ uint64_t Log::LogMessage::getTimestamp() {
     return rdtsc;
 }
 
+// Returns the identifier of the runtime thread that logged the log message.
+uint32_t Log::LogMessage::getRuntimeId() {
+    return runtimeId;
+}
+
+/**
+ * Returns the event name of a structured log message (i.e. NANO_LOG_KV).
+ *
+ * \return
+ *      The event name, or nullptr if the log message is not structured
+ */
+const char *
+Log::LogMessage::getEventName() {
+    if (metadata == nullptr || metadata->numPrintFragments == 0)
+        return nullptr;
+
+    auto *pf = reinterpret_cast<PrintFragment*>(
+                    reinterpret_cast<char*>(metadata)
+                    + sizeof(FormatMetadata)
+                    + metadata->filenameLength);
+    if (!pf->hasFieldName || pf->argType != NONE)
+        return nullptr;
+
+    return pf->formatFragment;
+}
+
+/**
+ * Returns the name of the n-th field (0-based) of a structured log message
+ * (i.e. NANO_LOG_KV).
+ *
+ * \param fieldNum
+ *      The n-th field whose name to return
+ *
+ * \return
+ *      The field name, or nullptr if the log message is not structured or
+ *      has fewer fields
+ */
+const char *
+Log::LogMessage::getFieldName(int fieldNum) {
+    if (metadata == nullptr)
+        return nullptr;
+
+    char *pos = reinterpret_cast<char*>(metadata)
+                    + sizeof(FormatMetadata)
+                    + metadata->filenameLength;
+    for (int i = 0; i < metadata->numPrintFragments; ++i) {
+        auto *pf = reinterpret_cast<PrintFragment*>(pos);
+        if (pf->hasFieldName && pf->argType != NONE && fieldNum-- == 0)
+            return pf->formatFragment;
+
+        pos += sizeof(PrintFragment) + pf->fragmentLength;
+    }
+
+    return nullptr;
+}
+
 /**
  * Decoder constructor.
  *
@@ -601,6 +928,10 @@ uint64_t Log::LogMessage::getTimestamp() {
 Log::Decoder::Decoder()
     : filename()
     , inputFd(nullptr)
+    , logFd(nullptr)
+    , blockContents()
+    , nextBlock()
+    , numCompressedBlocksRead(0)
     , logMsgsPrinted(0)
     , bufferFragment(nullptr)
     , good(false)
@@ -608,6 +939,9 @@ Log::Decoder::Decoder()
     , freeBuffers()
     , fmtId2metadata()
     , fmtId2fmtString()
+    , staticStrings()
+    , firstTimestamps()
+    , outputFormat(TEXT)
     , rawMetadata(nullptr)
     , endOfRawMetadata(nullptr)
     , numBufferFragmentsRead(0)
@@ -662,8 +996,12 @@ Log::Decoder::readDictionary(FILE *fd, bool flushOldDictionary) {
         endOfRawMetadata = rawMetadata;
         fmtId2metadata.clear();
         fmtId2fmtString.clear();
+        staticStrings.clear();
     }
 
+    // Timestamps are encoded in full again after every checkpoint
+    firstTimestamps.clear();
+
     // Build an index of format id to metadata
     const char *start = endOfRawMetadata;
     const char *newEnd = endOfRawMetadata + bytesRead;
@@ -680,7 +1018,12 @@ Log::Decoder::readDictionary(FILE *fd, bool flushOldDictionary) {
         {
             auto *pf = reinterpret_cast<PrintFragment*>(endOfRawMetadata);
             endOfRawMetadata += sizeof(PrintFragment) + pf->fragmentLength;
-            fmtString.append(pf->formatFragment);
+
+            // Skip the FormatType byte preceding delta encoded fragments
+            const char *fragment = pf->formatFragment;
+            if (pf->argType == delta_t)
+                ++fragment;
+            fmtString.append(fragment);
         }
 
         fmtId2fmtString.push_back(fmtString);
@@ -777,6 +1120,11 @@ getFormatType(std::string length, char specifier)
         if (length.empty()) return const_void_ptr_t;
     }
 
+    // Binary blob (NanoLog extension)
+    if (specifier == 'B') {
+        if (length.empty()) return blob_t;
+    }
+
 
     // Floating points
     if (specifier == 'f' || specifier == 'F'
@@ -819,6 +1167,19 @@ getFormatType(std::string length, char specifier)
  *      Line number within filename associated with the log invocation site
  * \param severity
  *      LogLevel severity associated with the log invocation site
+ * \param argEncodings
+ *      ArgEncoding of each parameter of the log invocation site as persisted
+ *      in the dictionary, i.e. one byte per parameter with CODEC encodings
+ *      followed by the codec's NULL-terminated name (may be nullptr if all
+ *      parameters use the DEFAULT_ENCODING)
+ * \param argEncodingsLength
+ *      Number of bytes in argEncodings
+ * \param fieldNames
+ *      For structured log invocation sites (i.e. NANO_LOG_KV), the
+ *      NULL-terminated name of the event followed by the name of each
+ *      parameter as persisted in the dictionary (nullptr otherwise)
+ * \param fieldNamesLength
+ *      Number of bytes in fieldNames
  * \return
  *      true indicates success; false indicates malformed printf format string
  */
@@ -827,10 +1188,52 @@ Log::Decoder::createMicroCode(char **microCode,
                                 const char *formatString,
                                 const char *filename,
                                 uint32_t linenum,
-                                uint8_t severity)
+                                uint8_t severity,
+                                const char *argEncodings,
+                                uint16_t argEncodingsLength,
+                                const char *fieldNames,
+                                uint16_t fieldNamesLength)
 {
     using namespace NanoLogInternal::Log;
 
+    // Unpack the encoding (and codec name, if any) of each parameter
+    std::vector<ArgEncoding> encodings;
+    std::vector<const char*> codecNames;
+    const char *endOfArgEncodings = argEncodings + argEncodingsLength;
+    while (argEncodings < endOfArgEncodings) {
+        encodings.push_back(static_cast<ArgEncoding>(*argEncodings++));
+        codecNames.push_back(nullptr);
+
+        if (encodings.back() == CODEC) {
+            size_t nameLength = strnlen(argEncodings, static_cast<size_t>(
+                                        endOfArgEncodings - argEncodings));
+            if (argEncodings + nameLength == endOfArgEncodings) {
+                fprintf(stderr, "Error: Malformed codec name for log "
+                                "message at %s:%u\r\n", filename, linenum);
+                return false;
+            }
+
+            codecNames.back() = argEncodings;
+            argEncodings += nameLength + 1;
+        }
+    }
+
+    // Unpack the event name and field names of structured log messages
+    std::vector<const char*> names;
+    const char *endOfFieldNames = fieldNames + fieldNamesLength;
+    while (fieldNames < endOfFieldNames) {
+        size_t nameLength = strnlen(fieldNames, static_cast<size_t>(
+                                        endOfFieldNames - fieldNames));
+        if (fieldNames + nameLength == endOfFieldNames) {
+            fprintf(stderr, "Error: Malformed field name for log "
+                            "message at %s:%u\r\n", filename, linenum);
+            return false;
+        }
+
+        names.push_back(fieldNames);
+        fieldNames += nameLength + 1;
+    }
+
     size_t formatStringLength = strlen(formatString) + 1; // +1 for NULL
     char *microCodeStartingPos = *microCode;
     FormatMetadata *fm = reinterpret_cast<FormatMetadata*>(*microCode);
@@ -849,7 +1252,7 @@ Log::Decoder::createMicroCode(char **microCode,
                      "([\\d]+|\\*)?" // Width (Position 2)
                      "(\\.(\\d+|\\*))?"// Precision (Position 4; 3 includes '.')
                      "(hh|h|l|ll|j|z|Z|t|L)?" // Length (Position 5)
-                     "([diuoxXfFeEgGaAcspn])"// Specifier (Position 6)
+                     "([diuoxXfFeEgGaAcspnB])"// Specifier (Position 6)
                      );
 
     size_t i = 0;
@@ -858,6 +1261,23 @@ Log::Decoder::createMicroCode(char **microCode,
     size_t startOfNextFragment = 0;
     PrintFragment *pf = nullptr;
 
+    // Index of the next log parameter to be consumed by a specifier
+    int paramNum = 0;
+
+    // Structured log messages start with a fragment naming the event
+    if (!names.empty()) {
+        pf = reinterpret_cast<PrintFragment*>(*microCode);
+        *microCode += sizeof(PrintFragment);
+
+        pf->argType = FormatType::NONE;
+        pf->hasDynamicWidth = pf->hasDynamicPrecision = false;
+        pf->hasFieldName = true;
+        *microCode = stpcpy(*microCode, names.front()) + 1;
+        *(*microCode)++ = '\0';
+        pf->fragmentLength = downCast<uint16_t>(strlen(names.front()) + 2);
+        ++fm->numPrintFragments;
+    }
+
     // The key idea here is to split up the format string in to fragments (i.e.
     // PrintFragments) such that there is at most one specifier per fragment.
     // This then allows the decompressor later to consume one argument at a
@@ -907,22 +1327,80 @@ Log::Decoder::createMicroCode(char **microCode,
             return false;
         }
 
-        pf->argType = 0x1F & type;
         pf->hasDynamicWidth = (width.empty()) ? false : width[0] == '*';
         pf->hasDynamicPrecision = (precision.empty()) ? false
                                                         : precision[0] == '*';
 
-        // Tricky tricky: We null-terminate the fragment by copying 1
-        // extra byte and then setting it to NULL
-        pf->fragmentLength = static_cast<uint16_t>(i - startOfNextFragment + 1);
-        memcpy(*microCode,
-                formatString + startOfNextFragment,
-                pf->fragmentLength);
-        *microCode += pf->fragmentLength;
-        *(*microCode - 1) = '\0';
+        paramNum += pf->hasDynamicWidth + pf->hasDynamicPrecision;
+        const char *codecName = nullptr;
+        FormatType deltaType = NONE;
+        if (type == const_char_ptr_t
+                && static_cast<size_t>(paramNum) < encodings.size()) {
+            if (encodings[paramNum] == STATIC_STRING_ID) {
+                type = const_char_ptr_static_t;
+                ++fm->numNibbles;
+            } else if (encodings[paramNum] == CODEC) {
+                type = codec_t;
+                codecName = codecNames[paramNum];
+            } else if (encodings[paramNum] == INTERNED_STRING) {
+                type = const_char_ptr_interned_t;
+            }
+        } else if (type >= unsigned_char_t && type <= double_t
+                        && static_cast<size_t>(paramNum) < encodings.size()
+                        && encodings[paramNum] == DELTA_ENCODED) {
+            deltaType = type;
+            type = delta_t;
+        }
+        ++paramNum;
+
+        pf->argType = 0x1F & type;
+
+        // Fields of structured log messages store their name in front of
+        // the fragment (and the codec name, if any). Note that names[0] is
+        // the event name, so the current parameter's name is at paramNum.
+        size_t fieldNameLength = 0;
+        pf->hasFieldName = static_cast<size_t>(paramNum) < names.size();
+        if (pf->hasFieldName) {
+            fieldNameLength = strlen(names[paramNum]) + 1;
+            memcpy(*microCode, names[paramNum], fieldNameLength);
+            *microCode += fieldNameLength;
+        }
+
+        // Codec arguments store the codec's name in front of the fragment
+        // and delta encoded arguments their actual FormatType
+        size_t codecNameLength = 0;
+        if (codecName) {
+            codecNameLength = strlen(codecName) + 1;
+            memcpy(*microCode, codecName, codecNameLength);
+            *microCode += codecNameLength;
+        } else if (type == delta_t) {
+            codecNameLength = 1;
+            *(*microCode)++ = static_cast<char>(deltaType);
+        }
+
+        std::string fragment(formatString + startOfNextFragment,
+                             i - startOfNextFragment);
+
+        // Blobs are rendered to strings before printing, so their specifier
+        // is replaced with a %s that keeps only the width (the precision was
+        // already applied by the runtime when recording the blob).
+        if (specifier == 'B') {
+            fragment.resize(fragment.size() - match.length());
+            fragment += "%";
+            if (match[1].str().find('-') != std::string::npos)
+                fragment += "-";
+            fragment += width + "s";
+        }
+
+        size_t fragmentLength = fragment.size() + 1;
+        pf->fragmentLength = static_cast<uint16_t>(fieldNameLength
+                                                            + codecNameLength
+                                                            + fragmentLength);
+        memcpy(*microCode, fragment.c_str(), fragmentLength);
+        *microCode += fragmentLength;
 
         // Non-strings and dynamic widths need nibbles!
-        if (specifier != 's')
+        if (specifier != 's' && specifier != 'B')
             ++fm->numNibbles;
 
         if (pf->hasDynamicWidth)
@@ -952,6 +1430,7 @@ Log::Decoder::createMicroCode(char **microCode,
 
         pf->argType = FormatType::NONE;
         pf->hasDynamicWidth = pf->hasDynamicPrecision = false;
+        pf->hasFieldName = false;
         pf->fragmentLength = downCast<uint16_t>(formatStringLength);
         memcpy(*microCode, formatString, formatStringLength);
         *microCode += formatStringLength;
@@ -994,6 +1473,8 @@ Log::Decoder::readDictionaryFragment(FILE *fd) {
     size_t bufferSize = 10*1024;
     char filenameBuffer[bufferSize];
     char formatBuffer[bufferSize];
+    char argEncodings[UINT16_MAX];
+    char fieldNames[UINT16_MAX];
 
     bool newBuffersAllocated = false;
     char *filename = filenameBuffer;
@@ -1008,6 +1489,9 @@ Log::Decoder::readDictionaryFragment(FILE *fd) {
 
     assert(df.entryType == EntryType::LOG_MSGS_OR_DIC);
 
+    if (df.isStaticStringTable)
+        return readStaticStrings(fd, df);
+
     while (bytesRead < df.newMetadataBytes && !feof(fd)) {
         CompressedLogInfo cli;
         size_t newBytesRead = 0;
@@ -1047,10 +1531,13 @@ Log::Decoder::readDictionaryFragment(FILE *fd) {
 
         newBytesRead += fread(filename, 1, cli.filenameLength, fd);
         newBytesRead += fread(format, 1, cli.formatStringLength, fd);
+        newBytesRead += fread(argEncodings, 1, cli.argEncodingsLength, fd);
+        newBytesRead += fread(fieldNames, 1, cli.fieldNamesLength, fd);
         bytesRead += newBytesRead;
 
-        if (newBytesRead != sizeof(CompressedLogInfo)
-                                + cli.filenameLength + cli.formatStringLength)
+        if (newBytesRead != sizeof(CompressedLogInfo) + cli.filenameLength
+                            + cli.formatStringLength + cli.argEncodingsLength
+                            + cli.fieldNamesLength)
         {
             fprintf(stderr, "Could not read in a log's filename/"
                             "format string\r\n");
@@ -1063,7 +1550,11 @@ Log::Decoder::readDictionaryFragment(FILE *fd) {
                             format,
                             filename,
                             cli.linenum,
-                            cli.severity);
+                            cli.severity,
+                            argEncodings,
+                            cli.argEncodingsLength,
+                            fieldNames,
+                            cli.fieldNamesLength);
     }
 
     if (newBuffersAllocated) {
@@ -1074,6 +1565,63 @@ Log::Decoder::readDictionaryFragment(FILE *fd) {
     return true;
 }
 
+/**
+ * Reads the body of a DictionaryFragment containing static strings (i.e.
+ * strings logged via NanoLog::static_str()) and appends them to the table of
+ * static strings.
+ *
+ * \param fd
+ *      File descriptor positioned right after the DictionaryFragment header
+ * \param df
+ *      DictionaryFragment header that was read from fd
+ * \return
+ *      true indicates success; false indicates error
+ */
+bool
+Log::Decoder::readStaticStrings(FILE *fd, const DictionaryFragment &df) {
+    size_t bodyBytes = df.newMetadataBytes - sizeof(DictionaryFragment);
+    std::vector<char> body(bodyBytes);
+
+    if (fread(body.data(), 1, bodyBytes, fd) != bodyBytes) {
+        fprintf(stderr, "Could not read in the static string table\r\n");
+        return false;
+    }
+
+    const char *pos = body.data();
+    const char *end = pos + bodyBytes;
+    while (pos < end) {
+        staticStrings.emplace_back(pos);
+        pos += staticStrings.back().size() + 1;
+    }
+
+    if (staticStrings.size() != df.totalMetadataEntries) {
+        fprintf(stderr, "Error: Static string table is inconsistent; "
+                        "expected %u strings, but found %lu\r\n",
+                        df.totalMetadataEntries,
+                        staticStrings.size());
+        return false;
+    }
+
+    return true;
+}
+
+// Definition for the in-class declaration (needed prior to C++17)
+constexpr const char *Log::Decoder::CSV_HEADER;
+
+/**
+ * Selects the representation in which the Decoder outputs log messages
+ * (TEXT by default). Note that the CSV OutputFormat does not output a header
+ * row; callers that need one can output CSV_HEADER first.
+ *
+ * \param format
+ *      OutputFormat to output log messages in
+ */
+void
+Log::Decoder::setOutputFormat(OutputFormat format)
+{
+    outputFormat = format;
+}
+
 /**
  * Opens a compressed log with contents created by Encoder.
  *
@@ -1084,15 +1632,25 @@ Log::Decoder::readDictionaryFragment(FILE *fd) {
  */
 bool
 Log::Decoder::open(const char *filename) {
-    inputFd = fopen(filename, "rb");
+    closeBlock();
+    if (nextBlock.decompressed.valid())
+        nextBlock.decompressed.get();
+
+    inputFd = logFd = fopen(filename, "rb");
     good = false;
 
     if (!inputFd)
         return false;
 
-    if(!readDictionary(inputFd, true)) {
-        fclose(inputFd);
-        inputFd = nullptr;
+    // The log may start with a CompressedBlock
+    numCompressedBlocksRead = 0;
+    bool blockRead = peekEntryType(inputFd) != EntryType::INVALID
+                        || readPaddingOrBlock();
+
+    if (!blockRead || !readDictionary(inputFd, true)) {
+        closeBlock();
+        fclose(logFd);
+        inputFd = logFd = nullptr;
         return false;
     }
 
@@ -1103,15 +1661,148 @@ Log::Decoder::open(const char *filename) {
     good = true;
     return true;
 }
+
+/**
+ * Consumes the \0 padding at the read position of the input, or reads the
+ * CompressedBlock that starts there, in which case the block's contents are
+ * read next. This should be invoked when the next entry is an INVALID one;
+ * at the end of a block's contents, it resumes reading the log file.
+ *
+ * \return
+ *      False if a CompressedBlock is corrupt
+ */
+bool
+Log::Decoder::readPaddingOrBlock()
+{
+    while (!feof(inputFd) && peekEntryType(inputFd) == EntryType::INVALID) {
+        int c = fgetc(inputFd);
+        if (c == EOF || c == 0)
+            continue;
+
+        // Blocks don't nest
+        ungetc(c, inputFd);
+        if (inputFd != logFd || !readCompressedBlock(logFd, nextBlock))
+            return false;
+
+        return openNextBlock();
+    }
+
+    if (inputFd == logFd || !feof(inputFd))
+        return true;
+
+    closeBlock();
+    inputFd = logFd;
+    if (!nextBlock.decompressed.valid())
+        return true;
+
+    return openNextBlock();
+}
+
+/**
+ * Reads the CompressedBlock at the read position of a log file and starts
+ * decompressing it on a helper thread.
+ *
+ * \param fd
+ *      Log file to read the CompressedBlock from
+ * \param[out] block
+ *      PendingBlock to read the block into; its decompression should be
+ *      waited on before it's reused.
+ *
+ * \return
+ *      False if the block is not a valid CompressedBlock
+ */
+bool
+Log::Decoder::readCompressedBlock(FILE *fd, PendingBlock &block)
+{
+    CompressedBlock &header = block.header;
+    if (fread(&header, sizeof(CompressedBlock), 1, fd) != 1
+            || header.entryType != EntryType::INVALID
+            || header.marker != CompressedBlock::BLOCK_MARKER) {
+        fprintf(stderr, "Internal Error: Corrupted CompressedBlock\r\n");
+        return false;
+    }
+
+    block.compressed.resize(header.compressedLength);
+    if (fread(block.compressed.data(), 1, header.compressedLength, fd)
+                                                != header.compressedLength) {
+        fprintf(stderr, "CompressedBlock is truncated\r\n");
+        return false;
+    }
+
+    block.contents.resize(header.uncompressedLength);
+    block.decompressed = std::async(std::launch::async, [&block]() {
+        return BlockCodec::decompress(
+                        static_cast<BlockCodec::Codec>(block.header.codec),
+                        block.compressed.data(), block.compressed.size(),
+                        block.contents.data(), block.contents.size());
+    });
+
+    return true;
+}
+
+/**
+ * Makes the input read the contents of nextBlock once it's decompressed,
+ * and starts decompressing the CompressedBlock after it (if the log file
+ * continues with one) in the meantime.
+ *
+ * \return
+ *      False if nextBlock is corrupt
+ */
+bool
+Log::Decoder::openNextBlock()
+{
+    if (!nextBlock.decompressed.get()) {
+        fprintf(stderr, "Internal Error: CompressedBlock could not be "
+                        "decompressed\r\n");
+        return false;
+    }
+
+    ++numCompressedBlocksRead;
+    std::swap(blockContents, nextBlock.contents);
+    if (blockContents.empty())
+        return readPaddingOrBlock();
+
+    inputFd = fmemopen(blockContents.data(), blockContents.size(), "rb");
+    if (inputFd == nullptr) {
+        inputFd = logFd;
+        return false;
+    }
+
+    // Padding is left for readPaddingOrBlock() to consume
+    int c = fgetc(logFd);
+    ungetc(c, logFd);
+    if (c == EOF || c == 0 || peekEntryType(logFd) != EntryType::INVALID)
+        return true;
+
+    return readCompressedBlock(logFd, nextBlock);
+}
+
+/**
+ * Stops reading the contents of the current CompressedBlock (if any) and
+ * returns to reading the log file.
+ */
+void
+Log::Decoder::closeBlock()
+{
+    if (inputFd != nullptr && inputFd != logFd)
+        fclose(inputFd);
+
+    inputFd = logFd;
+}
+
 /**
  * Decoder destructor
  */
 Log::Decoder::~Decoder() {
-    if (inputFd)
-        fclose(inputFd);
+    closeBlock();
+    if (nextBlock.decompressed.valid())
+        nextBlock.decompressed.wait();
+
+    if (logFd)
+        fclose(logFd);
 
     filename.clear();
-    inputFd = nullptr;
+    inputFd = logFd = nullptr;
     good = false;
 
     for (BufferFragment *bf : freeBuffers)
@@ -1135,7 +1826,11 @@ Log::Decoder::allocateBufferFragment()
         return ret;
     }
 
-    return new BufferFragment();
+    BufferFragment *bf = new BufferFragment();
+    bf->staticStrings = &staticStrings;
+    bf->outputFormat = &outputFormat;
+    bf->firstTimestamps = &firstTimestamps;
+    return bf;
 }
 
 /**
@@ -1161,9 +1856,27 @@ Log::Decoder::BufferFragment::BufferFragment()
     , hasMoreLogs(false)
     , nextLogId(-1)
     , nextLogTimestamp(0)
+    , staticStrings(nullptr)
+    , deltaBases()
+    , internedStrings()
+    , firstTimestamps(nullptr)
+    , renderedArgs()
+    , outputFormat(nullptr)
+    , scratchFd(nullptr)
+    , scratchBuffer(nullptr)
+    , scratchBufferSize(0)
 {
 }
 
+// BufferFragment destructor
+Log::Decoder::BufferFragment::~BufferFragment()
+{
+    if (scratchFd)
+        fclose(scratchFd);
+
+    free(scratchBuffer);
+}
+
 /**
  * Resets the state of the BufferFragment so that the data cannot be reused
  */
@@ -1176,6 +1889,37 @@ Log::Decoder::BufferFragment::reset()
     endOfBuffer = nullptr;
     hasMoreLogs = false;
 }
+/**
+ * Returns the scratch stream that log message arguments are rendered into
+ * for the JSON and CSV OutputFormats, after discarding its contents.
+ */
+FILE*
+Log::Decoder::BufferFragment::rewindScratch()
+{
+    if (scratchFd == nullptr) {
+        scratchFd = open_memstream(&scratchBuffer, &scratchBufferSize);
+        if (scratchFd == nullptr) {
+            fprintf(stderr, "Could not open an in-memory stream to render "
+                            "log messages\r\n");
+            exit(-1);
+        }
+    }
+
+    fseek(scratchFd, 0, SEEK_SET);
+    return scratchFd;
+}
+
+/**
+ * Returns what has been rendered into the scratch stream since the last
+ * invocation of rewindScratch().
+ */
+std::string
+Log::Decoder::BufferFragment::readScratch()
+{
+    fflush(scratchFd);
+    return std::string(scratchBuffer, static_cast<size_t>(ftell(scratchFd)));
+}
+
 /**
  * Read in the next buffer fragment from the compressed log. If an error occurs
  * the file descriptor will be in an undefined state.
@@ -1212,6 +1956,8 @@ Log::Decoder::BufferFragment::readBufferExtent(FILE *fd, bool *wrapAround) {
 
     readPos = storage + sizeof(BufferExtent);
     endOfBuffer = storage + validBytes;
+    deltaBases.clear();
+    internedStrings.clear();
 
     if (be->isShort)
         runtimeId = be->threadIdOrPackNibble;
@@ -1229,7 +1975,19 @@ Log::Decoder::BufferFragment::readBufferExtent(FILE *fd, bool *wrapAround) {
         return true;
     }
 
-    hasMoreLogs = decompressLogHeader(&readPos, 0, nextLogId, nextLogTimestamp);
+    // The first log message is relative to the first one of the runtime
+    // StagingBuffer's previous extent (see Encoder::firstTimestamps)
+    if (firstTimestamps == nullptr) {
+        hasMoreLogs = decompressLogHeader(&readPos, 0, nextLogId,
+                                          nextLogTimestamp);
+    } else {
+        uint64_t &firstTimestamp = (*firstTimestamps)[runtimeId];
+        hasMoreLogs = decompressLogHeader(&readPos, firstTimestamp, nextLogId,
+                                          nextLogTimestamp);
+        if (hasMoreLogs)
+            firstTimestamp = nextLogTimestamp;
+    }
+
     if (!hasMoreLogs)
         reset();
 
@@ -1283,6 +2041,207 @@ printSingleArg(FILE *outputFd,
 #pragma GCC diagnostic pop
 }
 
+/**
+ * Helper to decompressNextLogStatement to consume the next integer argument
+ * from the packed arguments of a log message.
+ *
+ * \tparam T
+ *      Type of the argument according to the format specifier
+ * \param nb
+ *      Nibbler to read the argument from
+ * \param deltaBase
+ *      Previous value of the argument if it was delta encoded (see
+ *      NanoLog::delta()), otherwise nullptr
+ */
+template<typename T>
+static inline T
+getNextInteger(BufferUtils::Nibbler &nb, uint64_t *deltaBase)
+{
+    if (deltaBase)
+        return nb.getNextDelta<T>(deltaBase);
+
+    return nb.getNext<T>();
+}
+
+/**
+ * Returns the table of NanoLog::Codec formatters registered with
+ * NanoLog::registerCodecFormatter(), keyed by codec name.
+ */
+static std::unordered_map<std::string, NanoLog::CodecFormatter>&
+getCodecFormatters()
+{
+    static std::unordered_map<std::string, NanoLog::CodecFormatter> formatters;
+    return formatters;
+}
+
+/**
+ * Helper to decompressNextLogStatement to render the compressed bytes of a
+ * NanoLog::Codec argument as a string. If no formatter has been registered
+ * for the codec, the bytes are rendered in hex (ex. "<Point:0a0b0c0d>").
+ *
+ * \param codecName
+ *      Name of the NanoLog::Codec that serialized the argument
+ * \param data
+ *      Bytes output by the codec's compress() function
+ * \param length
+ *      Number of bytes in data
+ * \return
+ *      Human-readable rendering of the argument
+ */
+static std::string
+formatCodecArgument(const char *codecName, const char *data, uint32_t length)
+{
+    auto &formatters = getCodecFormatters();
+    auto it = formatters.find(codecName);
+    if (it != formatters.end())
+        return it->second(data, length);
+
+    return std::string("<") + codecName + ":"
+                + Log::formatBlob(data, length, false) + ">";
+}
+
+/**
+ * Helper to decompressNextLogStatement to quote a string for the JSON
+ * (i.e. as a JSON string) or CSV (i.e. per RFC 4180) OutputFormat.
+ *
+ * \param format
+ *      OutputFormat to quote the string for
+ * \param str
+ *      String to quote
+ * \return
+ *      Quoted string
+ */
+static std::string
+quoteForOutput(Log::Decoder::OutputFormat format, const std::string &str)
+{
+    std::string quoted;
+    quoted.reserve(str.size() + 2);
+
+    if (format == Log::Decoder::CSV) {
+        if (str.find_first_of(",\"\r\n") == std::string::npos)
+            return str;
+
+        quoted.push_back('"');
+        for (char c : str) {
+            if (c == '"')
+                quoted.push_back('"');
+            quoted.push_back(c);
+        }
+        quoted.push_back('"');
+        return quoted;
+    }
+
+    quoted.push_back('"');
+    for (char c : str) {
+        switch (c) {
+            case '"':   quoted += "\\\"";   break;
+            case '\\':  quoted += "\\\\";   break;
+            case '\n':  quoted += "\\n";    break;
+            case '\r':  quoted += "\\r";    break;
+            case '\t':  quoted += "\\t";    break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    quoted += escape;
+                } else {
+                    quoted.push_back(c);
+                }
+        }
+    }
+    quoted.push_back('"');
+    return quoted;
+}
+
+/**
+ * Helper to decompressNextLogStatement to render an argument of a structured
+ * log message as a value in the given OutputFormat. Numbers are output as-is
+ * and everything else (including non-finite numbers such as "nan", which
+ * are not valid in JSON) is quoted.
+ *
+ * \param format
+ *      OutputFormat to render the value in
+ * \param numeric
+ *      Whether the argument was formatted by a numeric printf specifier
+ * \param value
+ *      Argument as formatted by its printf specifier
+ */
+static std::string
+formatFieldValue(Log::Decoder::OutputFormat format,
+                 bool numeric,
+                 const std::string &value)
+{
+    if (numeric && !value.empty()) {
+        char *end;
+        double number = strtod(value.c_str(), &end);
+        if (*end == '\0' && std::isfinite(number))
+            return value;
+    }
+
+    return quoteForOutput(format, value);
+}
+
+/**
+ * Helper to decompressNextLogStatement to render the context of a log message
+ * (i.e. time, location, severity and thread) for the JSON and CSV
+ * OutputFormats. In JSON, this is the start of the message's object, and
+ * in CSV, it's the columns preceding the event in each row.
+ */
+static std::string
+formatLogContext(Log::Decoder::OutputFormat format,
+                 const char *timeString,
+                 double nanos,
+                 const char *filename,
+                 uint32_t lineNumber,
+                 const char *logLevel,
+                 uint32_t runtimeId)
+{
+    char timestamp[64];
+    snprintf(timestamp, sizeof(timestamp), "%s.%09.0lf", timeString, nanos);
+
+    if (format == Log::Decoder::CSV) {
+        return std::string(timestamp) + ","
+                + quoteForOutput(format, filename) + ","
+                + std::to_string(lineNumber) + ","
+                + logLevel + ","
+                + std::to_string(runtimeId) + ",";
+    }
+
+    return std::string("{\"timestamp\":\"") + timestamp + "\""
+            + ",\"file\":" + quoteForOutput(format, filename)
+            + ",\"line\":" + std::to_string(lineNumber)
+            + ",\"severity\":\"" + logLevel + "\""
+            + ",\"thread\":" + std::to_string(runtimeId);
+}
+
+/**
+ * Helper to decompressNextLogStatement to output a regular (i.e. not
+ * structured) log message in the JSON or CSV OutputFormat.
+ *
+ * \param outputFd
+ *      Where to output the log message
+ * \param format
+ *      OutputFormat to output the log message in
+ * \param context
+ *      Context of the log message (see formatLogContext())
+ * \param message
+ *      Human-readable text of the log message
+ */
+static void
+printLogMessage(FILE *outputFd,
+                Log::Decoder::OutputFormat format,
+                const std::string &context,
+                const std::string &message)
+{
+    if (format == Log::Decoder::CSV) {
+        fprintf(outputFd, "%s,message,%s\r\n", context.c_str(),
+                quoteForOutput(format, message).c_str());
+    } else {
+        fprintf(outputFd, "%s,\"message\":%s}\r\n", context.c_str(),
+                quoteForOutput(format, message).c_str());
+    }
+}
+
 /**
  * Attempt to read back the next log statement contained in the BufferFragment,
  * output the original log message to outputFd, and if applicable, run an
@@ -1366,12 +2325,16 @@ Log::Decoder::BufferFragment::decompressNextLogStatement(FILE *outputFd,
         strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M:%S", tm);
     }
 
+    deltaBases.select(nextLogId);
+    internedStrings.select(nextLogId);
+
 #ifdef PREPROCESSOR_NANOLOG
     if (fmtId2metadata.empty() || aggregationFn != nullptr) {
         // Output the context
         struct GeneratedFunctions::LogMetadata meta =
                                 GeneratedFunctions::logId2Metadata[nextLogId];
-        if (outputFd) {
+        OutputFormat format = (outputFormat) ? *outputFormat : TEXT;
+        if (outputFd && format == TEXT) {
             fprintf(outputFd,"%s.%09.0lf %s:%u %s[%u]: "
                     , timeString
                     , nanos
@@ -1396,9 +2359,30 @@ Log::Decoder::BufferFragment::decompressNextLogStatement(FILE *outputFd,
             return false;
         }
 
-        GeneratedFunctions::decompressAndPrintFnArray[nextLogId](&readPos,
+        if (outputFd && format != TEXT) {
+            // The generated functions only output text, so the message is
+            // rendered to the scratch stream and quoted as a whole
+            GeneratedFunctions::decompressAndPrintFnArray[nextLogId](&readPos,
+                                                            rewindScratch(),
+                                                            aggFn,
+                                                            &deltaBases);
+            std::string message = readScratch();
+            while (!message.empty() && (message.back() == '\n'
+                                            || message.back() == '\r'))
+                message.pop_back();
+
+            printLogMessage(outputFd, format,
+                            formatLogContext(format, timeString, nanos,
+                                             meta.fileName, meta.lineNumber,
+                                             logLevelNames[meta.logLevel],
+                                             runtimeId),
+                            message);
+        } else {
+            GeneratedFunctions::decompressAndPrintFnArray[nextLogId](&readPos,
                                                                  outputFd,
-                                                                 aggFn);
+                                                                 aggFn,
+                                                                 &deltaBases);
+        }
     } else
 #endif // PREPROCESSOR_NANOLOG
     {
@@ -1409,10 +2393,13 @@ Log::Decoder::BufferFragment::decompressNextLogStatement(FILE *outputFd,
         const char *filename = metadata->filename;
         const char *logLevel = logLevelNames[metadata->logLevel];
 
-        logArgs.reset(metadata, nextLogId, nextLogTimestamp);
+        logArgs.reset(metadata, nextLogId, nextLogTimestamp, runtimeId);
+        renderedArgs.clear();
 
         // Output the context
-        if (outputFd) {
+        OutputFormat format = (outputFormat) ? *outputFormat : TEXT;
+        std::string context;
+        if (outputFd && format == TEXT) {
             fprintf(outputFd,"%s.%09.0lf %s:%u %s[%u]: "
                     , timeString
                     , nanos
@@ -1420,8 +2407,23 @@ Log::Decoder::BufferFragment::decompressNextLogStatement(FILE *outputFd,
                     , metadata->lineNumber
                     , logLevel
                     , runtimeId);
+        } else if (outputFd) {
+            context = formatLogContext(format, timeString, nanos, filename,
+                                       metadata->lineNumber, logLevel,
+                                       runtimeId);
         }
 
+        // In the JSON and CSV formats, the arguments are first rendered
+        // into a scratch stream so that they can be quoted.
+        FILE *fragmentFd = outputFd;
+        if (outputFd && format != TEXT)
+            fragmentFd = rewindScratch();
+
+        // Event name and number of fields output so far for structured
+        // log messages (i.e. NANO_LOG_KV)
+        const char *event = nullptr;
+        int numFields = 0;
+
         // Print out the actual log message, piece by piece
         PrintFragment *pf = reinterpret_cast<PrintFragment*>(
                 reinterpret_cast<char*>(metadata)
@@ -1436,6 +2438,29 @@ Log::Decoder::BufferFragment::decompressNextLogStatement(FILE *outputFd,
         for (int i = 0; i < metadata->numPrintFragments; ++i) {
             const wchar_t *wstrArg;
 
+            // Fragments of structured log messages are prefixed with the
+            // name of the field, or of the event for the first fragment
+            const char *fragment = pf->formatFragment;
+            const char *fieldName = nullptr;
+            if (pf->hasFieldName) {
+                fieldName = fragment;
+                fragment += strlen(fieldName) + 1;
+
+                if (pf->argType == NONE)
+                    event = fieldName;
+
+                if (outputFd && format == TEXT) {
+                    fprintf(outputFd, (event == fieldName) ? "%s" : " %s=",
+                            fieldName);
+                } else if (outputFd && format == JSON && event == fieldName) {
+                    fprintf(outputFd, "%s,\"event\":%s,\"fields\":{",
+                            context.c_str(),
+                            quoteForOutput(format, event).c_str());
+                } else if (outputFd) {
+                    rewindScratch();
+                }
+            }
+
             int width = -1;
             if (pf->hasDynamicWidth)
                 width = nb.getNext<int>();
@@ -1444,172 +2469,265 @@ Log::Decoder::BufferFragment::decompressNextLogStatement(FILE *outputFd,
             if (pf->hasDynamicPrecision)
                 precision = nb.getNext<int>();
 
-            switch(pf->argType) {
+            // Delta encoded integers and doubles are printed like the type
+            // that precedes their fragment, but with their value reconstructed
+            uint8_t argType = pf->argType;
+            uint64_t *deltaBase = nullptr;
+            if (argType == delta_t) {
+                argType = static_cast<uint8_t>(*fragment++);
+                deltaBase = deltaBases.getCurrent(metadata->numPrintFragments)
+                                                                        + i;
+            }
+
+            switch(argType) {
                 case NONE:
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-security"
 #pragma GCC diagnostic ignored "-Wformat-nonliteral"
-                    if (outputFd)
-                        fprintf(outputFd, pf->formatFragment);
+                    if (fragmentFd)
+                        fprintf(fragmentFd, fragment);
 #pragma GCC diagnostic pop
                     break;
 
                 case unsigned_char_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<unsigned char>(),
+                                   fragment,
+                                   getNextInteger<unsigned char>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case unsigned_short_int_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<unsigned short int>(),
+                                   fragment,
+                                   getNextInteger<unsigned short int>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case unsigned_int_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<unsigned int>(),
+                                   fragment,
+                                   getNextInteger<unsigned int>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case unsigned_long_int_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<unsigned long int>(),
+                                   fragment,
+                                   getNextInteger<unsigned long int>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case unsigned_long_long_int_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<unsigned long long int>(),
+                                   fragment,
+                                   getNextInteger<unsigned long long int>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case uintmax_t_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<uintmax_t>(),
+                                   fragment,
+                                   getNextInteger<uintmax_t>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case size_t_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<size_t>(),
+                                   fragment,
+                                   getNextInteger<size_t>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case wint_t_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<wint_t>(),
+                                   fragment,
+                                   getNextInteger<wint_t>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case signed_char_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<signed char>(),
+                                   fragment,
+                                   getNextInteger<signed char>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case short_int_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<short int>(),
+                                   fragment,
+                                   getNextInteger<short int>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case int_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<int>(),
+                                   fragment,
+                                   getNextInteger<int>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case long_int_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<long int>(),
+                                   fragment,
+                                   getNextInteger<long int>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case long_long_int_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<long long int>(),
+                                   fragment,
+                                   getNextInteger<long long int>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case intmax_t_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<intmax_t>(),
+                                   fragment,
+                                   getNextInteger<intmax_t>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case ptrdiff_t_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<ptrdiff_t>(),
+                                   fragment,
+                                   getNextInteger<ptrdiff_t>(nb, deltaBase),
                                    width, precision);
                     break;
 
                 case double_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
-                                   nb.getNext<double>(),
+                                   fragment,
+                                   (deltaBase) ? nb.getNextXor(deltaBase)
+                                               : nb.getNext<double>(),
                                    width, precision);
                     break;
 
                 case long_double_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
+                                   fragment,
                                    nb.getNext<long double>(),
                                    width, precision);
                     break;
 
                 case const_void_ptr_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
+                                   fragment,
                                    nb.getNext<const void *>(),
                                    width, precision);
                     break;
 
                 // The next two are strings, so handle it accordingly.
                 case const_char_ptr_t:
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
+                                   fragment,
                                    nextStringArg,
                                    width, precision);
 
                     nextStringArg += strlen(nextStringArg) + 1; // +1 for NULL
                     break;
 
+                case const_char_ptr_interned_t:
+                {
+                    const char *str = nextStringArg;
+                    if (*nextStringArg == '\0') {
+                        uint8_t id = static_cast<uint8_t>(nextStringArg[1]);
+                        nextStringArg += 2;
+
+                        if (id != 0)
+                            str = internedStrings.get(i, id);
+
+                        if (str == nullptr)
+                            str = "(unknown interned string)";
+                    } else {
+                        size_t length = strlen(nextStringArg);
+                        internedStrings.add(i, nextStringArg, length);
+                        nextStringArg += length + 1; // +1 for NULL
+                    }
+
+                    printSingleArg(fragmentFd,
+                                   logArgs,
+                                   fragment,
+                                   str,
+                                   width, precision);
+                    break;
+                }
+
+                case const_char_ptr_static_t:
+                {
+                    uint32_t id = nb.getNext<uint32_t>();
+                    const char *str = "(unknown static string)";
+                    if (staticStrings && id < staticStrings->size())
+                        str = staticStrings->at(id).c_str();
+
+                    printSingleArg(fragmentFd,
+                                   logArgs,
+                                   fragment,
+                                   str,
+                                   width, precision);
+                    break;
+                }
+
+                case codec_t:
+                {
+                    const char *codecName = fragment;
+                    const char *codecFragment = codecName
+                                                    + strlen(codecName) + 1;
+                    uint32_t length = unpackVarint(&nextStringArg);
+
+                    renderedArgs.push_back(formatCodecArgument(codecName,
+                                                               nextStringArg,
+                                                               length));
+                    printSingleArg(fragmentFd,
+                                   logArgs,
+                                   codecFragment,
+                                   renderedArgs.back().c_str(),
+                                   width, precision);
+
+                    nextStringArg += length;
+                    break;
+                }
+
+                case blob_t:
+                {
+                    uint32_t lengthWord;
+                    std::memcpy(&lengthWord, nextStringArg, sizeof(uint32_t));
+                    nextStringArg += sizeof(uint32_t);
+
+                    uint32_t length = lengthWord & MAX_BLOB_BYTES;
+                    renderedArgs.push_back(formatBlob(nextStringArg, length,
+                                                lengthWord & BLOB_BASE64_FLAG));
+
+                    // The precision was applied when the blob was recorded
+                    printSingleArg(fragmentFd,
+                                   logArgs,
+                                   fragment,
+                                   renderedArgs.back().c_str(),
+                                   width);
+
+                    nextStringArg += length;
+                    break;
+                }
+
                 case const_wchar_t_ptr_t:
 
                     /**
@@ -1640,9 +2758,9 @@ Log::Decoder::BufferFragment::decompressNextLogStatement(FILE *outputFd,
                      * passing it to printf.
                      */
                     wstrArg = reinterpret_cast<const wchar_t *>(nextStringArg);
-                    printSingleArg(outputFd,
+                    printSingleArg(fragmentFd,
                                    logArgs,
-                                   pf->formatFragment,
+                                   fragment,
                                    wstrArg,
                                    width, precision);
                     // +1 for NULL
@@ -1656,14 +2774,46 @@ Log::Decoder::BufferFragment::decompressNextLogStatement(FILE *outputFd,
                     exit(-1);
             }
 
+            // Output the field, which was rendered to the scratch stream
+            if (fieldName && event != fieldName && outputFd
+                    && format != TEXT) {
+                // %c arguments are integers, but are rendered as characters
+                bool numeric = argType <= long_double_t
+                                    && argType != wint_t_t
+                                    && fragment[strlen(fragment) - 1] != 'c';
+                std::string value = formatFieldValue(format, numeric,
+                                                     readScratch());
+
+                if (format == CSV) {
+                    fprintf(outputFd, "%s%s,%s,%s\r\n", context.c_str(),
+                            quoteForOutput(format, event ? event : "").c_str(),
+                            quoteForOutput(format, fieldName).c_str(),
+                            value.c_str());
+                } else {
+                    fprintf(outputFd, "%s%s:%s", (numFields > 0) ? "," : "",
+                            quoteForOutput(format, fieldName).c_str(),
+                            value.c_str());
+                }
+                ++numFields;
+            }
+
             pf = reinterpret_cast<PrintFragment*>(
                     reinterpret_cast<char*>(pf)
                     + pf->fragmentLength
                     + sizeof(PrintFragment));
         }
 
-        if (outputFd)
+        if (outputFd && format == TEXT) {
             fprintf(outputFd, "\r\n");
+        } else if (outputFd && event == nullptr) {
+            printLogMessage(outputFd, format, context, readScratch());
+        } else if (outputFd && format == JSON) {
+            fprintf(outputFd, "}}\r\n");
+        } else if (outputFd && numFields == 0) {
+            fprintf(outputFd, "%s%s,,\r\n", context.c_str(),
+                    quoteForOutput(format, event).c_str());
+        }
+
         // We're done, advance the pointer to the end of the last string
         readPos = nextStringArg;
     }
@@ -1759,7 +2909,7 @@ Log::Decoder::internalDecompressUnordered(FILE* outputFd,
             case EntryType::CHECKPOINT:
                 if (!readDictionary(inputFd, true))
                     good = false;
-                else if (outputFd)
+                else if (outputFd && outputFormat == TEXT)
                     fprintf(outputFd, "\r\n# New execution started\r\n");
 
                 break;
@@ -1767,14 +2917,13 @@ Log::Decoder::internalDecompressUnordered(FILE* outputFd,
                 good = readDictionaryFragment(inputFd);
                 break;
             case EntryType::INVALID:
-                // Consume whitespace
-                while (!feof(inputFd) && peekEntryType(inputFd) == INVALID)
-                    fgetc(inputFd);
+                // Consume padding or switch to/from reading a CompressedBlock
+                good = readPaddingOrBlock();
                 break;
         }
     }
 
-    if (outputFd)
+    if (outputFd && outputFormat == TEXT)
         fprintf(outputFd, "\r\n\r\n# Decompression Complete after printing "
                             "%lu log messages\r\n", logMsgsPrinted);
 
@@ -1873,7 +3022,7 @@ Log::Decoder::decompressTo(FILE* outputFd)
                     // We're safe, all the stages are empty
                     good = readDictionary(inputFd, true);
 
-                    if (good)
+                    if (good && outputFd && outputFormat == TEXT)
                         fprintf(outputFd,"\r\n# New execution started\r\n");
 
                     break;
@@ -1883,9 +3032,8 @@ Log::Decoder::decompressTo(FILE* outputFd)
                     break;
 
                 case EntryType::INVALID:
-                    // Consume padding
-                    while (!feof(inputFd) && peekEntryType(inputFd) == INVALID)
-                        fgetc(inputFd);
+                    // Consume padding or switch to/from reading a CompressedBlock
+                    good = readPaddingOrBlock();
                     break;
             }
 
@@ -2026,7 +3174,7 @@ Log::Decoder::getNextLogStatement(LogMessage &logMsg,
             case EntryType::CHECKPOINT:
                 if (readDictionary(inputFd, true)) {
 
-                    if (outputFd)
+                    if (outputFd && outputFormat == TEXT)
                         fprintf(outputFd, "\r\n# New execution started\r\n");
 
                     break;
@@ -2040,9 +3188,8 @@ Log::Decoder::getNextLogStatement(LogMessage &logMsg,
                 break;
 
             case EntryType::INVALID:
-                // Consume padding
-                while (!feof(inputFd) && peekEntryType(inputFd) == INVALID)
-                    fgetc(inputFd);
+                // Consume padding or switch to/from reading a CompressedBlock
+                good = readPaddingOrBlock();
                 break;
         }
     }
@@ -2056,6 +3203,33 @@ Log::Decoder::getNextLogStatement(LogMessage &logMsg,
                                                             nullptr);
 }
 
+/**
+ * Returns the conversion factor from the runtime timestamps of the log
+ * messages returned by getNextLogStatement() to seconds, as recorded by the
+ * execution that logged them.
+ */
+double
+Log::Decoder::getCyclesPerSecond() const {
+    return checkpoint.cyclesPerSecond;
+}
+
+/**
+ * Converts the runtime timestamp of a log message returned by
+ * getNextLogStatement() to seconds since the Unix epoch.
+ *
+ * \param timestamp
+ *      Runtime timestamp of the log message (i.e. LogMessage::getTimestamp())
+ */
+double
+Log::Decoder::getUnixTime(uint64_t timestamp) const {
+    double secondsSinceCheckpoint = (timestamp >= checkpoint.rdtsc)
+            ? PerfUtils::Cycles::toSeconds(timestamp - checkpoint.rdtsc,
+                                           checkpoint.cyclesPerSecond)
+            : -PerfUtils::Cycles::toSeconds(checkpoint.rdtsc - timestamp,
+                                            checkpoint.cyclesPerSecond);
+    return static_cast<double>(checkpoint.unixTime) + secondsSinceCheckpoint;
+}
+
 /**
  * Decompress the file open()-ed to a file descriptor. This invocation will
  * not attempt to sort the log entries by time, but otherwise functions
@@ -2075,3 +3249,24 @@ Log::Decoder::decompressUnordered(FILE* outputFd) {
 }
 
 }; /* NanoLogInternal */
+
+/**
+ * Registers a function that renders the arguments serialized by the
+ * NanoLog::Codec of the given name during decompression. This must be
+ * invoked before decompression in the program that decompresses the
+ * log (i.e. a decompressor built with the user's formatters linked in).
+ *
+ * \param name
+ *      Name of the codec (i.e. NanoLog::Codec<T>::name)
+ * \param formatter
+ *      Function that renders the bytes output by the codec's compress()
+ * \return
+ *      true if the formatter was registered; false if one was already
+ *      registered under the same name
+ */
+bool
+NanoLog::registerCodecFormatter(const char *name, CodecFormatter formatter)
+{
+    return NanoLogInternal::getCodecFormatters().emplace(name,
+                                                         formatter).second;
+}
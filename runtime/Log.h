@@ -13,12 +13,19 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <algorithm>
 #include <ctime>
+#include <deque>
+#include <future>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <cassert>
+#include <cstring>
 #include <stdio.h>
 
+#include "BlockCodec.h"
 #include "Config.h"
 #include "Common.h"
 #include "Cycles.h"
@@ -110,10 +117,62 @@ enum ParamType : int32_t {
     STRING = 0
 };
 
+/**
+ * Describes how a log argument is encoded in the compressed log when it
+ * differs from what its printf format specifier alone would imply. These
+ * are persisted per parameter in the dictionary by C++17 NanoLog.
+ */
+enum ArgEncoding : uint8_t {
+    // The argument is encoded according to its format specifier
+    DEFAULT_ENCODING = 0,
+
+    // The argument is a NanoLog::static_str() and is encoded as an id into
+    // the compressed log's table of static strings (see StaticStringTable)
+    STATIC_STRING_ID = 1,
+
+    // The argument is a user-defined type serialized by a NanoLog::Codec.
+    // In the dictionary, this encoding is followed by the NULL-terminated
+    // name of the Codec so that the decompressor can find its formatter.
+    CODEC = 2,
+
+    // The argument is a NanoLog::delta() integer or a floating-point value
+    // and is encoded as the (signed) difference from, or respectively the XOR
+    // with, the value it had in the previous log message of the same
+    // invocation site and BufferExtent (see DeltaBases)
+    DELTA_ENCODED = 3,
+
+    // The argument is a string that is replaced by a reference if it repeats
+    // a string interned by a previous log message of the same invocation site
+    // and BufferExtent (see InternedStrings)
+    INTERNED_STRING = 4
+};
+
+// Blobs logged with a %B specifier are prefixed with a uint32_t length; the
+// most significant bit of which marks that the blob is rendered in base64.
+static constexpr uint32_t BLOB_BASE64_FLAG = 1U << 31;
+static constexpr uint32_t MAX_BLOB_BYTES = BLOB_BASE64_FLAG - 1;
+
+// Names of the fields that the events logged by NANO_LOG_SPAN() record the
+// per-thread span identifier under; the event name is the span's name.
+static constexpr const char *SPAN_BEGIN_FIELD = "span.begin";
+static constexpr const char *SPAN_END_FIELD = "span.end";
+
+// Names of the fields that the events logged by NANO_METRIC_COUNTER() and
+// NANO_METRIC_GAUGE() record the metric's value under; the event name is the
+// metric's name.
+static constexpr const char *METRIC_COUNTER_FIELD = "counter";
+static constexpr const char *METRIC_GAUGE_FIELD = "gauge";
+
 // Default, uninitialized value for log identifiers associated with log
 // invocation sites.
 static constexpr int UNASSIGNED_LOGID = -1;
 
+namespace Log {
+    class StaticStringTable;
+    class DeltaBases;
+    class InternedStrings;
+};
+
 /**
  * Stores the static log information associated with a log invocation site
  * (i.e. filename/line/fmtString combination).
@@ -122,7 +181,9 @@ struct StaticLogInfo {
 
     // Function signature of the compression function used in the
     // non-preprocessor version of NanoLog
-    typedef void (*CompressionFn)(int, const ParamType*, char**, char**);
+    typedef void (*CompressionFn)(int, const ParamType*, char**, char**,
+                                  Log::StaticStringTable*, Log::DeltaBases*,
+                                  Log::InternedStrings*);
 
     // Constructor
     constexpr StaticLogInfo(CompressionFn compress,
@@ -132,7 +193,10 @@ struct StaticLogInfo {
                       const char* fmtString,
                       const int numParams,
                       const int numNibbles,
-                      const ParamType* paramTypes)
+                      const ParamType* paramTypes,
+                      const ArgEncoding* argEncodings=nullptr,
+                      const char* const* codecNames=nullptr,
+                      const char* const* fieldNames=nullptr)
             : compressionFunction(compress)
             , filename(filename)
             , lineNum(lineNum)
@@ -141,6 +205,9 @@ struct StaticLogInfo {
             , numParams(numParams)
             , numNibbles(numNibbles)
             , paramTypes(paramTypes)
+            , argEncodings(argEncodings)
+            , codecNames(codecNames)
+            , fieldNames(fieldNames)
     { }
 
     // Stores the compression function to be used on the log's dynamic arguments
@@ -168,6 +235,21 @@ struct StaticLogInfo {
     // argument list starting at 0) to parameter type as inferred from the
     // printf log message invocation
     const ParamType* paramTypes;
+
+    // Mapping of parameter index to how the argument is encoded, if the
+    // invocation site uses non-default encodings (i.e. static strings).
+    // A value of nullptr indicates all arguments use the DEFAULT_ENCODING.
+    const ArgEncoding* argEncodings;
+
+    // Mapping of parameter index to the name of the NanoLog::Codec used to
+    // serialize the argument for parameters with the CODEC encoding (the
+    // other entries are unused). May be nullptr if there are none.
+    const char* const* codecNames;
+
+    // For structured log invocations (i.e. NANO_LOG_KV), the name of the
+    // event followed by the field name of each parameter. A value of nullptr
+    // indicates a regular printf-style log invocation.
+    const char* const* fieldNames;
 };
 
 namespace Log {
@@ -346,17 +428,53 @@ namespace Log {
         uint32_t entryType:2;
 
         // Number of bytes for this fragment (including all CompressedLogInfo)
-        uint32_t newMetadataBytes:30;
+        uint32_t newMetadataBytes:29;
 
-        // Total number of FormatMetadata encountered so far in the log
-        // including this fragment (used as a sanity check only).
+        // Indicates that this fragment contains NULL-terminated static
+        // strings (see StaticStringTable) instead of CompressedLogInfo's
+        uint32_t isStaticStringTable:1;
+
+        // Total number of FormatMetadata (or static strings) encountered so
+        // far in the log including this fragment (used as a sanity check only)
         uint32_t totalMetadataEntries;
     };
     NANOLOG_PACK_POP
 
+    /**
+     * Frames an output buffer of the compressed log that was compressed a
+     * second time with a BlockCodec (see LoggerOptions::blockCompression).
+     * The block decompresses to a sequence of complete entries, which are
+     * read as if they were in place of the block. Both lengths are recorded
+     * so that a reader can skip from block to block and decompress them
+     * independently (i.e. in parallel).
+     */
+    NANOLOG_PACK_PUSH
+    struct CompressedBlock {
+        // Byte representation of an EntryType::INVALID, since the other
+        // types are taken; the marker distinguishes the block from the \0's
+        // padding the log.
+        uint8_t entryType:2;
+
+        // Always BLOCK_MARKER
+        uint8_t marker:4;
+
+        // BlockCodec::Codec the block is compressed with
+        uint8_t codec:2;
+
+        // Number of bytes following this header that hold the block
+        uint32_t compressedLength;
+
+        // Number of bytes the block decompresses to
+        uint32_t uncompressedLength;
+
+        static const uint8_t BLOCK_MARKER = 0x0B;
+    };
+    NANOLOG_PACK_POP
+
     /**
      * Stores the static log information associated with a log message on disk.
-     * Following this structure are the filename and format string.
+     * Following this structure are the filename, format string, and the
+     * ArgEncoding of each parameter (if any).
      */
     NANOLOG_PACK_PUSH
     struct CompressedLogInfo {
@@ -373,6 +491,18 @@ namespace Log {
         // Length of the format string that is associated with this log
         // invocation and comes after filename.
         uint16_t formatStringLength;
+
+        // Number of bytes following the format string that describe the
+        // ArgEncoding of each parameter (with CODEC encodings followed by the
+        // codec's NULL-terminated name). A value of 0 indicates all
+        // parameters use the DEFAULT_ENCODING.
+        uint16_t argEncodingsLength;
+
+        // Number of bytes following the argument encodings that contain the
+        // NULL-terminated event name and field names of a structured log
+        // invocation (i.e. NANO_LOG_KV). A value of 0 indicates a regular
+        // printf-style log invocation.
+        uint16_t fieldNamesLength;
     };
     NANOLOG_PACK_POP
 
@@ -419,6 +549,11 @@ namespace Log {
         bool hasDynamicWidth:1;
         bool hasDynamicPrecision:1;
 
+        // Indicates that the fragment belongs to a structured log message
+        // and that formatFragment starts with the NULL-terminated name of
+        // the field (or of the event, if the argType is NONE).
+        bool hasFieldName:1;
+
         //TODO(syang0) is this necessary? The format fragment is null-terminated
         // Length of the format fragment
         uint16_t fragmentLength;
@@ -462,6 +597,28 @@ namespace Log {
         const_char_ptr_t,
         const_wchar_t_ptr_t,
 
+        // A %s argument encoded as an id into the static string table
+        const_char_ptr_static_t,
+
+        // A %s argument serialized by a NanoLog::Codec; the codec's name
+        // precedes the format fragment in the PrintFragment
+        codec_t,
+
+        // A binary blob logged with a %B specifier and NanoLog::bytes();
+        // the fragment's specifier is rewritten to a %s for its rendering
+        blob_t,
+
+        // An integer or double argument encoded relative to its previous
+        // value (see NanoLog::delta() and BufferUtils::packXor()); the
+        // FormatType of the argument precedes the format fragment in the
+        // PrintFragment as a byte
+        delta_t,
+
+        // A %s argument that is either a string, which is interned unless
+        // it's empty, or a reference to a previously interned one (see
+        // InternedStrings)
+        const_char_ptr_interned_t,
+
         MAX_FORMAT_TYPE
     };
 
@@ -520,27 +677,32 @@ namespace Log {
      * \param[in/out] out
      *      Output byte buffer to compress the entry into
      * \param lastTimestamp
-     *      The timestamp of the last entry compacted. This value is used to
-     *      compute the rdtsc() difference in the CompressedRecordEntry. A
-     *      value of 0 shall be used for the first entry.
+     *      The timestamp of the last entry compacted (in units of
+     *      2^timestampShift cycles). This value is used to compute the rdtsc()
+     *      difference in the CompressedRecordEntry. A value of 0 shall be used
+     *      if there's no such entry.
+     * \param timestampShift
+     *      Number of least significant bits of the rdtsc() timestamp to drop
+     *      (see insertCheckpoint())
      *
      * \return
      *          Number of bytes written to out
      */
     inline size_t
     compressLogHeader(const UncompressedEntry *re, char** out,
-                        uint64_t lastTimestamp) {
+                        uint64_t lastTimestamp, uint32_t timestampShift=0) {
         CompressedEntry *mo = reinterpret_cast<CompressedEntry*>(*out);
         *out += sizeof(CompressedEntry);
 
         mo->entryType = EntryType::LOG_MSGS_OR_DIC;
 
         // Bitmask is needed to prevent -Wconversion warnings
+        uint64_t timestamp = re->timestamp >> timestampShift;
         mo->additionalFmtIdBytes = 0x03 & static_cast<uint8_t>(
                     BufferUtils::pack(out, re->fmtId) - 1);
         mo->additionalTimestampBytes = 0x0F & static_cast<uint8_t>(
                     BufferUtils::pack(out, static_cast<int64_t>(
-                                            re->timestamp - lastTimestamp)));
+                                            timestamp - lastTimestamp)));
 
         return sizeof(CompressedEntry)
                     + mo->additionalFmtIdBytes + 1
@@ -586,7 +748,22 @@ namespace Log {
 
     bool insertCheckpoint(char** out,
                           char *outLimit,
-                          bool writeDictionary);
+                          bool writeDictionary,
+                          uint32_t timestampShift=0);
+
+    std::string formatBlob(const char *data, uint32_t length, bool base64);
+
+    size_t compressBlock(const char *in, size_t length, char *out,
+                         BlockCodec::Codec codec);
+
+    /**
+     * Returns the largest number of bytes that compressBlock() can output
+     * for a block of the given length.
+     */
+    inline size_t
+    maxCompressedBlockSize(size_t length) {
+        return sizeof(CompressedBlock) + BlockCodec::maxCompressedSize(length);
+    }
 
     /**
      * Extracts a checkpoint from a file descriptor.
@@ -629,6 +806,521 @@ namespace Log {
         buffer += sizeof(T);
     }
 
+    /**
+     * Returns the number of bytes of a blob logged via a %B specifier that
+     * should be recorded after applying the specifier's precision (if any).
+     *
+     * \param length
+     *      Length of the blob passed in by the user
+     * \param precision
+     *      Precision of the %B specifier; a negative value indicates none
+     */
+    static inline uint32_t
+    getBlobBytes(size_t length, int64_t precision) {
+        if (precision >= 0 && length > static_cast<uint64_t>(precision))
+            length = static_cast<size_t>(precision);
+
+        return static_cast<uint32_t>(std::min<size_t>(length, MAX_BLOB_BYTES));
+    }
+
+    /**
+     * Copies a blob logged via a %B specifier to a character array as a
+     * uint32_t length (with the BLOB_BASE64_FLAG) followed by the bytes and
+     * bumps the array pointer. This is used by the injected record code and
+     * the C++17 NanoLog to save blobs to the staging buffer.
+     *
+     * \param buffer
+     *      Buffer to copy the blob to
+     * \param data
+     *      Start of the blob
+     * \param bytes
+     *      Number of bytes to copy (as returned by getBlobBytes())
+     * \param base64
+     *      Whether the blob should be rendered in base64 instead of hex
+     */
+    static inline void
+    recordBlob(char* &buffer, const void *data, uint32_t bytes, bool base64) {
+        uint32_t lengthWord = bytes | (base64 ? BLOB_BASE64_FLAG : 0);
+        std::memcpy(buffer, &lengthWord, sizeof(uint32_t));
+        std::memcpy(buffer + sizeof(uint32_t), data, bytes);
+        buffer += sizeof(uint32_t) + bytes;
+    }
+
+    /**
+     * Assigns small, dense identifiers to the static-lifetime strings logged
+     * via NanoLog::static_str() so that only the identifier needs to be
+     * encoded with each log message. Strings are identified by their address
+     * and the Encoder persists newly interned strings into the compressed log
+     * (as a DictionaryFragment) ahead of the first log message to use them.
+     *
+     * This class is only accessed by the compression thread.
+     */
+    class StaticStringTable {
+    PUBLIC:
+        StaticStringTable()
+            : ids()
+            , strings()
+            , numPersisted(0)
+            , unpersistedBytes(0)
+        {}
+
+        /**
+         * Returns the identifier associated with a static string, assigning
+         * a new one if this is the first time the string is encountered.
+         *
+         * \param str
+         *      NULL-terminated string with a static lifetime
+         * \return
+         *      Identifier for the string
+         */
+        inline uint32_t
+        intern(const char *str) {
+            auto it = ids.find(str);
+            if (it != ids.end())
+                return it->second;
+
+            uint32_t id = static_cast<uint32_t>(strings.size());
+            ids.emplace(str, id);
+            strings.push_back(str);
+            unpersistedBytes += strlen(str) + 1;
+            return id;
+        }
+
+        /**
+         * Forgets all the strings interned after the first newSize strings.
+         * This is used to roll back a partially encoded log message and
+         * must not discard strings that have already been persisted.
+         *
+         * \param newSize
+         *      Number of strings to keep
+         */
+        void
+        truncate(size_t newSize) {
+            assert(newSize >= numPersisted);
+            while (strings.size() > newSize) {
+                unpersistedBytes -= strlen(strings.back()) + 1;
+                ids.erase(strings.back());
+                strings.pop_back();
+            }
+        }
+
+        // Number of strings interned so far
+        size_t size() { return strings.size(); }
+
+        // Number of bytes needed to persist the strings interned since the
+        // last markPersisted() (including NULL terminators)
+        size_t getUnpersistedBytes() { return unpersistedBytes; }
+
+        // Index of the first string that has yet to be persisted
+        size_t getNumPersisted() { return numPersisted; }
+
+        // Returns the string associated with an identifier
+        const char *get(size_t id) { return strings.at(id); }
+
+        // Indicates that all the strings interned so far have been persisted
+        void markPersisted() {
+            numPersisted = strings.size();
+            unpersistedBytes = 0;
+        }
+
+        // Forgets all the strings (i.e. when starting a new compressed log)
+        void clear() {
+            ids.clear();
+            strings.clear();
+            numPersisted = 0;
+            unpersistedBytes = 0;
+        }
+
+    PRIVATE:
+        // Maps the address of a static string to its identifier
+        std::unordered_map<const char*, uint32_t> ids;
+
+        // Maps identifiers back to the static strings
+        std::vector<const char*> strings;
+
+        // Number of strings (starting from identifier 0) in the compressed log
+        size_t numPersisted;
+
+        // Bytes needed to encode the strings that have not been persisted yet
+        size_t unpersistedBytes;
+
+        DISALLOW_COPY_AND_ASSIGN(StaticStringTable);
+    };
+
+    /**
+     * Tracks the last value of every NanoLog::delta() and floating-point
+     * argument per log invocation site so that the next value can be encoded
+     * relative to it. The Encoder and the BufferFragments of the Decoder keep
+     * one each and clear it at the start of every BufferExtent, which keeps
+     * the extents independently decodable.
+     */
+    class DeltaBases {
+    PUBLIC:
+        DeltaBases()
+            : sites()
+            , currentLogId(0)
+            , generation(1)
+        {}
+
+        /**
+         * Selects the log invocation site that subsequent invocations of
+         * getCurrent() return the bases of.
+         *
+         * \param logId
+         *      Identifier of the log invocation site
+         */
+        inline void
+        select(uint32_t logId) {
+            currentLogId = logId;
+        }
+
+        /**
+         * Returns the last values of the arguments of the selected log
+         * invocation site, indexed by parameter number. The values start at
+         * 0 and are updated in place by the caller.
+         *
+         * \param numParams
+         *      Number of parameters of the log invocation site
+         */
+        inline uint64_t *
+        getCurrent(size_t numParams) {
+            if (currentLogId >= sites.size())
+                sites.resize(currentLogId + 1);
+
+            Site &site = sites[currentLogId];
+            if (site.generation != generation) {
+                site.generation = generation;
+                site.values.assign(site.values.size(), 0);
+            }
+
+            if (site.values.size() < numParams)
+                site.values.resize(numParams, 0);
+
+            return site.values.data();
+        }
+
+        // Forgets all the values (i.e. at the start of a BufferExtent)
+        void clear() {
+            ++generation;
+        }
+
+    PRIVATE:
+        // Last value of each argument of a log invocation site
+        struct Site {
+            Site()
+                : generation(0)
+                , values()
+            {}
+
+            // Value of DeltaBases::generation when values were last reset
+            uint64_t generation;
+
+            // Last value of each argument, indexed by parameter number
+            std::vector<uint64_t> values;
+        };
+
+        // Maps log invocation site identifiers (which are dense) to the last
+        // values of their arguments
+        std::vector<Site> sites;
+
+        // Log invocation site selected by select()
+        uint32_t currentLogId;
+
+        // Incremented by clear() to lazily reset the Sites upon next use
+        uint64_t generation;
+
+        DISALLOW_COPY_AND_ASSIGN(DeltaBases);
+    };
+
+    /**
+     * Tracks the strings recently passed to the string arguments of each log
+     * invocation site so that repeats can be encoded as references to them.
+     * In the compressed log, strings are interned when they first appear
+     * (i.e. the dictionary is written inline) and a reference is encoded as
+     * a NULL character followed by the 1-based index of the string as a byte
+     * (the empty string is encoded as two NULL characters). The Encoder and
+     * the BufferFragments of the Decoder keep one each and clear it at the
+     * start of every BufferExtent, so both sides intern the same strings.
+     */
+    class InternedStrings {
+    PUBLIC:
+        InternedStrings()
+            : sites()
+            , currentLogId(0)
+            , generation(1)
+        {}
+
+        /**
+         * Selects the log invocation site whose strings subsequent
+         * invocations of intern(), add() and get() operate on.
+         *
+         * \param logId
+         *      Identifier of the log invocation site
+         */
+        inline void
+        select(uint32_t logId) {
+            currentLogId = logId;
+        }
+
+        /**
+         * Looks up a string previously interned for an argument of the
+         * selected log invocation site and interns it if it's not found
+         * (and there's room). Used by the Encoder.
+         *
+         * \param argNum
+         *      Argument of the log invocation site the string is passed to
+         * \param str
+         *      String to look up (not necessarily NULL-terminated)
+         * \param length
+         *      Number of characters in the string
+         * \return
+         *      1-based index of the string if it was interned before, or 0
+         *      if it has to be encoded in full
+         */
+        inline uint32_t
+        intern(size_t argNum, const char *str, size_t length) {
+            if (length == 0
+                    || length > NanoLogConfig::MAX_INTERNED_STRING_LENGTH)
+                return 0;
+
+            // Once the Table is full, which is also when the Decoder stops
+            // interning, the lookups are skipped if they rarely succeeded
+            Table &table = getTable(argNum);
+            if (table.offsets.size() == NanoLogConfig::MAX_INTERNED_STRINGS
+                    && table.hits < table.offsets.size())
+                return 0;
+
+            // Arguments often repeat the last string, which needs no hashing
+            if (table.lastId != 0
+                    && matches(table, table.lastId, str, length)) {
+                ++table.hits;
+                return table.lastId;
+            }
+
+            if (table.index.empty())
+                table.index.resize(INDEX_SIZE, 0);
+
+            uint64_t hash = hashString(str, length);
+            size_t slot = hash & (INDEX_SIZE - 1);
+            while (table.index[slot] != 0) {
+                uint32_t id = table.index[slot];
+                if (table.hashes[id - 1] == hash
+                        && matches(table, id, str, length)) {
+                    ++table.hits;
+                    table.lastId = id;
+                    return id;
+                }
+
+                slot = (slot + 1) & (INDEX_SIZE - 1);
+            }
+
+            if (table.offsets.size() < NanoLogConfig::MAX_INTERNED_STRINGS) {
+                append(table, str, length);
+                table.hashes.push_back(hash);
+                table.index[slot] = static_cast<uint8_t>(table.offsets.size());
+                table.lastId = static_cast<uint32_t>(table.offsets.size());
+            }
+
+            return 0;
+        }
+
+        /**
+         * Interns a string that was encoded in full for an argument of the
+         * selected log invocation site, under the same conditions as
+         * intern(). Used by the Decoder.
+         *
+         * \param argNum
+         *      Argument of the log invocation site the string was passed to
+         * \param str
+         *      NULL-terminated string to intern
+         * \param length
+         *      Number of characters in the string
+         */
+        inline void
+        add(size_t argNum, const char *str, size_t length) {
+            if (length == 0
+                    || length > NanoLogConfig::MAX_INTERNED_STRING_LENGTH)
+                return;
+
+            Table &table = getTable(argNum);
+            if (table.offsets.size() < NanoLogConfig::MAX_INTERNED_STRINGS)
+                append(table, str, length);
+        }
+
+        /**
+         * Returns a string interned for an argument of the selected log
+         * invocation site. Used by the Decoder.
+         *
+         * \param argNum
+         *      Argument of the log invocation site the string was passed to
+         * \param id
+         *      1-based index of the string
+         * \return
+         *      The NULL-terminated string, which is valid until the next
+         *      string is interned for the argument, or nullptr if there's
+         *      no such string
+         */
+        inline const char *
+        get(size_t argNum, uint32_t id) {
+            Table &table = getTable(argNum);
+            if (id == 0 || id > table.offsets.size())
+                return nullptr;
+
+            return &table.characters[table.offsets[id - 1]];
+        }
+
+        // Forgets all the strings (i.e. at the start of a BufferExtent)
+        void clear() {
+            ++generation;
+        }
+
+    PRIVATE:
+        // Number of slots in the open addressing index of a Table, which
+        // must be a power of 2 larger than MAX_INTERNED_STRINGS
+        static const size_t INDEX_SIZE = 512;
+        static_assert(NanoLogConfig::MAX_INTERNED_STRINGS < INDEX_SIZE
+                        && NanoLogConfig::MAX_INTERNED_STRINGS <= UINT8_MAX,
+                      "Interned strings must be referable by a byte");
+
+        // Strings interned for an argument of a log invocation site
+        struct Table {
+            Table()
+                : offsets()
+                , hashes()
+                , characters()
+                , index()
+                , lastId(0)
+                , hits(0)
+            {}
+
+            // Offset of each string in characters, by (0-based) index
+            std::vector<uint32_t> offsets;
+
+            // Hash of each string, by index (only maintained by intern())
+            std::vector<uint64_t> hashes;
+
+            // The NULL-terminated strings, back to back
+            std::vector<char> characters;
+
+            // Open addressing hash table of the 1-based indexes of the
+            // strings; 0 marks an empty slot (only maintained by intern())
+            std::vector<uint8_t> index;
+
+            // 1-based index of the string last returned or interned by
+            // intern(), or 0 if none
+            uint32_t lastId;
+
+            // Number of strings found by intern()
+            uint64_t hits;
+        };
+
+        // Strings interned for each argument of a log invocation site
+        struct Site {
+            Site()
+                : generation(0)
+                , tables()
+            {}
+
+            // Value of InternedStrings::generation when tables were reset
+            uint64_t generation;
+
+            // Tables of each argument, indexed by argument number
+            std::vector<Table> tables;
+        };
+
+        /**
+         * Returns the Table of an argument of the selected log invocation
+         * site, resetting it first if it hasn't been used since clear().
+         */
+        inline Table &
+        getTable(size_t argNum) {
+            if (currentLogId >= sites.size())
+                sites.resize(currentLogId + 1);
+
+            Site &site = sites[currentLogId];
+            if (site.generation != generation) {
+                site.generation = generation;
+                for (Table &table : site.tables) {
+                    table.offsets.clear();
+                    table.hashes.clear();
+                    table.characters.clear();
+                    std::fill(table.index.begin(), table.index.end(), 0);
+                    table.lastId = 0;
+                    table.hits = 0;
+                }
+            }
+
+            if (argNum >= site.tables.size())
+                site.tables.resize(argNum + 1);
+
+            return site.tables[argNum];
+        }
+
+        // Checks whether a string equals the string of a Table with the
+        // given 1-based index
+        static inline bool
+        matches(const Table &table, uint32_t id, const char *str,
+                size_t length) {
+            uint32_t offset = table.offsets[id - 1];
+            size_t end = (id < table.offsets.size()) ? table.offsets[id]
+                                                     : table.characters.size();
+            return end - offset == length + 1
+                    && std::memcmp(&table.characters[offset], str, length) == 0;
+        }
+
+        // Appends a string to the end of a Table
+        static inline void
+        append(Table &table, const char *str, size_t length) {
+            table.offsets.push_back(
+                    static_cast<uint32_t>(table.characters.size()));
+            table.characters.insert(table.characters.end(), str, str + length);
+            table.characters.push_back('\0');
+        }
+
+        // Hashes a string by its length and (up to) 3 words sampled from its
+        // start, middle and end; collisions are resolved by matches()
+        static inline uint64_t
+        hashString(const char *str, size_t length) {
+            uint64_t words[3] = {0, 0, 0};
+            if (length >= sizeof(uint64_t)) {
+                std::memcpy(&words[0], str, sizeof(uint64_t));
+                std::memcpy(&words[1], str + length/2 - sizeof(uint64_t)/2,
+                            sizeof(uint64_t));
+                std::memcpy(&words[2], str + length - sizeof(uint64_t),
+                            sizeof(uint64_t));
+            } else if (length >= sizeof(uint32_t)) {
+                uint32_t first, last;
+                std::memcpy(&first, str, sizeof(uint32_t));
+                std::memcpy(&last, str + length - sizeof(uint32_t),
+                            sizeof(uint32_t));
+                words[0] = (static_cast<uint64_t>(first) << 32) | last;
+            } else {
+                for (size_t i = 0; i < length; ++i)
+                    words[0] = (words[0] << 8) | static_cast<uint8_t>(str[i]);
+            }
+
+            uint64_t hash = length;
+            for (uint64_t word : words) {
+                hash = (hash ^ word)*0x9E3779B97F4A7C15UL;
+                hash ^= hash >> 29;
+            }
+
+            return hash;
+        }
+
+        // Maps log invocation site identifiers (which are dense) to the
+        // strings interned for their arguments
+        std::vector<Site> sites;
+
+        // Log invocation site selected by select()
+        uint32_t currentLogId;
+
+        // Incremented by clear() to lazily reset the Sites upon next use
+        uint64_t generation;
+
+        DISALLOW_COPY_AND_ASSIGN(InternedStrings);
+    };
+
     /**
      * Encapsulates the knowledge on how to transform UncompresedLogMessage's
      * created by the generated code into a compressed log for a Decoder
@@ -653,7 +1345,8 @@ namespace Log {
     PUBLIC:
         Encoder(char *buffer, size_t bufferSize,
                 bool skipCheckpoint=false,
-                bool forceDictionaryOutput=false);
+                bool forceDictionaryOutput=false,
+                uint32_t timestampShift=0);
 
 #ifdef PREPROCESSOR_NANOLOG
         long encodeLogMsgs(char *from, uint64_t nbytes,
@@ -665,18 +1358,21 @@ namespace Log {
         long encodeLogMsgs(char *from, uint64_t nbytes,
                                     uint32_t bufferId,
                                     bool wrapAround,
-                                    std::vector<StaticLogInfo> dictionary,
+                                    const std::vector<StaticLogInfo> &dictionary,
                                     uint64_t *numEventsCompressed);
         uint32_t encodeNewDictionaryEntries(uint32_t& currentPosition,
-                                            std::vector<StaticLogInfo> allMetadata);
+                                const std::vector<StaticLogInfo> &allMetadata);
 
         size_t getEncodedBytes();
+        size_t getFreeBytes();
+        void restart(char *buffer, size_t bufferSize);
         void swapBuffer(char *inBuffer, size_t inSize,
                         char **outBuffer=nullptr, size_t *outLength=nullptr,
                         size_t *outSize=nullptr);
 
     PRIVATE:
         bool encodeBufferExtentStart(uint32_t bufferId, bool wrapAround);
+        void encodeStaticStringsAt(char *insertionPoint);
 
         // Used to store the compressed log messages and related metadata
         char *backing_buffer;
@@ -704,6 +1400,30 @@ namespace Log {
         // Metric: Number of consecutive encode failures due to missing metadata
         // Used to detect cases where the dictionary isn't persisted due to bugs
         uint32_t consecutiveEncodeMissesDueToMetadata;
+
+        // Strings logged via NanoLog::static_str() in this compressed log
+        StaticStringTable staticStrings;
+
+        // Last values of the NanoLog::delta() and floating-point arguments
+        // in the BufferExtent being encoded
+        DeltaBases deltaBases;
+
+        // Strings interned in the BufferExtent being encoded
+        InternedStrings internedStrings;
+
+        // Number of least significant bits dropped from the timestamps of
+        // the log messages (see insertCheckpoint())
+        uint32_t timestampShift;
+
+        // Timestamp of the first log message in the last BufferExtent of each
+        // StagingBuffer (by id) since the last Checkpoint. The first log
+        // message of the next BufferExtent is encoded relative to it rather
+        // than in full. The first log message is used rather than the last,
+        // since the Decoder reads the first one of each BufferExtent ahead of
+        // the others when sorting the log messages.
+        std::unordered_map<uint32_t, uint64_t> firstTimestamps;
+
+        DISALLOW_COPY_AND_ASSIGN(Encoder);
     };
 
     /**
@@ -733,6 +1453,10 @@ namespace Log {
         // Runtime timestamp of the log statement.
         uint64_t rdtsc;
 
+        // Identifier of the runtime thread (StagingBuffer) that logged the
+        // log statement.
+        uint32_t runtimeId;
+
         // Number of runtime arguments currently stored in the structure
         int numArgs;
 
@@ -756,8 +1480,11 @@ namespace Log {
         int getNumArgs();
         uint32_t getLogId();
         uint64_t getTimestamp();
+        uint32_t getRuntimeId();
+        const char *getEventName();
+        const char *getFieldName(int fieldNum);
         void reset(FormatMetadata *fm= nullptr, uint32_t logId=uint32_t(-1),
-                        uint64_t rdtsc=0);
+                        uint64_t rdtsc=0, uint32_t runtimeId=0);
 
         /**
          * Add a dynamic log argument into the structure.
@@ -862,16 +1589,38 @@ namespace Log {
      */
     class Decoder {
     public:
+        /**
+         * Representations in which the Decoder can output log messages.
+         *
+         * TEXT is the regular human-readable output. JSON outputs one object
+         * per log message (i.e. JSON Lines) with the fields of structured
+         * log messages (i.e. NANO_LOG_KV) in a nested "fields" object and
+         * the rendered text of the other messages in "message". CSV outputs
+         * one row per field with the columns listed in CSV_HEADER.
+         */
+        enum OutputFormat {
+            TEXT,
+            JSON,
+            CSV
+        };
+
+        // Column names of the rows output in the CSV OutputFormat
+        static constexpr const char *CSV_HEADER =
+                "timestamp,file,line,severity,thread,event,field,value";
+
         Decoder();
         ~Decoder();
 
         bool open(const char *filename);
+        void setOutputFormat(OutputFormat format);
 
         int64_t decompressUnordered(FILE *outputFd);
         int64_t decompressTo(FILE *outputFd);
 
         bool getNextLogStatement(LogMessage &logMsg,
                                  FILE *outputFd= nullptr);
+        double getCyclesPerSecond() const;
+        double getUnixTime(uint64_t timestamp) const;
 
     PRIVATE:
         /**
@@ -908,8 +1657,45 @@ namespace Log {
             uint32_t nextLogId;
             uint64_t nextLogTimestamp;
 
+            // Static strings read from the compressed log so far (owned by
+            // the Decoder); used to decode NanoLog::static_str() arguments.
+            const std::vector<std::string> *staticStrings;
+
+            // Last values of the NanoLog::delta() and floating-point
+            // arguments decoded from this extent, indexed by PrintFragment
+            // number.
+            DeltaBases deltaBases;
+
+            // Strings interned in this extent, indexed by PrintFragment number
+            InternedStrings internedStrings;
+
+            // Timestamps of the first log messages of the last extents read
+            // for each runtime StagingBuffer (owned by the Decoder; see
+            // Encoder::firstTimestamps). If nullptr, the first log message is
+            // decoded as if there were no previous extents.
+            std::unordered_map<uint32_t, uint64_t> *firstTimestamps;
+
+            // Renderings of the NanoLog::Codec and blob arguments of the last
+            // log message decompressed. They are kept here so that the
+            // pointers stored in the LogMessage remain valid until the next
+            // message.
+            std::deque<std::string> renderedArgs;
+
+            // Representation to output log messages in (owned by the Decoder)
+            const OutputFormat *outputFormat;
+
+            // In-memory stream that log message arguments are rendered into
+            // before being quoted for the JSON and CSV OutputFormats; it is
+            // opened on first use.
+            FILE *scratchFd;
+            char *scratchBuffer;
+            size_t scratchBufferSize;
+
             BufferFragment();
+            ~BufferFragment();
             void reset();
+            FILE *rewindScratch();
+            std::string readScratch();
             bool hasNext();
             bool readBufferExtent(FILE *fd, bool *wrapAround=nullptr);
             bool decompressNextLogStatement(FILE *outputFd,
@@ -920,6 +1706,8 @@ namespace Log {
                                  long aggregationFilterId=-1,
                                  void (*aggregationFn)(const char*, ...)=NULL);
             uint64_t getNextLogTimestamp() const;
+
+            DISALLOW_COPY_AND_ASSIGN(BufferFragment);
         };
 
         static bool compareBufferFragments(const BufferFragment *a,
@@ -934,19 +1722,65 @@ namespace Log {
                                 uint32_t aggregationTargetId=-1,
                                 void (*aggregationFn)(const char*,...)=nullptr);
 
+        bool readStaticStrings(FILE *fd, const DictionaryFragment &df);
+
+        /**
+         * A CompressedBlock read from the log file, which is decompressed
+         * asynchronously so that the next block can be decompressed while
+         * the current one is decoded.
+         */
+        struct PendingBlock {
+            // Header of the block
+            CompressedBlock header;
+
+            // Bytes of the block as read from the log file
+            std::vector<char> compressed;
+
+            // Bytes the block decompresses to
+            std::vector<char> contents;
+
+            // Result of decompressing the block into contents; invalid if
+            // there's no block pending.
+            std::future<bool> decompressed;
+        };
+
+        bool readPaddingOrBlock();
+        bool readCompressedBlock(FILE *fd, PendingBlock &block);
+        bool openNextBlock();
+        void closeBlock();
+
         static bool createMicroCode(char **microCode,
                                      const char *formatString,
                                      const char *filename,
                                      uint32_t linenum,
-                                     uint8_t severity);
+                                     uint8_t severity,
+                                     const char *argEncodings=nullptr,
+                                     uint16_t argEncodingsLength=0,
+                                     const char *fieldNames=nullptr,
+                                     uint16_t fieldNamesLength=0);
 
         // The symbolic file being operated on by the decoder. A string of
         // length 0 indicates that no valid file is currently opened.
         std::string filename;
 
-        // The handle for the log file currently being operated on
+        // The handle for the log file currently being operated on, or for
+        // the contents of the CompressedBlock being read (see blockContents)
         FILE *inputFd;
 
+        // The handle for the log file itself, which inputFd returns to at
+        // the end of a CompressedBlock
+        FILE *logFd;
+
+        // Decompressed contents of the CompressedBlock being read, if any
+        std::vector<char> blockContents;
+
+        // The CompressedBlock that follows the one being read in the log file
+        // (if any), which is decompressed in the meantime.
+        PendingBlock nextBlock;
+
+        // Metric: Number of CompressedBlock's read in the decompression
+        uint32_t numCompressedBlocksRead;
+
         // The number of log messages that has been outputted from the
         // current file
         uint64_t logMsgsPrinted;
@@ -973,6 +1807,17 @@ namespace Log {
         // built from FormatMetadata's.
         std::vector<std::string> fmtId2fmtString;
 
+        // Mapping of static string id to the strings logged via
+        // NanoLog::static_str(), built from the static string DictionaryFragments
+        std::vector<std::string> staticStrings;
+
+        // Timestamps of the first log messages of the last BufferExtent read
+        // for each runtime StagingBuffer since the last Checkpoint
+        std::unordered_map<uint32_t, uint64_t> firstTimestamps;
+
+        // Representation to output log messages in
+        OutputFormat outputFormat;
+
         // Contains the raw metadata to interpret log messages,
         // directly read from the log file
         char *rawMetadata;
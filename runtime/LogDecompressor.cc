@@ -15,6 +15,8 @@
 
 #include <algorithm>
 #include <fstream>
+#include <map>
+#include <string>
 #include <vector>
 
 #include <cstdarg>
@@ -112,6 +114,157 @@ void runRCDF(std::vector<uint64_t> timeDeltas, double cyclesPerSecond) {
            1e9*PerfUtils::Cycles::toSeconds(sum/timeDeltas.size(), cyclesPerSecond));
 }
 
+/**
+ * Pairs the begin and end events logged by NANO_LOG_SPAN() and prints the
+ * latency percentiles of each span name to stdout. Events are paired by
+ * the runtime thread that logged them and the span identifier.
+ *
+ * \param decoder
+ *      Decoder open()-ed on the log file to aggregate
+ */
+void runSpans(Decoder &decoder) {
+    using NanoLogInternal::SPAN_BEGIN_FIELD;
+    using NanoLogInternal::SPAN_END_FIELD;
+
+    // Timestamps of the spans that have begun but not ended, keyed by the
+    // runtime thread and span identifier.
+    std::map<std::pair<uint32_t, uint32_t>, uint64_t> openSpans;
+
+    // Latencies in nanoseconds of the completed spans, keyed by span name
+    std::map<std::string, std::vector<double>> latencies;
+    uint64_t unmatchedEvents = 0;
+
+    LogMessage args;
+    while (decoder.getNextLogStatement(args)) {
+        const char *name = args.getEventName();
+        const char *field = args.getFieldName(0);
+        if (name == nullptr || field == nullptr || args.getNumArgs() != 1)
+            continue;
+
+        std::pair<uint32_t, uint32_t> key(args.getRuntimeId(),
+                                          args.get<uint32_t>(0));
+        if (strcmp(field, SPAN_BEGIN_FIELD) == 0) {
+            auto inserted = openSpans.emplace(key, args.getTimestamp());
+            if (!inserted.second) {
+                inserted.first->second = args.getTimestamp();
+                ++unmatchedEvents;
+            }
+        } else if (strcmp(field, SPAN_END_FIELD) == 0) {
+            auto it = openSpans.find(key);
+            if (it == openSpans.end()) {
+                ++unmatchedEvents;
+                continue;
+            }
+
+            uint64_t cycles = args.getTimestamp() - it->second;
+            latencies[name].push_back(1.0e9*PerfUtils::Cycles::toSeconds(
+                                        cycles, decoder.getCyclesPerSecond()));
+            openSpans.erase(it);
+        }
+    }
+
+    printf("# Span latencies in nanoseconds\r\n");
+    printf("%-24s %10s %10s %10s %10s %10s %10s %10s %10s\r\n",
+           "name", "count", "min", "p50", "p90", "p99", "p99.9", "max",
+           "mean");
+
+    for (auto &span : latencies) {
+        std::vector<double> &times = span.second;
+        std::sort(times.begin(), times.end());
+
+        double sum = 0;
+        for (double time : times)
+            sum += time;
+
+        auto percentile = [&times](double p) {
+            size_t i = static_cast<size_t>(p*static_cast<double>(times.size()));
+            return times[std::min(i, times.size() - 1)];
+        };
+
+        printf("%-24s %10lu %10.0lf %10.0lf %10.0lf %10.0lf %10.0lf %10.0lf "
+               "%10.0lf\r\n",
+               span.first.c_str(), times.size(), times.front(),
+               percentile(0.50), percentile(0.90), percentile(0.99),
+               percentile(0.999), times.back(),
+               sum/static_cast<double>(times.size()));
+    }
+
+    if (!openSpans.empty() || unmatchedEvents > 0)
+        printf("\r\n# %lu spans never ended and %lu events were unmatched\r\n",
+               openSpans.size(), unmatchedEvents);
+}
+
+/**
+ * Reconstructs the time series of the metrics logged by NANO_METRIC_COUNTER()
+ * and NANO_METRIC_GAUGE() and prints them to stdout in CSV. Each row is a
+ * point in time at which a thread logged a metric; counters are output as
+ * the running total of all the threads' deltas and gauges as the value the
+ * thread logged.
+ *
+ * \param decoder
+ *      Decoder open()-ed on the log file to aggregate
+ */
+void runMetrics(Decoder &decoder) {
+    using NanoLogInternal::METRIC_COUNTER_FIELD;
+    using NanoLogInternal::METRIC_GAUGE_FIELD;
+
+    struct MetricPoint {
+        double time;
+        uint32_t thread;
+        bool isGauge;
+        int64_t count;
+        double gauge;
+    };
+
+    // Metric updates in the order they are logged, keyed by metric name
+    std::map<std::string, std::vector<MetricPoint>> metrics;
+
+    LogMessage args;
+    while (decoder.getNextLogStatement(args)) {
+        const char *name = args.getEventName();
+        const char *field = args.getFieldName(0);
+        if (name == nullptr || field == nullptr || args.getNumArgs() != 1)
+            continue;
+
+        MetricPoint point{decoder.getUnixTime(args.getTimestamp()),
+                          args.getRuntimeId(), false, 0, 0};
+        if (strcmp(field, METRIC_COUNTER_FIELD) == 0) {
+            point.count = args.get<int64_t>(0);
+        } else if (strcmp(field, METRIC_GAUGE_FIELD) == 0) {
+            point.isGauge = true;
+            point.gauge = args.get<double>(0);
+        } else {
+            continue;
+        }
+
+        metrics[name].push_back(point);
+    }
+
+    printf("timestamp,metric,type,thread,value\r\n");
+    for (auto &metric : metrics) {
+        // The log messages are not sorted across threads
+        std::vector<MetricPoint> &points = metric.second;
+        std::stable_sort(points.begin(), points.end(),
+                [](const MetricPoint &a, const MetricPoint &b) {
+                    return a.time < b.time;
+                });
+
+        int64_t total = 0;
+        for (MetricPoint &point : points) {
+            printf("%.9lf,%s,%s,%u,", point.time, metric.first.c_str(),
+                   (point.isGauge) ? METRIC_GAUGE_FIELD : METRIC_COUNTER_FIELD,
+                   point.thread);
+
+            if (point.isGauge) {
+                printf("%lg\r\n", point.gauge);
+            } else {
+                total += point.count;
+                printf("%ld\r\n", total);
+            }
+        }
+    }
+}
+
 /**
  * Prints the usage information to stdout.
  *
@@ -129,10 +282,24 @@ void printHelp(const char *exe) {
            "without sorting the messages by time:\r\n");
     printf("\t%s decompressUnordered <logFile>\r\n\r\n", exe);
 
+    printf("Decompress the log file into JSON (one object per log message)\r\n"
+           "or CSV (one row per field of the log messages). The fields of\r\n"
+           "structured messages (i.e. NANO_LOG_KV) are output individually:\r\n");
+    printf("\t%s decompressJson <logFile>\r\n", exe);
+    printf("\t%s decompressCsv <logFile>\r\n\r\n", exe);
+
     printf("Create an RCDF of the inter-log invocation times. Only works\r\n");
     printf("when there is one runtime logging thread:\r\n");
     printf("\t%s rcdfTime <logFile>\r\n\r\n", exe);
 
+    printf("Print the latency percentiles of the spans logged with\r\n");
+    printf("NANO_LOG_SPAN, grouped by span name:\r\n");
+    printf("\t%s spans <logFile>\r\n\r\n", exe);
+
+    printf("Print the time series of the NANO_METRIC_COUNTER and\r\n");
+    printf("NANO_METRIC_GAUGE metrics in CSV:\r\n");
+    printf("\t%s metrics <logFile>\r\n\r\n", exe);
+
 #ifdef PREPROCESSOR_NANOLOG
     printf("== Note ==\r\n");
     printf("The following 2 commands only work with logs produced by the\r\n");
@@ -165,7 +332,10 @@ int main(int argc, char** argv) {
     bool find = false;
     bool sorted = false;
     bool doRCDF = false;
+    bool doSpans = false;
+    bool doMetrics = false;
     FILE *outputFd = NULL;
+    Decoder::OutputFormat format = Decoder::TEXT;
     int filterId = -1;
 
     if (strcmp(command, "decompress") == 0) {
@@ -173,8 +343,20 @@ int main(int argc, char** argv) {
         sorted = true;
     } else if (strcmp(command, "decompressUnordered") == 0) {
         outputFd = stdout;
+    } else if (strcmp(command, "decompressJson") == 0) {
+        outputFd = stdout;
+        sorted = true;
+        format = Decoder::JSON;
+    } else if (strcmp(command, "decompressCsv") == 0) {
+        outputFd = stdout;
+        sorted = true;
+        format = Decoder::CSV;
     }  else if (strcmp(command, "rcdfTime") == 0) {
         doRCDF = true;
+    } else if (strcmp(command, "spans") == 0) {
+        doSpans = true;
+    } else if (strcmp(command, "metrics") == 0) {
+        doMetrics = true;
     } 
 #ifdef PREPROCESSOR_NANOLOG
     else if (strcmp(command, "minMaxMean") == 0) {
@@ -224,6 +406,16 @@ int main(int argc, char** argv) {
         return 0;
     }
 
+    if (doSpans) {
+        runSpans(decoder);
+        return 0;
+    }
+
+    if (doMetrics) {
+        runMetrics(decoder);
+        return 0;
+    }
+
     LogMessage args;
     if (doRCDF) {
         uint64_t start = PerfUtils::Cycles::rdtsc();
@@ -265,6 +457,15 @@ int main(int argc, char** argv) {
         return 0;
     }
 
+    if (sorted && format != Decoder::TEXT) {
+        decoder.setOutputFormat(format);
+        if (format == Decoder::CSV)
+            fprintf(outputFd, "%s\r\n", Decoder::CSV_HEADER);
+
+        decoder.decompressTo(outputFd);
+        return 0;
+    }
+
     if (sorted) {
         int64_t numLogMsgs = decoder.decompressTo(outputFd);
 
@@ -805,6 +805,23 @@ TEST_F(LogTest, swapBuffer) {
     EXPECT_EQ(nullptr, encoder.currentExtentSize);
 }
 
+TEST_F(LogTest, restart) {
+    char buffer1[1000], buffer2[1000];
+    Encoder encoder(buffer1, 1000, true);
+    encoder.staticStrings.intern("static");
+    EXPECT_EQ(0U, encoder.getEncodedBytes());
+    EXPECT_EQ(1000U, encoder.getFreeBytes());
+
+    encoder.restart(buffer2, 1000);
+    EXPECT_EQ(buffer2, encoder.backing_buffer);
+    EXPECT_EQ(0U, encoder.staticStrings.size());
+    EXPECT_LE(sizeof(Checkpoint), encoder.getEncodedBytes());
+    EXPECT_EQ(1000U, encoder.getEncodedBytes() + encoder.getFreeBytes());
+
+    Checkpoint *ck = reinterpret_cast<Checkpoint*>(buffer2);
+    EXPECT_EQ(EntryType::CHECKPOINT, ck->entryType);
+}
+
 TEST_F(LogTest, Decoder_open) {
     char buffer[1000];
     const char *testFile = "/tmp/testFile";
@@ -2328,6 +2345,168 @@ TEST_F(LogTest, Decoder_getNextLogStatement) {
     std::remove(decomp);
 }
 
+TEST_F(LogTest, Decoder_timestampChaining) {
+    const char *testFile = "/tmp/testFile";
+    char inputBuffer[100], buffer1[1000], buffer2[1000];
+    Encoder encoder(buffer1, 1000, false, true);
+
+    // Encodes a log message into its own extent and returns the extent's size
+    auto encode = [&](uint32_t bufferId, uint64_t timestamp) {
+        UncompressedEntry *ue = reinterpret_cast<UncompressedEntry*>(
+                                                                inputBuffer);
+        ue->timestamp = timestamp;
+        ue->fmtId = integerParamId;
+        ue->entrySize = sizeof(UncompressedEntry) + sizeof(int);
+        *((int*)(ue->argData)) = 1;
+
+        size_t encodedBytes = encoder.getEncodedBytes();
+        EXPECT_EQ(ue->entrySize, encoder.encodeLogMsgs(inputBuffer,
+                                        ue->entrySize, bufferId, false,
+                                        nullptr));
+        return encoder.getEncodedBytes() - encodedBytes;
+    };
+
+    // The first log message of a StagingBuffer is encoded in full, the first
+    // of its later extents relative to the first of its previous one.
+    uint64_t base = 1UL << 40;
+    size_t fullSize = encode(1, base);
+    EXPECT_EQ(fullSize, encode(2, base + 5));
+    EXPECT_EQ(fullSize - 5, encode(1, base + 100));
+    EXPECT_EQ(fullSize - 5, encode(2, base + 105));
+    EXPECT_EQ(2U, encoder.firstTimestamps.size());
+    EXPECT_EQ(base + 100, encoder.firstTimestamps[1]);
+    size_t buffer1Bytes = encoder.getEncodedBytes();
+
+    // Checkpoints reset the chain
+    encoder.restart(buffer2, 1000);
+    EXPECT_TRUE(encoder.firstTimestamps.empty());
+    EXPECT_EQ(fullSize, encode(1, base + 200));
+
+    std::ofstream oFile;
+    oFile.open(testFile);
+    oFile.write(buffer1, buffer1Bytes);
+    oFile.write(buffer2, encoder.getEncodedBytes());
+    oFile.close();
+
+    LogMessage logMsg;
+    Decoder dc;
+    ASSERT_TRUE(dc.open(testFile));
+    for (uint64_t offset : {0, 5, 100, 105, 200}) {
+        ASSERT_TRUE(dc.getNextLogStatement(logMsg));
+        EXPECT_EQ(base + offset, logMsg.getTimestamp());
+        EXPECT_EQ(1, logMsg.get<int>(0));
+    }
+    EXPECT_FALSE(dc.getNextLogStatement(logMsg));
+    EXPECT_EQ(2, dc.numCheckpointsRead);
+
+    // Coarse timestamps drop the least significant bits of the timestamps
+    // and scale the checkpoint to match.
+    uint32_t shift = NanoLogConfig::COARSE_TIMESTAMP_SHIFT;
+    Encoder coarseEncoder(buffer1, 1000, false, true, shift);
+    Checkpoint *ck = reinterpret_cast<Checkpoint*>(buffer1);
+    EXPECT_NEAR(PerfUtils::Cycles::getCyclesPerSec(),
+                ck->cyclesPerSecond * double(1 << shift), 1.0);
+    EXPECT_GT(PerfUtils::Cycles::rdtsc() >> (shift - 1), ck->rdtsc);
+
+    UncompressedEntry *ue = reinterpret_cast<UncompressedEntry*>(inputBuffer);
+    ue->timestamp = base + 1000;
+    ue->fmtId = integerParamId;
+    ue->entrySize = sizeof(UncompressedEntry) + sizeof(int);
+    *((int*)(ue->argData)) = 2;
+    EXPECT_EQ(ue->entrySize, coarseEncoder.encodeLogMsgs(inputBuffer,
+                                    ue->entrySize, 1, false, nullptr));
+
+    oFile.open(testFile);
+    oFile.write(buffer1, coarseEncoder.getEncodedBytes());
+    oFile.close();
+
+    ASSERT_TRUE(dc.open(testFile));
+    ASSERT_TRUE(dc.getNextLogStatement(logMsg));
+    EXPECT_EQ((base + 1000) >> shift, logMsg.getTimestamp());
+    EXPECT_EQ(2, logMsg.get<int>(0));
+
+    std::remove(testFile);
+}
+
+TEST_F(LogTest, Decoder_compressedBlocks) {
+    const char *testFile = "/tmp/testFile";
+    char inputBuffer[100];
+    char buffer1[10000], buffer2[10000];
+    char blockBuffer[20000];
+    Encoder encoder(buffer1, 10000, false, true);
+
+    // Encodes numMsgs log messages and returns the encoder's output buffer
+    int nextValue = 0;
+    auto encode = [&](int numMsgs, char **out, size_t *outLength) {
+        for (int i = 0; i < numMsgs; ++i) {
+            UncompressedEntry *ue = reinterpret_cast<UncompressedEntry*>(
+                                                                inputBuffer);
+            ue->timestamp = 1000 + nextValue;
+            ue->fmtId = integerParamId;
+            ue->entrySize = sizeof(UncompressedEntry) + sizeof(int);
+            *((int*)(ue->argData)) = nextValue++;
+            EXPECT_EQ(ue->entrySize, encoder.encodeLogMsgs(inputBuffer,
+                                            ue->entrySize, 1, false, nullptr));
+        }
+
+        char *next = (*out == buffer1) ? buffer2 : buffer1;
+        encoder.swapBuffer(next, 10000, out, outLength);
+    };
+
+    // The file interleaves CompressedBlocks with raw output (i.e. from a
+    // crash drain) and \0 padding, and ends with consecutive blocks that
+    // the Decoder decompresses ahead of time.
+    std::ofstream oFile;
+    oFile.open(testFile);
+
+    char *out = nullptr;
+    size_t outLength, blockLength;
+    encode(100, &out, &outLength);
+    blockLength = compressBlock(out, outLength, blockBuffer, BlockCodec::LZ);
+    EXPECT_GT(outLength, blockLength);
+    EXPECT_GE(maxCompressedBlockSize(outLength), blockLength);
+    oFile.write(blockBuffer, blockLength);
+    oFile.write("\0\0\0", 3);
+
+    encode(10, &out, &outLength);
+    oFile.write(out, outLength);
+
+    for (BlockCodec::Codec codec : {BlockCodec::LZ, BlockCodec::STORED,
+                                    BlockCodec::LZ}) {
+        encode(50, &out, &outLength);
+        blockLength = compressBlock(out, outLength, blockBuffer, codec);
+        CompressedBlock *block = reinterpret_cast<CompressedBlock*>(
+                                                                blockBuffer);
+        EXPECT_EQ(codec, block->codec);
+        oFile.write(blockBuffer, blockLength);
+    }
+    oFile.close();
+
+    LogMessage logMsg;
+    Decoder dc;
+    ASSERT_TRUE(dc.open(testFile));
+    for (int i = 0; i < nextValue; ++i) {
+        ASSERT_TRUE(dc.getNextLogStatement(logMsg));
+        EXPECT_EQ(i, logMsg.get<int>(0));
+        EXPECT_EQ(1000U + i, logMsg.getTimestamp());
+    }
+    EXPECT_FALSE(dc.getNextLogStatement(logMsg));
+    EXPECT_EQ(4U, dc.numCompressedBlocksRead);
+
+    // Corrupt blocks stop the decoding
+    oFile.open(testFile);
+    encoder.restart(buffer1, 10000);
+    encode(100, &out, &outLength);
+    blockLength = compressBlock(out, outLength, blockBuffer, BlockCodec::LZ);
+    reinterpret_cast<CompressedBlock*>(blockBuffer)->uncompressedLength += 1;
+    oFile.write(blockBuffer, blockLength);
+    oFile.close();
+
+    EXPECT_FALSE(dc.open(testFile));
+
+    std::remove(testFile);
+}
+
 // Static helper functions to test when aggregation is run.
 static int numInvocations = 0;
 
@@ -2565,13 +2744,15 @@ static int compressHelper0TimesRun = 0;
 static int compressHelper1TimesRun = 0;
 
 static void
-compressHelper0(int numNibbles, const ParamType*, char **in, char**out)
+compressHelper0(int numNibbles, const ParamType*, char **in, char**out,
+                StaticStringTable*, DeltaBases*, InternedStrings*)
 {
     ++compressHelper0TimesRun;
 }
 
 static void
-compressHelper1(int numNibbles, const ParamType*, char **in, char**out)
+compressHelper1(int numNibbles, const ParamType*, char **in, char**out,
+                StaticStringTable*, DeltaBases*, InternedStrings*)
 {
     ++compressHelper1TimesRun;
 }
@@ -2774,6 +2955,97 @@ TEST_F(LogTest, createMicroCode) {
     EXPECT_TRUE(pf->hasDynamicPrecision);
 }
 
+TEST_F(LogTest, createMicroCode_blobs) {
+    using namespace NanoLogInternal::Log;
+    char backing_buffer[1024];
+    char *microCode = backing_buffer;
+
+    EXPECT_TRUE(Decoder::createMicroCode(&microCode, "pkt %#-8.16B %.*B end",
+                                         "file", 4, 0));
+
+    microCode = backing_buffer;
+    FormatMetadata *fm = push<FormatMetadata>(microCode);
+    microCode += fm->filenameLength;
+
+    // Only the dynamic precision needs a nibble
+    EXPECT_EQ(1, fm->numNibbles);
+    EXPECT_EQ(2, fm->numPrintFragments);
+
+    PrintFragment *pf = push<PrintFragment>(microCode);
+    microCode += pf->fragmentLength;
+    EXPECT_EQ(FormatType::blob_t, pf->argType);
+    EXPECT_STREQ("pkt %-8s", pf->formatFragment);
+    EXPECT_EQ(strlen("pkt %-8s") + 1, pf->fragmentLength);
+
+    pf = push<PrintFragment>(microCode);
+    EXPECT_EQ(FormatType::blob_t, pf->argType);
+    EXPECT_STREQ(" %s end", pf->formatFragment);
+    EXPECT_EQ(strlen(" %s end") + 1, pf->fragmentLength);
+    EXPECT_TRUE(pf->hasDynamicPrecision);
+}
+
+TEST_F(LogTest, createMicroCode_fieldNames) {
+    using namespace NanoLogInternal::Log;
+    char backing_buffer[1024];
+    char *microCode = backing_buffer;
+    const char fieldNames[] = "fill\0id\0point";
+    const char argEncodings[] = {DEFAULT_ENCODING, CODEC, 'P', 't', '\0'};
+
+    EXPECT_TRUE(Decoder::createMicroCode(&microCode, "%d%s", "file", 4, 0,
+                                         argEncodings, sizeof(argEncodings),
+                                         fieldNames, sizeof(fieldNames)));
+
+    microCode = backing_buffer;
+    FormatMetadata *fm = push<FormatMetadata>(microCode);
+    microCode += fm->filenameLength;
+    EXPECT_EQ(1, fm->numNibbles);
+    EXPECT_EQ(3, fm->numPrintFragments);
+
+    // The event name comes first in a fragment without an argument
+    PrintFragment *pf = push<PrintFragment>(microCode);
+    microCode += pf->fragmentLength;
+    EXPECT_EQ(FormatType::NONE, pf->argType);
+    EXPECT_TRUE(pf->hasFieldName);
+    EXPECT_STREQ("fill", pf->formatFragment);
+    EXPECT_STREQ("", pf->formatFragment + sizeof("fill"));
+    EXPECT_EQ(sizeof("fill") + 1, pf->fragmentLength);
+
+    pf = push<PrintFragment>(microCode);
+    microCode += pf->fragmentLength;
+    EXPECT_EQ(FormatType::int_t, pf->argType);
+    EXPECT_TRUE(pf->hasFieldName);
+    EXPECT_STREQ("id", pf->formatFragment);
+    EXPECT_STREQ("%d", pf->formatFragment + sizeof("id"));
+    EXPECT_EQ(sizeof("id") + sizeof("%d"), pf->fragmentLength);
+
+    // Field names precede codec names
+    pf = push<PrintFragment>(microCode);
+    EXPECT_EQ(FormatType::codec_t, pf->argType);
+    EXPECT_TRUE(pf->hasFieldName);
+    EXPECT_STREQ("point", pf->formatFragment);
+    EXPECT_STREQ("Pt", pf->formatFragment + sizeof("point"));
+    EXPECT_STREQ("%s", pf->formatFragment + sizeof("point") + sizeof("Pt"));
+
+    // Truncated field names are rejected
+    microCode = backing_buffer;
+    EXPECT_FALSE(Decoder::createMicroCode(&microCode, "%d", "file", 4, 0,
+                                          nullptr, 0, "fill\0id", 7));
+}
+
+TEST_F(LogTest, formatBlob) {
+    using namespace NanoLogInternal::Log;
+    const char data[] = "\x00\x01\xabMan";
+
+    EXPECT_STREQ("", formatBlob(data, 0, false).c_str());
+    EXPECT_STREQ("0001ab4d616e", formatBlob(data, 6, false).c_str());
+
+    EXPECT_STREQ("", formatBlob(data + 3, 0, true).c_str());
+    EXPECT_STREQ("TQ==", formatBlob(data + 3, 1, true).c_str());
+    EXPECT_STREQ("TWE=", formatBlob(data + 3, 2, true).c_str());
+    EXPECT_STREQ("TWFu", formatBlob(data + 3, 3, true).c_str());
+    EXPECT_STREQ("AAGrTWFu", formatBlob(data, 6, true).c_str());
+}
+
 TEST_F(LogTest, createMicroCode_specifiersWithoutSpaces) {
     using namespace NanoLogInternal::Log;
     FormatMetadata *fm;
@@ -2838,6 +3110,7 @@ TEST_F(LogTest, readDictionaryFragment) {
 
     DictionaryFragment *df = push<DictionaryFragment>(writePos);
     df->entryType = EntryType::LOG_MSGS_OR_DIC;
+    df->isStaticStringTable = false;
     df->totalMetadataEntries = 0;
     df->newMetadataBytes = 0;
 
@@ -2876,6 +3149,8 @@ TEST_F(LogTest, readDictionaryFragment) {
     cli->linenum = 124;
     cli->filenameLength = strlen(filename) + 1;
     cli->formatStringLength = strlen(formatString) + 1;
+    cli->argEncodingsLength = 0;
+    cli->fieldNamesLength = 0;
 
     memcpy(writePos, filename, cli->filenameLength);
     writePos += cli->filenameLength;
@@ -2890,6 +3165,8 @@ TEST_F(LogTest, readDictionaryFragment) {
     cli->linenum = 124;
     cli->filenameLength = strlen(filename2) + 1;
     cli->formatStringLength = strlen(formatString2) + 1;
+    cli->argEncodingsLength = 0;
+    cli->fieldNamesLength = 0;
 
     memcpy(writePos, filename2, cli->filenameLength);
     writePos += cli->filenameLength;
@@ -3075,4 +3352,61 @@ TEST_F(LogTest, LogMessage_reset) {
     EXPECT_EQ(nullptr, la.rawArgsExtension);
 
 }
+
+TEST_F(LogTest, InternedStrings) {
+    InternedStrings encoder, decoder;
+    encoder.select(3);
+    decoder.select(3);
+
+    // First occurrences are encoded in full, repeats by index
+    EXPECT_EQ(0U, encoder.intern(1, "alpha", 5));
+    decoder.add(1, "alpha", 5);
+    EXPECT_EQ(0U, encoder.intern(1, "beta", 4));
+    decoder.add(1, "beta", 4);
+    EXPECT_EQ(1U, encoder.intern(1, "alphabet", 5));
+    EXPECT_EQ(2U, encoder.intern(1, "beta", 4));
+    EXPECT_STREQ("alpha", decoder.get(1, 1));
+    EXPECT_STREQ("beta", decoder.get(1, 2));
+    EXPECT_EQ(nullptr, decoder.get(1, 3));
+    EXPECT_EQ(nullptr, decoder.get(1, 0));
+
+    // Strings are scoped by argument and log invocation site
+    EXPECT_EQ(0U, encoder.intern(0, "beta", 4));
+    encoder.select(4);
+    EXPECT_EQ(0U, encoder.intern(1, "alpha", 5));
+    encoder.select(3);
+    EXPECT_EQ(1U, encoder.intern(1, "alpha", 5));
+
+    // Empty and overly long strings are never interned
+    std::string longString(NanoLogConfig::MAX_INTERNED_STRING_LENGTH + 1, 'x');
+    EXPECT_EQ(0U, encoder.intern(2, "", 0));
+    EXPECT_EQ(0U, encoder.intern(2, "", 0));
+    EXPECT_EQ(0U, encoder.intern(2, longString.c_str(), longString.size()));
+    EXPECT_EQ(0U, encoder.intern(2, longString.c_str(), longString.size()));
+
+    // Once full, no more strings are interned...
+    char buffer[16];
+    for (uint32_t i = 0; i <= NanoLogConfig::MAX_INTERNED_STRINGS; ++i) {
+        int length = snprintf(buffer, sizeof(buffer), "s%u", i);
+        EXPECT_EQ(0U, encoder.intern(2, buffer, length));
+        EXPECT_EQ(0U, encoder.intern(3, buffer, length));
+        EXPECT_EQ(1U, encoder.intern(3, "s0", 2));
+        EXPECT_EQ(1U, encoder.intern(3, "s0", 2));
+        decoder.add(2, buffer, length);
+    }
+    EXPECT_EQ(0U, encoder.intern(2, "s255", 4));
+    EXPECT_EQ(0U, encoder.intern(3, "s255", 4));
+    EXPECT_STREQ("s254", decoder.get(2, 255));
+    EXPECT_EQ(nullptr, decoder.get(2, 256));
+
+    // ... and lookups stop unless they have been fruitful
+    EXPECT_EQ(0U, encoder.intern(2, "s0", 2));
+    EXPECT_EQ(1U, encoder.intern(3, "s0", 2));
+
+    // clear() forgets everything
+    encoder.clear();
+    decoder.clear();
+    EXPECT_EQ(0U, encoder.intern(1, "alpha", 5));
+    EXPECT_EQ(nullptr, decoder.get(1, 1));
+}
 }; //namespace
\ No newline at end of file
@@ -11,6 +11,10 @@ namespace NanoLog {
         return RuntimeLogger::getStats();
     }
 
+    std::string getStats(Logger *logger) {
+        return logger->getStats_internal();
+    }
+
     void printConfig() {
         printf("==== NanoLog Configuration ====\r\n");
 
@@ -20,6 +24,9 @@ namespace NanoLog {
                NanoLogConfig::OUTPUT_BUFFER_SIZE / 1000000);
         printf("Release Threshold : %u MB\r\n",
                NanoLogConfig::RELEASE_THRESHOLD / 1000000);
+        printf("Publish Threshold : %u logs or %u B\r\n",
+               NanoLogConfig::PUBLISH_THRESHOLD_RECORDS,
+               NanoLogConfig::PUBLISH_THRESHOLD_BYTES);
         printf("Idle Poll Interval: %u µs\r\n",
                NanoLogConfig::POLL_INTERVAL_NO_WORK_US);
         printf("IO Poll Interval  : %u µs\r\n",
@@ -42,10 +49,59 @@ namespace NanoLog {
         RuntimeLogger::setLogLevel(logLevel);
     }
 
+    void setBacktraceLogLevel(LogLevel logLevel) {
+        RuntimeLogger::setBacktraceLogLevel(logLevel);
+    }
+
+    void setPriorityLogLevel(LogLevel logLevel) {
+        RuntimeLogger::setPriorityLogLevel(logLevel);
+    }
+
+    void setBlockCompression(BlockCompression compression) {
+        RuntimeLogger::setBlockCompression(compression);
+    }
+
+    void triggerBacktrace() {
+        RuntimeLogger::triggerBacktrace();
+    }
+
+    void setFlightRecorder(uint64_t bytes) {
+        RuntimeLogger::setFlightRecorder(bytes);
+    }
+
+    void dumpFlightRecorder(const char *path) {
+        RuntimeLogger::dumpFlightRecorder(path);
+    }
+
+    void setCrashHandler(bool enabled) {
+        RuntimeLogger::setCrashHandler(enabled);
+    }
+
+    int startAgent() {
+        return RuntimeLogger::startAgent();
+    }
+
+    void setPerProcessLogFiles(bool enabled) {
+        RuntimeLogger::setPerProcessLogFiles(enabled);
+    }
+
     void sync() {
         RuntimeLogger::sync();
     }
 
+    void sync(Logger *logger) {
+        logger->sync_internal();
+    }
+
+    Logger *createLogger(const char *name, const char *filename,
+                         const LoggerOptions &options) {
+        return RuntimeLogger::createLogger(name, filename, options);
+    }
+
+    Logger *getLogger(const char *name) {
+        return RuntimeLogger::getLogger(name);
+    }
+
     int getCoreIdOfBackgroundThread() {
         return RuntimeLogger::getCoreIdOfBackgroundThread();
     }
@@ -18,6 +18,10 @@
 
 #include <string>
 
+namespace NanoLogInternal {
+class RuntimeLogger;
+};
+
 /**
  * This header serves as the application and generated code interface into
  * the NanoLog Runtime system. This should be included where-ever the NANO_LOG
@@ -60,6 +64,65 @@ namespace LogLevels {
 };
 using namespace LogLevels;
 
+/**
+ * An independent instance of the NanoLog runtime with its own log file,
+ * StagingBuffers and compression thread (see createLogger()).
+ */
+typedef NanoLogInternal::RuntimeLogger Logger;
+
+/**
+ * What a Logger does with a log message when the logging thread's
+ * StagingBuffer for the Logger is full.
+ */
+enum OverflowPolicy {
+    // Wait for the compression thread to free up space (as NANO_LOG() does)
+    BLOCK_ON_OVERFLOW,
+    // Drop the log message, which is counted in getStats()
+    DROP_ON_OVERFLOW
+};
+
+/**
+ * Second compression stage that a Logger can apply to its compressed log
+ * (see setBlockCompression()).
+ */
+enum BlockCompression {
+    // The compressed log is written as is
+    NO_BLOCK_COMPRESSION,
+    // Each output buffer is compressed with the bundled LZ codec
+    LZ_BLOCK_COMPRESSION
+};
+
+/**
+ * Configuration of a Logger created by createLogger().
+ */
+struct LoggerOptions {
+    LoggerOptions()
+        : logLevel(NOTICE)
+        , durable(false)
+        , overflowPolicy(BLOCK_ON_OVERFLOW)
+        , coarseTimestamps(false)
+        , blockCompression(NO_BLOCK_COMPRESSION)
+    {}
+
+    // Least severe log messages the Logger records
+    LogLevel logLevel;
+
+    // Whether the log file is opened with O_DSYNC, so that log messages are
+    // on stable storage once they're written (i.e. when sync() returns).
+    bool durable;
+
+    // What to do with log messages when a StagingBuffer is full
+    OverflowPolicy overflowPolicy;
+
+    // Whether log messages are timestamped with a coarser resolution of
+    // 2^NanoLogConfig::COARSE_TIMESTAMP_SHIFT cycles, which makes the log
+    // file smaller. Decoded times remain in seconds, but only that precise.
+    bool coarseTimestamps;
+
+    // Second compression stage applied to the Logger's compressed log
+    BlockCompression blockCompression;
+};
+
 // User API
 
 /**
@@ -96,6 +159,155 @@ void setLogLevel(LogLevel logLevel);
  */
 LogLevel getLogLevel();
 
+/**
+ * Retains the log messages that are less severe than the log level but at
+ * least as severe as the given level (i.e. DEBUG) in a per-thread in-memory
+ * ring instead of dropping them. They are only output when an ERROR is
+ * logged on the same thread or triggerBacktrace() is invoked, in which case
+ * the messages logged in the preceding NanoLogConfig::BACKTRACE_WINDOW_MS
+ * are output. The default, SILENT_LOG_LEVEL, disables the rings.
+ *
+ * \param logLevel
+ *      Least severe log level to retain
+ */
+void setBacktraceLogLevel(LogLevel logLevel);
+
+/**
+ * Expedites the log messages at least as severe as the given level (i.e.
+ * ERROR) through a small per-thread ring that the compression thread drains
+ * ahead of the StagingBuffers, and writes the output holding them without
+ * waiting for the rest of the backlog to be compressed. The decompressor
+ * still outputs the log messages in chronological order. The default,
+ * SILENT_LOG_LEVEL, disables the rings.
+ *
+ * \param logLevel
+ *      Least severe log level to expedite
+ */
+void setPriorityLogLevel(LogLevel logLevel);
+
+/**
+ * Compresses the output of the default Logger a second time before it's
+ * written, which mostly pays off for logs heavy in strings. Each output
+ * buffer is compressed on a helper thread, so the compression thread keeps
+ * encoding log messages in the meantime, and is framed in the log file so
+ * that the decompressor can decompress the blocks independently. The
+ * trade-off between the ratio achieved and the CPU time spent is reported
+ * by getStats(). The default is NO_BLOCK_COMPRESSION.
+ *
+ * \param compression
+ *      Compression to apply to the output written from now on
+ */
+void setBlockCompression(BlockCompression compression);
+
+/**
+ * Outputs the recently retained log messages of all threads (see
+ * setBacktraceLogLevel()) as if each had logged an ERROR.
+ */
+void triggerBacktrace();
+
+/**
+ * Enables the flight recorder, which keeps the most recent compressed log
+ * in a circular memory region instead of outputting it to the log file. The
+ * region is divided into NanoLogConfig::FLIGHT_RECORDER_SEGMENT_SIZE segments
+ * and the oldest segment is overwritten once the region is full. The log
+ * messages pending in the previous mode are output first.
+ *
+ * The flight recorder is persisted with dumpFlightRecorder() or by sending
+ * the process NanoLogConfig::FLIGHT_RECORDER_DUMP_SIGNAL.
+ *
+ * \param bytes
+ *      Size of the memory region (at least two segments are allocated), or
+ *      0 to disable the flight recorder and output to the log file again
+ */
+void setFlightRecorder(uint64_t bytes);
+
+/**
+ * Writes the contents of the flight recorder (see setFlightRecorder()),
+ * including the log messages logged before this invocation, to a file that
+ * can be read by the decompressor. Blocks until the file is written.
+ *
+ * An exception will be thrown if the file cannot be opened/created
+ *
+ * \param path
+ *      Where to place the dump; existing files are overwritten
+ */
+void dumpFlightRecorder(const char *path);
+
+/**
+ * Installs (or removes) handlers for the fatal signals SIGSEGV, SIGBUS,
+ * SIGFPE, SIGILL and SIGABRT that output the log messages still staged in
+ * memory before the process dies, since they are usually the most relevant
+ * to the crash. The handler stops recording new log messages, compresses the
+ * staged ones and writes them synchronously to the log file (or dumps the
+ * flight recorder), then re-raises the signal. It gives up after
+ * NanoLogConfig::CRASH_DRAIN_TIMEOUT_S.
+ *
+ * The handlers replace any previously installed for these signals.
+ *
+ * \param enabled
+ *      true to install the handlers and false to restore the default actions
+ */
+void setCrashHandler(bool enabled);
+
+/**
+ * Moves the compression of log messages out of the application into a
+ * forked agent process. Log messages are staged in memory shared with the
+ * agent, so that the log messages staged when the application dies (even
+ * from SIGKILL) are still compressed and output by the agent, which exits
+ * once it has done so. The agent keeps the current log file, so this should
+ * be invoked after setLogFile() and before other threads start logging.
+ * Backtraces (see setBacktraceLogLevel()) are unavailable in this mode.
+ *
+ * \return
+ *      Process id of the agent
+ */
+int startAgent();
+
+/**
+ * NanoLog handles fork() (via pthread_atfork()): the log messages staged
+ * before the fork are output by the parent, and the child starts with a
+ * compression thread and StagingBuffers of its own. By default the child
+ * appends to the parent's log file, where the compressed logs of the two
+ * processes interleave. This makes the child output to a log file of its
+ * own instead, named after the current log file and its process id (i.e.
+ * "/tmp/logFile.1234").
+ *
+ * \param enabled
+ *      true to give each forked child process its own log file
+ */
+void setPerProcessLogFiles(bool enabled);
+
+/**
+ * Creates a Logger that is independent of the default one that NANO_LOG()
+ * logs to; log messages are sent to it with NANO_LOG_TO(). Each Logger
+ * outputs a complete compressed log of its own, which can be decompressed
+ * on its own. Loggers live until the process exits.
+ *
+ * An exception will be thrown if the log file cannot be opened/created.
+ *
+ * \param name
+ *      Name to look the Logger up by with getLogger()
+ * \param filename
+ *      Log file of the Logger
+ * \param options
+ *      Configuration of the Logger
+ *
+ * \return
+ *      The new Logger, or nullptr if the name is already used or there are
+ *      NanoLogConfig::MAX_LOGGERS already.
+ */
+Logger *createLogger(const char *name, const char *filename,
+                     const LoggerOptions &options = LoggerOptions());
+
+/**
+ * Returns the Logger created by createLogger() with a name, or nullptr if
+ * there's none.
+ *
+ * \param name
+ *      Name of the Logger
+ */
+Logger *getLogger(const char *name);
+
 /**
  * Waits until all pending log statements are persisted to disk. Note that if
  * there is another logging thread continually adding new pending log
@@ -104,6 +316,14 @@ LogLevel getLogLevel();
  */
 void sync();
 
+/**
+ * Variant of sync() for a Logger created by createLogger().
+ *
+ * \param logger
+ *      Logger to sync
+ */
+void sync(Logger *logger);
+
 // Debugging API
 
 /**
@@ -114,6 +334,14 @@ void sync();
  */
 std::string getStats();
 
+/**
+ * Variant of getStats() for a Logger created by createLogger().
+ *
+ * \param logger
+ *      Logger to return the statistics of
+ */
+std::string getStats(Logger *logger);
+
 /**
  * Prints the configuration parameters being used by NanoLog to stdout. This is
  * primarily used to keep track of configurations for benchmarking.
@@ -125,6 +353,65 @@ void printConfig();
  */
 int getCoreIdOfBackgroundThread();
 
+// Argument API
+
+/**
+ * Describes a binary blob to be logged with a NANO_LOG %B specifier (see
+ * bytes() and bytesAsBase64() below).
+ */
+struct Bytes {
+    // Start of the blob
+    const void *data;
+
+    // Number of bytes in the blob
+    size_t length;
+
+    // Whether the blob is rendered in base64 (vs. hex) when decompressed
+    bool base64;
+};
+
+/**
+ * Logs a binary blob via a %B specifier, which is copied into the log as-is
+ * and rendered in hex by the decompressor. A precision (i.e. %.64B or %.*B)
+ * limits the number of bytes logged.
+ * Ex: NANO_LOG(DEBUG, "Packet header: %.20B", NanoLog::bytes(pkt, len));
+ *
+ * \param data
+ *      Start of the blob
+ * \param length
+ *      Number of bytes in the blob
+ */
+inline Bytes
+bytes(const void *data, size_t length)
+{
+    return Bytes{data, length, false};
+}
+
+/**
+ * Same as bytes(), except the blob is rendered in base64.
+ */
+inline Bytes
+bytesAsBase64(const void *data, size_t length)
+{
+    return Bytes{data, length, true};
+}
+
+// Decompressor API
+
+/**
+ * Renders the bytes produced by a NanoLog::Codec<T>::compress() function
+ * as a human-readable string during decompression.
+ */
+typedef std::string (*CodecFormatter)(const char *data, size_t length);
+
+/**
+ * Registers the CodecFormatter used to render arguments serialized by the
+ * NanoLog::Codec of the given name. This must be invoked in the program that
+ * decompresses the log (i.e. a decompressor built from LogDecompressor.cc
+ * with the user's formatters linked in).
+ */
+bool registerCodecFormatter(const char *name, CodecFormatter formatter);
+
 }; // namespace NanoLog
 
 
@@ -19,9 +19,22 @@
 #include <cstring>
 
 #include <algorithm>
+#include <array>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "Common.h"
 #include "Cycles.h"
 #include "Packer.h"
@@ -41,8 +54,180 @@
  *          and produce a more compact encoding that's compatible with the
  *          NanoLog decompressor.
  */
+namespace NanoLog {
+
+/**
+ * Wraps a string with a static lifetime (i.e. a string literal or a string
+ * that is never freed/modified) so that NANO_LOG records only its pointer
+ * instead of copying its contents. The compression thread assigns each unique
+ * pointer a small id on first sight and persists the string only once per
+ * log file; subsequent log messages reference the string by id.
+ *
+ * Use this via static_str() below.
+ */
+struct StaticString {
+    const char *str;
+};
+
+/**
+ * Marks a string as having a static lifetime for a NANO_LOG %s argument.
+ * Ex: NANO_LOG(NOTICE, "State is %s", NanoLog::static_str(stateNames[i]));
+ *
+ * \param str
+ *      NULL-terminated string that will remain valid and unchanged for the
+ *      lifetime of the NanoLog runtime
+ */
+constexpr StaticString
+static_str(const char *str) {
+    return StaticString{str};
+}
+
+/**
+ * Wraps an integer so that NANO_LOG records it as the difference from the
+ * value it had in the previous log message of the same invocation site and
+ * thread. Monotonic values (i.e. sequence numbers, counters, offsets) then
+ * compress to a byte or two regardless of their magnitude.
+ *
+ * Use this via delta() below.
+ */
+template<typename T>
+struct Delta {
+    static_assert(std::is_integral<T>::value,
+                  "NanoLog::delta() only supports integers");
+
+    typedef T Type;
+    T value;
+};
+
+/**
+ * Marks an integer NANO_LOG argument as delta encoded (see Delta).
+ * Ex: NANO_LOG(NOTICE, "Sent packet %lu", NanoLog::delta(sequenceNumber));
+ *
+ * \param value
+ *      Integer to log
+ */
+template<typename T>
+constexpr Delta<T>
+delta(T value) {
+    return Delta<T>{value};
+}
+
+/**
+ * Customization point for logging user-defined types as NANO_LOG %s
+ * arguments. Instead of formatting the value in the logging thread, a binary
+ * image of the value is recorded and only rendered by the decompressor.
+ *
+ * To log a type T, specialize this template with the following members:
+ *
+ *  static constexpr const char *name;
+ *      Unique name of the codec; the decompressor uses it to find the
+ *      formatter registered with NanoLog::registerCodecFormatter()
+ *  static constexpr uint32_t maxSize;
+ *      Upper bound on the number of bytes store() outputs
+ *  static uint32_t size(const T &value);
+ *      Exact number of bytes store() will output for value
+ *  static void store(const T &value, char *out);
+ *      Serializes value into out; this runs in the logging thread
+ *  static uint32_t compress(const char *in, uint32_t length, char *out);
+ *      Re-encodes the length bytes output by store() into at most length
+ *      bytes and returns the number of bytes written to out; this runs in
+ *      the background compression thread
+ *
+ * Types without a specialization are logged as usual.
+ */
+template<typename T>
+struct Codec {};
+
+/**
+ * Base for Codecs of trivially copyable types that simply records the bytes
+ * of the value. Ex:
+ *
+ * template<> struct NanoLog::Codec<Point> : NanoLog::RawCodec<Point> {
+ *     static constexpr const char *name = "Point";
+ * };
+ */
+template<typename T>
+struct RawCodec {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "RawCodec requires a trivially copyable type");
+
+    static constexpr uint32_t maxSize = sizeof(T);
+
+    static uint32_t
+    size(const T&) {
+        return sizeof(T);
+    }
+
+    static void
+    store(const T &value, char *out) {
+        std::memcpy(out, &value, sizeof(T));
+    }
+
+    static uint32_t
+    compress(const char *in, uint32_t length, char *out) {
+        std::memcpy(out, in, length);
+        return length;
+    }
+};
+
+}; // namespace NanoLog
+
 namespace NanoLogInternal {
 
+/**
+ * Indicates whether a type T has a NanoLog::Codec specialization.
+ */
+template<typename T, typename = void>
+struct hasCodec : std::false_type {};
+
+template<typename T>
+struct hasCodec<T, std::void_t<decltype(NanoLog::Codec<T>::name)>>
+        : std::true_type {};
+
+/**
+ * A log argument that is serialized with its NanoLog::Codec. It refers to
+ * the original argument (which outlives the NANO_LOG invocation) so that the
+ * value is only copied once, directly into the StagingBuffer.
+ */
+template<typename T>
+struct CodecArgument {
+    typedef T Type;
+    const T *value;
+};
+
+template<typename T>
+struct isCodecArgument : std::false_type {};
+
+template<typename T>
+struct isCodecArgument<CodecArgument<T>> : std::true_type {};
+
+template<typename T>
+struct isDeltaArgument : std::false_type {};
+
+template<typename T>
+struct isDeltaArgument<NanoLog::Delta<T>> : std::true_type {};
+
+// Floats and doubles are always packed relative to their previous value
+// (see BufferUtils::packXor()); long doubles are stored verbatim.
+// Strings whose length is known are interned (see Log::InternedStrings)
+template<typename T>
+struct isInternedArgument : std::integral_constant<bool,
+                            std::is_same<T, const char*>::value
+                            || std::is_same<T, char*>::value
+                            || std::is_same<T, std::string_view>::value> {};
+
+template<typename T>
+struct isXorArgument : std::integral_constant<bool,
+                            std::is_same<T, double>::value
+                            || std::is_same<T, float>::value> {};
+
+template<typename T>
+struct isCString : std::integral_constant<bool,
+                            std::is_same<T, const char*>::value
+                            || std::is_same<T, char*>::value
+                            || std::is_same<T, const wchar_t*>::value
+                            || std::is_same<T, wchar_t*>::value> {};
+
 /**
  * Checks whether a character is with the terminal set of format specifier
  * characters according to the printf specification:
@@ -65,7 +250,7 @@ isTerminal(char c)
                 || c == 'a' || c == 'A'
                 || c == 'c' || c == 'p'
                 || c == '%' || c == 's'
-                || c == 'n';
+                || c == 'n' || c == 'B';
 }
 
 /**
@@ -114,6 +299,19 @@ isDigit(char c) {
     return (c >= '0' && c <= '9');
 }
 
+/**
+ * Type information about a parameter of a printf style format string, as
+ * returned by getParamSpecifier().
+ */
+struct ParamSpecifier {
+    // Describes the type of the parameter
+    ParamType type;
+
+    // Terminal character of the specifier that consumes the parameter
+    // (ex. 'd' for %d), or '*' for dynamic widths/precisions
+    char terminal;
+};
+
 /**
  * Analyzes a static printf style format string and extracts type information
  * about the p-th parameter that would be used in a corresponding NANO_LOG()
@@ -126,12 +324,12 @@ isDigit(char c) {
  * \param paramNum
  *      p-th parameter to return type information for (starts from zero)
  * \return
- *      Returns an ParamType enum describing the type of the parameter
+ *      Returns a ParamSpecifier describing the parameter
  */
 template<int N>
-constexpr inline ParamType
-getParamInfo(const char (&fmt)[N],
-             int paramNum=0)
+constexpr inline ParamSpecifier
+getParamSpecifier(const char (&fmt)[N],
+                  int paramNum=0)
 {
     int pos = 0;
     while (pos < N - 1) {
@@ -164,7 +362,7 @@ getParamInfo(const char (&fmt)[N],
                 // Consume width
                 if (fmt[pos] == '*') {
                     if (paramNum == 0)
-                        return ParamType::DYNAMIC_WIDTH;
+                        return {ParamType::DYNAMIC_WIDTH, '*'};
 
                     --paramNum;
                     ++pos;
@@ -181,7 +379,7 @@ getParamInfo(const char (&fmt)[N],
 
                     if (fmt[pos] == '*') {
                         if (paramNum == 0)
-                            return ParamType::DYNAMIC_PRECISION;
+                            return {ParamType::DYNAMIC_PRECISION, '*'};
 
                         hasDynamicPrecision = true;
                         --paramNum;
@@ -217,22 +415,44 @@ getParamInfo(const char (&fmt)[N],
                     ++pos;
                     continue;
                 } else {
-                    if (fmt[pos] != 's')
-                        return ParamType::NON_STRING;
+                    // Blobs (%B) are variable length like strings and
+                    // likewise use the precision to limit their length
+                    if (fmt[pos] != 's' && fmt[pos] != 'B')
+                        return {ParamType::NON_STRING, fmt[pos]};
 
                     if (hasDynamicPrecision)
-                        return ParamType::STRING_WITH_DYNAMIC_PRECISION;
+                        return {ParamType::STRING_WITH_DYNAMIC_PRECISION,
+                                fmt[pos]};
 
                     if (precision == -1)
-                        return ParamType::STRING_WITH_NO_PRECISION;
+                        return {ParamType::STRING_WITH_NO_PRECISION, fmt[pos]};
                     else
-                        return ParamType(precision);
+                        return {ParamType(precision), fmt[pos]};
                 }
             }
         }
     }
 
-    return ParamType::INVALID;
+    return {ParamType::INVALID, '\0'};
+}
+
+/**
+ * Returns the ParamType of the p-th parameter of a printf style format
+ * string (see getParamSpecifier()).
+ *
+ * \tparam N
+ *      Length of the static format string (automatically deduced)
+ * \param fmt
+ *      Format string to parse
+ * \param paramNum
+ *      p-th parameter to return type information for (starts from zero)
+ */
+template<int N>
+constexpr inline ParamType
+getParamInfo(const char (&fmt)[N],
+             int paramNum=0)
+{
+    return getParamSpecifier(fmt, paramNum).type;
 }
 
 
@@ -341,6 +561,53 @@ getNumNibblesNeeded(const char (&fmt)[N])
     return numNibbles;
 }
 
+/**
+ * Checks whether a printf style format string contains a %B (i.e. blob)
+ * specifier, which the GNU format checker does not understand.
+ *
+ * \tparam N
+ *      length of the printf style format string (automatically deduced)
+ * \param fmt
+ *      printf style format string to analyze
+ */
+template<size_t N>
+constexpr bool
+hasBlobSpecifier(const char (&fmt)[N])
+{
+    for (int i = 0; i < countFmtParams(fmt); ++i) {
+        if (getParamSpecifier(fmt, i).terminal == 'B')
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Checks that NanoLog::Bytes arguments are passed to exactly the %B
+ * specifiers of a format string. This stands in for the GNU format checker
+ * on these arguments.
+ *
+ * \tparam Ts
+ *      Types of the log arguments
+ * \tparam N
+ *      length of the printf style format string (automatically deduced)
+ * \param fmt
+ *      printf style format string to analyze
+ */
+template<typename... Ts, size_t N>
+constexpr bool
+checkBlobArguments(const char (&fmt)[N])
+{
+    constexpr bool isBlob[] = {std::is_same<Ts, NanoLog::Bytes>::value...,
+                               false};
+    for (int i = 0; i < static_cast<int>(sizeof...(Ts)); ++i) {
+        if (isBlob[i] != (getParamSpecifier(fmt, i).terminal == 'B'))
+            return false;
+    }
+
+    return true;
+}
+
 /**
  * Stores a single printf argument into a buffer and bumps the buffer pointer.
  *
@@ -435,6 +702,78 @@ store_argument(char **storage,
     return;
 }
 
+/**
+ * std::string_view specialization of store_argument. The view's contents
+ * are stored in the same format as a 'const char*' string (i.e. a 32-bit
+ * length followed by stringSize bytes and no NULL terminator).
+ */
+inline void
+store_argument(char **storage,
+               std::string_view arg,
+               const ParamType paramType,
+               const size_t stringSize)
+{
+    if (paramType <= ParamType::NON_STRING) {
+        store_argument<const void*>(storage,
+                                    static_cast<const void*>(arg.data()),
+                                    paramType, stringSize);
+        return;
+    }
+
+    if (stringSize > std::numeric_limits<uint32_t>::max())
+    {
+        throw std::invalid_argument("Strings larger than std::numeric_limits<uint32_t>::max() are unsupported");
+    }
+    auto size = static_cast<uint32_t>(stringSize);
+    std::memcpy(*storage, &size, sizeof(uint32_t));
+    *storage += sizeof(uint32_t);
+
+    memcpy(*storage, arg.data(), stringSize);
+    *storage += stringSize;
+}
+
+/**
+ * NanoLog::Bytes (i.e. blob) specialization of store_argument. Blobs are
+ * stored with Log::recordBlob(); stringSize includes the uint32_t length.
+ */
+inline void
+store_argument(char **storage,
+               NanoLog::Bytes arg,
+               const ParamType,
+               const size_t stringSize)
+{
+    Log::recordBlob(*storage, arg.data,
+                    static_cast<uint32_t>(stringSize - sizeof(uint32_t)),
+                    arg.base64);
+}
+
+/**
+ * CodecArgument specialization of store_argument. The argument is stored
+ * like a 'const char*' string (i.e. a 32-bit length followed by stringSize
+ * bytes), except that the bytes are produced by the Codec's store().
+ */
+template<typename T>
+inline void
+store_argument(char **storage,
+               CodecArgument<T> arg,
+               const ParamType paramType,
+               const size_t stringSize)
+{
+    if (paramType <= ParamType::NON_STRING) {
+        store_argument<const void*>(storage,
+                                    static_cast<const void*>(arg.value),
+                                    paramType, stringSize);
+        return;
+    }
+
+    auto size = static_cast<uint32_t>(stringSize);
+    std::memcpy(*storage, &size, sizeof(uint32_t));
+    *storage += sizeof(uint32_t);
+
+    NanoLog::Codec<T>::store(*arg.value, *storage);
+    *storage += stringSize;
+}
+
 /**
  * Given a variable number of arguments to a NANO_LOG (i.e. printf-like)
  * statement, recursively unpack the arguments, store them to a buffer, and
@@ -627,6 +966,72 @@ getArgSize(const ParamType fmtType,
     return stringBytes + sizeof(uint32_t);
 }
 
+/**
+ * std::string_view specialization of the above. Unlike 'const char*', the
+ * length of the string is already known, so the string is not scanned.
+ */
+inline size_t
+getArgSize(const ParamType fmtType,
+           uint64_t &previousPrecision,
+           size_t &stringBytes,
+           std::string_view str)
+{
+    if (fmtType <= ParamType::NON_STRING)
+        return sizeof(void*);
+
+    stringBytes = str.size();
+    uint32_t fmtLength = static_cast<uint32_t>(fmtType);
+
+    if (fmtType >= ParamType::STRING && stringBytes > fmtLength)
+        stringBytes = fmtLength;
+    else if (fmtType == ParamType::STRING_WITH_DYNAMIC_PRECISION &&
+                stringBytes > previousPrecision)
+        stringBytes = previousPrecision;
+
+    return stringBytes + sizeof(uint32_t);
+}
+
+/**
+ * NanoLog::Bytes (i.e. blob) specialization of getArgSize. Returns the
+ * number of bytes in the blob after applying the precision (if any) plus a
+ * uint32_t length.
+ */
+inline size_t
+getArgSize(const ParamType fmtType,
+           uint64_t &previousPrecision,
+           size_t &stringBytes,
+           NanoLog::Bytes arg)
+{
+    int64_t precision = -1;
+    if (fmtType >= ParamType::STRING)
+        precision = fmtType;
+    else if (fmtType == ParamType::STRING_WITH_DYNAMIC_PRECISION)
+        precision = static_cast<int64_t>(previousPrecision);
+
+    stringBytes = sizeof(uint32_t) + Log::getBlobBytes(arg.length, precision);
+    return stringBytes;
+}
+
+/**
+ * CodecArgument specialization of getArgSize. Returns the number of bytes
+ * the Codec's store() needs plus a uint32_t length. Precision specifiers are
+ * applied to the rendered value by the decompressor instead.
+ */
+template<typename T>
+inline size_t
+getArgSize(const ParamType fmtType,
+           uint64_t &,
+           size_t &stringBytes,
+           CodecArgument<T> arg)
+{
+    if (fmtType <= ParamType::NON_STRING)
+        return sizeof(void*);
+
+    stringBytes = NanoLog::Codec<T>::size(*arg.value);
+    assert(stringBytes <= NanoLog::Codec<T>::maxSize);
+    return stringBytes + sizeof(uint32_t);
+}
+
 /**
  * Wide-character string specialization of the above.
  */
@@ -721,51 +1126,311 @@ getArgSizes(const std::array<ParamType, N>&, uint64_t &, size_t (&)[M])
 }
 
 /**
- * Takes a single argument and compresses into a format that's compatible with
- * the NanoLog Decompressor.
+ * Copies a NULL terminated string to dest until either its NULL terminator
+ * or limit characters, whichever comes first, scanning the string only once.
+ * The string is read 16 bytes at a time, which may read past its NULL
+ * terminator but never into the next page, and dest is written 16 bytes at a
+ * time, which may write past the characters copied but never past limit.
  *
- * \tparam T
- *      Type of the argument to compress
- *
- * \param[in/out] nibbles
- *      Preallocated location for nibbles (used for non-string type compression)
- * \param[in/out] nibbleCnt
- *      Number of nibbles used so far
- * \param paramType
- *      Type of the argument according to the original printf-like format string
- * \param stringsOnly
- *      Indicates that the compression function should store strings only
- *      False means that it will store non-string types only
- * \param[in/out] in
- *      Input buffer to read the arguments back from
- * \param[in/out out
- *      Output buffer to write the compressed results to
+ * \param dest
+ *      Where to copy the string to; it is not NULL terminated
+ * \param src
+ *      String to copy
+ * \param limit
+ *      Maximum number of characters to copy
+ * \return
+ *      Number of characters copied
  */
-template<typename T>
-inline void
-compressSingle(BufferUtils::TwoNibbles* nibbles,
-                int *nibbleCnt,
-                const ParamType paramType,
-                bool stringsOnly,
-                char **in,
-                char **out)
+__attribute__((no_sanitize_address))
+inline size_t
+copyString(char *dest, const char *src, size_t limit)
 {
-    if (paramType > ParamType::NON_STRING) {
-        uint32_t stringBytes;
-        std::memcpy(&stringBytes, *in, sizeof(uint32_t));
-        *in += sizeof(uint32_t);
+    size_t n = 0;
+
+#ifdef __SSE2__
+    const __m128i zeros = _mm_setzero_si128();
+    uintptr_t address = reinterpret_cast<uintptr_t>(src);
+
+    // Only the first read is unaligned (and may thus cross into the next
+    // page); the rest are of the 16 byte aligned blocks that follow it,
+    // read in pairs within 32 byte aligned blocks where possible.
+    if (limit >= sizeof(__m128i) && (address & 4095) <= 4096 - 16) {
+        __m128i chars = _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(src));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), chars);
+
+        int nulls = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, zeros));
+        if (nulls != 0)
+            return __builtin_ctz(nulls);
+
+        n = sizeof(__m128i) - (address & 15);
+        if (((address + n) & 31) != 0 && n + sizeof(__m128i) <= limit) {
+            chars = _mm_load_si128(reinterpret_cast<const __m128i*>(src + n));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), chars);
+
+            nulls = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, zeros));
+            if (nulls != 0)
+                return n + __builtin_ctz(nulls);
+
+            n += sizeof(__m128i);
+        }
 
-        // Skipping strings
-        if (!stringsOnly) {
-            *in += stringBytes;
-            return;
+        while (n + 2*sizeof(__m128i) <= limit) {
+            chars = _mm_load_si128(reinterpret_cast<const __m128i*>(src + n));
+            __m128i next = _mm_load_si128(
+                            reinterpret_cast<const __m128i*>(src + n + 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), chars);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 16), next);
+
+            nulls = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                                        _mm_min_epu8(chars, next), zeros));
+            if (nulls != 0) {
+                nulls = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, zeros))
+                    | (_mm_movemask_epi8(_mm_cmpeq_epi8(next, zeros)) << 16);
+                return n + __builtin_ctz(nulls);
+            }
+
+            n += 2*sizeof(__m128i);
         }
 
-#ifdef ENABLE_DEBUG_PRINTING
-        printf("\tCString [%p->%p-%u]\r\n", *in, *out, stringBytes);
-#endif
+        if (n + sizeof(__m128i) <= limit) {
+            chars = _mm_load_si128(reinterpret_cast<const __m128i*>(src + n));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), chars);
 
-        memcpy(*out, *in, stringBytes);
+            nulls = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, zeros));
+            if (nulls != 0)
+                return n + __builtin_ctz(nulls);
+
+            n += sizeof(__m128i);
+        }
+    }
+#endif
+
+    while (n < limit && src[n] != '\0') {
+        dest[n] = src[n];
+        ++n;
+    }
+
+    return n;
+}
+
+/**
+ * Wide-character string version of the above. (See above for documentation)
+ */
+inline size_t
+copyString(char *dest, const wchar_t *src, size_t limit)
+{
+    size_t n = 0;
+    for (; n < limit && src[n] != L'\0'; ++n)
+        std::memcpy(dest + n*sizeof(wchar_t), src + n, sizeof(wchar_t));
+
+    return n;
+}
+
+/**
+ * For a single argument, return an upper bound on the number of bytes needed
+ * to represent it without compression, without scanning 'const char*'
+ * strings (see getArgSize() for the exact size). The bound for a string is
+ * its precision (if any), but at most NanoLogConfig::STRING_CAPTURE_BYTES,
+ * plus a uint32_t length.
+ *
+ * \param fmtType
+ *      Type of the argument according to the original printf-like format
+ *      string
+ * \param[in/out] previousPrecision
+ *      Store the last 'precision' format specifier type encountered
+ *      (as dictated by the fmtType)
+ * \param[out] stringSize
+ *      For strings, the maximum number of characters to store according to
+ *      the precision; otherwise, as set by getArgSize()
+ * \param arg
+ *      Argument to compute the bound for
+ * \return
+ *      Upper bound on the size of the argument without compression
+ */
+template<typename T>
+inline size_t
+getArgBound(const ParamType fmtType,
+            uint64_t &previousPrecision,
+            size_t &stringSize,
+            T arg)
+{
+    if constexpr (isCString<T>::value) {
+        if (fmtType > ParamType::NON_STRING) {
+            typedef typename std::remove_cv<
+                            typename std::remove_pointer<T>::type>::type CharT;
+            constexpr size_t maxChars =
+                            NanoLogConfig::STRING_CAPTURE_BYTES/sizeof(CharT);
+
+            stringSize = std::numeric_limits<size_t>::max();
+            if (fmtType >= ParamType::STRING)
+                stringSize = static_cast<size_t>(fmtType);
+            else if (fmtType == ParamType::STRING_WITH_DYNAMIC_PRECISION)
+                stringSize = previousPrecision;
+
+            return sizeof(uint32_t)
+                        + std::min(stringSize, maxChars)*sizeof(CharT);
+        }
+    }
+
+    return getArgSize(fmtType, previousPrecision, stringSize, arg);
+}
+
+/**
+ * Given a variable number of printf arguments and type information deduced
+ * from the original format string, compute an upper bound on the space
+ * needed to store all the arguments with capture_arguments(). This is the
+ * counterpart of getArgSizes() that doesn't scan 'const char*' strings.
+ * (See getArgSizes() for documentation)
+ */
+template<int argNum = 0, unsigned long N, int M, typename T1, typename... Ts>
+inline size_t
+getArgBounds(const std::array<ParamType, N>& argFmtTypes,
+             uint64_t &previousPrecision,
+             size_t (&stringSizes)[M],
+             T1 head, Ts... rest)
+{
+    return getArgBound(argFmtTypes[argNum], previousPrecision,
+                                                    stringSizes[argNum], head)
+           + getArgBounds<argNum + 1>(argFmtTypes, previousPrecision,
+                                                    stringSizes, rest...);
+}
+
+template<int argNum = 0, unsigned long N, int M>
+inline size_t
+getArgBounds(const std::array<ParamType, N>&, uint64_t &, size_t (&)[M])
+{
+    return 0;
+}
+
+/**
+ * Stores a single printf argument into a buffer and bumps the buffer pointer
+ * like store_argument(), except that 'const char*' strings are copied while
+ * they're scanned for their length. Such strings must fit within the bound
+ * computed by getArgBound().
+ *
+ * \param[in/out] storage
+ *      Buffer to store the argument into
+ * \param arg
+ *      Argument to store
+ * \param paramType
+ *      Type information deduced from the format string about this argument
+ * \param stringSize
+ *      For strings, the maximum number of characters to store as set by
+ *      getArgBound(); otherwise, as set by getArgSize()
+ * \return
+ *      false if the string was longer than the bound from getArgBound(),
+ *      in which case storage is left undefined; true otherwise
+ */
+template<typename T>
+inline bool
+capture_argument(char **storage,
+                 T arg,
+                 const ParamType paramType,
+                 const size_t stringSize)
+{
+    if constexpr (isCString<T>::value) {
+        if (paramType > ParamType::NON_STRING) {
+            typedef typename std::remove_cv<
+                            typename std::remove_pointer<T>::type>::type CharT;
+            constexpr size_t maxChars =
+                            NanoLogConfig::STRING_CAPTURE_BYTES/sizeof(CharT);
+
+            size_t limit = std::min(stringSize, maxChars);
+            size_t length = copyString(*storage + sizeof(uint32_t), arg, limit);
+            if (length == maxChars && limit < stringSize && arg[length] != 0)
+                return false;
+
+            auto size = static_cast<uint32_t>(length*sizeof(CharT));
+            std::memcpy(*storage, &size, sizeof(uint32_t));
+            *storage += sizeof(uint32_t) + size;
+            return true;
+        }
+    }
+
+    store_argument(storage, arg, paramType, stringSize);
+    return true;
+}
+
+/**
+ * Given a variable number of arguments to a NANO_LOG (i.e. printf-like)
+ * statement, store them to a buffer with capture_argument() and bump the
+ * buffer pointer. (See store_arguments() for documentation)
+ *
+ * \return
+ *      false if a string was longer than the bound from getArgBounds(),
+ *      in which case storage is left undefined; true otherwise
+ */
+template<int argNum = 0, unsigned long N, int M, typename T1, typename... Ts>
+inline bool
+capture_arguments(const std::array<ParamType, N>& paramTypes,
+                  size_t (&stringSizes)[M],
+                  char **storage,
+                  T1 head,
+                  Ts... rest)
+{
+    return capture_argument(storage, head, paramTypes[argNum],
+                            stringSizes[argNum])
+           && capture_arguments<argNum + 1>(paramTypes, stringSizes, storage,
+                                            rest...);
+}
+
+template<int argNum = 0, unsigned long N, int M>
+inline bool
+capture_arguments(const std::array<ParamType, N>&, size_t (&)[M], char **)
+{
+    return true;
+}
+
+/**
+ * Takes a single argument and compresses into a format that's compatible with
+ * the NanoLog Decompressor.
+ *
+ * \tparam T
+ *      Type of the argument to compress
+ *
+ * \param[in/out] nibbles
+ *      Preallocated location for nibbles (used for non-string type compression)
+ * \param[in/out] nibbleCnt
+ *      Number of nibbles used so far
+ * \param paramType
+ *      Type of the argument according to the original printf-like format string
+ * \param stringsOnly
+ *      Indicates that the compression function should store strings only
+ *      False means that it will store non-string types only
+ * \param[in/out] in
+ *      Input buffer to read the arguments back from
+ * \param[in/out out
+ *      Output buffer to write the compressed results to
+ * \param staticStrings
+ *      Table to intern NanoLog::static_str() arguments into
+ */
+template<typename T>
+inline typename std::enable_if<!isCodecArgument<T>::value>::type
+compressSingle(BufferUtils::TwoNibbles* nibbles,
+                int *nibbleCnt,
+                const ParamType paramType,
+                bool stringsOnly,
+                char **in,
+                char **out,
+                Log::StaticStringTable *staticStrings=nullptr)
+{
+    if (paramType > ParamType::NON_STRING) {
+        uint32_t stringBytes;
+        std::memcpy(&stringBytes, *in, sizeof(uint32_t));
+        *in += sizeof(uint32_t);
+
+        // Skipping strings
+        if (!stringsOnly) {
+            *in += stringBytes;
+            return;
+        }
+
+#ifdef ENABLE_DEBUG_PRINTING
+        printf("\tCString [%p->%p-%u]\r\n", *in, *out, stringBytes);
+#endif
+
+        memcpy(*out, *in, stringBytes);
         *in += stringBytes;
         *out += stringBytes;
 
@@ -815,91 +1480,576 @@ compressSingle(BufferUtils::TwoNibbles* nibbles,
 }
 
 /**
- * Trickiness: There is an extra level of indirection (which will be compiled
- * out, but) required between compress_internal and compressHelper due to C++
- * disallowing partial template function specialization. More specifically, we
- * cannot have a single level of calls (i.e. compress<T, Ts..> and
- * compress<Ts..> because for a case of compress<int>, the compiler can't tell
- * whether it's suppose to call the first one with arguments <int, {}>
- * or <int> with the second.
- *
- * https://stackoverflow.com/questions/23443511/how-to-match-empty-arguments-pack-in-variadic-template
+ * NanoLog::StaticString specialization of compressSingle. Static strings are
+ * stored as pointers in the input buffer and compressed as (packed) ids into
+ * the static string table, or as pointers if the specifier is a %p.
+ * (See above for documentation)
  */
-template<typename... Ts>
-NANOLOG_ALWAYS_INLINE
-void compress_internal(BufferUtils::TwoNibbles*, int,
-                       const bool*, bool, int, char **, char **);
+template<>
+inline void
+compressSingle<NanoLog::StaticString>(BufferUtils::TwoNibbles* nibbles,
+                                      int *nibbleCnt,
+                                      const ParamType paramType,
+                                      bool stringsOnly,
+                                      char **in,
+                                      char **out,
+                                      Log::StaticStringTable *staticStrings)
+{
+    // The ids are packed with the non-string types, so there's nothing to
+    // do in the strings pass
+    if (stringsOnly) {
+        *in += sizeof(NanoLog::StaticString);
+        return;
+    }
+
+    NanoLog::StaticString arg;
+    std::memcpy(&arg, *in, sizeof(NanoLog::StaticString));
+    *in += sizeof(NanoLog::StaticString);
+
+    int nibble;
+    if (paramType > ParamType::NON_STRING && staticStrings)
+        nibble = BufferUtils::pack(out, staticStrings->intern(arg.str));
+    else
+        nibble = BufferUtils::pack(out, static_cast<const void*>(arg.str));
+
+    if (*nibbleCnt & 0x1)
+        nibbles[*nibbleCnt/2].second = 0xf & nibble;
+    else
+        nibbles[*nibbleCnt/2].first = 0xf & nibble;
+
+    ++(*nibbleCnt);
+}
 
 /**
- * Recursively peels off an argument from an argument pack and compresses
- * into a format that's compatible withthe NanoLog Decompressor.
+ * std::string_view specialization of compressSingle. The views are stored
+ * like 'const char*' strings in the input buffer, but since they're not
+ * guaranteed to be free of NULL characters, the compressed copy is cut short
+ * at the first one (if any) to keep the NULL-terminated output decodable.
+ * (See above for documentation)
+ */
+template<>
+inline void
+compressSingle<std::string_view>(BufferUtils::TwoNibbles* nibbles,
+                                 int *nibbleCnt,
+                                 const ParamType paramType,
+                                 bool stringsOnly,
+                                 char **in,
+                                 char **out,
+                                 Log::StaticStringTable *staticStrings)
+{
+    // Views passed to %p specifiers are stored as pointers
+    if (paramType <= ParamType::NON_STRING) {
+        compressSingle<const void*>(nibbles, nibbleCnt, paramType,
+                                    stringsOnly, in, out, staticStrings);
+        return;
+    }
+
+    uint32_t stringBytes;
+    std::memcpy(&stringBytes, *in, sizeof(uint32_t));
+    *in += sizeof(uint32_t);
+
+    if (!stringsOnly) {
+        *in += stringBytes;
+        return;
+    }
+
+    size_t length = strnlen(*in, stringBytes);
+    memcpy(*out, *in, length);
+    *in += stringBytes;
+    *out += length;
+
+    **out = '\0';
+    *out += 1;
+}
+
+/**
+ * NanoLog::Bytes (i.e. blob) specialization of compressSingle. Blobs are
+ * copied as-is, length included, with the strings.
+ * (See above for documentation)
+ */
+template<>
+inline void
+compressSingle<NanoLog::Bytes>(BufferUtils::TwoNibbles*,
+                               int*,
+                               const ParamType,
+                               bool stringsOnly,
+                               char **in,
+                               char **out,
+                               Log::StaticStringTable*)
+{
+    uint32_t lengthWord;
+    std::memcpy(&lengthWord, *in, sizeof(uint32_t));
+    size_t bytes = sizeof(uint32_t) + (lengthWord & MAX_BLOB_BYTES);
+
+    if (stringsOnly) {
+        memcpy(*out, *in, bytes);
+        *out += bytes;
+    }
+
+    *in += bytes;
+}
+
+/**
+ * CodecArgument specialization of compressSingle. The bytes output by the
+ * Codec's store() are re-encoded with its compress() function and stored
+ * with the strings, prefixed with their length as a BufferUtils varint.
+ * (See above for documentation)
+ */
+template<typename T>
+inline typename std::enable_if<isCodecArgument<T>::value>::type
+compressSingle(BufferUtils::TwoNibbles* nibbles,
+               int *nibbleCnt,
+               const ParamType paramType,
+               bool stringsOnly,
+               char **in,
+               char **out,
+               Log::StaticStringTable *staticStrings=nullptr)
+{
+    using Codec = NanoLog::Codec<typename T::Type>;
+
+    if (paramType <= ParamType::NON_STRING) {
+        compressSingle<const void*>(nibbles, nibbleCnt, paramType,
+                                    stringsOnly, in, out, staticStrings);
+        return;
+    }
+
+    uint32_t storedBytes;
+    std::memcpy(&storedBytes, *in, sizeof(uint32_t));
+    *in += sizeof(uint32_t);
+
+    if (!stringsOnly) {
+        *in += storedBytes;
+        return;
+    }
+
+    // The length has to precede the compressed bytes, but it's unknown until
+    // compress() runs. So leave room for the largest possible length and
+    // slide the bytes over should the actual length encode in fewer bytes.
+    char *compressed = *out + BufferUtils::getVarintSize(storedBytes);
+    uint32_t compressedBytes = Codec::compress(*in, storedBytes, compressed);
+    assert(compressedBytes <= storedBytes);
+
+    BufferUtils::packVarint(out, compressedBytes);
+    if (*out != compressed)
+        memmove(*out, compressed, compressedBytes);
+
+    *out += compressedBytes;
+    *in += storedBytes;
+}
+
+/**
+ * Compresses a NanoLog::delta() argument as the difference from its previous
+ * value, which is packed with the non-string types.
  *
- * \tparam T1
- *      Type of the head argument (i.e the current one to process)
- * \tparam Ts
- *      Type of the rest of the pack arguments
+ * \tparam T
+ *      NanoLog::Delta type of the argument
  *
  * \param[in/out] nibbles
- *      Preallocated location for nibbles (used for non-string type compression)
+ *      Preallocated location for nibbles
  * \param[in/out] nibbleCnt
  *      Number of nibbles used so far
- * \param paramType
- *      Type of the argument according to the original printf-like format string
  * \param stringsOnly
  *      Indicates that the compression function should store strings only
- *      False means that it will store non-string types only
- * \param argNum
- *      The argument number we're processing (i.e. the recursion depth)
  * \param[in/out] in
- *      Input buffer to read the arguments back from
- * \param[in/out out
+ *      Input buffer to read the argument back from
+ * \param[in/out] out
  *      Output buffer to write the compressed results to
+ * \param[in/out] base
+ *      Previous value of the argument, which is updated; nullptr encodes
+ *      the difference from 0
  */
-template<typename T1, typename... Ts>
-NANOLOG_ALWAYS_INLINE
-void compressHelper(BufferUtils::TwoNibbles *nibbles,
-                    int nibbleCnt,
-                    const ParamType *paramTypes,
-                    bool stringsOnly,
-                    int argNum,
-                    char **in,
-                    char **out)
+template<typename T>
+inline void
+compressDelta(BufferUtils::TwoNibbles* nibbles,
+              int *nibbleCnt,
+              bool stringsOnly,
+              char **in,
+              char **out,
+              uint64_t *base)
 {
-    // Peel off the first argument, and recursively process the rest
-    compressSingle<T1>(nibbles, &nibbleCnt, paramTypes[argNum], stringsOnly,
-                       in, out);
-    compress_internal<Ts...>(nibbles, nibbleCnt, paramTypes, stringsOnly,
-                                argNum + 1, in, out);
-}
+    if (stringsOnly) {
+        *in += sizeof(T);
+        return;
+    }
 
+    T arg;
+    std::memcpy(&arg, *in, sizeof(T));
+    *in += sizeof(T);
 
-template<typename... Ts>
-NANOLOG_ALWAYS_INLINE 
-void compress_internal(BufferUtils::TwoNibbles *nibbles, int nibbleCnt,
-                       const ParamType *isArgString, bool stringsOnly, int argNum,
-                       char **in, char **out)
-{
-    compressHelper<Ts...>(nibbles, nibbleCnt, isArgString, stringsOnly,
-                                argNum, in, out);
-}
+    uint64_t noBase = 0;
+    int nibble = BufferUtils::packDelta(out, arg.value,
+                                        (base) ? base : &noBase);
 
-template<>
-NANOLOG_ALWAYS_INLINE 
-void compress_internal(BufferUtils::TwoNibbles *nibbles, int nibbleCnt,
-                       const ParamType *isArgString, bool stringsOnly, int argNum,
-                       char **in, char **out)
-{
-    // This is a catch for compress when the template arguments are empty,
-    // in which case we do nothing. This is needed since the head/tail pack
-    // expansion used above will always end with Ts = {}
-}
+    if (*nibbleCnt & 0x1)
+        nibbles[*nibbleCnt/2].second = 0xf & nibble;
+    else
+        nibbles[*nibbleCnt/2].first = 0xf & nibble;
 
+    ++(*nibbleCnt);
+}
 
 /**
- * Consumes the raw log format parameters in the input buffer and compresses
- * them to the output buffer. Both the pointers will be modified to reflect
- * the consumption/output. The template parameters are used to specify how to
- * interpret the input buffer bytes.
+ * Compresses a float or double argument as the XOR with the previous value of
+ * the same argument (see BufferUtils::packXor()). Floats are widened to
+ * doubles, so they are always decompressed as such.
+ *
+ * \tparam T
+ *      Floating-point type of the argument
+ *
+ * \param[in/out] nibbles
+ *      Preallocated location for nibbles
+ * \param[in/out] nibbleCnt
+ *      Number of nibbles used so far
+ * \param stringsOnly
+ *      Indicates that the compression function should store strings only
+ * \param[in/out] in
+ *      Input buffer to read the argument back from
+ * \param[in/out] out
+ *      Output buffer to write the compressed results to
+ * \param[in/out] base
+ *      Bits of the previous value of the argument, which are updated;
+ *      nullptr XORs with 0
+ */
+template<typename T>
+inline void
+compressXor(BufferUtils::TwoNibbles* nibbles,
+            int *nibbleCnt,
+            bool stringsOnly,
+            char **in,
+            char **out,
+            uint64_t *base)
+{
+    if (stringsOnly) {
+        *in += sizeof(T);
+        return;
+    }
+
+    T arg;
+    std::memcpy(&arg, *in, sizeof(T));
+    *in += sizeof(T);
+
+    uint64_t noBase = 0;
+    int nibble = BufferUtils::packXor(out, static_cast<double>(arg),
+                                      (base) ? base : &noBase);
+
+    if (*nibbleCnt & 0x1)
+        nibbles[*nibbleCnt/2].second = 0xf & nibble;
+    else
+        nibbles[*nibbleCnt/2].first = 0xf & nibble;
+
+    ++(*nibbleCnt);
+}
+
+/**
+ * Compresses a string argument either as a reference to an identical string
+ * interned by a previous log message of the same invocation site, or in full
+ * (see Log::InternedStrings). Like other strings, the result is output with
+ * the strings; arguments passed to %p specifiers are left to compressSingle().
+ *
+ * \tparam T
+ *      Type of the string argument
+ *
+ * \param[in/out] nibbles
+ *      Preallocated location for nibbles
+ * \param[in/out] nibbleCnt
+ *      Number of nibbles used so far
+ * \param paramType
+ *      Type of the argument according to the original printf format string
+ * \param stringsOnly
+ *      Indicates that the compression function should store strings only
+ * \param argNum
+ *      Index of the argument in the log invocation site
+ * \param[in/out] in
+ *      Input buffer to read the argument back from
+ * \param[in/out] out
+ *      Output buffer to write the compressed results to
+ * \param staticStrings
+ *      Table to intern NanoLog::static_str() arguments into
+ * \param internedStrings
+ *      Strings interned by the log invocation site; nullptr encodes all the
+ *      strings in full
+ */
+template<typename T>
+inline void
+compressInterned(BufferUtils::TwoNibbles* nibbles,
+                 int *nibbleCnt,
+                 const ParamType paramType,
+                 bool stringsOnly,
+                 int argNum,
+                 char **in,
+                 char **out,
+                 Log::StaticStringTable *staticStrings,
+                 Log::InternedStrings *internedStrings)
+{
+    if (paramType <= ParamType::NON_STRING) {
+        compressSingle<T>(nibbles, nibbleCnt, paramType, stringsOnly, in, out,
+                          staticStrings);
+        return;
+    }
+
+    uint32_t stringBytes;
+    std::memcpy(&stringBytes, *in, sizeof(uint32_t));
+    *in += sizeof(uint32_t);
+
+    if (!stringsOnly) {
+        *in += stringBytes;
+        return;
+    }
+
+    // Views may contain NULL characters, so they're cut short at the first
+    const char *str = *in;
+    size_t length = stringBytes;
+    if constexpr (std::is_same<T, std::string_view>::value)
+        length = strnlen(str, stringBytes);
+    *in += stringBytes;
+
+    uint32_t id = 0;
+    if (internedStrings)
+        id = internedStrings->intern(argNum, str, length);
+
+    if (id != 0 || length == 0) {
+        *(*out)++ = '\0';
+        *(*out)++ = static_cast<char>(id);
+        return;
+    }
+
+    memcpy(*out, str, length);
+    *out += length;
+    *(*out)++ = '\0';
+}
+
+/**
+ * Reads back an argument stored by store_argument() as is (i.e. not a string).
+ *
+ * \tparam T
+ *      Type of the argument
+ * \param[in/out] in
+ *      Input buffer to read the argument back from
+ */
+template<typename T>
+inline T
+readArgument(char **in)
+{
+    T argument;
+    std::memcpy(&argument, *in, sizeof(T));
+    *in += sizeof(T);
+    return argument;
+}
+
+/**
+ * Compresses the arguments of a log message that takes only integers in one
+ * batch with BufferUtils::packIntegers(), producing the same output as
+ * invoking compressSingle() on each argument.
+ *
+ * \tparam Ts
+ *      Types of the (integer) arguments encoded in the input buffer
+ *
+ * \param nibbles
+ *      Preallocated location for the nibbles of the arguments
+ * \param[in/out] in
+ *      Input buffer to read the arguments back from
+ * \param[in/out] out
+ *      Output buffer to write the compressed results to
+ */
+template<typename... Ts>
+inline void
+compressIntegers(BufferUtils::TwoNibbles *nibbles, char **in, char **out)
+{
+    uint64_t values[sizeof...(Ts)];
+    uint8_t negated[sizeof...(Ts)];
+
+    size_t i = 0;
+    ((values[i] = BufferUtils::getPackable(readArgument<Ts>(in), &negated[i]),
+      ++i), ...);
+
+    BufferUtils::packIntegers(out, nibbles, values, negated, sizeof...(Ts));
+}
+
+/**
+ * Returns the largest number of bytes packIntegerArguments() may write for
+ * the arguments of types Ts, which includes the slack packIntegers() needs.
+ */
+template<typename... Ts>
+constexpr size_t
+getMaxPackedSize()
+{
+    return (sizeof...(Ts) + 1)/2 + sizeof(uint64_t)*sizeof...(Ts);
+}
+
+/**
+ * Packs the arguments of a NANO_LOG_PACKED() invocation (i.e. only integers)
+ * into a StagingBuffer in their compressed form, which is the nibbles
+ * followed by the packed values as compressIntegers() would output them.
+ *
+ * \tparam Ts
+ *      Types of the (integer) arguments
+ *
+ * \param[in/out] storage
+ *      Buffer to pack the arguments into, which must have space for
+ *      getMaxPackedSize<Ts...>() bytes; it's bumped past the packed bytes
+ * \param args
+ *      Arguments to pack
+ */
+template<typename... Ts>
+inline void
+packIntegerArguments(char **storage, Ts... args)
+{
+    if constexpr (sizeof...(Ts) > 0) {
+        auto *nibbles = reinterpret_cast<BufferUtils::TwoNibbles*>(*storage);
+        *storage += (sizeof...(Ts) + 1)/2;
+
+        uint64_t values[sizeof...(Ts)];
+        uint8_t negated[sizeof...(Ts)];
+
+        size_t i = 0;
+        ((values[i] = BufferUtils::getPackable(args, &negated[i]), ++i), ...);
+
+        BufferUtils::packIntegers(storage, nibbles, values, negated,
+                                  sizeof...(Ts));
+    }
+}
+
+/**
+ * Compression function of NANO_LOG_PACKED() invocation sites, whose
+ * arguments are already packed by the producer (see packIntegerArguments()),
+ * so they only need to be copied to the output. The arguments are the same
+ * as for compress().
+ */
+template<typename... Ts>
+inline void
+compressPrepacked(int numNibbles, const ParamType *paramTypes, char **input,
+                  char **output, Log::StaticStringTable *staticStrings,
+                  Log::DeltaBases *deltaBases,
+                  Log::InternedStrings *internedStrings)
+{
+    constexpr uint32_t N = sizeof...(Ts);
+    auto *nibbles = reinterpret_cast<const BufferUtils::TwoNibbles*>(*input);
+    size_t length = (N + 1)/2 + BufferUtils::getSizeOfPackedValues(nibbles, N);
+
+    std::memcpy(*output, *input, length);
+    *input += length;
+    *output += length;
+}
+
+/**
+ * Trickiness: There is an extra level of indirection (which will be compiled
+ * out, but) required between compress_internal and compressHelper due to C++
+ * disallowing partial template function specialization. More specifically, we
+ * cannot have a single level of calls (i.e. compress<T, Ts..> and
+ * compress<Ts..> because for a case of compress<int>, the compiler can't tell
+ * whether it's suppose to call the first one with arguments <int, {}>
+ * or <int> with the second.
+ *
+ * https://stackoverflow.com/questions/23443511/how-to-match-empty-arguments-pack-in-variadic-template
+ */
+template<typename... Ts>
+NANOLOG_ALWAYS_INLINE
+void compress_internal(BufferUtils::TwoNibbles*, int,
+                       const bool*, bool, int, char **, char **,
+                       Log::StaticStringTable*, uint64_t*,
+                       Log::InternedStrings*);
+
+/**
+ * Recursively peels off an argument from an argument pack and compresses
+ * into a format that's compatible withthe NanoLog Decompressor.
+ *
+ * \tparam T1
+ *      Type of the head argument (i.e the current one to process)
+ * \tparam Ts
+ *      Type of the rest of the pack arguments
+ *
+ * \param[in/out] nibbles
+ *      Preallocated location for nibbles (used for non-string type compression)
+ * \param[in/out] nibbleCnt
+ *      Number of nibbles used so far
+ * \param paramType
+ *      Type of the argument according to the original printf-like format string
+ * \param stringsOnly
+ *      Indicates that the compression function should store strings only
+ *      False means that it will store non-string types only
+ * \param argNum
+ *      The argument number we're processing (i.e. the recursion depth)
+ * \param[in/out] in
+ *      Input buffer to read the arguments back from
+ * \param[in/out out
+ *      Output buffer to write the compressed results to
+ * \param staticStrings
+ *      Table to intern NanoLog::static_str() arguments into
+ * \param deltaBases
+ *      Previous values of the NanoLog::delta() and floating-point arguments,
+ *      indexed by argument number (may be nullptr)
+ * \param internedStrings
+ *      Strings interned by the log invocation site (may be nullptr)
+ */
+template<typename T1, typename... Ts>
+NANOLOG_ALWAYS_INLINE
+void compressHelper(BufferUtils::TwoNibbles *nibbles,
+                    int nibbleCnt,
+                    const ParamType *paramTypes,
+                    bool stringsOnly,
+                    int argNum,
+                    char **in,
+                    char **out,
+                    Log::StaticStringTable *staticStrings=nullptr,
+                    uint64_t *deltaBases=nullptr,
+                    Log::InternedStrings *internedStrings=nullptr)
+{
+    // Peel off the first argument, and recursively process the rest
+    if constexpr (isDeltaArgument<T1>::value) {
+        compressDelta<T1>(nibbles, &nibbleCnt, stringsOnly, in, out,
+                          (deltaBases) ? deltaBases + argNum : nullptr);
+    } else if constexpr (isXorArgument<T1>::value) {
+        compressXor<T1>(nibbles, &nibbleCnt, stringsOnly, in, out,
+                        (deltaBases) ? deltaBases + argNum : nullptr);
+    } else if constexpr (isInternedArgument<T1>::value) {
+        compressInterned<T1>(nibbles, &nibbleCnt, paramTypes[argNum],
+                             stringsOnly, argNum, in, out, staticStrings,
+                             internedStrings);
+    } else {
+        compressSingle<T1>(nibbles, &nibbleCnt, paramTypes[argNum],
+                           stringsOnly, in, out, staticStrings);
+    }
+
+    compress_internal<Ts...>(nibbles, nibbleCnt, paramTypes, stringsOnly,
+                                argNum + 1, in, out, staticStrings,
+                                deltaBases, internedStrings);
+}
+
+
+template<typename... Ts>
+NANOLOG_ALWAYS_INLINE 
+void compress_internal(BufferUtils::TwoNibbles *nibbles, int nibbleCnt,
+                       const ParamType *isArgString, bool stringsOnly, int argNum,
+                       char **in, char **out,
+                       Log::StaticStringTable *staticStrings=nullptr,
+                       uint64_t *deltaBases=nullptr,
+                       Log::InternedStrings *internedStrings=nullptr)
+{
+    compressHelper<Ts...>(nibbles, nibbleCnt, isArgString, stringsOnly,
+                                argNum, in, out, staticStrings, deltaBases,
+                                internedStrings);
+}
+
+template<>
+NANOLOG_ALWAYS_INLINE 
+void compress_internal(BufferUtils::TwoNibbles *nibbles, int nibbleCnt,
+                       const ParamType *isArgString, bool stringsOnly, int argNum,
+                       char **in, char **out,
+                       Log::StaticStringTable *staticStrings,
+                       uint64_t *deltaBases,
+                       Log::InternedStrings *internedStrings)
+{
+    // This is a catch for compress when the template arguments are empty,
+    // in which case we do nothing. This is needed since the head/tail pack
+    // expansion used above will always end with Ts = {}
+}
+
+
+/**
+ * Consumes the raw log format parameters in the input buffer and compresses
+ * them to the output buffer. Both the pointers will be modified to reflect
+ * the consumption/output. The template parameters are used to specify how to
+ * interpret the input buffer bytes.
  *
  * \tparam Ts
  *      Varadic template that specifies the order and types of arguments
@@ -914,13 +2064,33 @@ void compress_internal(BufferUtils::TwoNibbles *nibbles, int nibbleCnt,
  *      Input buffer to read the arguments back from
  * \param[in/out out
  *      Output buffer to write the compressed results to
+ * \param staticStrings
+ *      Table to intern NanoLog::static_str() arguments into; this may be
+ *      nullptr if the arguments contain no static strings.
+ * \param deltaBases
+ *      Previous values of the NanoLog::delta() and floating-point arguments
+ *      with the log invocation site selected; this may be nullptr if the
+ *      arguments contain neither.
+ * \param internedStrings
+ *      Strings interned by the log invocation site, which is selected; this
+ *      may be nullptr to encode all the strings in full.
  */
 template<typename... Ts>
 inline void
-compress(int numNibbles, const ParamType *paramTypes, char **input, char **output) {
+compress(int numNibbles, const ParamType *paramTypes, char **input,
+         char **output, Log::StaticStringTable *staticStrings=nullptr,
+         Log::DeltaBases *deltaBases=nullptr,
+         Log::InternedStrings *internedStrings=nullptr) {
     char *in = *input;
     char *out = *output;
 
+    uint64_t *bases = nullptr;
+    if constexpr (((isDeltaArgument<Ts>::value || isXorArgument<Ts>::value)
+                        || ...)) {
+        if (deltaBases)
+            bases = deltaBases->getCurrent(sizeof...(Ts));
+    }
+
     // Compress the arguments into a format that looks something like:
     // <Nibbles>
     // <Non-String types>
@@ -936,6 +2106,15 @@ compress(int numNibbles, const ParamType *paramTypes, char **input, char **outpu
     printf("\r\n");
 #endif
 
+    // Log messages that take only integers need neither the strings pass
+    // below nor to be compressed one argument at a time
+    if constexpr (sizeof...(Ts) > 0 && (std::is_integral<Ts>::value && ...)) {
+        compressIntegers<Ts...>(nibbles, &in, &out);
+        *input = in;
+        *output = out;
+        return;
+    }
+
     // This method of passing in stack-copies of the input/output pointers
     // seems to allow the compiler to generate much more optimized code.
     // The alternative of passing **input/**output directly into
@@ -943,18 +2122,122 @@ compress(int numNibbles, const ParamType *paramTypes, char **input, char **outpu
     // down the operation. My suspicion is that the compiler can more
     // aggressively optimize the compress_internal functions when it KNOWS
     // it has exclusive access to the indirection pointers.
-    compress_internal<Ts...>(nibbles, 0, paramTypes, false, 0,  &in, &out);
+    compress_internal<Ts...>(nibbles, 0, paramTypes, false, 0,  &in, &out,
+                             staticStrings, bases);
     in = *input;
 
     // We make two passes through the arguments, once processing only the
     // non-string types and a second processing only strings. This produces
     // an encoding that keeps all the nibbles closely packed together and
     // is compatible with the legacy pre-processor based NanoLog system.
-    compress_internal<Ts...>(nibbles, 0, paramTypes, true, 0,  &in, &out);
+    compress_internal<Ts...>(nibbles, 0, paramTypes, true, 0,  &in, &out,
+                             staticStrings, bases, internedStrings);
     *input = in;
     *output = out;
 }
 
+/**
+ * Returns how an argument of type T is encoded in the compressed log if it
+ * deviates from what the format specifier would imply (see ArgEncoding).
+ *
+ * \tparam T
+ *      Type of the log argument
+ */
+template<typename T>
+constexpr ArgEncoding
+getArgEncoding() {
+    if (std::is_same<T, NanoLog::StaticString>::value)
+        return STATIC_STRING_ID;
+
+    if (isCodecArgument<T>::value)
+        return CODEC;
+
+    if (isDeltaArgument<T>::value || isXorArgument<T>::value)
+        return DELTA_ENCODED;
+
+    if (isInternedArgument<T>::value)
+        return INTERNED_STRING;
+
+    return DEFAULT_ENCODING;
+}
+
+/**
+ * ArgEncodings of the n-th argument of a log invocation site whose argument
+ * types are Ts. The extra trailing entry is needed since zero length arrays
+ * are not allowed.
+ */
+template<typename... Ts>
+constexpr ArgEncoding argEncodings[] = {getArgEncoding<Ts>()...,
+                                        DEFAULT_ENCODING};
+
+/**
+ * Returns the name of the NanoLog::Codec used to encode an argument of type
+ * T, or nullptr if it is not a CodecArgument.
+ *
+ * \tparam T
+ *      Type of the log argument
+ */
+template<typename T>
+constexpr const char*
+getCodecName() {
+    if constexpr (isCodecArgument<T>::value)
+        return NanoLog::Codec<typename T::Type>::name;
+    else
+        return nullptr;
+}
+
+/**
+ * Codec names of the n-th argument of a log invocation site whose argument
+ * types are Ts (see getCodecName()).
+ */
+template<typename... Ts>
+constexpr const char* codecNames[] = {getCodecName<Ts>()..., nullptr};
+
+/**
+ * Creates the static information of a log invocation site whose arguments
+ * are of types Ts (see log_internal() for the documentation of the rest).
+ */
+template<typename... Ts>
+inline StaticLogInfo
+createStaticLogInfo(const char *filename,
+                    const int linenum,
+                    const LogLevel severity,
+                    const char *format,
+                    const int numNibbles,
+                    const ParamType *paramTypes,
+                    const char* const* fieldNames,
+                    StaticLogInfo::CompressionFn compressFn = &compress<Ts...>)
+{
+    using namespace NanoLogInternal::Log;
+    constexpr size_t N = sizeof...(Ts);
+
+    // Static strings passed to %s specifiers are compressed to ids,
+    // which need nibbles in addition to the ones the format string needs
+    int staticStringNibbles = 0;
+    const ArgEncoding *encodings = nullptr;
+    for (size_t i = 0; i < N; ++i) {
+        if (argEncodings<Ts...>[i] == DEFAULT_ENCODING)
+            continue;
+
+        encodings = argEncodings<Ts...>;
+        if (argEncodings<Ts...>[i] == STATIC_STRING_ID
+                && paramTypes[i] > ParamType::NON_STRING)
+            ++staticStringNibbles;
+    }
+
+    return StaticLogInfo(compressFn,
+                         filename,
+                         linenum,
+                         severity,
+                         format,
+                         N,
+                         numNibbles + staticStringNibbles,
+                         paramTypes,
+                         encodings,
+                         codecNames<Ts...>,
+                         fieldNames);
+}
+
 /**
  * Logs a log message in the NanoLog system given all the static and dynamic
  * information associated with the log message. This function is meant to work
@@ -969,6 +2252,9 @@ compress(int numNibbles, const ParamType *paramTypes, char **input, char **outpu
  * \tparam Ts
  *      Types of the arguments passed in for the log (automatically deduced)
  *
+ * \param logger
+ *      Logger to log to (see NanoLog::createLogger()), or nullptr for the
+ *      default Logger
  * \param logId[in/out]
  *      LogId that should be permanently associated with the static information.
  *      An input value of -1 indicates that NanoLog should persist the static
@@ -988,54 +2274,99 @@ compress(int numNibbles, const ParamType *paramTypes, char **input, char **outpu
  *      An array indicating the type of the n-th format parameter associated
  *      with the format string to be processed.
  *      *** THIS VARIABLE MUST HAVE A STATIC LIFETIME AS PTRS WILL BE SAVED ***
+ * \param fieldNames
+ *      For structured log invocations (i.e. NANO_LOG_KV), the event name
+ *      followed by the name of each argument; nullptr otherwise.
+ *      *** THIS VARIABLE MUST HAVE A STATIC LIFETIME AS PTRS WILL BE SAVED ***
  * \param args
  *      Argument pack for all the arguments for the log invocation
  */
 template<long unsigned int N, int M, typename... Ts>
 inline void
-log(int &logId,
+log_internal(RuntimeLogger *logger,
+    int &logId,
     const char *filename,
     const int linenum,
     const LogLevel severity,
     const char (&format)[M],
     const int numNibbles,
     const std::array<ParamType, N>& paramTypes,
+    const char* const* fieldNames,
     Ts... args)
 {
     using namespace NanoLogInternal::Log;
     assert(N == static_cast<uint32_t>(sizeof...(Ts)));
 
     if (logId == UNASSIGNED_LOGID) {
-        const ParamType *array = paramTypes.data();
-        StaticLogInfo info(&compress<Ts...>,
-                        filename,
-                        linenum,
-                        severity,
-                        format,
-                        sizeof...(Ts),
-                        numNibbles,
-                        array);
-
+        StaticLogInfo info = createStaticLogInfo<Ts...>(filename, linenum,
+                                severity, format, numNibbles,
+                                paramTypes.data(), fieldNames);
         RuntimeLogger::registerInvocationSite(info, logId);
     }
 
     uint64_t previousPrecision = -1;
     uint64_t timestamp = PerfUtils::Cycles::rdtsc();
     size_t stringSizes[N + 1] = {}; //HACK: Zero length arrays are not allowed
-    size_t allocSize = getArgSizes(paramTypes, previousPrecision,
-                            stringSizes, args...) + sizeof(UncompressedEntry);
+    RuntimeLogger::StagingLane lane = RuntimeLogger::STAGING_BUFFER_LANE;
 
-    char *writePos = NanoLogInternal::RuntimeLogger::reserveAlloc(allocSize);
-    auto originalWritePos = writePos;
+    // 'const char*' strings are copied while they're scanned for their
+    // length into space reserved for their longest length, which is trimmed
+    // back to what was used once their lengths are known.
+    if constexpr ((isCString<Ts>::value || ...)) {
+        size_t maxAllocSize = getArgBounds(paramTypes, previousPrecision,
+                            stringSizes, args...) + sizeof(UncompressedEntry);
 
-    UncompressedEntry *ue = new(writePos) UncompressedEntry();
-    writePos += sizeof(UncompressedEntry);
+        char *writePos = (logger == nullptr)
+                ? RuntimeLogger::reserveAlloc(maxAllocSize, severity, lane)
+                : logger->reserveInstanceAlloc(maxAllocSize);
+        if (writePos == nullptr)
+            return;
 
-    store_arguments(paramTypes, stringSizes, &writePos, args...);
+        auto originalWritePos = writePos;
+        UncompressedEntry *ue = new(writePos) UncompressedEntry();
+        writePos += sizeof(UncompressedEntry);
 
-    ue->fmtId = logId;
-    ue->timestamp = timestamp;
-    ue->entrySize = downCast<uint32_t>(allocSize);
+        if (capture_arguments(paramTypes, stringSizes, &writePos, args...)) {
+            size_t allocSize = writePos - originalWritePos;
+            ue->fmtId = logId;
+            ue->timestamp = timestamp;
+            ue->entrySize = downCast<uint32_t>(allocSize);
+
+            if (logger == nullptr) {
+                RuntimeLogger::trimAlloc(maxAllocSize - allocSize, lane);
+                RuntimeLogger::finishAlloc(allocSize, severity, lane);
+            } else {
+                logger->finishInstanceAlloc(allocSize);
+            }
+            return;
+        }
+
+        // A string was longer than the space reserved for it, so give the
+        // space back and size the arguments before storing them instead.
+        if (logger == nullptr)
+            RuntimeLogger::trimAlloc(maxAllocSize, lane);
+        previousPrecision = -1;
+    }
+
+    size_t allocSize = getArgSizes(paramTypes, previousPrecision,
+                            stringSizes, args...) + sizeof(UncompressedEntry);
+
+    char *writePos = (logger == nullptr)
+            ? RuntimeLogger::reserveAlloc(allocSize, severity, lane)
+            : logger->reserveInstanceAlloc(allocSize);
+    if (writePos == nullptr)
+        return;
+
+    auto originalWritePos = writePos;
+
+    UncompressedEntry *ue = new(writePos) UncompressedEntry();
+    writePos += sizeof(UncompressedEntry);
+
+    store_arguments(paramTypes, stringSizes, &writePos, args...);
+
+    ue->fmtId = logId;
+    ue->timestamp = timestamp;
+    ue->entrySize = downCast<uint32_t>(allocSize);
 
 #ifdef ENABLE_DEBUG_PRINTING
     printf("\r\nRecording %d:'%s' of size %u\r\n",
@@ -1043,7 +2374,257 @@ log(int &logId,
 #endif
 
     assert(allocSize == downCast<uint32_t>((writePos - originalWritePos)));
-    NanoLogInternal::RuntimeLogger::finishAlloc(allocSize);
+    if (logger == nullptr)
+        RuntimeLogger::finishAlloc(allocSize, severity, lane);
+    else
+        logger->finishInstanceAlloc(allocSize);
+}
+
+/**
+ * Converts a log argument to the type it is recorded as. Strings whose
+ * length is already known (i.e. std::string and spans of characters) are
+ * converted to std::string_view to avoid rescanning them for their length
+ * and copying them into the argument pack. Types with a NanoLog::Codec are
+ * wrapped in a CodecArgument. All other arguments pass through unchanged.
+ *
+ * \param arg
+ *      Log argument to convert
+ */
+template<typename T>
+constexpr typename std::enable_if<!hasCodec<T>::value, const T&>::type
+asLogArgument(const T &arg) {
+    return arg;
+}
+
+template<typename T>
+constexpr typename std::enable_if<hasCodec<T>::value, CodecArgument<T>>::type
+asLogArgument(const T &arg) {
+    return CodecArgument<T>{&arg};
+}
+
+inline std::string_view
+asLogArgument(const std::string &arg) {
+    return arg;
+}
+
+#if __cplusplus >= 202002L
+template<std::size_t Extent>
+constexpr std::string_view
+asLogArgument(std::span<const char, Extent> arg) {
+    return std::string_view(arg.data(), arg.size());
+}
+
+template<std::size_t Extent>
+constexpr std::string_view
+asLogArgument(std::span<char, Extent> arg) {
+    return std::string_view(arg.data(), arg.size());
+}
+#endif
+
+/**
+ * Entry point for NANO_LOG() that converts the arguments with asLogArgument()
+ * before logging them with log_internal(). The arguments are taken by
+ * reference so that strings with a known size are never copied.
+ * (See log_internal() for documentation)
+ */
+template<long unsigned int N, int M, typename... Ts>
+inline void
+log(int &logId,
+    const char *filename,
+    const int linenum,
+    const LogLevel severity,
+    const char (&format)[M],
+    const int numNibbles,
+    const std::array<ParamType, N>& paramTypes,
+    const Ts&... args)
+{
+    log_internal(nullptr, logId, filename, linenum, severity, format,
+                 numNibbles, paramTypes, nullptr, asLogArgument(args)...);
+}
+
+/**
+ * Entry point for NANO_LOG_TO(), which logs to the given Logger.
+ * (See log_internal() for documentation)
+ */
+template<long unsigned int N, int M, typename... Ts>
+inline void
+logTo(RuntimeLogger *logger,
+      int &logId,
+      const char *filename,
+      const int linenum,
+      const LogLevel severity,
+      const char (&format)[M],
+      const int numNibbles,
+      const std::array<ParamType, N>& paramTypes,
+      const Ts&... args)
+{
+    log_internal(logger, logId, filename, linenum, severity, format,
+                 numNibbles, paramTypes, nullptr, asLogArgument(args)...);
+}
+
+/**
+ * Entry point for NANO_LOG_PACKED(), which packs the (integer) arguments
+ * directly into the StagingBuffer instead of storing them in full for the
+ * compression thread to pack. The space for the log message is reserved for
+ * the largest packed size and trimmed to the actual size afterwards.
+ * (See log_internal() for documentation)
+ */
+template<long unsigned int N, int M, typename... Ts>
+inline void
+logPacked(int &logId,
+          const char *filename,
+          const int linenum,
+          const LogLevel severity,
+          const char (&format)[M],
+          const int numNibbles,
+          const std::array<ParamType, N>& paramTypes,
+          Ts... args)
+{
+    using namespace NanoLogInternal::Log;
+    static_assert((std::is_integral<Ts>::value && ...),
+                  "NANO_LOG_PACKED() only takes integer arguments");
+    assert(N == static_cast<uint32_t>(sizeof...(Ts)));
+
+    if (logId == UNASSIGNED_LOGID) {
+        StaticLogInfo info = createStaticLogInfo<Ts...>(filename, linenum,
+                                severity, format, numNibbles,
+                                paramTypes.data(), nullptr,
+                                &compressPrepacked<Ts...>);
+        RuntimeLogger::registerInvocationSite(info, logId);
+    }
+
+    uint64_t timestamp = PerfUtils::Cycles::rdtsc();
+    constexpr size_t maxAllocSize = sizeof(UncompressedEntry)
+                                        + getMaxPackedSize<Ts...>();
+
+    RuntimeLogger::StagingLane lane = RuntimeLogger::STAGING_BUFFER_LANE;
+    char *writePos = RuntimeLogger::reserveAlloc(maxAllocSize, severity, lane);
+    if (writePos == nullptr)
+        return;
+
+    auto originalWritePos = writePos;
+
+    UncompressedEntry *ue = new(writePos) UncompressedEntry();
+    writePos += sizeof(UncompressedEntry);
+
+    packIntegerArguments(&writePos, args...);
+    size_t allocSize = writePos - originalWritePos;
+
+    ue->fmtId = logId;
+    ue->timestamp = timestamp;
+    ue->entrySize = downCast<uint32_t>(allocSize);
+
+    RuntimeLogger::trimAlloc(maxAllocSize - allocSize, lane);
+    RuntimeLogger::finishAlloc(allocSize, severity, lane);
+}
+
+/**
+ * Static information of a NANO_LOG_SIGNAL_SAFE() site that's known without
+ * its argument types (see log_internal() for documentation of the fields).
+ */
+struct SignalSafeSiteDescription {
+    const char *filename;
+    int linenum;
+    LogLevel severity;
+    const char *format;
+    int numNibbles;
+    const ParamType *paramTypes;
+};
+
+/**
+ * Instantiates the RuntimeLogger::SignalSafeSite of a NANO_LOG_SIGNAL_SAFE()
+ * as a static data member, which is constructed (and thus queued for
+ * registration) during static initialization rather than on first use.
+ *
+ * \tparam Site
+ *      Type unique to the log invocation site with a static describe()
+ *      function returning its SignalSafeSiteDescription
+ * \tparam Ts
+ *      Types of the arguments the site logs
+ */
+template<typename Site, typename... Ts>
+struct SignalSafeSiteInstance {
+    static RuntimeLogger::SignalSafeSite site;
+};
+
+template<typename Site, typename... Ts>
+RuntimeLogger::SignalSafeSite SignalSafeSiteInstance<Site, Ts...>::site(
+        createStaticLogInfo<Ts...>(Site::describe().filename,
+                                   Site::describe().linenum,
+                                   Site::describe().severity,
+                                   Site::describe().format,
+                                   Site::describe().numNibbles,
+                                   Site::describe().paramTypes,
+                                   nullptr));
+
+/**
+ * Async-signal-safe variant of log_internal() for NANO_LOG_SIGNAL_SAFE().
+ * The site is registered ahead of time (see SignalSafeSiteInstance) and the
+ * log message is staged in the emergency StagingBuffer (see
+ * RuntimeLogger::reserveSignalSafeAlloc()), so this never allocates or locks.
+ * The log message is dropped if its site has yet to be registered or the
+ * emergency StagingBuffer is unavailable.
+ *
+ * \tparam Site
+ *      Type unique to the log invocation site (see SignalSafeSiteInstance)
+ * \param severity
+ *      LogLevel severity of the log invocation
+ * \param paramTypes
+ *      Types of the format parameters (see log_internal())
+ * \param args
+ *      Argument pack for all the arguments for the log invocation
+ */
+template<typename Site, long unsigned int N, typename... Ts>
+inline void
+logSignalSafe_internal(const LogLevel severity,
+                       const std::array<ParamType, N>& paramTypes,
+                       Ts... args)
+{
+    using namespace NanoLogInternal::Log;
+    assert(N == static_cast<uint32_t>(sizeof...(Ts)));
+
+    RuntimeLogger::SignalSafeSite &site =
+                                    SignalSafeSiteInstance<Site, Ts...>::site;
+    if (!site.registered) {
+        RuntimeLogger::dropSignalSafeLog();
+        return;
+    }
+    Fence::lfence(); // Pairs with the registration's sfence for the logId
+
+    uint64_t previousPrecision = -1;
+    uint64_t timestamp = PerfUtils::Cycles::rdtsc();
+    size_t stringSizes[N + 1] = {}; //HACK: Zero length arrays are not allowed
+    size_t allocSize = getArgSizes(paramTypes, previousPrecision,
+                            stringSizes, args...) + sizeof(UncompressedEntry);
+
+    char *writePos = RuntimeLogger::reserveSignalSafeAlloc(allocSize,
+                                                           severity);
+    if (writePos == nullptr)
+        return;
+
+    UncompressedEntry *ue = new(writePos) UncompressedEntry();
+    writePos += sizeof(UncompressedEntry);
+
+    store_arguments(paramTypes, stringSizes, &writePos, args...);
+
+    ue->fmtId = site.logId;
+    ue->timestamp = timestamp;
+    ue->entrySize = downCast<uint32_t>(allocSize);
+
+    RuntimeLogger::finishSignalSafeAlloc(allocSize);
+}
+
+/**
+ * Entry point for NANO_LOG_SIGNAL_SAFE() that converts the arguments with
+ * asLogArgument() (see log()).
+ */
+template<typename Site, long unsigned int N, typename... Ts>
+inline void
+logSignalSafe(const LogLevel severity,
+              const std::array<ParamType, N>& paramTypes,
+              const Ts&... args)
+{
+    logSignalSafe_internal<Site>(severity, paramTypes, asLogArgument(args)...);
 }
 
 /**
@@ -1059,6 +2640,568 @@ static void
 NANOLOG_PRINTF_FORMAT_ATTR(1, 2)
 checkFormat(NANOLOG_PRINTF_FORMAT const char *, ...) {}
 
+/**
+ * Converts a log argument to the type printf would see when checking the
+ * format string (i.e. for checkFormat()). Most arguments are passed through
+ * as-is, but wrappers such as NanoLog::StaticString are unwrapped.
+ *
+ * \param arg
+ *      Log argument to convert
+ */
+template<typename T>
+constexpr typename std::enable_if<!hasCodec<T>::value, T>::type
+printfArg(T arg) {
+    return arg;
+}
+
+// Types with a NanoLog::Codec are rendered as strings (i.e. with %s)
+template<typename T>
+constexpr typename std::enable_if<hasCodec<T>::value, const char*>::type
+printfArg(const T &) {
+    return "";
+}
+
+constexpr const char*
+printfArg(NanoLog::StaticString arg) {
+    return arg.str;
+}
+
+template<typename T>
+constexpr T
+printfArg(NanoLog::Delta<T> arg) {
+    return arg.value;
+}
+
+inline const char*
+printfArg(const std::string &arg) {
+    return arg.c_str();
+}
+
+constexpr const char*
+printfArg(std::string_view arg) {
+    return arg.data();
+}
+
+#if __cplusplus >= 202002L
+constexpr const char*
+printfArg(std::span<const char> arg) {
+    return arg.data();
+}
+#endif
+
+
+/**
+ * Converts a NANO_LOG_KV() value to the type it is logged as. Enumerations
+ * are logged as their underlying integer, booleans as 0 or 1 and everything
+ * else is converted as in NANO_LOG() (see asLogArgument()).
+ *
+ * \param value
+ *      Value to convert
+ */
+template<typename T>
+constexpr typename std::enable_if<!std::is_enum<T>::value, const T&>::type
+asKeyValueArgument(const T &value) {
+    return value;
+}
+
+template<typename T>
+constexpr typename std::enable_if<std::is_enum<T>::value,
+                                  typename std::underlying_type<T>::type>::type
+asKeyValueArgument(const T &value) {
+    return static_cast<typename std::underlying_type<T>::type>(value);
+}
+
+constexpr int
+asKeyValueArgument(bool value) {
+    return value;
+}
+
+/**
+ * Returns the printf specifier that NANO_LOG_KV() records a value with,
+ * given the type T the value is logged as (see asKeyValueArgument()).
+ *
+ * \tparam T
+ *      Type of the value
+ */
+template<typename T>
+constexpr const char*
+getKeyValueSpecifier() {
+    using U = typename std::decay<T>::type;
+    if constexpr (isDeltaArgument<U>::value) {
+        return getKeyValueSpecifier<typename U::Type>();
+    } else if constexpr (std::is_same<U, NanoLog::Bytes>::value) {
+        return "%B";
+    } else if constexpr (isCodecArgument<U>::value
+                            || std::is_same<U, NanoLog::StaticString>::value
+                            || std::is_same<U, std::string_view>::value
+                            || std::is_same<U, const char*>::value
+                            || std::is_same<U, char*>::value) {
+        return "%s";
+    } else if constexpr (std::is_same<U, const wchar_t*>::value
+                            || std::is_same<U, wchar_t*>::value) {
+        return "%ls";
+    } else if constexpr (std::is_pointer<U>::value) {
+        return "%p";
+    } else if constexpr (std::is_same<U, char>::value) {
+        return "%c";
+    } else if constexpr (std::is_same<U, long double>::value) {
+        return "%Lf";
+    } else if constexpr (std::is_floating_point<U>::value) {
+        return "%lf";
+    } else if constexpr (std::is_integral<U>::value && std::is_signed<U>::value) {
+        return (sizeof(U) == 1) ? "%hhd" : (sizeof(U) == 2) ? "%hd"
+                : (sizeof(U) == 4) ? "%d" : "%lld";
+    } else if constexpr (std::is_integral<U>::value) {
+        return (sizeof(U) == 1) ? "%hhu" : (sizeof(U) == 2) ? "%hu"
+                : (sizeof(U) == 4) ? "%u" : "%llu";
+    } else {
+        return nullptr;
+    }
+}
+
+/**
+ * printf format string synthesized for the values of a NANO_LOG_KV()
+ * invocation whose values are logged as types Ts. It consists solely of the
+ * specifiers of the values (ex. "%d%s"); the event and field names are
+ * stored separately in the dictionary.
+ */
+template<typename... Ts>
+struct KeyValueFormat {
+    char str[(std::char_traits<char>::length(getKeyValueSpecifier<Ts>())
+                                                                + ... + 1)];
+};
+
+template<typename... Ts>
+constexpr KeyValueFormat<Ts...>
+makeKeyValueFormat() {
+    KeyValueFormat<Ts...> format{};
+    const char *specifiers[] = {getKeyValueSpecifier<Ts>()..., ""};
+
+    size_t pos = 0;
+    for (const char *specifier : specifiers) {
+        while (*specifier != '\0')
+            format.str[pos++] = *specifier++;
+    }
+
+    format.str[pos] = '\0';
+    return format;
+}
+
+template<typename... Ts>
+constexpr KeyValueFormat<Ts...> keyValueFormat = makeKeyValueFormat<Ts...>();
+
+/**
+ * Types of the parameters of keyValueFormat<Ts...> (see analyzeFormatString()).
+ * These are shared by all NANO_LOG_KV() invocations with the same value types.
+ */
+template<typename... Ts>
+constexpr std::array<ParamType, sizeof...(Ts)> keyValueParamTypes =
+        analyzeFormatString<sizeof...(Ts)>(keyValueFormat<Ts...>.str);
+
+/**
+ * Checks whether T is the type of a string literal, as required for
+ * NANO_LOG_KV() event and field names.
+ */
+template<typename T>
+constexpr bool
+isStringLiteral() {
+    return std::is_array<T>::value && std::is_same<
+            typename std::remove_cv<typename std::remove_extent<T>::type>::type,
+            char>::value;
+}
+
+/**
+ * Returns (as the type of an std::integral_constant) the number of names in
+ * a NANO_LOG_KV() invocation, i.e. the event name and one name per field.
+ * This is only used in unevaluated contexts to size the names array.
+ */
+template<typename... Ts>
+std::integral_constant<size_t, (sizeof...(Ts) + 1) / 2>
+countKeyValueNames(const Ts&...);
+
+/**
+ * Helper to logKeyValues() that logs the values of a structured log message
+ * once they are converted to the types they are logged as (Ts).
+ * (See logKeyValues() for documentation)
+ */
+template<size_t F, typename... Ts>
+inline void
+logKeyValueArguments(int &logId,
+                     const char *(&fieldNames)[F],
+                     const char *filename,
+                     const int linenum,
+                     const LogLevel severity,
+                     Ts... values)
+{
+    static_assert(((getKeyValueSpecifier<Ts>() != nullptr) && ... && true),
+            "NANO_LOG_KV() values must be strings, pointers, arithmetic types,"
+            " enumerations, NanoLog::Bytes or types with a NanoLog::Codec");
+
+    constexpr auto &format = keyValueFormat<Ts...>;
+    constexpr int numNibbles = getNumNibblesNeeded(format.str);
+
+    log_internal(nullptr, logId, filename, linenum, severity, format.str,
+                 numNibbles, keyValueParamTypes<Ts...>, fieldNames, values...);
+}
+
+/**
+ * Helper to logKeyValues() that splits the alternating field names and
+ * values into the names array and the log arguments.
+ * (See logKeyValues() for documentation)
+ */
+template<size_t F, typename... Ts, size_t... Is>
+inline void
+logKeyValuesHelper(int &logId,
+                   const char *(&fieldNames)[F],
+                   const char *filename,
+                   const int linenum,
+                   const LogLevel severity,
+                   const char *event,
+                   std::index_sequence<Is...>,
+                   const std::tuple<const Ts&...> &keyValues)
+{
+    static_assert(F == sizeof...(Is) + 1, "Mismatched NANO_LOG_KV() names");
+    static_assert((isStringLiteral<typename std::tuple_element<2*Is,
+                            std::tuple<Ts...>>::type>() && ... && true),
+            "NANO_LOG_KV() field names must be string literals");
+
+    if (logId == UNASSIGNED_LOGID) {
+        fieldNames[0] = event;
+        ((fieldNames[Is + 1] = std::get<2*Is>(keyValues)), ...);
+    }
+
+    logKeyValueArguments(logId, fieldNames, filename, linenum, severity,
+                         asLogArgument(asKeyValueArgument(
+                                std::get<2*Is + 1>(keyValues)))...);
+}
+
+/**
+ * Entry point for NANO_LOG_KV() that logs a structured log message, i.e.
+ * an event name and alternating field names and values. The printf format
+ * string is synthesized from the types of the values and the names are
+ * persisted once in the dictionary, so only the values are logged at runtime.
+ *
+ * \param logId[in/out]
+ *      LogId that should be permanently associated with the invocation site
+ *      (see log_internal())
+ * \param fieldNames
+ *      Storage for the event name and field names of the invocation site;
+ *      it is filled in when the site is first registered.
+ *      *** THIS VARIABLE MUST HAVE A STATIC LIFETIME AS PTRS WILL BE SAVED ***
+ * \param filename
+ *      Name of the file containing the log invocation
+ * \param linenum
+ *      Line number within filename of the log invocation.
+ * \param severity
+ *      LogLevel severity of the log invocation
+ * \param event
+ *      Name of the event (must be a string literal)
+ * \param keyValues
+ *      Alternating field names (must be string literals) and values
+ */
+template<size_t F, size_t E, typename... Ts>
+inline void
+logKeyValues(int &logId,
+             const char *(&fieldNames)[F],
+             const char *filename,
+             const int linenum,
+             const LogLevel severity,
+             const char (&event)[E],
+             const Ts&... keyValues)
+{
+    static_assert(sizeof...(Ts) % 2 == 0,
+            "NANO_LOG_KV() expects a field name followed by a value per field");
+
+    logKeyValuesHelper(logId, fieldNames, filename, linenum, severity, event,
+                       std::make_index_sequence<sizeof...(Ts) / 2>{},
+                       std::tuple<const Ts&...>(keyValues...));
+}
+
+/**
+ * Invocation sites of the begin and end events of a NANO_LOG_SPAN(); each
+ * expansion of the macro owns one with a static lifetime.
+ */
+struct SpanSite {
+    // LogIds of the begin and end events (see log_internal())
+    int beginLogId;
+    int endLogId;
+
+    // Span name and field name of the begin and end events (see logKeyValues())
+    const char *beginNames[2];
+    const char *endNames[2];
+};
+
+/**
+ * RAII object created by NANO_LOG_SPAN() that logs a begin event when it is
+ * constructed and an end event when it goes out of scope. Both are logged as
+ * structured log messages of the span's name with a single field holding the
+ * span's identifier, which is unique within the thread. The decompressor
+ * pairs the events by thread and identifier and derives the span's duration
+ * from the events' timestamps.
+ */
+class ScopedSpan {
+PRIVATE:
+    // Invocation sites of the span's events
+    SpanSite &site;
+
+    // Location and severity of the NANO_LOG_SPAN() invocation
+    const char *filename;
+    const int linenum;
+    const LogLevel severity;
+
+    // Identifier of the span within the thread
+    uint32_t spanId;
+
+    // Indicates that the begin event was logged, so the end event must be too
+    bool active;
+
+    /**
+     * Returns a new span identifier for the calling thread.
+     */
+    static inline uint32_t
+    nextSpanId() {
+        static __thread uint32_t lastSpanId = 0;
+        return ++lastSpanId;
+    }
+
+PUBLIC:
+    /**
+     * Begins a span and logs its begin event (if the severity is enabled).
+     *
+     * \param site
+     *      Invocation sites of the span's events
+     *      *** THIS VARIABLE MUST HAVE A STATIC LIFETIME AS PTRS WILL BE SAVED ***
+     * \param filename
+     *      Name of the file containing the NANO_LOG_SPAN() invocation
+     * \param linenum
+     *      Line number within filename of the NANO_LOG_SPAN() invocation
+     * \param severity
+     *      LogLevel severity of the span's events
+     * \param name
+     *      Name of the span (must be a string literal)
+     */
+    template<size_t N>
+    ScopedSpan(SpanSite &site, const char *filename, const int linenum,
+               const LogLevel severity, const char (&name)[N])
+        : site(site)
+        , filename(filename)
+        , linenum(linenum)
+        , severity(severity)
+        , spanId(0)
+        , active(false)
+    {
+        if (!RuntimeLogger::isRecorded(severity))
+            return;
+
+        if (site.beginLogId == UNASSIGNED_LOGID) {
+            site.beginNames[0] = name;
+            site.beginNames[1] = SPAN_BEGIN_FIELD;
+        }
+
+        if (site.endLogId == UNASSIGNED_LOGID) {
+            site.endNames[0] = name;
+            site.endNames[1] = SPAN_END_FIELD;
+        }
+
+        spanId = nextSpanId();
+        active = true;
+        logKeyValueArguments(site.beginLogId, site.beginNames, filename,
+                             linenum, severity, spanId);
+    }
+
+    /**
+     * Ends the span and logs its end event.
+     */
+    ~ScopedSpan() {
+        if (active)
+            logKeyValueArguments(site.endLogId, site.endNames, filename,
+                                 linenum, severity, spanId);
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedSpan);
+};
+
+/**
+ * Thread-local pre-aggregator for a NANO_METRIC_COUNTER() or
+ * NANO_METRIC_GAUGE() invocation site. Updates are accumulated in the
+ * logging thread and only logged (as a structured log message of the
+ * metric's name with a single "counter" or "gauge" field) on the first
+ * update after the compression thread starts a new pass through the
+ * StagingBuffers. Thus, a counter increment usually costs an addition
+ * rather than a log message.
+ *
+ * Counters log the sum of their deltas since the last log message and
+ * gauges log their latest value. The pending updates of a thread are also
+ * logged by NanoLog::flushMetrics() and when the thread exits.
+ */
+class MetricAggregator {
+PRIVATE:
+    // LogId of the invocation site (see log_internal())
+    int &logId;
+
+    // Metric name and field name of the invocation site (see logKeyValues())
+    const char *(&fieldNames)[2];
+
+    // Location of the invocation site
+    const char *filename;
+    const int linenum;
+
+    // Indicates that the site is a NANO_METRIC_GAUGE()
+    const bool isGauge;
+
+    // Indicates that there are updates that have not been logged yet
+    bool pending;
+
+    // Sum of the counter's deltas that have not been logged yet
+    int64_t count;
+
+    // Latest value of the gauge
+    double gauge;
+
+    // Compression pass during which the updates were last logged
+    uint32_t lastPass;
+
+    // Next aggregator of the thread (see getThreadAggregators())
+    MetricAggregator *next;
+
+    /**
+     * Returns the head of the calling thread's list of aggregators.
+     */
+    static inline MetricAggregator *&
+    getThreadAggregators() {
+        static __thread MetricAggregator *threadAggregators = nullptr;
+        return threadAggregators;
+    }
+
+    /**
+     * Logs the pending updates once the compression thread has moved on to
+     * a new pass since the last time they were logged.
+     */
+    inline void
+    maybeFlush() {
+        if (lastPass != RuntimeLogger::getCompressionPasses())
+            flush();
+    }
+
+PUBLIC:
+    /**
+     * Creates the calling thread's aggregator for an invocation site.
+     *
+     * \param logId
+     *      LogId of the invocation site
+     * \param fieldNames
+     *      Storage for the metric name and field name of the invocation site
+     *      *** THESE VARIABLES MUST HAVE A STATIC LIFETIME AS PTRS WILL BE SAVED ***
+     * \param filename
+     *      Name of the file containing the invocation site
+     * \param linenum
+     *      Line number within filename of the invocation site
+     * \param isGauge
+     *      Whether the site is a NANO_METRIC_GAUGE()
+     * \param name
+     *      Name of the metric (must be a string literal)
+     */
+    template<size_t N>
+    MetricAggregator(int &logId, const char *(&fieldNames)[2],
+                     const char *filename, const int linenum,
+                     const bool isGauge, const char (&name)[N])
+        : logId(logId)
+        , fieldNames(fieldNames)
+        , filename(filename)
+        , linenum(linenum)
+        , isGauge(isGauge)
+        , pending(false)
+        , count(0)
+        , gauge(0)
+        , lastPass(RuntimeLogger::getCompressionPasses())
+        , next(getThreadAggregators())
+    {
+        if (logId == UNASSIGNED_LOGID) {
+            fieldNames[0] = name;
+            fieldNames[1] = (isGauge) ? METRIC_GAUGE_FIELD
+                                      : METRIC_COUNTER_FIELD;
+        }
+
+        // Allocating the StagingBuffer first ensures that it outlives this
+        // thread_local, so the destructor below can still log.
+        RuntimeLogger::preallocate();
+        getThreadAggregators() = this;
+    }
+
+    /**
+     * Logs the pending updates and removes the aggregator from the thread's
+     * list; this happens when the thread exits.
+     */
+    ~MetricAggregator() {
+        flush();
+
+        MetricAggregator **it = &getThreadAggregators();
+        while (*it != nullptr && *it != this)
+            it = &(*it)->next;
+
+        if (*it != nullptr)
+            *it = next;
+    }
+
+    /**
+     * Adds a delta to a counter.
+     *
+     * \param delta
+     *      Amount to add to the counter
+     */
+    inline void
+    add(int64_t delta) {
+        count += delta;
+        pending = true;
+        maybeFlush();
+    }
+
+    /**
+     * Sets the value of a gauge.
+     *
+     * \param value
+     *      New value of the gauge
+     */
+    inline void
+    set(double value) {
+        gauge = value;
+        pending = true;
+        maybeFlush();
+    }
+
+    /**
+     * Logs the pending updates, if any.
+     */
+    void
+    flush() {
+        lastPass = RuntimeLogger::getCompressionPasses();
+        if (!pending)
+            return;
+
+        // Metrics have no severity so that they're always output
+        if (isGauge)
+            logKeyValueArguments(logId, fieldNames, filename, linenum,
+                                 SILENT_LOG_LEVEL, gauge);
+        else
+            logKeyValueArguments(logId, fieldNames, filename, linenum,
+                                 SILENT_LOG_LEVEL, count);
+
+        pending = false;
+        count = 0;
+    }
+
+    /**
+     * Logs the pending updates of all the calling thread's aggregators.
+     */
+    static void
+    flushThreadAggregators() {
+        for (MetricAggregator *it = getThreadAggregators(); it != nullptr;
+                it = it->next)
+            it->flush();
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(MetricAggregator);
+};
 
 /**
  * NANO_LOG macro used for logging.
@@ -1084,17 +3227,286 @@ checkFormat(NANOLOG_PRINTF_FORMAT const char *, ...) {}
                                 NanoLogInternal::analyzeFormatString<nParams>(format); \
     static int logId = NanoLogInternal::UNASSIGNED_LOGID; \
     \
-    if (NanoLog::severity > NanoLog::getLogLevel()) \
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(NanoLog::severity)) \
         break; \
     \
     /* Triggers the GNU printf checker by passing it into a no-op function.
      * Trick: This call is surrounded by an if false so that the VA_ARGS don't
-     * evaluate for cases like '++i'.*/ \
-    if (false) { NanoLogInternal::checkFormat(format, ##__VA_ARGS__); } /*NOLINT(cppcoreguidelines-pro-type-vararg, hicpp-vararg)*/\
+     * evaluate for cases like '++i'. The arguments are passed through a
+     * lambda so that wrapper types can be unwrapped with printfArg().
+     * The GNU checker doesn't know %B, so such formats are only checked for
+     * matching NanoLog::bytes() arguments. */ \
+    if (false) { \
+        [](auto... args) { \
+            static_assert(NanoLogInternal::checkBlobArguments< \
+                                                decltype(args)...>(format), \
+                    "NanoLog::bytes() arguments must match %B specifiers"); \
+            if constexpr (!NanoLogInternal::hasBlobSpecifier(format)) \
+                NanoLogInternal::checkFormat(format, \
+                        NanoLogInternal::printfArg(args)...); \
+        }(__VA_ARGS__); \
+    } /*NOLINT(cppcoreguidelines-pro-type-vararg, hicpp-vararg)*/\
     \
     NanoLogInternal::log(logId, __FILE__, __LINE__, NanoLog::severity, format, \
                             numNibbles, paramTypes, ##__VA_ARGS__); \
 } while(0)
+
+/**
+ * NANO_LOG_TO macro used for logging to a Logger other than the default one
+ * (see NanoLog::createLogger()). The log invocation sites are shared by all
+ * Loggers, so the same NANO_LOG_TO() may log to different Loggers.
+ *
+ * \param logger
+ *      NanoLog::Logger* to log to
+ * \param severity
+ *      The LogLevel of the log invocation (must be constant)
+ * \param format
+ *      printf-like format string (must be literal)
+ * \param ...
+ *      Log arguments associated with the printf-like string.
+ */
+#define NANO_LOG_TO(logger, severity, format, ...) do { \
+    constexpr int numNibbles = NanoLogInternal::getNumNibblesNeeded(format); \
+    constexpr int nParams = NanoLogInternal::countFmtParams(format); \
+    \
+    /* These must be 'static' (see NANO_LOG) */ \
+    static constexpr std::array<NanoLogInternal::ParamType, nParams> paramTypes = \
+                                NanoLogInternal::analyzeFormatString<nParams>(format); \
+    static int logId = NanoLogInternal::UNASSIGNED_LOGID; \
+    \
+    NanoLog::Logger *nanoLogTarget = (logger); \
+    if (!nanoLogTarget->isInstanceRecorded(NanoLog::severity)) \
+        break; \
+    \
+    /* Checks the format string (see NANO_LOG) */ \
+    if (false) { \
+        [](auto... args) { \
+            static_assert(NanoLogInternal::checkBlobArguments< \
+                                                decltype(args)...>(format), \
+                    "NanoLog::bytes() arguments must match %B specifiers"); \
+            if constexpr (!NanoLogInternal::hasBlobSpecifier(format)) \
+                NanoLogInternal::checkFormat(format, \
+                        NanoLogInternal::printfArg(args)...); \
+        }(__VA_ARGS__); \
+    } /*NOLINT(cppcoreguidelines-pro-type-vararg, hicpp-vararg)*/\
+    \
+    NanoLogInternal::logTo(nanoLogTarget, logId, __FILE__, __LINE__, \
+                           NanoLog::severity, format, numNibbles, paramTypes, \
+                           ##__VA_ARGS__); \
+} while(0)
+
+/**
+ * NANO_LOG_PACKED macro, a variant of NANO_LOG for log messages that take
+ * only integers (i.e. counters and identifiers). The arguments are packed
+ * into their compressed form by the logging thread, which takes a few more
+ * instructions than storing them in full but uses a fraction of the
+ * StagingBuffer space and leaves the compression thread only a copy.
+ *
+ * \param severity
+ *      The LogLevel of the log invocation (must be constant)
+ * \param format
+ *      printf-like format string (must be literal)
+ * \param ...
+ *      Integer log arguments associated with the printf-like string.
+ */
+#define NANO_LOG_PACKED(severity, format, ...) do { \
+    constexpr int numNibbles = NanoLogInternal::getNumNibblesNeeded(format); \
+    constexpr int nParams = NanoLogInternal::countFmtParams(format); \
+    \
+    /* These must be 'static' (see NANO_LOG) */ \
+    static constexpr std::array<NanoLogInternal::ParamType, nParams> paramTypes = \
+                                NanoLogInternal::analyzeFormatString<nParams>(format); \
+    static int logId = NanoLogInternal::UNASSIGNED_LOGID; \
+    \
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(NanoLog::severity)) \
+        break; \
+    \
+    /* Checks the format string (see NANO_LOG) */ \
+    if (false) { \
+        NanoLogInternal::checkFormat(format, ##__VA_ARGS__); \
+    } /*NOLINT(cppcoreguidelines-pro-type-vararg, hicpp-vararg)*/\
+    \
+    NanoLogInternal::logPacked(logId, __FILE__, __LINE__, NanoLog::severity, \
+                               format, numNibbles, paramTypes, \
+                               ##__VA_ARGS__); \
+} while(0)
+
+/**
+ * NANO_LOG_SIGNAL_SAFE macro used for logging from signal handlers (or while
+ * holding locks that NANO_LOG() may need, such as the allocator's). It's
+ * async-signal-safe: the log invocation site is registered before main()
+ * and the log message is staged in an emergency buffer shared by all
+ * threads, so it never allocates memory, takes locks or blocks. In return,
+ * the log message is dropped if the emergency buffer is full or in use by
+ * another signal handler, or if it is logged before the compression thread
+ * has registered the site (i.e. very early in main()). The number of log
+ * messages dropped is reported in NanoLog::getStats().
+ *
+ * The log messages are output as any other.
+ *
+ * \param severity
+ *      The LogLevel of the log invocation (must be constant)
+ * \param format
+ *      printf-like format string (must be literal)
+ * \param ...
+ *      Log arguments associated with the printf-like string.
+ */
+#define NANO_LOG_SIGNAL_SAFE(severity, format, ...) do { \
+    constexpr int numNibbles = NanoLogInternal::getNumNibblesNeeded(format); \
+    constexpr int nParams = NanoLogInternal::countFmtParams(format); \
+    \
+    /* The paramTypes must be 'static' (see NANO_LOG) and NanoLogSite gives
+     * the site a unique type, with which the site is instantiated statically
+     * (see NanoLogInternal::SignalSafeSiteInstance). */ \
+    static constexpr std::array<NanoLogInternal::ParamType, nParams> paramTypes = \
+                                NanoLogInternal::analyzeFormatString<nParams>(format); \
+    struct NanoLogSite { \
+        static constexpr NanoLogInternal::SignalSafeSiteDescription describe() { \
+            return {__FILE__, __LINE__, NanoLog::severity, format, numNibbles, \
+                    paramTypes.data()}; \
+        } \
+    }; \
+    \
+    /* Checks the format string (see NANO_LOG) */ \
+    if (false) { \
+        [](auto... args) { \
+            static_assert(NanoLogInternal::checkBlobArguments< \
+                                                decltype(args)...>(format), \
+                    "NanoLog::bytes() arguments must match %B specifiers"); \
+            if constexpr (!NanoLogInternal::hasBlobSpecifier(format)) \
+                NanoLogInternal::checkFormat(format, \
+                        NanoLogInternal::printfArg(args)...); \
+        }(__VA_ARGS__); \
+    } /*NOLINT(cppcoreguidelines-pro-type-vararg, hicpp-vararg)*/\
+    \
+    NanoLogInternal::logSignalSafe<NanoLogSite>(NanoLog::severity, paramTypes, \
+                                                ##__VA_ARGS__); \
+} while(0)
+
+/**
+ * NANO_LOG_KV macro used for structured logging. Instead of a format string,
+ * it takes an event name followed by alternating field names and values.
+ * The names are stored once in the log's dictionary and only the values are
+ * logged at runtime, so the decompressor can output the fields directly
+ * (i.e. as JSON or CSV). In text, the message reads "event name=value ...".
+ *
+ * Ex: NANO_LOG_KV(NOTICE, "order_fill", "id", id, "px", px, "qty", qty);
+ *
+ * \param severity
+ *      The LogLevel of the log invocation (must be constant)
+ * \param event
+ *      Name of the event (must be a string literal)
+ * \param ...
+ *      Alternating field names (must be string literals) and values
+ */
+#define NANO_LOG_KV(severity, event, ...) do { \
+    /* Both must be 'static' so that they persist beyond the invocation
+     * (see NANO_LOG). The names array is sized without evaluating the
+     * arguments. */ \
+    static int logId = NanoLogInternal::UNASSIGNED_LOGID; \
+    static const char *fieldNames[decltype(NanoLogInternal:: \
+                        countKeyValueNames(event, ##__VA_ARGS__))::value]; \
+    \
+    if (!NanoLogInternal::RuntimeLogger::isRecorded(NanoLog::severity)) \
+        break; \
+    \
+    NanoLogInternal::logKeyValues(logId, fieldNames, __FILE__, __LINE__, \
+                                  NanoLog::severity, event, ##__VA_ARGS__); \
+} while(0)
+
+/**
+ * Common implementation of NANO_METRIC_COUNTER() and NANO_METRIC_GAUGE()
+ * that creates the site's static state and the thread's MetricAggregator on
+ * first use and applies the update.
+ */
+#define NANO_METRIC_UPDATE(name, isGauge, update) do { \
+    /* The logId and names must be 'static' so that they persist beyond the
+     * invocation (see NANO_LOG) and the aggregator is per-thread. */ \
+    static int logId = NanoLogInternal::UNASSIGNED_LOGID; \
+    static const char *fieldNames[2]; \
+    static thread_local NanoLogInternal::MetricAggregator aggregator( \
+                    logId, fieldNames, __FILE__, __LINE__, isGauge, name); \
+    aggregator.update; \
+} while(0)
+
+/**
+ * NANO_METRIC_COUNTER macro used to count events. The deltas are summed in
+ * the logging thread and logged at most once per pass of the compression
+ * thread (see NanoLogInternal::MetricAggregator). The counter is logged as
+ * a structured log message of the metric's name with a "counter" field and
+ * the decompressor's "metrics" command reconstructs its time series.
+ *
+ * Ex: NANO_METRIC_COUNTER("rpcs_handled", 1);
+ *
+ * \param name
+ *      Name of the metric (must be a string literal)
+ * \param delta
+ *      Integer amount to add to the counter
+ */
+#define NANO_METRIC_COUNTER(name, delta) \
+    NANO_METRIC_UPDATE(name, false, add(static_cast<int64_t>(delta)))
+
+/**
+ * NANO_METRIC_GAUGE macro used to record a value that varies over time. Only
+ * the latest value is logged per pass of the compression thread (see
+ * NANO_METRIC_COUNTER).
+ *
+ * Ex: NANO_METRIC_GAUGE("queue_depth", queue.size());
+ *
+ * \param name
+ *      Name of the metric (must be a string literal)
+ * \param value
+ *      Arithmetic value of the gauge
+ */
+#define NANO_METRIC_GAUGE(name, value) \
+    NANO_METRIC_UPDATE(name, true, set(static_cast<double>(value)))
+
+// Helpers to give the variables declared by NANO_LOG_SPAN() unique names
+#define NANO_LOG_SPAN_CONCAT_(a, b) a##b
+#define NANO_LOG_SPAN_CONCAT(a, b) NANO_LOG_SPAN_CONCAT_(a, b)
+
+/**
+ * NANO_LOG_SPAN macro used to measure the latency of a scope. It logs a
+ * begin event when the invocation is reached and an end event when the
+ * enclosing scope exits, both as structured log messages of the span's name
+ * (see NANO_LOG_KV). The decompressor's "spans" command pairs the events
+ * and reports the latency percentiles of each span name.
+ *
+ * Only one span may be started per line.
+ *
+ * Ex: NANO_LOG_SPAN(NOTICE, "handle_rpc");
+ *
+ * \param severity
+ *      The LogLevel of the span's events (must be constant)
+ * \param name
+ *      Name of the span (must be a string literal)
+ */
+#define NANO_LOG_SPAN(severity, name) \
+    NanoLogInternal::ScopedSpan NANO_LOG_SPAN_CONCAT(nanoLogSpan, __LINE__)( \
+        []() -> NanoLogInternal::SpanSite& { \
+            /* Static so that it persists beyond the invocation (see
+             * NANO_LOG); each expansion has its own lambda and site. */ \
+            static NanoLogInternal::SpanSite site = { \
+                    NanoLogInternal::UNASSIGNED_LOGID, \
+                    NanoLogInternal::UNASSIGNED_LOGID, {}, {}}; \
+            return site; \
+        }(), __FILE__, __LINE__, NanoLog::severity, name)
 } /* Namespace NanoLogInternal */
 
+namespace NanoLog {
+
+/**
+ * Logs the updates that the calling thread's NANO_METRIC_COUNTER() and
+ * NANO_METRIC_GAUGE() invocations have aggregated but not yet logged.
+ * Updates are otherwise logged lazily on the thread's next update after
+ * each pass of the compression thread, so this should be invoked before
+ * sync() if the latest values must be in the log.
+ */
+inline void
+flushMetrics() {
+    NanoLogInternal::MetricAggregator::flushThreadAggregators();
+}
+
+}; // namespace NanoLog
+
 #endif //NANOLOG_CPP17_H
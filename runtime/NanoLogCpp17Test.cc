@@ -13,6 +13,11 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <fstream>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "gtest/gtest.h"
 
 #include "TestUtil.h"
@@ -20,6 +25,46 @@
 #include "RuntimeLogger.h"
 #include "NanoLogCpp17.h"
 
+namespace {
+struct TestPoint {
+    int32_t x;
+    int32_t y;
+};
+
+struct TestBlob {
+    uint8_t length;
+    char data[200];
+};
+}; // namespace
+
+template<>
+struct NanoLog::Codec<TestPoint> : NanoLog::RawCodec<TestPoint> {
+    static constexpr const char *name = "TestPoint";
+};
+
+// Variable length codec that drops the length byte when compressing
+template<>
+struct NanoLog::Codec<TestBlob> {
+    static constexpr const char *name = "TestBlob";
+    static constexpr uint32_t maxSize = 1 + sizeof(TestBlob::data);
+
+    static uint32_t
+    size(const TestBlob &blob) {
+        return 1 + blob.length;
+    }
+
+    static void
+    store(const TestBlob &blob, char *out) {
+        memcpy(out, &blob, size(blob));
+    }
+
+    static uint32_t
+    compress(const char *in, uint32_t length, char *out) {
+        memcpy(out, in + 1, length - 1);
+        return length - 1;
+    }
+};
+
 namespace {
 using namespace NanoLogInternal;
 using namespace PerfUtils;
@@ -643,6 +688,100 @@ TEST_F(NanoLogCpp17Test, getArgSizes) {
                                                      "Seo Jin Park"));
 }
 
+TEST_F(NanoLogCpp17Test, copyString) {
+    char src[64];
+    char dest[64];
+    for (size_t offset = 0; offset < 8; ++offset) {
+        for (size_t length = 0; length < 40; ++length) {
+            memset(src, 'x', sizeof(src));
+            for (size_t i = 0; i < length; ++i)
+                src[offset + i] = static_cast<char>('a' + i);
+            src[offset + length] = '\0';
+
+            for (size_t limit : {0, 1, 7, 8, 9, 15, 16, 17, 33, 39, 63}) {
+                memset(dest, '#', sizeof(dest));
+                size_t copied = copyString(dest, src + offset, limit);
+                ASSERT_EQ(std::min(length, limit), copied);
+                EXPECT_EQ(0, memcmp(dest, src + offset, copied));
+                EXPECT_EQ('#', dest[limit]);
+            }
+        }
+    }
+
+    // Strings ending right before an inaccessible page
+    long pageSize = sysconf(_SC_PAGESIZE);
+    char *pages = static_cast<char*>(mmap(NULL, 2*pageSize,
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    ASSERT_NE(MAP_FAILED, pages);
+    ASSERT_EQ(0, mprotect(pages + pageSize, pageSize, PROT_NONE));
+    memset(pages, 'p', pageSize);
+    pages[pageSize - 1] = '\0';
+    for (size_t length = 0; length < 40; ++length) {
+        const char *str = pages + pageSize - 1 - length;
+        EXPECT_EQ(length, copyString(dest, str, 63));
+        EXPECT_EQ(0, memcmp(dest, str, length));
+    }
+    munmap(pages, 2*pageSize);
+
+    wchar_t wsrc[] = L"wide";
+    EXPECT_EQ(4U, copyString(dest, wsrc, 10));
+    EXPECT_EQ(0, memcmp(dest, wsrc, 4*sizeof(wchar_t)));
+    EXPECT_EQ(2U, copyString(dest, wsrc, 2));
+}
+
+TEST_F(NanoLogCpp17Test, capture_arguments) {
+    const char *shortStr = "Stephen Yang";
+    const wchar_t *wideStr = L"Seo Jin Park";
+    std::string longStr(NanoLogConfig::STRING_CAPTURE_BYTES + 1, 'L');
+    std::string maxStr(NanoLogConfig::STRING_CAPTURE_BYTES, 'M');
+
+    // Captures must be identical to sizing and then storing the arguments
+    auto check = [&](const auto &paramTypes, auto... args) {
+        char expected[1024], actual[1024];
+        uint64_t previousPrecision = -1;
+        size_t stringSizes[10] = {};
+        size_t size = getArgSizes(paramTypes, previousPrecision, stringSizes,
+                                  args...);
+        char *pos = expected;
+        store_arguments(paramTypes, stringSizes, &pos, args...);
+
+        previousPrecision = -1;
+        size_t bound = getArgBounds(paramTypes, previousPrecision,
+                                    stringSizes, args...);
+        EXPECT_LE(size, bound);
+        pos = actual;
+        EXPECT_TRUE(capture_arguments(paramTypes, stringSizes, &pos, args...));
+        EXPECT_EQ(size, static_cast<size_t>(pos - actual));
+        EXPECT_EQ(0, memcmp(expected, actual, size));
+    };
+
+    check(analyzeFormatString<0>("No arguments"));
+    check(analyzeFormatString<2>("%d %s"), 5, shortStr);
+    check(analyzeFormatString<1>("%s"), "");
+    check(analyzeFormatString<1>("%.4s"), shortStr);
+    check(analyzeFormatString<1>("%.40s"), shortStr);
+    check(analyzeFormatString<2>("%.*s"), 3, shortStr);
+    check(analyzeFormatString<2>("%.*s"), -1, shortStr);
+    check(analyzeFormatString<2>("%p %ls"), shortStr, wideStr);
+    check(analyzeFormatString<1>("%.3ls"), wideStr);
+    check(analyzeFormatString<1>("%s"), maxStr.c_str());
+    check(analyzeFormatString<1>("%.10s"), longStr.c_str());
+    check(analyzeFormatString<2>("%.*s"), 300, maxStr.c_str());
+
+    // Strings longer than the bound are sized before they're stored instead
+    char buffer[1024];
+    char *pos = buffer;
+    uint64_t previousPrecision = -1;
+    size_t stringSizes[10] = {};
+    constexpr auto paramTypes = analyzeFormatString<2>("%s %s");
+    EXPECT_EQ(2*(sizeof(uint32_t) + NanoLogConfig::STRING_CAPTURE_BYTES),
+              getArgBounds(paramTypes, previousPrecision, stringSizes,
+                           shortStr, longStr.c_str()));
+    EXPECT_FALSE(capture_arguments(paramTypes, stringSizes, &pos,
+                                   shortStr, longStr.c_str()));
+}
+
 TEST_F(NanoLogCpp17Test, compressSingle) {
     BufferUtils::TwoNibbles nibbles[10] {};
     ParamType type = ParamType::INVALID;
@@ -930,4 +1069,1039 @@ TEST_F(NanoLogCpp17Test, compress) {
     EXPECT_EQ(0, *out); ++out;
 }
 
-}; //namespace
\ No newline at end of file
+TEST_F(NanoLogCpp17Test, stringView) {
+    uint64_t precision = -1;
+    size_t stringBytes = 0;
+    std::string str("Hello World");
+    std::string_view view = asLogArgument(str);
+    EXPECT_EQ(str.data(), view.data());
+
+    // Sizes come from the view and respect static and dynamic precisions
+    EXPECT_EQ(sizeof(uint32_t) + 11, getArgSize(STRING_WITH_NO_PRECISION,
+                                            precision, stringBytes, view));
+    EXPECT_EQ(11U, stringBytes);
+    EXPECT_EQ(sizeof(uint32_t) + 5, getArgSize(ParamType(5), precision,
+                                            stringBytes, view));
+    EXPECT_EQ(5U, stringBytes);
+
+    precision = 3;
+    EXPECT_EQ(sizeof(uint32_t) + 3, getArgSize(STRING_WITH_DYNAMIC_PRECISION,
+                                            precision, stringBytes, view));
+    EXPECT_EQ(3U, stringBytes);
+    EXPECT_EQ(sizeof(void*), getArgSize(NON_STRING, precision,
+                                            stringBytes, view));
+
+    // Views with embedded NULLs are cut short in the compressed output
+    char inBuffer[1024];
+    char outBuffer[1024];
+    char *in = inBuffer;
+    char *out = outBuffer;
+    std::string_view nulls("ab\0cd", 5);
+    store_argument(&in, nulls, STRING_WITH_NO_PRECISION, nulls.size());
+    EXPECT_EQ(inBuffer + sizeof(uint32_t) + 5, in);
+
+    BufferUtils::TwoNibbles nibbles[1] {};
+    int nibbleCnt = 0;
+    in = inBuffer;
+    compressSingle<std::string_view>(nibbles, &nibbleCnt,
+                                     STRING_WITH_NO_PRECISION, false,
+                                     &in, &out);
+    EXPECT_EQ(inBuffer + sizeof(uint32_t) + 5, in);
+    EXPECT_EQ(outBuffer, out);
+
+    in = inBuffer;
+    compressSingle<std::string_view>(nibbles, &nibbleCnt,
+                                     STRING_WITH_NO_PRECISION, true,
+                                     &in, &out);
+    EXPECT_EQ(inBuffer + sizeof(uint32_t) + 5, in);
+    EXPECT_EQ(outBuffer + 3, out);
+    EXPECT_STREQ("ab", outBuffer);
+    EXPECT_EQ(0, nibbleCnt);
+}
+
+TEST_F(NanoLogCpp17Test, compressSingle_staticString) {
+    BufferUtils::TwoNibbles nibbles[10] {};
+    Log::StaticStringTable table;
+    const char *strA = "State A";
+    const char *strB = "State B";
+
+    char inBuffer[1024];
+    char outBuffer[1024];
+    char *in = inBuffer;
+    char *out = outBuffer;
+    int nibbleCnt = 0;
+
+    NanoLog::StaticString args[] = {NanoLog::static_str(strA),
+                                    NanoLog::static_str(strB),
+                                    NanoLog::static_str(strA)};
+    memcpy(inBuffer, args, sizeof(args));
+
+    // Strings-only pass skips the pointers entirely
+    compressSingle<NanoLog::StaticString>(nibbles, &nibbleCnt,
+                                          ParamType::STRING_WITH_NO_PRECISION,
+                                          true, &in, &out, &table);
+    EXPECT_EQ(inBuffer + sizeof(NanoLog::StaticString), in);
+    EXPECT_EQ(outBuffer, out);
+    EXPECT_EQ(0, nibbleCnt);
+    EXPECT_EQ(0U, table.size());
+
+    // Non-string pass interns the string and packs the id
+    in = inBuffer;
+    for (int i = 0; i < 3; ++i)
+        compressSingle<NanoLog::StaticString>(nibbles, &nibbleCnt,
+                                        ParamType::STRING_WITH_NO_PRECISION,
+                                        false, &in, &out, &table);
+
+    EXPECT_EQ(inBuffer + sizeof(args), in);
+    EXPECT_EQ(3, nibbleCnt);
+    EXPECT_EQ(2U, table.size());
+    EXPECT_EQ(strlen(strA) + strlen(strB) + 2, table.getUnpersistedBytes());
+    EXPECT_EQ(3, out - outBuffer);
+
+    const char *read = outBuffer;
+    EXPECT_EQ(0U, BufferUtils::unpack<uint32_t>(&read, nibbles[0].first));
+    EXPECT_EQ(1U, BufferUtils::unpack<uint32_t>(&read, nibbles[0].second));
+    EXPECT_EQ(0U, BufferUtils::unpack<uint32_t>(&read, nibbles[1].first));
+
+    // %p specifiers get the pointer instead
+    in = inBuffer; out = outBuffer; nibbleCnt = 0;
+    compressSingle<NanoLog::StaticString>(nibbles, &nibbleCnt,
+                                          ParamType::NON_STRING,
+                                          false, &in, &out, &table);
+    read = outBuffer;
+    EXPECT_EQ(strA, BufferUtils::unpack<const void*>(&read, nibbles[0].first));
+    EXPECT_EQ(2U, table.size());
+
+    // Rolling back only discards the strings that are not persisted
+    table.markPersisted();
+    EXPECT_EQ(2U, table.intern("New"));
+    EXPECT_EQ(4U, table.getUnpersistedBytes());
+    table.truncate(2);
+    EXPECT_EQ(2U, table.size());
+    EXPECT_EQ(0U, table.getUnpersistedBytes());
+}
+
+TEST_F(NanoLogCpp17Test, staticStrings_end2end) {
+    using namespace Log;
+    const char *testFile = "/tmp/testFile_staticStrings";
+    const char *decompressedFile = "/tmp/testFile_staticStrings2";
+    char inBuffer[1024];
+    char outBuffer[4096];
+
+    const char *stateA = "Running";
+    const char *stateB = "Stopped";
+
+    static constexpr std::array<ParamType, 2> paramTypes =
+                            analyzeFormatString<2>("State=%s code=%d");
+    std::vector<StaticLogInfo> dictionary;
+    dictionary.emplace_back(&compress<NanoLog::StaticString, int>,
+                            "file.cc", 10, NOTICE, "State=%s code=%d", 2, 2,
+                            paramTypes.data(),
+                            argEncodings<NanoLog::StaticString, int>);
+
+    Encoder encoder(outBuffer, sizeof(outBuffer), true);
+    ASSERT_TRUE(insertCheckpoint(&encoder.writePos, encoder.endOfBuffer,
+                                 false));
+    uint32_t dictPos = 0;
+    encoder.encodeNewDictionaryEntries(dictPos, dictionary);
+
+    // Encodes one log message per state into its own extent
+    const char *states[] = {stateA, stateA, stateB};
+    for (int i = 0; i < 3; ++i) {
+        char *in = inBuffer;
+        auto *ue = new(in) UncompressedEntry();
+        in += sizeof(UncompressedEntry);
+        ue->fmtId = 0;
+        ue->timestamp = i;
+        ue->entrySize = sizeof(UncompressedEntry)
+                            + sizeof(NanoLog::StaticString) + sizeof(int);
+
+        NanoLog::StaticString str = NanoLog::static_str(states[i]);
+        memcpy(in, &str, sizeof(str));
+        in += sizeof(str);
+        memcpy(in, &i, sizeof(int));
+
+        char *extentStart = encoder.writePos;
+        EXPECT_EQ(ue->entrySize, encoder.encodeLogMsgs(inBuffer,
+                                        ue->entrySize, 1, false, dictionary,
+                                        nullptr));
+
+        // Newly seen strings are persisted right before the extent
+        bool expectNewString = (i != 1);
+        EXPECT_EQ(expectNewString, peekEntryType(extentStart)
+                                            == EntryType::LOG_MSGS_OR_DIC);
+    }
+    EXPECT_EQ(2U, encoder.staticStrings.size());
+    EXPECT_EQ(2U, encoder.staticStrings.getNumPersisted());
+
+    FILE *fd = fopen(testFile, "wb");
+    ASSERT_NE(nullptr, fd);
+    fwrite(outBuffer, 1, encoder.getEncodedBytes(), fd);
+    fclose(fd);
+
+    Decoder decoder;
+    ASSERT_TRUE(decoder.open(testFile));
+    FILE *outputFd = fopen(decompressedFile, "w");
+    ASSERT_NE(nullptr, outputFd);
+    EXPECT_EQ(3, decoder.decompressTo(outputFd));
+    fclose(outputFd);
+
+    std::ifstream iFile(decompressedFile);
+    std::string line;
+    std::vector<std::string> messages;
+    while (std::getline(iFile, line)) {
+        size_t pos = line.find("]: ");
+        if (pos != std::string::npos)
+            messages.push_back(line.substr(pos + 3));
+    }
+
+    ASSERT_EQ(3U, messages.size());
+    EXPECT_STREQ("State=Running code=0\r", messages[0].c_str());
+    EXPECT_STREQ("State=Running code=1\r", messages[1].c_str());
+    EXPECT_STREQ("State=Stopped code=2\r", messages[2].c_str());
+
+    std::remove(testFile);
+    std::remove(decompressedFile);
+}
+
+TEST_F(NanoLogCpp17Test, deltaEncoding_end2end) {
+    using namespace Log;
+    const char *testFile = "/tmp/testFile_deltaEncoding";
+    const char *decompressedFile = "/tmp/testFile_deltaEncoding2";
+    char inBuffer[1024];
+    char outBuffer[4096];
+
+    typedef NanoLog::Delta<uint64_t> Seq;
+    typedef NanoLog::Delta<int> Id;
+    static_assert(argEncodings<Seq, Id, int>[0] == DELTA_ENCODED);
+    static_assert(argEncodings<Seq, Id, int>[2] == DEFAULT_ENCODING);
+
+    static constexpr std::array<ParamType, 3> paramTypes =
+                        analyzeFormatString<3>("Seq=%lu id=%d code=%d");
+    std::vector<StaticLogInfo> dictionary;
+    dictionary.emplace_back(&compress<Seq, Id, int>,
+                            "file.cc", 10, NOTICE, "Seq=%lu id=%d code=%d",
+                            3, 3, paramTypes.data(),
+                            argEncodings<Seq, Id, int>);
+
+    Encoder encoder(outBuffer, sizeof(outBuffer), true);
+    ASSERT_TRUE(insertCheckpoint(&encoder.writePos, encoder.endOfBuffer,
+                                 false));
+    uint32_t dictPos = 0;
+    encoder.encodeNewDictionaryEntries(dictPos, dictionary);
+
+    // Two extents of 3 log messages with increasing sequence numbers and
+    // decreasing (negative) ids.
+    uint64_t seq = 1000000000000UL;
+    int id = -10;
+    size_t extentBytes[2];
+    for (int extent = 0; extent < 2; ++extent) {
+        char *in = inBuffer;
+        for (int i = 0; i < 3; ++i) {
+            auto *ue = new(in) UncompressedEntry();
+            in += sizeof(UncompressedEntry);
+            ue->fmtId = 0;
+            ue->timestamp = 3*extent + i;
+            ue->entrySize = sizeof(UncompressedEntry)
+                                + sizeof(Seq) + sizeof(Id) + sizeof(int);
+
+            Seq s = NanoLog::delta(seq++);
+            Id d = NanoLog::delta(id--);
+            int code = 3*extent + i;
+            memcpy(in, &s, sizeof(s));
+            in += sizeof(s);
+            memcpy(in, &d, sizeof(d));
+            in += sizeof(d);
+            memcpy(in, &code, sizeof(int));
+            in += sizeof(int);
+        }
+
+        char *extentStart = encoder.writePos;
+        long bytes = in - inBuffer;
+        EXPECT_EQ(bytes, encoder.encodeLogMsgs(inBuffer, bytes, 1, false,
+                                               dictionary, nullptr));
+        extentBytes[extent] = encoder.writePos - extentStart;
+    }
+
+    // The bases are reset for every extent, so they compress the same
+    EXPECT_EQ(extentBytes[0], extentBytes[1]);
+
+    FILE *fd = fopen(testFile, "wb");
+    ASSERT_NE(nullptr, fd);
+    fwrite(outBuffer, 1, encoder.getEncodedBytes(), fd);
+    fclose(fd);
+
+    Decoder decoder;
+    ASSERT_TRUE(decoder.open(testFile));
+    FILE *outputFd = fopen(decompressedFile, "w");
+    ASSERT_NE(nullptr, outputFd);
+    EXPECT_EQ(6, decoder.decompressTo(outputFd));
+    fclose(outputFd);
+
+    std::ifstream iFile(decompressedFile);
+    std::string line;
+    std::vector<std::string> messages;
+    while (std::getline(iFile, line)) {
+        size_t pos = line.find("]: ");
+        if (pos != std::string::npos)
+            messages.push_back(line.substr(pos + 3));
+    }
+
+    ASSERT_EQ(6U, messages.size());
+    EXPECT_STREQ("Seq=1000000000000 id=-10 code=0\r", messages[0].c_str());
+    EXPECT_STREQ("Seq=1000000000001 id=-11 code=1\r", messages[1].c_str());
+    EXPECT_STREQ("Seq=1000000000002 id=-12 code=2\r", messages[2].c_str());
+    EXPECT_STREQ("Seq=1000000000003 id=-13 code=3\r", messages[3].c_str());
+    EXPECT_STREQ("Seq=1000000000005 id=-15 code=5\r", messages[5].c_str());
+
+    std::remove(testFile);
+    std::remove(decompressedFile);
+}
+
+TEST_F(NanoLogCpp17Test, packedIntegers_end2end) {
+    using namespace Log;
+    const char *testFile = "/tmp/testFile_packedIntegers";
+    const char *decompressedFile = "/tmp/testFile_packedIntegers2";
+    char rawBuffer[1024];
+    char packedBuffer[1024];
+    char outBuffer[4096];
+    char expectedBuffer[1024];
+
+    // (The unused nibble of an odd number of arguments is left as is)
+    memset(packedBuffer, 0, sizeof(packedBuffer));
+    memset(outBuffer, 0, sizeof(outBuffer));
+    memset(expectedBuffer, 0, sizeof(expectedBuffer));
+
+    // The producer packs the arguments exactly as compress() would
+    int a = -7;
+    uint64_t b = 1UL << 40;
+    int8_t c = 100;
+    long d = -(1L << 60);
+    uint16_t e = 0;
+
+    char *raw = rawBuffer;
+    store_argument(&raw, a, NON_STRING, 0);
+    store_argument(&raw, b, NON_STRING, 0);
+    store_argument(&raw, c, NON_STRING, 0);
+    store_argument(&raw, d, NON_STRING, 0);
+    store_argument(&raw, e, NON_STRING, 0);
+
+    static constexpr std::array<ParamType, 5> paramTypes =
+            analyzeFormatString<5>("a=%d b=%lu c=%hhd d=%ld e=%hu");
+    char *in = rawBuffer;
+    char *expected = expectedBuffer;
+    compress<int, uint64_t, int8_t, long, uint16_t>(5, paramTypes.data(),
+                                                   &in, &expected);
+    size_t packedSize = expected - expectedBuffer;
+
+    char *packed = packedBuffer;
+    packIntegerArguments(&packed, a, b, c, d, e);
+    ASSERT_EQ(packedSize, size_t(packed - packedBuffer));
+    EXPECT_EQ(0, memcmp(expectedBuffer, packedBuffer, packedSize));
+    EXPECT_GE((getMaxPackedSize<int, uint64_t, int8_t, long, uint16_t>()),
+              packedSize);
+    EXPECT_GT(size_t(raw - rawBuffer), packedSize);
+
+    // The compression thread copies them
+    in = packedBuffer;
+    char *out = outBuffer;
+    compressPrepacked<int, uint64_t, int8_t, long, uint16_t>(5,
+            paramTypes.data(), &in, &out, nullptr, nullptr, nullptr);
+    EXPECT_EQ(packed, in);
+    EXPECT_EQ(packedSize, size_t(out - outBuffer));
+    EXPECT_EQ(0, memcmp(expectedBuffer, outBuffer, packedSize));
+
+    // Log messages packed by the producer decompress like any other
+    std::vector<StaticLogInfo> dictionary;
+    dictionary.push_back(createStaticLogInfo<int, uint64_t, int8_t, long,
+                                             uint16_t>(
+            "file.cc", 10, NOTICE, "a=%d b=%lu c=%hhd d=%ld e=%hu", 5,
+            paramTypes.data(), nullptr,
+            &compressPrepacked<int, uint64_t, int8_t, long, uint16_t>));
+
+    Encoder encoder(outBuffer, sizeof(outBuffer), true);
+    ASSERT_TRUE(insertCheckpoint(&encoder.writePos, encoder.endOfBuffer,
+                                 false));
+    uint32_t dictPos = 0;
+    encoder.encodeNewDictionaryEntries(dictPos, dictionary);
+
+    char inBuffer[1024];
+    in = inBuffer;
+    for (int i = 0; i < 3; ++i) {
+        auto *ue = new(in) UncompressedEntry();
+        char *args = in + sizeof(UncompressedEntry);
+        packIntegerArguments(&args, a*i, b + i, c, d, uint16_t(e + i));
+
+        ue->fmtId = 0;
+        ue->timestamp = i;
+        ue->entrySize = downCast<uint32_t>(args - in);
+        in = args;
+    }
+
+    long bytes = in - inBuffer;
+    EXPECT_EQ(bytes, encoder.encodeLogMsgs(inBuffer, bytes, 1, false,
+                                           dictionary, nullptr));
+
+    FILE *fd = fopen(testFile, "wb");
+    ASSERT_NE(nullptr, fd);
+    fwrite(outBuffer, 1, encoder.getEncodedBytes(), fd);
+    fclose(fd);
+
+    Decoder decoder;
+    ASSERT_TRUE(decoder.open(testFile));
+    FILE *outputFd = fopen(decompressedFile, "w");
+    ASSERT_NE(nullptr, outputFd);
+    EXPECT_EQ(3, decoder.decompressTo(outputFd));
+    fclose(outputFd);
+
+    std::ifstream iFile(decompressedFile);
+    std::string line;
+    std::vector<std::string> messages;
+    while (std::getline(iFile, line)) {
+        size_t pos = line.find("]: ");
+        if (pos != std::string::npos)
+            messages.push_back(line.substr(pos + 3));
+    }
+
+    ASSERT_EQ(3U, messages.size());
+    EXPECT_STREQ("a=0 b=1099511627776 c=100 d=-1152921504606846976 e=0\r",
+                 messages[0].c_str());
+    EXPECT_STREQ("a=-14 b=1099511627778 c=100 d=-1152921504606846976 e=2\r",
+                 messages[2].c_str());
+
+    std::remove(testFile);
+    std::remove(decompressedFile);
+}
+
+TEST_F(NanoLogCpp17Test, xorEncoding_end2end) {
+    using namespace Log;
+    const char *testFile = "/tmp/testFile_xorEncoding";
+    const char *decompressedFile = "/tmp/testFile_xorEncoding2";
+    char inBuffer[1024];
+    char outBuffer[4096];
+
+    static_assert(argEncodings<double, float, long double>[0]
+                                                        == DELTA_ENCODED);
+    static_assert(argEncodings<double, float, long double>[1]
+                                                        == DELTA_ENCODED);
+    static_assert(argEncodings<double, float, long double>[2]
+                                                        == DEFAULT_ENCODING);
+
+    static constexpr std::array<ParamType, 3> paramTypes =
+                        analyzeFormatString<3>("bid=%.2lf ask=%.2f q=%.1Lf");
+    std::vector<StaticLogInfo> dictionary;
+    dictionary.emplace_back(&compress<double, float, long double>,
+                            "file.cc", 10, NOTICE,
+                            "bid=%.2lf ask=%.2f q=%.1Lf",
+                            3, 3, paramTypes.data(),
+                            argEncodings<double, float, long double>);
+
+    Encoder encoder(outBuffer, sizeof(outBuffer), true);
+    ASSERT_TRUE(insertCheckpoint(&encoder.writePos, encoder.endOfBuffer,
+                                 false));
+    uint32_t dictPos = 0;
+    encoder.encodeNewDictionaryEntries(dictPos, dictionary);
+
+    // Two extents of 3 log messages with a repeating bid and an ask that
+    // moves by a quarter.
+    size_t extentBytes[2];
+    for (int extent = 0; extent < 2; ++extent) {
+        char *in = inBuffer;
+        for (int i = 0; i < 3; ++i) {
+            auto *ue = new(in) UncompressedEntry();
+            in += sizeof(UncompressedEntry);
+            ue->fmtId = 0;
+            ue->timestamp = 3*extent + i;
+            ue->entrySize = sizeof(UncompressedEntry) + sizeof(double)
+                                + sizeof(float) + sizeof(long double);
+
+            double bid = 100.5;
+            float ask = 100.75f + 0.25f*static_cast<float>(i);
+            long double quantity = 3*extent + i;
+            memcpy(in, &bid, sizeof(double));
+            in += sizeof(double);
+            memcpy(in, &ask, sizeof(float));
+            in += sizeof(float);
+            memcpy(in, &quantity, sizeof(long double));
+            in += sizeof(long double);
+        }
+
+        char *extentStart = encoder.writePos;
+        long bytes = in - inBuffer;
+        EXPECT_EQ(bytes, encoder.encodeLogMsgs(inBuffer, bytes, 1, false,
+                                               dictionary, nullptr));
+        extentBytes[extent] = encoder.writePos - extentStart;
+    }
+
+    // The bases are reset for every extent, so they compress the same
+    EXPECT_EQ(extentBytes[0], extentBytes[1]);
+
+    FILE *fd = fopen(testFile, "wb");
+    ASSERT_NE(nullptr, fd);
+    fwrite(outBuffer, 1, encoder.getEncodedBytes(), fd);
+    fclose(fd);
+
+    Decoder decoder;
+    ASSERT_TRUE(decoder.open(testFile));
+    FILE *outputFd = fopen(decompressedFile, "w");
+    ASSERT_NE(nullptr, outputFd);
+    EXPECT_EQ(6, decoder.decompressTo(outputFd));
+    fclose(outputFd);
+
+    std::ifstream iFile(decompressedFile);
+    std::string line;
+    std::vector<std::string> messages;
+    while (std::getline(iFile, line)) {
+        size_t pos = line.find("]: ");
+        if (pos != std::string::npos)
+            messages.push_back(line.substr(pos + 3));
+    }
+
+    ASSERT_EQ(6U, messages.size());
+    EXPECT_STREQ("bid=100.50 ask=100.75 q=0.0\r", messages[0].c_str());
+    EXPECT_STREQ("bid=100.50 ask=101.00 q=1.0\r", messages[1].c_str());
+    EXPECT_STREQ("bid=100.50 ask=101.25 q=2.0\r", messages[2].c_str());
+    EXPECT_STREQ("bid=100.50 ask=100.75 q=3.0\r", messages[3].c_str());
+    EXPECT_STREQ("bid=100.50 ask=101.25 q=5.0\r", messages[5].c_str());
+
+    std::remove(testFile);
+    std::remove(decompressedFile);
+}
+
+TEST_F(NanoLogCpp17Test, internedStrings_end2end) {
+    using namespace Log;
+    const char *testFile = "/tmp/testFile_internedStrings";
+    const char *decompressedFile = "/tmp/testFile_internedStrings2";
+    char inBuffer[1024];
+    char outBuffer[4096];
+
+    typedef std::string_view View;
+    static_assert(argEncodings<const char*, View, int>[0] == INTERNED_STRING);
+    static_assert(argEncodings<const char*, View, int>[1] == INTERNED_STRING);
+    static_assert(argEncodings<const char*, View, int>[2] == DEFAULT_ENCODING);
+
+    static constexpr std::array<ParamType, 3> paramTypes =
+                        analyzeFormatString<3>("sym=%s venue=%s qty=%d");
+    std::vector<StaticLogInfo> dictionary;
+    dictionary.emplace_back(&compress<const char*, View, int>,
+                            "file.cc", 10, NOTICE, "sym=%s venue=%s qty=%d",
+                            3, 1, paramTypes.data(),
+                            argEncodings<const char*, View, int>);
+
+    Encoder encoder(outBuffer, sizeof(outBuffer), true);
+    ASSERT_TRUE(insertCheckpoint(&encoder.writePos, encoder.endOfBuffer,
+                                 false));
+    uint32_t dictPos = 0;
+    encoder.encodeNewDictionaryEntries(dictPos, dictionary);
+
+    // Two extents of 4 log messages with repeating symbols and venues
+    const char *symbols[] = {"MSFT", "AAPL", "MSFT", ""};
+    View venues[] = {"XNAS", "XNAS", std::string_view("XN\0AS", 5), ""};
+    size_t extentBytes[2];
+    for (int extent = 0; extent < 2; ++extent) {
+        char *in = inBuffer;
+        for (int i = 0; i < 4; ++i) {
+            uint64_t previousPrecision = -1;
+            size_t stringSizes[3] = {};
+            size_t argBytes = getArgSizes(paramTypes, previousPrecision,
+                                          stringSizes, symbols[i], venues[i],
+                                          4*extent + i);
+
+            auto *ue = new(in) UncompressedEntry();
+            in += sizeof(UncompressedEntry);
+            ue->fmtId = 0;
+            ue->timestamp = 4*extent + i;
+            ue->entrySize = downCast<uint32_t>(sizeof(UncompressedEntry)
+                                                    + argBytes);
+            store_arguments(paramTypes, stringSizes, &in, symbols[i],
+                            venues[i], 4*extent + i);
+        }
+
+        char *extentStart = encoder.writePos;
+        long bytes = in - inBuffer;
+        EXPECT_EQ(bytes, encoder.encodeLogMsgs(inBuffer, bytes, 1, false,
+                                               dictionary, nullptr));
+        extentBytes[extent] = encoder.writePos - extentStart;
+    }
+
+    // The interned strings are forgotten at every extent, so they compress
+    // the same
+    EXPECT_EQ(extentBytes[0], extentBytes[1]);
+
+    FILE *fd = fopen(testFile, "wb");
+    ASSERT_NE(nullptr, fd);
+    fwrite(outBuffer, 1, encoder.getEncodedBytes(), fd);
+    fclose(fd);
+
+    Decoder decoder;
+    ASSERT_TRUE(decoder.open(testFile));
+    FILE *outputFd = fopen(decompressedFile, "w");
+    ASSERT_NE(nullptr, outputFd);
+    EXPECT_EQ(8, decoder.decompressTo(outputFd));
+    fclose(outputFd);
+
+    std::ifstream iFile(decompressedFile);
+    std::string line;
+    std::vector<std::string> messages;
+    while (std::getline(iFile, line)) {
+        size_t pos = line.find("]: ");
+        if (pos != std::string::npos)
+            messages.push_back(line.substr(pos + 3));
+    }
+
+    ASSERT_EQ(8U, messages.size());
+    EXPECT_STREQ("sym=MSFT venue=XNAS qty=0\r", messages[0].c_str());
+    EXPECT_STREQ("sym=AAPL venue=XNAS qty=1\r", messages[1].c_str());
+    EXPECT_STREQ("sym=MSFT venue=XN qty=2\r", messages[2].c_str());
+    EXPECT_STREQ("sym= venue= qty=3\r", messages[3].c_str());
+    EXPECT_STREQ("sym=MSFT venue=XNAS qty=4\r", messages[4].c_str());
+    EXPECT_STREQ("sym=MSFT venue=XN qty=6\r", messages[6].c_str());
+
+    std::remove(testFile);
+    std::remove(decompressedFile);
+}
+
+TEST_F(NanoLogCpp17Test, blobs) {
+    static_assert(getParamSpecifier("%d %*.*B").terminal == 'd');
+    static_assert(getParamSpecifier("%d %*.*B", 1).terminal == '*');
+    static_assert(getParamSpecifier("%d %*.*B", 3).terminal == 'B');
+    static_assert(getParamInfo("%d %.5B", 1) == ParamType(5));
+    static_assert(getNumNibblesNeeded("%B %.*B") == 1);
+
+    static_assert(hasBlobSpecifier("%d %B"));
+    static_assert(!hasBlobSpecifier("%d %s %%B"));
+    static_assert(checkBlobArguments<int, NanoLog::Bytes>("%d %B"));
+    static_assert(!checkBlobArguments<int, const char*>("%d %B"));
+    static_assert(!checkBlobArguments<NanoLog::Bytes>("%s"));
+
+    const char data[] = "0123456789";
+    uint64_t prec = 0;
+    size_t stringBytes = 0;
+    NanoLog::Bytes blob = NanoLog::bytes(data, 10);
+    EXPECT_EQ(4U + 10, getArgSize(STRING_WITH_NO_PRECISION, prec,
+                                  stringBytes, blob));
+    EXPECT_EQ(4U + 4, getArgSize(ParamType(4), prec, stringBytes, blob));
+
+    prec = 2;
+    EXPECT_EQ(4U + 2, getArgSize(STRING_WITH_DYNAMIC_PRECISION, prec,
+                                 stringBytes, blob));
+    prec = -1;
+    EXPECT_EQ(4U + 10, getArgSize(STRING_WITH_DYNAMIC_PRECISION, prec,
+                                  stringBytes, blob));
+
+    // Blobs are stored and compressed as a length followed by the bytes
+    char buffer[100], compressed[100];
+    char *pos = buffer;
+    store_argument(&pos, NanoLog::bytesAsBase64(data, 10), ParamType(4), 8);
+    EXPECT_EQ(8, pos - buffer);
+
+    uint32_t lengthWord;
+    memcpy(&lengthWord, buffer, sizeof(uint32_t));
+    EXPECT_EQ(4U | BLOB_BASE64_FLAG, lengthWord);
+    EXPECT_EQ(0, memcmp(buffer + 4, "0123", 4));
+
+    int nibbleCnt = 0;
+    char *in = buffer, *out = compressed;
+    compressSingle<NanoLog::Bytes>(nullptr, &nibbleCnt, ParamType(4), false,
+                                   &in, &out, nullptr);
+    EXPECT_EQ(pos, in);
+    EXPECT_EQ(compressed, out);
+
+    in = buffer;
+    compressSingle<NanoLog::Bytes>(nullptr, &nibbleCnt, ParamType(4), true,
+                                   &in, &out, nullptr);
+    EXPECT_EQ(pos, in);
+    EXPECT_EQ(8, out - compressed);
+    EXPECT_EQ(0, memcmp(buffer, compressed, 8));
+    EXPECT_EQ(0, nibbleCnt);
+}
+
+TEST_F(NanoLogCpp17Test, codec) {
+    TestPoint point = {1, -2};
+    auto arg = asLogArgument(point);
+    static_assert(std::is_same<CodecArgument<TestPoint>,
+                                                decltype(arg)>::value);
+    static_assert(!hasCodec<int>::value && hasCodec<TestBlob>::value);
+    EXPECT_EQ(&point, arg.value);
+    EXPECT_STREQ("", printfArg(point));
+
+    uint64_t prec = 0;
+    size_t stringBytes = 0;
+    EXPECT_EQ(sizeof(void*), getArgSize(NON_STRING, prec, stringBytes, arg));
+    EXPECT_EQ(4U + sizeof(TestPoint), getArgSize(STRING_WITH_NO_PRECISION,
+                                                 prec, stringBytes, arg));
+    EXPECT_EQ(sizeof(TestPoint), stringBytes);
+
+    EXPECT_EQ(CODEC, getArgEncoding<CodecArgument<TestPoint>>());
+    EXPECT_STREQ("TestBlob", (codecNames<int, CodecArgument<TestBlob>>[1]));
+    EXPECT_EQ(nullptr, (codecNames<int, CodecArgument<TestBlob>>[0]));
+}
+
+TEST_F(NanoLogCpp17Test, codec_end2end) {
+    using namespace Log;
+    const char *testFile = "/tmp/testFile_codec";
+    const char *decompressedFile = "/tmp/testFile_codec2";
+    char inBuffer[1024];
+    char outBuffer[4096];
+
+    NanoLog::registerCodecFormatter("TestPoint",
+        [](const char *data, size_t length) -> std::string {
+            TestPoint p;
+            if (length != sizeof(p))
+                return "(bad point)";
+
+            memcpy(&p, data, sizeof(p));
+            return "(" + std::to_string(p.x) + ", " + std::to_string(p.y) + ")";
+        });
+
+    // 127 data bytes + 1 length byte needs a 2 byte varint before the
+    // codec compresses it down to 127 bytes, which only needs 1.
+    TestBlob blob;
+    blob.length = 127;
+    memset(blob.data, 0xab, blob.length);
+    TestPoint point = {3, -4};
+    int n = 42;
+
+    static constexpr std::array<ParamType, 3> paramTypes =
+                    analyzeFormatString<3>("p=%s blob=%.12s n=%d");
+    typedef CodecArgument<TestPoint> PointArg;
+    typedef CodecArgument<TestBlob> BlobArg;
+    std::vector<StaticLogInfo> dictionary;
+    dictionary.emplace_back(&compress<PointArg, BlobArg, int>,
+                            "file.cc", 10, NOTICE, "p=%s blob=%.12s n=%d", 3,
+                            getNumNibblesNeeded("p=%s blob=%.12s n=%d"),
+                            paramTypes.data(),
+                            argEncodings<PointArg, BlobArg, int>,
+                            codecNames<PointArg, BlobArg, int>);
+
+    Encoder encoder(outBuffer, sizeof(outBuffer), true);
+    ASSERT_TRUE(insertCheckpoint(&encoder.writePos, encoder.endOfBuffer,
+                                 false));
+    uint32_t dictPos = 0;
+    encoder.encodeNewDictionaryEntries(dictPos, dictionary);
+
+    uint64_t previousPrecision = -1;
+    size_t stringSizes[3] = {};
+    size_t argBytes = getArgSizes(paramTypes, previousPrecision, stringSizes,
+                                  PointArg{&point}, BlobArg{&blob}, n);
+    EXPECT_EQ(4 + sizeof(TestPoint) + 4 + 128 + sizeof(int), argBytes);
+
+    char *in = inBuffer;
+    auto *ue = new(in) UncompressedEntry();
+    in += sizeof(UncompressedEntry);
+    ue->fmtId = 0;
+    ue->timestamp = 0;
+    ue->entrySize = downCast<uint32_t>(sizeof(UncompressedEntry) + argBytes);
+    store_arguments(paramTypes, stringSizes, &in,
+                    PointArg{&point}, BlobArg{&blob}, n);
+    EXPECT_EQ(ue->entrySize, in - inBuffer);
+
+    EXPECT_EQ(ue->entrySize, encoder.encodeLogMsgs(inBuffer, ue->entrySize, 1,
+                                                   false, dictionary, nullptr));
+
+    FILE *fd = fopen(testFile, "wb");
+    ASSERT_NE(nullptr, fd);
+    fwrite(outBuffer, 1, encoder.getEncodedBytes(), fd);
+    fclose(fd);
+
+    Decoder decoder;
+    ASSERT_TRUE(decoder.open(testFile));
+    FILE *outputFd = fopen(decompressedFile, "w");
+    ASSERT_NE(nullptr, outputFd);
+    EXPECT_EQ(1, decoder.decompressTo(outputFd));
+    fclose(outputFd);
+
+    std::ifstream iFile(decompressedFile);
+    std::string line;
+    std::vector<std::string> messages;
+    while (std::getline(iFile, line)) {
+        size_t pos = line.find("]: ");
+        if (pos != std::string::npos)
+            messages.push_back(line.substr(pos + 3));
+    }
+
+    // The blob has no formatter registered, so it's rendered in hex
+    ASSERT_EQ(1U, messages.size());
+    EXPECT_STREQ("p=(3, -4) blob=<TestBlob:ab n=42\r", messages[0].c_str());
+
+    std::remove(testFile);
+    std::remove(decompressedFile);
+}
+TEST_F(NanoLogCpp17Test, keyValueFormat) {
+    enum Color : int16_t { RED = 1 };
+
+    EXPECT_STREQ("%d", getKeyValueSpecifier<int>());
+    EXPECT_STREQ("%llu", getKeyValueSpecifier<uint64_t>());
+    EXPECT_STREQ("%hhd", getKeyValueSpecifier<int8_t>());
+    EXPECT_STREQ("%c", getKeyValueSpecifier<char>());
+    EXPECT_STREQ("%lf", getKeyValueSpecifier<float>());
+    EXPECT_STREQ("%Lf", getKeyValueSpecifier<long double>());
+    EXPECT_STREQ("%s", getKeyValueSpecifier<const char*>());
+    EXPECT_STREQ("%s", getKeyValueSpecifier<std::string_view>());
+    EXPECT_STREQ("%s", getKeyValueSpecifier<NanoLog::StaticString>());
+    EXPECT_STREQ("%s", getKeyValueSpecifier<CodecArgument<TestPoint>>());
+    EXPECT_STREQ("%B", getKeyValueSpecifier<NanoLog::Bytes>());
+    EXPECT_STREQ("%p", getKeyValueSpecifier<const int*>());
+    EXPECT_STREQ("%hd", getKeyValueSpecifier<
+                            decltype(asKeyValueArgument(Color::RED))>());
+    EXPECT_STREQ("%d", getKeyValueSpecifier<
+                            decltype(asKeyValueArgument(true))>());
+    EXPECT_EQ(nullptr, getKeyValueSpecifier<std::vector<int>>());
+
+    EXPECT_STREQ("", keyValueFormat<>.str);
+    EXPECT_STREQ("%d%s%lf",
+                 (keyValueFormat<int, std::string_view, double>.str));
+
+    static_assert(decltype(countKeyValueNames("event"))::value == 1, "");
+    static_assert(decltype(countKeyValueNames("event", "a", 1, "b", 2))
+                        ::value == 3, "");
+    static_assert(isStringLiteral<const char[5]>(), "");
+    static_assert(!isStringLiteral<const char*>(), "");
+}
+
+TEST_F(NanoLogCpp17Test, keyValues_end2end) {
+    using namespace Log;
+    const char *testFile = "/tmp/testFile_keyValues";
+    const char *decompressedFile = "/tmp/testFile_keyValues2";
+    char inBuffer[1024];
+    char outBuffer[4096];
+
+    constexpr auto &format = keyValueFormat<int, std::string_view, double>;
+    static const char *fieldNames[] = {"order_fill", "id", "sym", "px"};
+    std::vector<StaticLogInfo> dictionary;
+    dictionary.emplace_back(&compress<int, std::string_view, double>,
+                            "file.cc", 10, NOTICE, format.str, 3,
+                            getNumNibblesNeeded(format.str),
+                            keyValueParamTypes<int, std::string_view,
+                                               double>.data(),
+                            argEncodings<int, std::string_view, double>,
+                            nullptr, fieldNames);
+    dictionary.emplace_back(&compress<>, "file.cc", 11, WARNING,
+                            keyValueFormat<>.str, 0, 0,
+                            keyValueParamTypes<>.data(),
+                            nullptr, nullptr, fieldNames);
+    dictionary.emplace_back(&compress<>, "file.cc", 12, NOTICE,
+                            "Plain, \"text\"", 0, 0, nullptr);
+
+    Encoder encoder(outBuffer, sizeof(outBuffer), true);
+    ASSERT_TRUE(insertCheckpoint(&encoder.writePos, encoder.endOfBuffer,
+                                 false));
+    uint32_t dictPos = 0;
+    encoder.encodeNewDictionaryEntries(dictPos, dictionary);
+    EXPECT_EQ(3U, dictPos);
+
+    uint64_t previousPrecision = -1;
+    size_t stringSizes[3] = {};
+    std::string_view sym = "AB,\"C\"";
+    size_t argBytes = getArgSizes(keyValueParamTypes<int, std::string_view,
+                                                     double>,
+                                  previousPrecision, stringSizes,
+                                  -7, sym, 1.5);
+
+    char *in = inBuffer;
+    for (uint32_t id = 0; id < 3; ++id) {
+        auto *ue = new(in) UncompressedEntry();
+        in += sizeof(UncompressedEntry);
+        ue->fmtId = id;
+        ue->timestamp = id;
+        ue->entrySize = sizeof(UncompressedEntry);
+
+        if (id == 0) {
+            ue->entrySize += downCast<uint32_t>(argBytes);
+            store_arguments(keyValueParamTypes<int, std::string_view, double>,
+                            stringSizes, &in, -7, sym, 1.5);
+        }
+    }
+
+    size_t inBytes = in - inBuffer;
+    EXPECT_EQ(inBytes, encoder.encodeLogMsgs(inBuffer, inBytes, 1, false,
+                                             dictionary, nullptr));
+
+    FILE *fd = fopen(testFile, "wb");
+    ASSERT_NE(nullptr, fd);
+    fwrite(outBuffer, 1, encoder.getEncodedBytes(), fd);
+    fclose(fd);
+
+    // Strips the timestamps from the decompressed lines
+    const Decoder::OutputFormat formats[] = {Decoder::TEXT, Decoder::JSON,
+                                             Decoder::CSV};
+    const char *separators[] = {"]: ", "\"file\"", ","};
+    std::vector<std::string> messages[3];
+    for (int i = 0; i < 3; ++i) {
+        Decoder decoder;
+        decoder.setOutputFormat(formats[i]);
+        ASSERT_TRUE(decoder.open(testFile));
+        FILE *outputFd = fopen(decompressedFile, "w");
+        ASSERT_NE(nullptr, outputFd);
+        EXPECT_EQ(3, decoder.decompressTo(outputFd));
+        fclose(outputFd);
+
+        std::ifstream iFile(decompressedFile);
+        std::string line;
+        while (std::getline(iFile, line)) {
+            size_t pos = line.find(separators[i]);
+            if (pos != std::string::npos && line[0] != '#')
+                messages[i].push_back(line.substr(pos));
+        }
+    }
+
+    ASSERT_EQ(3U, messages[0].size());
+    EXPECT_EQ("]: order_fill id=-7 sym=AB,\"C\" px=1.500000\r",
+              messages[0][0]);
+    EXPECT_EQ("]: order_fill\r", messages[0][1]);
+    EXPECT_EQ("]: Plain, \"text\"\r", messages[0][2]);
+
+    ASSERT_EQ(3U, messages[1].size());
+    EXPECT_EQ("\"file\":\"file.cc\",\"line\":10,\"severity\":\"NOTICE\","
+              "\"thread\":1,\"event\":\"order_fill\",\"fields\":{\"id\":-7,"
+              "\"sym\":\"AB,\\\"C\\\"\",\"px\":1.500000}}\r", messages[1][0]);
+    EXPECT_EQ("\"file\":\"file.cc\",\"line\":11,\"severity\":\"WARNING\","
+              "\"thread\":1,\"event\":\"order_fill\",\"fields\":{}}\r",
+              messages[1][1]);
+    EXPECT_EQ("\"file\":\"file.cc\",\"line\":12,\"severity\":\"NOTICE\","
+              "\"thread\":1,\"message\":\"Plain, \\\"text\\\"\"}\r",
+              messages[1][2]);
+
+    ASSERT_EQ(5U, messages[2].size());
+    EXPECT_EQ(",file.cc,10,NOTICE,1,order_fill,id,-7\r", messages[2][0]);
+    EXPECT_EQ(",file.cc,10,NOTICE,1,order_fill,sym,\"AB,\"\"C\"\"\"\r",
+              messages[2][1]);
+    EXPECT_EQ(",file.cc,10,NOTICE,1,order_fill,px,1.500000\r",
+              messages[2][2]);
+    EXPECT_EQ(",file.cc,11,WARNING,1,order_fill,,\r", messages[2][3]);
+    EXPECT_EQ(",file.cc,12,NOTICE,1,,message,\"Plain, \"\"text\"\"\"\r",
+              messages[2][4]);
+
+    std::remove(testFile);
+    std::remove(decompressedFile);
+}
+
+TEST_F(NanoLogCpp17Test, spans_end2end) {
+    using namespace Log;
+    const char *testFile = "/tmp/testFile_spans";
+    char inBuffer[1024];
+    char outBuffer[4096];
+
+    // Mirrors the dictionary entries registered by a NANO_LOG_SPAN()
+    constexpr auto &format = keyValueFormat<uint32_t>;
+    static const char *beginNames[] = {"rpc", SPAN_BEGIN_FIELD};
+    static const char *endNames[] = {"rpc", SPAN_END_FIELD};
+    std::vector<StaticLogInfo> dictionary;
+    dictionary.emplace_back(&compress<uint32_t>, "file.cc", 10, NOTICE,
+                            format.str, 1, getNumNibblesNeeded(format.str),
+                            keyValueParamTypes<uint32_t>.data(),
+                            nullptr, nullptr, beginNames);
+    dictionary.emplace_back(&compress<uint32_t>, "file.cc", 10, NOTICE,
+                            format.str, 1, getNumNibblesNeeded(format.str),
+                            keyValueParamTypes<uint32_t>.data(),
+                            nullptr, nullptr, endNames);
+    dictionary.emplace_back(&compress<>, "file.cc", 12, NOTICE,
+                            "Plain", 0, 0, nullptr);
+
+    Encoder encoder(outBuffer, sizeof(outBuffer), true);
+    ASSERT_TRUE(insertCheckpoint(&encoder.writePos, encoder.endOfBuffer,
+                                 false));
+    uint32_t dictPos = 0;
+    encoder.encodeNewDictionaryEntries(dictPos, dictionary);
+
+    char *in = inBuffer;
+    for (uint32_t id = 0; id < 3; ++id) {
+        auto *ue = new(in) UncompressedEntry();
+        in += sizeof(UncompressedEntry);
+        ue->fmtId = id;
+        ue->timestamp = 100 + 50*id;
+        ue->entrySize = sizeof(UncompressedEntry);
+
+        if (id < 2) {
+            uint64_t previousPrecision = -1;
+            size_t stringSizes[1] = {};
+            ue->entrySize += downCast<uint32_t>(getArgSizes(
+                                keyValueParamTypes<uint32_t>,
+                                previousPrecision, stringSizes, 7U));
+            store_arguments(keyValueParamTypes<uint32_t>, stringSizes, &in,
+                            7U);
+        }
+    }
+
+    size_t inBytes = in - inBuffer;
+    EXPECT_EQ(inBytes, encoder.encodeLogMsgs(inBuffer, inBytes, 3, false,
+                                             dictionary, nullptr));
+
+    FILE *fd = fopen(testFile, "wb");
+    ASSERT_NE(nullptr, fd);
+    fwrite(outBuffer, 1, encoder.getEncodedBytes(), fd);
+    fclose(fd);
+
+    Decoder decoder;
+    LogMessage msg;
+    ASSERT_TRUE(decoder.open(testFile));
+
+    ASSERT_TRUE(decoder.getNextLogStatement(msg));
+    EXPECT_STREQ("rpc", msg.getEventName());
+    EXPECT_STREQ(SPAN_BEGIN_FIELD, msg.getFieldName(0));
+    EXPECT_EQ(nullptr, msg.getFieldName(1));
+    EXPECT_EQ(3U, msg.getRuntimeId());
+    EXPECT_EQ(100U, msg.getTimestamp());
+    ASSERT_EQ(1, msg.getNumArgs());
+    EXPECT_EQ(7U, msg.get<uint32_t>(0));
+
+    ASSERT_TRUE(decoder.getNextLogStatement(msg));
+    EXPECT_STREQ("rpc", msg.getEventName());
+    EXPECT_STREQ(SPAN_END_FIELD, msg.getFieldName(0));
+    EXPECT_EQ(3U, msg.getRuntimeId());
+    EXPECT_EQ(150U, msg.getTimestamp());
+    EXPECT_EQ(7U, msg.get<uint32_t>(0));
+
+    ASSERT_TRUE(decoder.getNextLogStatement(msg));
+    EXPECT_EQ(nullptr, msg.getEventName());
+    EXPECT_EQ(nullptr, msg.getFieldName(0));
+
+    std::remove(testFile);
+}
+
+TEST_F(NanoLogCpp17Test, metricAggregator) {
+    using namespace Log;
+    static int logId = UNASSIGNED_LOGID;
+    static const char *fieldNames[2];
+
+    // Redirect this thread's log messages into the test's StagingBuffer
+    RuntimeLogger::stagingBuffer = sb;
+    {
+        MetricAggregator counter(logId, fieldNames, "file.cc", 10, false,
+                                 "requests");
+        EXPECT_STREQ("requests", fieldNames[0]);
+        EXPECT_STREQ(METRIC_COUNTER_FIELD, fieldNames[1]);
+
+        // Skips registering the site with the RuntimeLogger singleton
+        logId = 7;
+        for (int i = 1; i <= 100; ++i)
+            counter.add(i);
+
+        NanoLog::flushMetrics();
+        EXPECT_NE(sb->storage, sb->producerPos);
+    }
+    RuntimeLogger::stagingBuffer = nullptr;
+
+    // The deltas are split among the log messages depending on when the
+    // compression thread made its passes, but none may be lost.
+    int64_t total = 0;
+    int numLogMsgs = 0;
+    char *pos = sb->storage;
+    while (pos < sb->producerPos) {
+        auto *ue = reinterpret_cast<UncompressedEntry*>(pos);
+        EXPECT_EQ(7U, ue->fmtId);
+        EXPECT_EQ(sizeof(UncompressedEntry) + sizeof(int64_t), ue->entrySize);
+
+        int64_t count;
+        memcpy(&count, pos + sizeof(UncompressedEntry), sizeof(count));
+        EXPECT_LT(0, count);
+        total += count;
+        ++numLogMsgs;
+        pos += ue->entrySize;
+    }
+
+    EXPECT_EQ(5050, total);
+    EXPECT_GE(100, numLogMsgs);
+}
+
+}; //namespace
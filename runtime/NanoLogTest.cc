@@ -13,6 +13,9 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "gtest/gtest.h"
 
 #include "TestUtil.h"
@@ -209,7 +212,7 @@ TEST_F(NanoLogTest, StagingBuffer_peek) {
     uint64_t bytesAvailable = -1;
 
     // Case 1: Empty Buffer
-    sb->peek(&bytesAvailable);
+    sb->peek(&bytesAvailable, true);
     EXPECT_EQ(0U, bytesAvailable);
 
     // Case 2: There's stuff (via API);
@@ -217,11 +220,11 @@ TEST_F(NanoLogTest, StagingBuffer_peek) {
     sb->finishReservation(1000);
     sb->reserveProducerSpace(150);
 
-    sb->peek(&bytesAvailable);
+    sb->peek(&bytesAvailable, true);
     EXPECT_EQ(1000U, bytesAvailable);
 
     sb->finishReservation(150);
-    sb->peek(&bytesAvailable);
+    sb->peek(&bytesAvailable, true);
     EXPECT_EQ(1150U, bytesAvailable);
 
     sb->consume(1150U);
@@ -232,7 +235,7 @@ TEST_F(NanoLogTest, StagingBuffer_peek) {
 
     sb->reserveProducerSpace(bufferSize - 100);
     sb->finishReservation(bufferSize - 100);
-    sb->peek(&bytesAvailable);
+    sb->peek(&bytesAvailable, true);
     EXPECT_EQ(bufferSize - 100, bytesAvailable);
     sb->consume(halfSize + 10);
 
@@ -245,26 +248,291 @@ TEST_F(NanoLogTest, StagingBuffer_peek) {
     //    halfSize - 10 - 100 bytes to consume
     //    100 bytes to skip (unrecorded space)
 
-    sb->peek(&bytesAvailable);
+    sb->peek(&bytesAvailable, true);
     EXPECT_EQ(halfSize - 110, bytesAvailable);
     sb->consume(bytesAvailable - 1);
 
-    sb->peek(&bytesAvailable);
+    sb->peek(&bytesAvailable, true);
     EXPECT_EQ(1U, bytesAvailable);
     sb->consume(1);
 
-    sb->peek(&bytesAvailable);
+    sb->peek(&bytesAvailable, true);
     EXPECT_EQ(halfSize, bytesAvailable);
     sb->consume(halfSize);
 
     // At this point we should have no data.
-    sb->peek(&bytesAvailable);
+    sb->peek(&bytesAvailable, true);
     EXPECT_EQ(0U, bytesAvailable);
 
     // Put a bit more to finish it off.
     sb->reserveProducerSpace(10);
     sb->finishReservation(10);
+    sb->peek(&bytesAvailable, true);
+    EXPECT_EQ(10U, bytesAvailable);
+}
+TEST_F(NanoLogTest, StagingBuffer_publish) {
+    uint64_t bytesAvailable = -1;
+
+    // Case 1: Below the thresholds, nothing is visible to the consumer
+    sb->reserveProducerSpace(10);
+    sb->finishReservation(10);
+    EXPECT_EQ(sb->storage, sb->peek(&bytesAvailable));
+    EXPECT_EQ(0U, bytesAvailable);
+    EXPECT_EQ(1U, sb->unpublishedRecords);
+    EXPECT_EQ(10U, sb->unpublishedBytes);
+
+    // Case 2: Crossing the record threshold publishes everything
+    for (uint32_t i = 1; i < NanoLogConfig::PUBLISH_THRESHOLD_RECORDS; ++i) {
+        sb->reserveProducerSpace(1);
+        sb->finishReservation(1);
+    }
+
+    uint64_t published = 10 + NanoLogConfig::PUBLISH_THRESHOLD_RECORDS - 1;
+    sb->peek(&bytesAvailable);
+    EXPECT_EQ(published, bytesAvailable);
+    EXPECT_EQ(0U, sb->unpublishedRecords);
+    EXPECT_EQ(0U, sb->unpublishedBytes);
+
+    // Case 3: Crossing the byte threshold publishes everything
+    sb->reserveProducerSpace(NanoLogConfig::PUBLISH_THRESHOLD_BYTES);
+    sb->finishReservation(NanoLogConfig::PUBLISH_THRESHOLD_BYTES);
+    published += NanoLogConfig::PUBLISH_THRESHOLD_BYTES;
+    sb->peek(&bytesAvailable);
+    EXPECT_EQ(published, bytesAvailable);
+
+    // Case 4: The doorbell forces a publication on the next reservation
+    sb->requestPublication();
+    EXPECT_TRUE(sb->publicationRequested);
+    sb->reserveProducerSpace(5);
+    sb->finishReservation(5);
+    published += 5;
+    sb->peek(&bytesAvailable);
+    EXPECT_EQ(published, bytesAvailable);
+    EXPECT_FALSE(sb->publicationRequested);
+
+    // Case 5: The consumer publishes on behalf of an idle producer
+    sb->reserveProducerSpace(5);
+    sb->finishReservation(5);
+    sb->peek(&bytesAvailable);
+    EXPECT_EQ(published, bytesAvailable);
+
+    published += 5;
+    sb->peek(&bytesAvailable, true);
+    EXPECT_EQ(published, bytesAvailable);
+    EXPECT_EQ(sb->producerPos, sb->publishedPos);
+
+    // Case 6: The buffer can't be deleted until everything is consumed
+    sb->reserveProducerSpace(5);
+    sb->finishReservation(5);
+    sb->consume(published);
+    sb->shouldDeallocate = true;
+    EXPECT_FALSE(sb->checkCanDelete());
+
+    sb->publish();
+    EXPECT_FALSE(sb->checkCanDelete());
+    sb->peek(&bytesAvailable);
+    EXPECT_EQ(5U, bytesAvailable);
+    sb->consume(5);
+    EXPECT_TRUE(sb->checkCanDelete());
+}
+
+TEST_F(NanoLogTest, StagingBuffer_reserveSpaceInternal_publishes) {
+    uint64_t bytesAvailable = -1;
+
+    sb->reserveProducerSpace(10);
+    sb->finishReservation(10);
+    sb->peek(&bytesAvailable);
+    EXPECT_EQ(0U, bytesAvailable);
+
+    // A producer about to block must make its bytes visible
+    EXPECT_EQ(nullptr, sb->reserveSpaceInternal(bufferSize, false));
     sb->peek(&bytesAvailable);
     EXPECT_EQ(10U, bytesAvailable);
 }
+
+TEST_F(NanoLogTest, BacktraceRing_reserve) {
+    const uint64_t size = NanoLogConfig::BACKTRACE_RING_SIZE;
+    const uint32_t entrySize = downCast<uint32_t>(size/4 - 1000);
+    char *ring;
+
+    // Fill the ring until the next entry no longer fits at the end
+    for (uint32_t i = 0; i < 4; ++i) {
+        ring = sb->reserveBacktraceSpace(entrySize);
+        ASSERT_NE(nullptr, ring);
+        EXPECT_EQ(sb->backtraceRing->storage + i*entrySize, ring);
+
+        auto *ue = reinterpret_cast<Log::UncompressedEntry*>(ring);
+        ue->fmtId = i;
+        ue->timestamp = i;
+        ue->entrySize = entrySize;
+        sb->backtraceRing->finishReservation(entrySize);
+    }
+
+    RuntimeLogger::BacktraceRing *br = sb->backtraceRing;
+    EXPECT_EQ(4U*entrySize, br->head);
+    EXPECT_EQ(0U, br->tail);
+
+    // The end of the ring is padded and the oldest entry discarded
+    ring = sb->reserveBacktraceSpace(entrySize);
+    EXPECT_EQ(br->storage, ring);
+    EXPECT_EQ(1U*entrySize, br->tail);
+    EXPECT_EQ(4U*entrySize, br->head);
+
+    auto *pad = reinterpret_cast<Log::UncompressedEntry*>(
+                                        br->storage + 4*entrySize);
+    uint32_t paddingId = RuntimeLogger::BacktraceRing::PADDING_ID;
+    EXPECT_EQ(paddingId, pad->fmtId);
+    EXPECT_EQ(size - 4*entrySize, br->getEntrySize(4*entrySize));
+
+    br->finishReservation(entrySize);
+    EXPECT_EQ(size + entrySize, br->head);
+
+    // Too little space for a header is padded implicitly
+    EXPECT_EQ(4U, br->getEntrySize(size - 4));
+
+    // Messages too large to retain are rejected
+    EXPECT_EQ(nullptr, sb->reserveBacktraceSpace(size/2));
+}
+
+TEST_F(NanoLogTest, BacktraceRing_requestDump) {
+    sb->reserveBacktraceSpace(100);
+    RuntimeLogger::BacktraceRing *br = sb->backtraceRing;
+    EXPECT_FALSE(br->isDumpPending(0));
+
+    // Triggers that predate the ring are ignored
+    EXPECT_FALSE(br->isDumpPending(br->dumpHandledAt - 1));
+    EXPECT_TRUE(br->isDumpPending(br->dumpHandledAt + 1));
+
+    // The buffer can't be deleted until the dump is output
+    sb->shouldDeallocate = true;
+    EXPECT_TRUE(sb->checkCanDelete());
+    br->requestDump();
+    EXPECT_TRUE(br->isDumpPending(0));
+    EXPECT_FALSE(sb->checkCanDelete());
+
+    br->dumpHandledAt = br->dumpRequestedAt;
+    EXPECT_TRUE(sb->checkCanDelete());
+}
+
+TEST_F(NanoLogTest, PriorityRing_reserveAndPeek) {
+    const uint64_t size = NanoLogConfig::PRIORITY_RING_SIZE;
+    const uint32_t entrySize = downCast<uint32_t>(size/4 - 1000);
+    RuntimeLogger::PriorityRing &pr = sb->priorityRing;
+    uint64_t bytesAvailable;
+    char *ring;
+
+    EXPECT_TRUE(pr.isEmpty());
+    EXPECT_EQ(pr.storage, pr.peek(&bytesAvailable));
+    EXPECT_EQ(0U, bytesAvailable);
+
+    for (uint32_t i = 0; i < 4; ++i) {
+        ring = pr.reserve(entrySize);
+        ASSERT_NE(nullptr, ring);
+        EXPECT_EQ(pr.storage + i*entrySize, ring);
+
+        auto *ue = reinterpret_cast<Log::UncompressedEntry*>(ring);
+        ue->fmtId = i;
+        ue->timestamp = i;
+        ue->entrySize = entrySize;
+        pr.finishReservation();
+    }
+
+    // Unlike the BacktraceRing, nothing is discarded when it's full
+    EXPECT_EQ(nullptr, pr.reserve(entrySize));
+    EXPECT_EQ(0U, pr.tail);
+
+    EXPECT_EQ(pr.storage, pr.peek(&bytesAvailable));
+    EXPECT_EQ(4U*entrySize, bytesAvailable);
+    pr.consume(entrySize);
+
+    // The end of the ring is padded and the padding is never peek()-ed
+    ring = pr.reserve(entrySize);
+    EXPECT_EQ(pr.storage, ring);
+    reinterpret_cast<Log::UncompressedEntry*>(ring)->entrySize = entrySize;
+    pr.finishReservation();
+    EXPECT_EQ(size + entrySize, pr.head);
+
+    EXPECT_EQ(pr.storage + entrySize, pr.peek(&bytesAvailable));
+    EXPECT_EQ(3U*entrySize, bytesAvailable);
+    pr.consume(bytesAvailable);
+
+    EXPECT_EQ(pr.storage, pr.peek(&bytesAvailable));
+    EXPECT_EQ(entrySize, bytesAvailable);
+    EXPECT_EQ(size, pr.tail);
+    pr.consume(bytesAvailable);
+    EXPECT_TRUE(pr.isEmpty());
+
+    // Messages too large to expedite are rejected
+    EXPECT_EQ(nullptr, pr.reserve(size/2));
+}
+
+TEST_F(NanoLogTest, Rings_trimReservation) {
+    RuntimeLogger::PriorityRing &pr = sb->priorityRing;
+    char *ring = pr.reserve(200);
+    ASSERT_NE(nullptr, ring);
+    pr.trimReservation(150);
+    pr.finishReservation();
+    EXPECT_EQ(50U, pr.head);
+    EXPECT_EQ(pr.storage + 50, pr.reserve(100));
+
+    ring = sb->reserveBacktraceSpace(200);
+    RuntimeLogger::BacktraceRing *br = sb->backtraceRing;
+    ASSERT_NE(nullptr, br);
+    EXPECT_EQ(br->storage, ring);
+    br->trimReservation(150);
+    br->finishReservation(50);
+    EXPECT_EQ(50U, br->head);
+    EXPECT_EQ(br->storage + 50, br->reserve(100));
+}
+
+TEST_F(NanoLogTest, BlockCompressionStage_submit) {
+    const char *testFile = "/tmp/testFile";
+    int fd = open(testFile, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    ASSERT_LE(0, fd);
+
+    std::string input;
+    for (int i = 0; i < 1000; ++i)
+        input += "Block compressed log message " + std::to_string(i) + "\n";
+
+    RuntimeLogger::BlockCompressionStage stage;
+    for (int i = 0; i < 2; ++i) {
+        stage.submit(fd, input.data(), input.size(), BlockCodec::LZ);
+        stage.wait();
+        EXPECT_FALSE(stage.isBusy());
+        EXPECT_FALSE(stage.writeFailed);
+    }
+
+    // The thread is restarted by the next submit() after a stop()
+    stage.stop();
+    EXPECT_FALSE(stage.thread.joinable());
+    stage.submit(fd, input.data(), 10, BlockCodec::LZ);
+    stage.wait();
+
+    EXPECT_EQ(3U, stage.numBlocks);
+    EXPECT_EQ(1U, stage.numBlocksStored);
+    EXPECT_EQ(2*input.size() + 10, stage.totalBytesIn);
+
+    // Each output buffer is written as a CompressedBlock
+    std::vector<char> file(stage.totalBytesOut);
+    ASSERT_EQ(ssize_t(file.size()), pread(fd, file.data(), file.size(), 0));
+    close(fd);
+
+    size_t offset = 0;
+    std::vector<char> output(input.size());
+    for (size_t length : {input.size(), input.size(), size_t(10)}) {
+        auto *block = reinterpret_cast<Log::CompressedBlock*>(&file[offset]);
+        EXPECT_EQ(int(Log::CompressedBlock::BLOCK_MARKER), block->marker);
+        EXPECT_EQ(length, block->uncompressedLength);
+
+        offset += sizeof(Log::CompressedBlock);
+        ASSERT_TRUE(BlockCodec::decompress(
+                static_cast<BlockCodec::Codec>(block->codec), &file[offset],
+                block->compressedLength, output.data(), length));
+        EXPECT_EQ(input.substr(0, length), std::string(output.data(), length));
+        offset += block->compressedLength;
+    }
+    EXPECT_EQ(file.size(), offset);
+
+    std::remove(testFile);
+}
 }; //namespace
\ No newline at end of file
@@ -22,6 +22,10 @@
 #include "Common.h"
 #include "Portability.h"
 
+#ifdef NANOLOG_HAS_TARGET_AVX2
+#include <immintrin.h>
+#endif
+
 #ifndef PACKER_H
 #define PACKER_H
 
@@ -42,7 +46,8 @@
  * The current compression scheme used in the pack/unpack functions is to store
  * the fewest number of bytes needed to represent integer values. No compression
  * is performed for floating-point and string types which are stored verbatim
- * into the compressed stream.
+ * into the compressed stream. Doubles can instead be packed relative to their
+ * previous value with packXor() (see below).
  *
  * For the integer values, the algorithm will check the value of the integer
  * and determine how many bytes need to be stored. For example, a value of 127
@@ -60,10 +65,10 @@
  * TODO(syang0) Consider a packing scheme that can encode the special code
  * directly in the stream itself
  *
- * TODO(syang0) A common use case for logs is to log metrics, which tend to be
- * monotonically increasing (i.e. time alive, number of hits, etc), so would it
- * make more sense to start encoding number deltas instead of just the smallest
- * value.
+ * A common use case for logs is to log metrics, which tend to be
+ * monotonically increasing (i.e. time alive, number of hits, etc). Such
+ * integers can instead be encoded as the difference from their previous value
+ * with packDelta(), which the caller needs to keep track of.
  */
 
 namespace BufferUtils {
@@ -289,6 +294,197 @@ unpack(const char **in, uint8_t packNibble) {
     return result;
 }
 
+/**
+ * Packs the difference between an integer and a base value (i.e. the
+ * previous value of the same integer) as a signed 64-bit integer and replaces
+ * the base with the integer. The difference wraps around, so any two values
+ * are encodable regardless of their order.
+ *
+ * \param[in/out] buffer
+ *      char array pointer used to store the compressed difference and bump
+ * \param val
+ *      Integer to pack into the buffer
+ * \param[in/out] base
+ *      Value to compute the difference from; updated to val
+ *
+ * \return
+ *      Special 4-bit value indicating how the difference was packed
+ */
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value, int>::type
+packDelta(char **buffer, T val, uint64_t *base)
+{
+    // Signed integers are sign-extended so that the unpacked value can be
+    // truncated back to T
+    uint64_t current = static_cast<uint64_t>(val);
+    int64_t delta = static_cast<int64_t>(current - *base);
+    *base = current;
+
+    return pack(buffer, delta);
+}
+
+/**
+ * Packs a double as the XOR of its bits with those of a base value (i.e. the
+ * previous value of the same double) in the fashion of the Gorilla time
+ * series database and replaces the base with the double's bits. Similar
+ * values share their sign, exponent and most significant mantissa bits, so
+ * only the bytes in between the leading and trailing zero bytes of the XOR
+ * need to be stored. The special code S returned indicates
+ *      (a) S = [1, 7]  => the S least significant bytes of the XOR were stored
+ *      (b) S = 8       => the XOR was stored in full
+ *      (c) S = [9, 15] => a byte with the number of trailing zero bytes of the
+ *                         XOR was stored followed by the S-9 bytes before them
+ *                         (S = 9 indicates that the value didn't change)
+ * which take the same number of bytes as pack()-ed integers with the same S.
+ *
+ * \param[in/out] buffer
+ *      char array pointer used to store the compressed value and bump
+ * \param val
+ *      Double to pack into the buffer
+ * \param[in/out] base
+ *      Bits of the double to XOR with; updated to those of val
+ *
+ * \return
+ *      Special 4-bit value indicating how the double was packed
+ */
+inline int
+packXor(char **buffer, double val, uint64_t *base)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &val, sizeof(double));
+    uint64_t xorBits = bits ^ *base;
+    *base = bits;
+
+    if (xorBits == 0) {
+        *(*buffer)++ = 0;
+        return 9;
+    }
+
+    int leadingBytes = __builtin_clzll(xorBits)/8;
+    int trailingBytes = __builtin_ctzll(xorBits)/8;
+    int meaningfulBytes = 8 - leadingBytes - trailingBytes;
+
+    if (trailingBytes == 0 || meaningfulBytes > 6) {
+        int numBytes = (trailingBytes == 0) ? meaningfulBytes : 8;
+        std::memcpy(*buffer, &xorBits, sizeof(uint64_t));
+        *buffer += numBytes;
+        return numBytes;
+    }
+
+    *(*buffer)++ = static_cast<char>(trailingBytes);
+    xorBits >>= 8*trailingBytes;
+    std::memcpy(*buffer, &xorBits, sizeof(uint64_t));
+    *buffer += meaningfulBytes;
+    return 9 + meaningfulBytes;
+}
+
+/**
+ * Reverses the operation of packXor() and bumps the input pointer.
+ *
+ * \param in
+ *      char array to decode the value from
+ * \param packResult
+ *      special 4-bit code returned from packXor()
+ * \param[in/out] base
+ *      Bits of the double passed to packXor(); updated to those returned
+ *
+ * \return
+ *      The original double
+ */
+inline double
+unpackXor(const char **in, uint8_t packResult, uint64_t *base)
+{
+    uint64_t xorBits = 0;
+    if (packResult <= 8) {
+        std::memcpy(&xorBits, *in, packResult);
+        *in += packResult;
+    } else {
+        int trailingBytes = 0x7 & *(*in)++;
+        int meaningfulBytes = packResult - 9;
+        std::memcpy(&xorBits, *in, meaningfulBytes);
+        *in += meaningfulBytes;
+        xorBits <<= 8*trailingBytes;
+    }
+
+    *base ^= xorBits;
+
+    double val;
+    std::memcpy(&val, base, sizeof(double));
+    return val;
+}
+
+/**
+ * Packs an unsigned integer into a variable number of bytes, 7 bits at a time
+ * starting with the least significant, with the high bit of each byte marking
+ * that more bytes follow. Unlike pack(), this does not need a nibble to
+ * describe the encoding and can be used in the variable length (i.e. string)
+ * section of the compressed log.
+ *
+ * \param[in/out] buffer
+ *      char array pointer used to store the compressed value and bump
+ * \param val
+ *      Value to pack into the buffer
+ *
+ * \return
+ *      Number of bytes used to encode the value
+ */
+inline int
+packVarint(char **buffer, uint32_t val)
+{
+    int bytes = 1;
+    while (val >= 0x80) {
+        *(*buffer)++ = static_cast<char>(0x80 | (val & 0x7f));
+        val >>= 7;
+        ++bytes;
+    }
+
+    *(*buffer)++ = static_cast<char>(val);
+    return bytes;
+}
+
+/**
+ * Returns the number of bytes packVarint() would use to encode a value.
+ *
+ * \param val
+ *      Value to be packed
+ */
+inline int
+getVarintSize(uint32_t val)
+{
+    int bytes = 1;
+    while (val >= 0x80) {
+        val >>= 7;
+        ++bytes;
+    }
+
+    return bytes;
+}
+
+/**
+ * Reverses the operation of packVarint() and bumps the input pointer.
+ *
+ * \param in
+ *      char array to decode the value from
+ *
+ * \return
+ *      Value before it was packed
+ */
+inline uint32_t
+unpackVarint(const char **in)
+{
+    uint32_t val = 0;
+    int shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = static_cast<uint8_t>(*(*in)++);
+        val |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && shift < 32);
+
+    return val;
+}
+
 /**
  * Given a stream of nibbles, return the total number of bytes used to represent
  * the values encoded with the nibbles.
@@ -328,6 +524,261 @@ getSizeOfPackedValues(const TwoNibbles *nibbles, uint32_t numNibbles)
     return size;
 }
 
+/**
+ * Below are batch versions of pack() and unpack() for runs of integers, such
+ * as all the arguments of a log message that takes only integers. They
+ * produce and consume exactly the same bytes and nibbles as the one at a
+ * time versions, but avoid their branches over byte counts, and
+ * unpackIntegers() uses AVX2 instructions when the CPU supports them.
+ *
+ * The batch versions operate on 64-bit values. To pack an integer as pack()
+ * would, it is first converted with getPackable(), which applies the
+ * negation pack() would apply. Conversely, unpackIntegers() returns the bits
+ * of unpack<int64_t>(), which can be truncated to the original type.
+ */
+
+/**
+ * Converts an integer into the 64-bit value pack() would store the bytes of,
+ * and indicates whether pack() would negate it.
+ *
+ * \param val
+ *      Integer to be packed
+ * \param[out] negated
+ *      Set to 8 if the integer is negated (i.e. the amount to add to the
+ *      number of bytes to get the nibble), otherwise 0
+ *
+ * \return
+ *      Value to pass to packIntegers()
+ */
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value &&
+                                !std::is_signed<T>::value, uint64_t>::type
+getPackable(T val, uint8_t *negated)
+{
+    *negated = 0;
+    return val;
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value &&
+                                std::is_signed<T>::value &&
+                                sizeof(T) <= sizeof(int32_t), uint64_t>::type
+getPackable(T val, uint8_t *negated)
+{
+    // Smaller signed integers are promoted to int32_t by pack()
+    int32_t promoted = val;
+    if (promoted >= 0 || promoted <= int32_t(-(1<<24))) {
+        *negated = 0;
+        return static_cast<uint32_t>(promoted);
+    }
+
+    *negated = 8;
+    return static_cast<uint32_t>(-promoted);
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value &&
+                                std::is_signed<T>::value &&
+                                sizeof(T) == sizeof(int64_t), uint64_t>::type
+getPackable(T val, uint8_t *negated)
+{
+    int64_t promoted = val;
+    if (promoted >= 0 || promoted <= int64_t(-(1LL<<56))) {
+        *negated = 0;
+        return static_cast<uint64_t>(promoted);
+    }
+
+    *negated = 8;
+    return static_cast<uint64_t>(-promoted);
+}
+
+/**
+ * Returns the number of bytes pack() uses to store a (non-negative) value.
+ *
+ * \param val
+ *      Value returned by getPackable()
+ */
+inline int
+getPackedSize(uint64_t val)
+{
+    // The | 1 takes care of zero, for which the leading zeros are undefined
+    return (64 + 7 - __builtin_clzll(val | 1))/8;
+}
+
+/**
+ * Packs a run of integers (converted with getPackable()) and their nibbles
+ * the same way invoking pack() on each integer would. Like pack(), this
+ * stores each value in full (i.e. 8 bytes), so the buffer needs room for
+ * that many bytes past the last packed byte.
+ *
+ * Unlike unpackIntegers(), this has no AVX2 implementation: counting the
+ * bytes of a value takes a single instruction (i.e. lzcnt), and an AVX2
+ * implementation counting the bytes of 4 values at a time was no faster.
+ *
+ * \param[in/out] buffer
+ *      char array pointer used to store the compressed values and bump
+ * \param nibbles
+ *      Location to store the nibbles at, starting with the first nibble of
+ *      the first TwoNibbles
+ * \param values
+ *      Values to pack, as returned by getPackable()
+ * \param negated
+ *      Negation indications returned by getPackable()
+ * \param count
+ *      Number of values to pack
+ */
+inline void
+packIntegers(char **buffer, TwoNibbles *nibbles, const uint64_t *values,
+             const uint8_t *negated, int count)
+{
+    char *out = *buffer;
+    for (int i = 0; i < count; ++i) {
+        int numBytes = getPackedSize(values[i]);
+        std::memcpy(out, &values[i], sizeof(uint64_t));
+        out += numBytes;
+
+        if (i & 0x1)
+            nibbles[i/2].second = 0xf & (numBytes + negated[i]);
+        else
+            nibbles[i/2].first = 0xf & (numBytes + negated[i]);
+    }
+
+    *buffer = out;
+}
+
+#ifdef NANOLOG_HAS_TARGET_AVX2
+/**
+ * Returns whether the CPU supports AVX2 instructions.
+ */
+inline bool
+cpuHasAvx2()
+{
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2;
+}
+#endif // NANOLOG_HAS_TARGET_AVX2
+
+// Number of bytes unpack() consumes for each nibble value
+static const uint8_t unpackedSizes[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8,
+                                          1, 2, 3, 4, 5, 6, 7};
+
+/**
+ * Scalar implementation of unpackIntegers(); see below.
+ */
+inline void
+unpackIntegersScalar(const char **in, const char *end,
+                     const TwoNibbles *nibbles, int count, uint64_t *values)
+{
+    const char *pos = *in;
+    for (int i = 0; i < count; ++i) {
+        uint8_t nibble = (i & 0x1) ? nibbles[i/2].second : nibbles[i/2].first;
+        int numBytes = unpackedSizes[nibble];
+
+        // Reading a whole word and masking it avoids a variable length copy
+        uint64_t value = 0;
+        if (end - pos >= static_cast<long>(sizeof(uint64_t))) {
+            std::memcpy(&value, pos, sizeof(uint64_t));
+            if (numBytes < 8)
+                value &= (1ULL << (8*numBytes)) - 1;
+        } else {
+            std::memcpy(&value, pos, numBytes);
+        }
+
+        values[i] = (nibble > 8) ? -value : value;
+        pos += numBytes;
+    }
+
+    *in = pos;
+}
+
+#ifdef NANOLOG_HAS_TARGET_AVX2
+/**
+ * AVX2 implementation of unpackIntegers(), which gathers 4 values at a time
+ * as whole words, and then masks and negates them as indicated by their
+ * nibbles. The last values are unpacked by the scalar implementation, so
+ * that no words are read past the end of the buffer.
+ */
+NANOLOG_TARGET_AVX2
+inline void
+unpackIntegersAvx2(const char **in, const char *end,
+                   const TwoNibbles *nibbles, int count, uint64_t *values)
+{
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    const __m256i sixtyFour = _mm256_set1_epi64x(64);
+
+    const char *pos = *in;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint8_t n0 = nibbles[i/2].first;
+        uint8_t n1 = nibbles[i/2].second;
+        uint8_t n2 = nibbles[i/2 + 1].first;
+        uint8_t n3 = nibbles[i/2 + 1].second;
+
+        long long o1 = unpackedSizes[n0];
+        long long o2 = o1 + unpackedSizes[n1];
+        long long o3 = o2 + unpackedSizes[n2];
+        long long size = o3 + unpackedSizes[n3];
+        if (end - pos < o3 + static_cast<long long>(sizeof(uint64_t)))
+            break;
+
+        __m256i vals = _mm256_i64gather_epi64(
+                                reinterpret_cast<const long long*>(pos),
+                                _mm256_set_epi64x(o3, o2, o1, 0), 1);
+
+        // Shifting by 64 bits or more yields 0, which masks 0 byte values
+        __m256i bits = _mm256_set_epi64x(8*unpackedSizes[n3],
+                                         8*unpackedSizes[n2],
+                                         8*unpackedSizes[n1],
+                                         8*unpackedSizes[n0]);
+        vals = _mm256_and_si256(vals, _mm256_srlv_epi64(ones,
+                                        _mm256_sub_epi64(sixtyFour, bits)));
+
+        // Negation is (x ^ -1) - -1 for negated values and (x ^ 0) - 0 else
+        __m256i negate = _mm256_set_epi64x(-(n3 > 8), -(n2 > 8),
+                                           -(n1 > 8), -(n0 > 8));
+        vals = _mm256_sub_epi64(_mm256_xor_si256(vals, negate), negate);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), vals);
+        pos += size;
+    }
+
+    *in = pos;
+    unpackIntegersScalar(in, end, nibbles + i/2, count - i, values + i);
+}
+#endif // NANOLOG_HAS_TARGET_AVX2
+
+/**
+ * Unpacks a run of pack()-ed integers the same way invoking
+ * unpack<int64_t>() on each integer would, and bumps the input pointer.
+ *
+ * \param[in/out] in
+ *      char array to decode the values from
+ * \param end
+ *      End of the readable bytes of the char array (the values can be read
+ *      faster if there are bytes past the last one)
+ * \param nibbles
+ *      Nibbles returned by pack(), starting with the first nibble of the
+ *      first TwoNibbles
+ * \param count
+ *      Number of values to unpack
+ * \param[out] values
+ *      Unpacked values, which can be truncated to the types originally
+ *      pack()-ed
+ */
+inline void
+unpackIntegers(const char **in, const char *end, const TwoNibbles *nibbles,
+               int count, uint64_t *values)
+{
+#ifdef NANOLOG_HAS_TARGET_AVX2
+    if (count >= 4 && cpuHasAvx2()) {
+        unpackIntegersAvx2(in, end, nibbles, count, values);
+        return;
+    }
+#endif
+
+    unpackIntegersScalar(in, end, nibbles, count, values);
+}
+
 /**
  * This class takes in a data stream of pack() Nibbles followed by pack()'ed
  * values as produced by the compressor and unpack()'s them one by one.
@@ -395,6 +846,46 @@ public:
         return ret;
     }
 
+    /**
+     * Returns the next packDelta()-ed value in the stream
+     *
+     * \tparam T
+     *      Type of the value originally packed
+     * \param[in/out] base
+     *      Base value passed to packDelta(); updated to the returned value
+     * \return
+     *      Next packDelta()-ed value in the stream
+     */
+    template<typename T>
+    T getNextDelta(uint64_t *base) {
+        *base += static_cast<uint64_t>(getNext<int64_t>());
+        return static_cast<T>(*base);
+    }
+
+    /**
+     * Returns the next packXor()-ed double in the stream
+     *
+     * \param[in/out] base
+     *      Base passed to packXor(); updated to the bits of the double
+     * \return
+     *      Next packXor()-ed double in the stream
+     */
+    double getNextXor(uint64_t *base) {
+        assert(currPackedValue < endOfValues);
+
+        uint8_t nibble = (onFirstNibble) ? nibblePosition->first
+                                         : nibblePosition->second;
+
+        double ret = unpackXor(&currPackedValue, nibble, base);
+
+        if (!onFirstNibble)
+            ++nibblePosition;
+
+        onFirstNibble = !onFirstNibble;
+
+        return ret;
+    }
+
     /**
      * Returns a pointer to to the first byte beyond the last pack()-ed value
      *
@@ -14,9 +14,12 @@
  */
 
 #include <cassert>
+#include <cmath>
 #include <cstdlib>
 #include <cstdio>
 #include <fstream>
+#include <limits>
+#include <vector>
 
 #include "TestUtil.h"
 #include "Packer.h"
@@ -495,6 +498,214 @@ TEST_F(PackerTest, nibbler) {
 
 }
 
+TEST_F(PackerTest, packVarint) {
+    char backing_buffer[100];
+    char *buffer = backing_buffer;
+    const char *readPtr = backing_buffer;
+
+    uint32_t values[] = {0, 1, 127, 128, 300, 16383, 16384, 1U << 28,
+                         std::numeric_limits<uint32_t>::max()};
+    int sizes[] = {1, 1, 1, 2, 2, 2, 3, 5, 5};
+
+    for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); ++i) {
+        EXPECT_EQ(sizes[i], getVarintSize(values[i]));
+        EXPECT_EQ(sizes[i], packVarint(&buffer, values[i]));
+    }
+
+    for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); ++i)
+        EXPECT_EQ(values[i], unpackVarint(&readPtr));
+
+    EXPECT_EQ(buffer, readPtr);
+}
+
+TEST_F(PackerTest, packDelta) {
+    BufferUtils::TwoNibbles nibbles[10];
+    char backing_buffer[1024];
+    char *buffer = backing_buffer;
+
+    // Monotonic values only need their differences from the previous value,
+    // but values going backwards (or wrapping) are also encodable.
+    uint64_t values[] = {1UL << 40, (1UL << 40) + 1, (1UL << 40) + 300,
+                         5, std::numeric_limits<uint64_t>::max(), 0};
+    int sizes[] = {6, 1, 2, 6, 1, 1};
+
+    uint64_t base = 0;
+    int nibbleCntr = 0;
+    char *start = buffer;
+    for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); ++i) {
+        int nibble = packDelta(&buffer, values[i], &base);
+        EXPECT_EQ(values[i], base);
+        EXPECT_EQ(sizes[i], buffer - start);
+        start = buffer;
+
+        if (nibbleCntr & 0x1)
+            nibbles[nibbleCntr++/2].second = 0xf & nibble;
+        else
+            nibbles[nibbleCntr++/2].first = 0xf & nibble;
+    }
+
+    // Signed values are sign-extended
+    int32_t negatives[] = {-5, -6, 100};
+    for (int32_t value : negatives) {
+        int nibble = packDelta(&buffer, value, &base);
+        if (nibbleCntr & 0x1)
+            nibbles[nibbleCntr++/2].second = 0xf & nibble;
+        else
+            nibbles[nibbleCntr++/2].first = 0xf & nibble;
+    }
+
+    uint32_t packedBytes = buffer - backing_buffer;
+    uint32_t nibbleBytes = (nibbleCntr+1)/2;
+    memmove(backing_buffer + nibbleBytes, backing_buffer, packedBytes);
+    memcpy(backing_buffer, nibbles, nibbleBytes);
+
+    Nibbler nb(backing_buffer, nibbleCntr);
+    base = 0;
+    for (uint64_t value : values)
+        EXPECT_EQ(value, nb.getNextDelta<uint64_t>(&base));
+
+    for (int32_t value : negatives)
+        EXPECT_EQ(value, nb.getNextDelta<int32_t>(&base));
+
+    EXPECT_EQ(backing_buffer + nibbleBytes + packedBytes,
+              nb.getEndOfPackedArguments());
+}
+
+TEST_F(PackerTest, packXor) {
+    BufferUtils::TwoNibbles nibbles[10];
+    char backing_buffer[1024];
+    char *buffer = backing_buffer;
+
+    // Repeated and similar values only need the bytes that differ in their
+    // XOR with the previous value, while dissimilar ones need all 8.
+    double values[] = {100.25, 100.25, 100.5, -100.5, 0.1,
+                       std::nextafter(0.1, 1.0)};
+    int sizes[] = {4, 1, 2, 2, 8, 1};
+    int expectedNibbles[] = {12, 9, 10, 10, 8, 1};
+
+    uint64_t base = 0;
+    int nibbleCntr = 0;
+    char *start = buffer;
+    for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); ++i) {
+        int nibble = packXor(&buffer, values[i], &base);
+        EXPECT_EQ(expectedNibbles[i], nibble);
+        EXPECT_EQ(sizes[i], buffer - start);
+        EXPECT_EQ(0, memcmp(&values[i], &base, sizeof(double)));
+        start = buffer;
+
+        if (nibbleCntr & 0x1)
+            nibbles[nibbleCntr++/2].second = 0xf & nibble;
+        else
+            nibbles[nibbleCntr++/2].first = 0xf & nibble;
+    }
+
+    uint32_t packedBytes = buffer - backing_buffer;
+    uint32_t nibbleBytes = (nibbleCntr+1)/2;
+    memmove(backing_buffer + nibbleBytes, backing_buffer, packedBytes);
+    memcpy(backing_buffer, nibbles, nibbleBytes);
+
+    Nibbler nb(backing_buffer, nibbleCntr);
+    base = 0;
+    for (double value : values)
+        EXPECT_EQ(value, nb.getNextXor(&base));
+
+    EXPECT_EQ(backing_buffer + nibbleBytes + packedBytes,
+              nb.getEndOfPackedArguments());
+}
+
+// Packs values with pack() and checks that packIntegers() and
+// unpackIntegers() produce and consume the same bytes and nibbles.
+template<typename T>
+static void
+checkBatchKernels(const std::vector<T> &values)
+{
+    int count = static_cast<int>(values.size());
+    char expected[1024] = {};
+    TwoNibbles expectedNibbles[64] = {};
+    char *out = expected;
+    for (int i = 0; i < count; ++i) {
+        int nibble = pack(&out, values[i]);
+        if (i & 0x1)
+            expectedNibbles[i/2].second = 0xf & nibble;
+        else
+            expectedNibbles[i/2].first = 0xf & nibble;
+    }
+    long expectedBytes = out - expected;
+    int nibbleBytes = (count + 1)/2;
+
+    uint64_t packables[64];
+    uint8_t negated[64];
+    for (int i = 0; i < count; ++i)
+        packables[i] = getPackable(values[i], &negated[i]);
+
+    typedef void (*UnpackFn)(const char**, const char*, const TwoNibbles*,
+                             int, uint64_t*);
+    std::vector<UnpackFn> unpackFns = {unpackIntegers, unpackIntegersScalar};
+#ifdef NANOLOG_HAS_TARGET_AVX2
+    if (cpuHasAvx2())
+        unpackFns.push_back(unpackIntegersAvx2);
+#endif
+
+    char packed[1024] = {};
+    TwoNibbles nibbles[64] = {};
+    out = packed;
+    packIntegers(&out, nibbles, packables, negated, count);
+    ASSERT_EQ(expectedBytes, out - packed);
+    EXPECT_EQ(0, memcmp(expected, packed, expectedBytes));
+    EXPECT_EQ(0, memcmp(expectedNibbles, nibbles, nibbleBytes));
+
+    for (UnpackFn unpackFn : unpackFns) {
+        // Unpacking must not read past the end, with or without slack
+        for (long slack : {0L, 8L}) {
+            uint64_t unpacked[64];
+            const char *in = expected;
+            unpackFn(&in, expected + expectedBytes + slack, expectedNibbles,
+                     count, unpacked);
+            EXPECT_EQ(expected + expectedBytes, in);
+
+            for (int i = 0; i < count; ++i)
+                EXPECT_EQ(values[i], static_cast<T>(unpacked[i]));
+        }
+    }
+}
+
+TEST_F(PackerTest, packIntegers) {
+    // Values of every byte count, both signs, and those pack() won't negate
+    std::vector<int64_t> int64s;
+    for (int bits = 0; bits < 64; bits += 5) {
+        int64s.push_back(int64_t(1) << bits);
+        int64s.push_back(-(int64_t(1) << bits));
+        int64s.push_back((int64_t(1) << bits) - 1);
+    }
+    int64s.push_back(std::numeric_limits<int64_t>::min());
+    int64s.push_back(-(1LL << 56));
+    int64s.push_back(std::numeric_limits<int64_t>::max());
+
+    std::vector<int32_t> int32s = {0, 1, -1, 255, -256, 1 << 20, -(1 << 24),
+                                   -(1 << 24) + 1, -(1 << 24) - 1,
+                                   std::numeric_limits<int32_t>::min(),
+                                   std::numeric_limits<int32_t>::max()};
+
+    std::vector<uint64_t> uint64s;
+    for (int64_t value : int64s)
+        uint64s.push_back(static_cast<uint64_t>(value));
+
+    std::vector<short> shorts = {0, -1, 300, -300, 32767, -32768};
+    std::vector<uint8_t> uint8s = {0, 1, 127, 128, 255};
+
+    checkBatchKernels(int64s);
+    checkBatchKernels(int32s);
+    checkBatchKernels(uint64s);
+    checkBatchKernels(shorts);
+    checkBatchKernels(uint8s);
+
+    // Shorter runs are handled in part or entirely by the scalar kernels
+    for (size_t count = 0; count < 9; ++count) {
+        checkBatchKernels(std::vector<int64_t>(int64s.begin(),
+                                               int64s.begin() + count));
+    }
+}
+
 TEST_F(PackerTest, nibbler_assert) {
     BufferUtils::TwoNibbles nibbles[1000];
     char backing_buffer[1024];
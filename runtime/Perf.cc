@@ -37,6 +37,7 @@
 #include <fstream>
 #include <map>
 #include <thread>
+#include <vector>
 
 #include <unistd.h>
 #include <sched.h>
@@ -45,8 +46,10 @@
 #include <stdio.h>
 #include <xmmintrin.h>
 
+#include "Config.h"
 #include "Cycles.h"
 #include "Log.h"
+#include "NanoLogCpp17.h"
 #include "PerfHelper.h"
 #include "Portability.h"
 #include "Util.h"
@@ -405,6 +408,160 @@ double compressLinearSearch() {
     return Cycles::toSeconds(stop - start)/count;
 }
 
+// Distributions of the integers packed by the pack/unpack benchmarks below:
+// small values (i.e. counters and ids), values of random byte counts, and
+// values of random byte counts and signs.
+enum PackDistribution { SMALL, RANDOM_SIZE, RANDOM_SIGNED };
+
+// Number of integers per log message in the pack/unpack benchmarks
+static const int integersPerMessage = 8;
+
+// Generates count integers of the given distribution for the pack/unpack
+// benchmarks.
+static std::vector<int64_t>
+generatePackValues(PackDistribution distribution, int count)
+{
+    std::vector<int64_t> values(count);
+
+    srand(0);
+    for (int i = 0; i < count; ++i) {
+        if (distribution == SMALL) {
+            values[i] = rand()%200;
+        } else {
+            values[i] = static_cast<int64_t>(1UL << (rand()%63));
+            if (distribution == RANDOM_SIGNED && (rand() & 0x1))
+                values[i] = -values[i];
+        }
+    }
+
+    return values;
+}
+
+// Measure the per integer cost of packing integers one at a time with
+// pack() or in batches of a log message with packIntegers().
+double packIntegersHelper(PackDistribution distribution, bool batch) {
+    const int count = 1000000;
+    std::vector<int64_t> values = generatePackValues(distribution, count);
+    char *buffer = static_cast<char*>(malloc(count*(sizeof(uint64_t) + 1)));
+    auto *nibbles = reinterpret_cast<BufferUtils::TwoNibbles*>(buffer);
+
+    uint64_t start = Cycles::rdtsc();
+    char *out = buffer + count/2;
+    for (int i = 0; i < count; i += integersPerMessage) {
+        if (batch) {
+            uint64_t packables[integersPerMessage];
+            uint8_t negated[integersPerMessage];
+            for (int j = 0; j < integersPerMessage; ++j)
+                packables[j] = BufferUtils::getPackable(values[i + j],
+                                                        &negated[j]);
+
+            BufferUtils::packIntegers(&out, nibbles + i/2, packables,
+                                      negated, integersPerMessage);
+        } else {
+            for (int j = 0; j < integersPerMessage; j += 2) {
+                nibbles[(i + j)/2].first = 0xf & BufferUtils::pack(&out,
+                                                            values[i + j]);
+                nibbles[(i + j)/2].second = 0xf & BufferUtils::pack(&out,
+                                                        values[i + j + 1]);
+            }
+        }
+    }
+    uint64_t stop = Cycles::rdtsc();
+
+    discard(out);
+    free(buffer);
+    return Cycles::toSeconds(stop - start)/count;
+}
+
+double packSmall() {
+    return packIntegersHelper(SMALL, false);
+}
+
+double packIntegersSmall() {
+    return packIntegersHelper(SMALL, true);
+}
+
+double packRandom() {
+    return packIntegersHelper(RANDOM_SIZE, false);
+}
+
+double packIntegersRandom() {
+    return packIntegersHelper(RANDOM_SIZE, true);
+}
+
+double packSigned() {
+    return packIntegersHelper(RANDOM_SIGNED, false);
+}
+
+double packIntegersSigned() {
+    return packIntegersHelper(RANDOM_SIGNED, true);
+}
+
+// Measure the per integer cost of unpacking integers one at a time with
+// unpack() or in batches of a log message with unpackIntegers().
+double unpackIntegersHelper(PackDistribution distribution, bool batch) {
+    const int count = 1000000;
+    std::vector<int64_t> values = generatePackValues(distribution, count);
+    char *buffer = static_cast<char*>(malloc(count*(sizeof(uint64_t) + 1)));
+    auto *nibbles = reinterpret_cast<BufferUtils::TwoNibbles*>(buffer);
+
+    char *out = buffer + count/2;
+    for (int i = 0; i < count; i += 2) {
+        nibbles[i/2].first = 0xf & BufferUtils::pack(&out, values[i]);
+        nibbles[i/2].second = 0xf & BufferUtils::pack(&out, values[i + 1]);
+    }
+    const char *end = out;
+
+    int64_t sum = 0;
+    uint64_t start = Cycles::rdtsc();
+    const char *in = buffer + count/2;
+    for (int i = 0; i < count; i += integersPerMessage) {
+        if (batch) {
+            uint64_t unpacked[integersPerMessage];
+            BufferUtils::unpackIntegers(&in, end, nibbles + i/2,
+                                        integersPerMessage, unpacked);
+            for (int j = 0; j < integersPerMessage; ++j)
+                sum += static_cast<int64_t>(unpacked[j]);
+        } else {
+            for (int j = 0; j < integersPerMessage; j += 2) {
+                sum += BufferUtils::unpack<int64_t>(&in,
+                                                nibbles[(i + j)/2].first);
+                sum += BufferUtils::unpack<int64_t>(&in,
+                                                nibbles[(i + j)/2].second);
+            }
+        }
+    }
+    uint64_t stop = Cycles::rdtsc();
+
+    discard(&sum);
+    free(buffer);
+    return Cycles::toSeconds(stop - start)/count;
+}
+
+double unpackSmall() {
+    return unpackIntegersHelper(SMALL, false);
+}
+
+double unpackIntegersSmall() {
+    return unpackIntegersHelper(SMALL, true);
+}
+
+double unpackRandom() {
+    return unpackIntegersHelper(RANDOM_SIZE, false);
+}
+
+double unpackIntegersRandom() {
+    return unpackIntegersHelper(RANDOM_SIZE, true);
+}
+
+double unpackSigned() {
+    return unpackIntegersHelper(RANDOM_SIGNED, false);
+}
+
+double unpackIntegersSigned() {
+    return unpackIntegersHelper(RANDOM_SIGNED, true);
+}
+
 double delayInBenchmark() {
     int count = 1000000;
     uint64_t x = 0;
@@ -855,6 +1012,153 @@ double mm_stream_pi_contended()
     return Cycles::toSeconds(stop - start)/(count);
 }
 
+/**
+ * Consumer half of the publishHelper benchmark below; it continuously polls
+ * the position published by the producer the way the compression thread
+ * polls a StagingBuffer, which pulls the cache line holding the position
+ * over to its core.
+ */
+void publishedPosReader(char* volatile *publishedPos,
+                        volatile bool *run,
+                        pthread_barrier_t *barrier,
+                        int core=0)
+{
+    bindThreadToCpu(core);
+    pthread_barrier_wait(barrier);
+
+    uint64_t sum = 0;
+    while(*run) {
+        sum += reinterpret_cast<uint64_t>(*publishedPos);
+        NanoLogInternal::Fence::lfence();
+    }
+
+    discard(&sum);
+}
+
+/**
+ * Measures the cost for a producer to record a 32-byte log entry and publish
+ * its new position every publishInterval entries while a consumer on another
+ * core is polling said position. This mimics the StagingBuffer's
+ * finishReservation() with a PUBLISH_THRESHOLD_RECORDS of publishInterval
+ * and shows the cross-core traffic saved by coalescing publications.
+ */
+double publishHelper(int publishInterval)
+{
+    const int entrySize = 32;
+    const int count = 1000000;
+    const uint32_t storageSize = NanoLogConfig::STAGING_BUFFER_SIZE;
+    char *storage = static_cast<char*>(malloc(storageSize));
+    memset(storage, 0, storageSize);
+
+    // Keep the published position on its own cache line
+    char *backing_buffer = static_cast<char*>(malloc(3*64));
+    char* volatile *publishedPos = reinterpret_cast<char* volatile*>(
+                                                        backing_buffer + 64);
+    *publishedPos = storage;
+
+    char *producerPos = storage;
+    int unpublishedRecords = 0;
+
+    volatile bool run = true;
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, 2);
+    std::thread consumerThread(publishedPosReader, publishedPos, &run,
+                                &barrier, 0);
+    pthread_barrier_wait(&barrier);
+
+    uint64_t start = Cycles::rdtsc();
+    for (int i = 0; i < count; i++) {
+        memset(producerPos, i, entrySize);
+        NanoLogInternal::Fence::sfence();
+        producerPos += entrySize;
+
+        if (producerPos + entrySize > storage + storageSize)
+            producerPos = storage;
+
+        if (++unpublishedRecords >= publishInterval) {
+            unpublishedRecords = 0;
+            *publishedPos = producerPos;
+        }
+    }
+    uint64_t stop = Cycles::rdtsc();
+
+    run = false;
+    consumerThread.join();
+    pthread_barrier_destroy(&barrier);
+
+    discard(storage);
+    free(backing_buffer);
+    free(storage);
+    return Cycles::toSeconds(stop - start)/(count);
+}
+
+double publishEveryLog() {
+    return publishHelper(1);
+}
+
+double publishCoalesced() {
+    return publishHelper(NanoLogConfig::PUBLISH_THRESHOLD_RECORDS);
+}
+
+/**
+ * Thread run by skewedThreads() that emits a log message every logInterval
+ * until told to stop.
+ */
+void coldLogger(volatile bool *run, pthread_barrier_t *barrier,
+                uint64_t logIntervalCycles)
+{
+    pthread_barrier_wait(barrier);
+    uint64_t nextLog = Cycles::rdtsc();
+    int i = 0;
+    while (*run) {
+        if (Cycles::rdtsc() >= nextLog) {
+            NANO_LOG(NOTICE, "Cold thread heartbeat %d", ++i);
+            nextLog += logIntervalCycles;
+        }
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * Measures the average cost of a log message on one thread logging
+ * back-to-back while 50 other threads log once a millisecond. Each of the
+ * cold threads holds a StagingBuffer that the compression thread must visit,
+ * so this measures how well the hot thread's backlog is serviced before it
+ * blocks on a full StagingBuffer.
+ */
+double skewedThreads()
+{
+    const int numColdThreads = 50;
+    const int count = 10000000;
+
+    NanoLog::setLogFile("/tmp/skewedThreads.nanolog");
+
+    volatile bool run = true;
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, numColdThreads + 1);
+
+    std::vector<std::thread> coldThreads;
+    for (int i = 0; i < numColdThreads; ++i)
+        coldThreads.emplace_back(coldLogger, &run, &barrier,
+                                 Cycles::fromSeconds(1e-3));
+    pthread_barrier_wait(&barrier);
+
+    uint64_t start = Cycles::rdtsc();
+    for (int i = 0; i < count; ++i) {
+        NANO_LOG(NOTICE, "Hot thread message %d with a double %lf", i, 0.5);
+    }
+    uint64_t stop = Cycles::rdtsc();
+
+    run = false;
+    for (auto &thread : coldThreads)
+        thread.join();
+    pthread_barrier_destroy(&barrier);
+
+    NanoLog::sync();
+    unlink("/tmp/skewedThreads.nanolog");
+    return Cycles::toSeconds(stop - start)/count;
+}
+
 // Cost of notifying a condition variable
 double notify_all() {
     int count = 1000000;
@@ -1239,6 +1543,30 @@ TestInfo tests[] = {
      "Compress 1M uint64_t's via binary searching if-statements"},
     {"compressLinearSearch", compressLinearSearch,
      "Compress 1M uint64_t's via linear searching for-loop"},
+    {"packSmall", packSmall,
+     "pack() 8 int64_t's < 200, one at a time"},
+    {"packIntegersSmall", packIntegersSmall,
+     "packIntegers() 8 int64_t's < 200"},
+    {"packRandom", packRandom,
+     "pack() 8 int64_t's of random sizes, one at a time"},
+    {"packIntegersRandom", packIntegersRandom,
+     "packIntegers() 8 int64_t's of random sizes"},
+    {"packSigned", packSigned,
+     "pack() 8 int64_t's of random sizes/signs, one at a time"},
+    {"packIntegersSigned", packIntegersSigned,
+     "packIntegers() 8 int64_t's of random sizes/signs"},
+    {"unpackSmall", unpackSmall,
+     "unpack() 8 int64_t's < 200, one at a time"},
+    {"unpackIntegersSmall", unpackIntegersSmall,
+     "unpackIntegers() 8 int64_t's < 200"},
+    {"unpackRandom", unpackRandom,
+     "unpack() 8 int64_t's of random sizes, one at a time"},
+    {"unpackIntegersRandom", unpackIntegersRandom,
+     "unpackIntegers() 8 int64_t's of random sizes"},
+    {"unpackSigned", unpackSigned,
+     "unpack() 8 int64_t's of random sizes/signs, one at a time"},
+    {"unpackIntegersSigned", unpackIntegersSigned,
+     "unpackIntegers() 8 int64_t's of random sizes/signs"},
     {"delayInBenchmark", delayInBenchmark,
      "Taking an addition, modulo, and rdtsc()"},
     {"div32", div32,
@@ -1293,6 +1621,10 @@ TestInfo tests[] = {
      "Cost to write 8-bytes without polluting cache"},
     {"mm_stream_pi_contended", mm_stream_pi_contended,
      "mm_stream_pi with a second thread reading the variable"},
+    {"publishEveryLog", publishEveryLog,
+     "Record+publish a 32B log with a consumer polling"},
+    {"publishCoalesced", publishCoalesced,
+     "publishEveryLog, but publishing every few logs"},
     {"notify_all", notify_all,
      "condition_variable.notify_all()"},
     {"notify_one", notify_one,
@@ -1301,6 +1633,8 @@ TestInfo tests[] = {
      "cost of an rdtsc call"},
     {"rdtscp", rdtscp_test,
      "cost of an rdtscp call"},
+    {"skewedThreads", skewedThreads,
+     "NANO_LOG on a hot thread with 50 cold logging threads"},
     {"sched_getcpu", sched_getcpu_test,
      "Cost of sched_getcpu"},
     {"snprintfFileLocation", snprintfFileLocation,
@@ -17,6 +17,16 @@
 #define NANOLOG_NOINLINE
 #endif
 
+// Functions marked NANOLOG_TARGET_AVX2 may use AVX2 instructions regardless
+// of the compiler flags, and must only be invoked after checking that the CPU
+// supports them (i.e. with __builtin_cpu_supports("avx2"))
+#if defined(__GNUC__) && defined(__x86_64__)
+#define NANOLOG_HAS_TARGET_AVX2 1
+#define NANOLOG_TARGET_AVX2 __attribute__((__target__("avx2")))
+#else
+#define NANOLOG_TARGET_AVX2
+#endif
+
 #ifdef _MSC_VER
 #define NANOLOG_PACK_PUSH __pragma(pack(push, 1))
 #define NANOLOG_PACK_POP __pragma(pack(pop))
@@ -14,13 +14,18 @@
  */
 
 
+#include <algorithm>
 #include <fcntl.h>
+#include <functional>
 #include <iosfwd>
 #include <iostream>
 #include <locale>
+#include <signal.h>
 #include <sstream>
 #include <string>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "Cycles.h"         /* Cycles::rdtsc() */
@@ -34,9 +39,40 @@ namespace NanoLogInternal {
 __thread RuntimeLogger::StagingBuffer *RuntimeLogger::stagingBuffer = nullptr;
 thread_local RuntimeLogger::StagingBufferDestroyer RuntimeLogger::sbc;
 RuntimeLogger RuntimeLogger::nanoLogSingleton;
-
-// RuntimeLogger constructor
+__thread RuntimeLogger::StagingBuffer *
+        RuntimeLogger::loggerStagingBuffers[NanoLogConfig::MAX_LOGGERS] = {};
+RuntimeLogger *RuntimeLogger::loggers[NanoLogConfig::MAX_LOGGERS] = {};
+std::mutex RuntimeLogger::loggersMutex;
+volatile sig_atomic_t RuntimeLogger::flightRecorderSignaled = 0;
+volatile sig_atomic_t RuntimeLogger::crashSignal = 0;
+__thread bool RuntimeLogger::isCompressionThread = false;
+RuntimeLogger::SignalSafeSite *volatile
+                            RuntimeLogger::pendingSignalSafeSites = nullptr;
+
+// RuntimeLogger constructor of the default Logger
 RuntimeLogger::RuntimeLogger()
+        : RuntimeLogger(0, "", NanoLogConfig::DEFAULT_LOG_FILE,
+                        openDefaultLogFile(), LoggerOptions())
+{
+}
+
+/**
+ * Constructs a Logger and starts its compression thread.
+ *
+ * \param loggerId
+ *      Index of the Logger in loggers[]
+ * \param name
+ *      Name of the Logger (see createLogger())
+ * \param filename
+ *      Path of the log file
+ * \param fd
+ *      File descriptor of the opened log file, which the Logger takes over
+ * \param options
+ *      Configuration of the Logger
+ */
+RuntimeLogger::RuntimeLogger(uint32_t loggerId, const char *name,
+                             const char *filename, int fd,
+                             const LoggerOptions &options)
         : threadBuffers()
         , nextBufferId()
         , bufferMutex()
@@ -47,11 +83,51 @@ RuntimeLogger::RuntimeLogger()
         , condMutex()
         , workAdded()
         , hintSyncCompleted()
-        , outputFd(-1)
+        , outputFd(fd)
         , aioCb()
         , compressingBuffer(nullptr)
         , outputDoubleBuffer(nullptr)
-        , currentLogLevel(NOTICE)
+        , flightRecorder(nullptr)
+        , flightRecorderSegments(0)
+        , currentSegment(0)
+        , segmentLengths()
+        , flightRecorderDumpFd(-1)
+        , hintDumpCompleted()
+        , activeEncoder(nullptr)
+        , crashDrainRequested(0)
+        , compressionThreadParked(0)
+        , emergencyBuffer(nullptr)
+        , emergencyBufferInUse(0)
+        , signalSafeLogsDropped(0)
+        , agentRegion(nullptr)
+        , agentPid(0)
+        , agentParentPid(0)
+        , agentSyncPending(false)
+        , agentSyncTarget(0)
+        , agentExiting(false)
+        , agentForking(false)
+        , perProcessLogFiles(false)
+        , logFilePath(filename)
+        , aioAvailable(true)
+        , loggerId(loggerId)
+        , loggerName(name)
+        , overflowPolicy(options.overflowPolicy)
+        , outputFileFlags(NanoLogConfig::FILE_PARAMS |
+                          (options.durable ? O_DSYNC : 0))
+        , timestampShift(options.coarseTimestamps
+                            ? NanoLogConfig::COARSE_TIMESTAMP_SHIFT : 0)
+        , blockCompression(options.blockCompression)
+        , blockStage(nullptr)
+        , outputToBlockStage(false)
+        , logsDropped(0)
+        , currentLogLevel(options.logLevel)
+        , backtraceLogLevel(SILENT_LOG_LEVEL)
+        , priorityLogLevel(SILENT_LOG_LEVEL)
+        , numExpeditedWrites(0)
+        , numUrgentBuffersScheduled(0)
+        , backtraceTriggeredAt(0)
+        , backtraceScratch(nullptr)
+        , compressionPasses(0)
         , cycleAtThreadStart(0)
         , cyclesAtLastAIOStart(0)
         , cyclesActive(0)
@@ -72,16 +148,6 @@ RuntimeLogger::RuntimeLogger()
     for (size_t i = 0; i < Util::arraySize(stagingBufferPeekDist); ++i)
         stagingBufferPeekDist[i] = 0;
 
-    const char *filename = NanoLogConfig::DEFAULT_LOG_FILE;
-    outputFd = open(filename, NanoLogConfig::FILE_PARAMS, 0666);
-    if (outputFd < 0) {
-        fprintf(stderr, "NanoLog could not open the default file location "
-                "for the log file (\"%s\").\r\n Please check the permissions "
-                "or use NanoLog::setLogFile(const char* filename) to "
-                "specify a different log file.\r\n", filename);
-        std::exit(-1);
-    }
-
     memset(&aioCb, 0, sizeof(aioCb));
 
     int err = posix_memalign(reinterpret_cast<void **>(&compressingBuffer),
@@ -103,21 +169,57 @@ RuntimeLogger::RuntimeLogger()
 #ifndef BENCHMARK_DISCARD_ENTRIES_AT_STAGINGBUFFER
     compressionThread = std::thread(&RuntimeLogger::compressionThreadMain, this);
 #endif
+
+    if (loggerId == 0) {
+        loggers[0] = this;
+        pthread_atfork(&RuntimeLogger::handleForkPrepare,
+                       &RuntimeLogger::handleForkParent,
+                       &RuntimeLogger::handleForkChild);
+    }
+}
+
+/**
+ * Opens the log file of the default Logger, exiting on failure.
+ *
+ * \return
+ *      File descriptor of the log file
+ */
+int
+RuntimeLogger::openDefaultLogFile()
+{
+    const char *filename = NanoLogConfig::DEFAULT_LOG_FILE;
+    int fd = open(filename, NanoLogConfig::FILE_PARAMS, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "NanoLog could not open the default file location "
+                "for the log file (\"%s\").\r\n Please check the permissions "
+                "or use NanoLog::setLogFile(const char* filename) to "
+                "specify a different log file.\r\n", filename);
+        std::exit(-1);
+    }
+
+    return fd;
 }
 
 // RuntimeLogger destructor
 RuntimeLogger::~RuntimeLogger() {
-    sync();
-
-    // Stop the compression thread
-    {
-        std::lock_guard<std::mutex> lock(nanoLogSingleton.condMutex);
-        nanoLogSingleton.compressionThreadShouldExit = true;
-        nanoLogSingleton.workAdded.notify_all();
+    // The other Loggers output everything before the default one goes away
+    if (loggerId == 0) {
+        std::lock_guard<std::mutex> lock(loggersMutex);
+        for (uint32_t i = 1; i < NanoLogConfig::MAX_LOGGERS; ++i) {
+            delete loggers[i];
+            loggers[i] = nullptr;
+        }
     }
 
-    if (nanoLogSingleton.compressionThread.joinable())
-        nanoLogSingleton.compressionThread.join();
+    sync_internal();
+    stopCompressionThread();
+
+    // The agent exits once it has output everything
+    if (agentPid > 0) {
+        agentRegion->shouldExit = 1;
+        waitpid(agentPid, nullptr, 0);
+        agentPid = 0;
+    }
 
     // Free all the data structures
     if (compressingBuffer) {
@@ -130,6 +232,21 @@ RuntimeLogger::~RuntimeLogger() {
         outputDoubleBuffer = nullptr;
     }
 
+    if (backtraceScratch) {
+        free(backtraceScratch);
+        backtraceScratch = nullptr;
+    }
+
+    if (flightRecorder) {
+        free(flightRecorder);
+        flightRecorder = nullptr;
+    }
+
+    if (blockStage) {
+        delete blockStage;
+        blockStage = nullptr;
+    }
+
     if (outputFd > 0)
         close(outputFd);
 
@@ -139,33 +256,41 @@ RuntimeLogger::~RuntimeLogger() {
 // Documentation in NanoLog.h
 std::string
 RuntimeLogger::getStats() {
+    return nanoLogSingleton.getStats_internal();
+}
+
+/**
+ * Implements getStats() for this Logger.
+ */
+std::string
+RuntimeLogger::getStats_internal() {
     std::ostringstream out;
     char buffer[1024];
     // Leaks abstraction, but basically flush so we get all the time
     uint64_t start = PerfUtils::Cycles::rdtsc();
-    fdatasync(nanoLogSingleton.outputFd);
+    fdatasync(outputFd);
     uint64_t stop = PerfUtils::Cycles::rdtsc();
-    nanoLogSingleton.cyclesDiskIO_upperBound += (stop - start);
+    cyclesDiskIO_upperBound += (stop - start);
 
     double outputTime =
-            PerfUtils::Cycles::toSeconds(nanoLogSingleton.cyclesDiskIO_upperBound);
+            PerfUtils::Cycles::toSeconds(cyclesDiskIO_upperBound);
     double compressTime =
-            PerfUtils::Cycles::toSeconds(nanoLogSingleton.cyclesCompressing);
+            PerfUtils::Cycles::toSeconds(cyclesCompressing);
     double workTime = outputTime + compressTime;
 
     double totalBytesWrittenDouble = static_cast<double>(
-            nanoLogSingleton.totalBytesWritten);
+            totalBytesWritten);
     double totalBytesReadDouble = static_cast<double>(
-            nanoLogSingleton.totalBytesRead);
+            totalBytesRead);
     double padBytesWrittenDouble = static_cast<double>(
-            nanoLogSingleton.padBytesWritten);
+            padBytesWritten);
     double numEventsProcessedDouble = static_cast<double>(
-            nanoLogSingleton.logsProcessed);
+            logsProcessed);
 
     snprintf(buffer, 1024,
                "\r\nWrote %lu events (%0.2lf MB) in %0.3lf seconds "
                    "(%0.3lf seconds spent compressing)\r\n",
-               nanoLogSingleton.logsProcessed,
+               logsProcessed,
                totalBytesWrittenDouble / 1.0e6,
                workTime,
                compressTime);
@@ -173,14 +298,14 @@ RuntimeLogger::getStats() {
 
     snprintf(buffer, 1024,
            "There were %u file flushes and the final sync time was %lf sec\r\n",
-           nanoLogSingleton.numAioWritesCompleted,
+           numAioWritesCompleted,
            PerfUtils::Cycles::toSeconds(stop - start));
     out << buffer;
 
     double secondsAwake =
-            PerfUtils::Cycles::toSeconds(nanoLogSingleton.cyclesActive);
+            PerfUtils::Cycles::toSeconds(cyclesActive);
     double secondsThreadHasBeenAlive = PerfUtils::Cycles::toSeconds(
-            PerfUtils::Cycles::rdtsc() - nanoLogSingleton.cycleAtThreadStart);
+            PerfUtils::Cycles::rdtsc() - cycleAtThreadStart);
     snprintf(buffer, 1024,
                "Compression Thread was active for %0.3lf out of %0.3lf seconds "
                    "(%0.2lf %%)\r\n",
@@ -207,7 +332,7 @@ RuntimeLogger::getStats() {
     snprintf(buffer, 1024,
                 "\t%0.2lf MB per flush with %0.1lf bytes/event\r\n",
                 (totalBytesWrittenDouble / 1.0e6) /
-                                         nanoLogSingleton.numAioWritesCompleted,
+                                         numAioWritesCompleted,
                 totalBytesWrittenDouble * 1.0 / numEventsProcessedDouble);
     out << buffer;
 
@@ -223,11 +348,56 @@ RuntimeLogger::getStats() {
            1.0 * totalBytesReadDouble / (totalBytesWrittenDouble
                                          + padBytesWrittenDouble),
            1.0 * totalBytesReadDouble / totalBytesWrittenDouble,
-           nanoLogSingleton.totalBytesRead,
-           nanoLogSingleton.totalBytesWritten,
-           nanoLogSingleton.padBytesWritten);
+           totalBytesRead,
+           totalBytesWritten,
+           padBytesWritten);
     out << buffer;
 
+    if (blockStage != nullptr && blockStage->numBlocks > 0) {
+        double blockBytesIn = static_cast<double>(blockStage->totalBytesIn);
+        double blockBytesOut = static_cast<double>(blockStage->totalBytesOut);
+        double blockTime =
+                PerfUtils::Cycles::toSeconds(blockStage->cyclesCompressing);
+        snprintf(buffer, 1024, "Block compression shrank the output from "
+                               "%0.2lf MB to %0.2lf MB (%0.2lfx) in %0.3lf "
+                               "seconds on its helper thread (%0.2lf MB/s); "
+                               "%lu of %lu blocks were stored verbatim\r\n",
+                 blockBytesIn / 1.0e6,
+                 blockBytesOut / 1.0e6,
+                 blockBytesIn / blockBytesOut,
+                 blockTime,
+                 (blockBytesIn / 1.0e6) / blockTime,
+                 blockStage->numBlocksStored,
+                 blockStage->numBlocks);
+        out << buffer;
+    }
+
+    if (logsDropped > 0) {
+        snprintf(buffer, 1024, "%lu log messages were dropped on overflow\r\n",
+                 logsDropped);
+        out << buffer;
+    }
+
+    if (numUrgentBuffersScheduled > 0) {
+        snprintf(buffer, 1024, "StagingBuffers were compressed ahead of their "
+                               "turn %lu times due to their backlog\r\n",
+                 numUrgentBuffersScheduled);
+        out << buffer;
+    }
+
+    if (numExpeditedWrites > 0) {
+        snprintf(buffer, 1024, "%lu writes were expedited for log messages "
+                               "at or above the priority log level\r\n",
+                 numExpeditedWrites);
+        out << buffer;
+    }
+
+    if (signalSafeLogsDropped > 0) {
+        snprintf(buffer, 1024, "%lu signal-safe log messages were dropped\r\n",
+                 signalSafeLogsDropped);
+        out << buffer;
+    }
+
     return out.str();
 }
 
@@ -319,31 +489,289 @@ RuntimeLogger::preallocate() {
 void
 RuntimeLogger::waitForAIO() {
     if (hasOutstandingOperation) {
-        if (aio_error(&aioCb) == EINPROGRESS) {
-            const struct aiocb *const aiocb_list[] = {&aioCb};
-            int err = aio_suspend(aiocb_list, 1, NULL);
+        if (isOutputInProgress())
+            waitForOutput();
 
-            if (err != 0)
-                perror("LogCompressor's Posix AIO suspend operation failed");
+        completeOutput();
+
+        if (syncStatus == WAITING_ON_AIO) {
+            syncStatus = SYNC_COMPLETED;
+            hintSyncCompleted.notify_one();
         }
+    }
+}
 
-        int err = aio_error(&aioCb);
-        ssize_t ret = aio_return(&aioCb);
+/**
+ * Outputs the log messages in a StagingBuffer's BacktraceRing that were
+ * logged in the BACKTRACE_WINDOW_MS before a pending backtrace request.
+ * The ring is copied before parsing so that the producer can continue to
+ * overwrite it; messages overwritten during the copy are not output.
+ *
+ * \param sb
+ *      StagingBuffer whose BacktraceRing has a pending backtrace
+ * \param globalTrigger
+ *      rdtsc() of the last triggerBacktrace()
+ * \param encoder
+ *      Encoder to compress the log messages into
+ * \param[in/out] wrapAround
+ *      Whether the next BufferExtent starts a new pass through the
+ *      StagingBuffers; cleared once encoded
+ * \param shadowStaticInfo
+ *      Static information of the log messages known to the encoder
+ *
+ * \return
+ *      true if the backtrace was output and false if it could not be
+ *      encoded yet (i.e. insufficient space), in which case it should be
+ *      retried in a later pass
+ */
+bool
+RuntimeLogger::encodeBacktrace(StagingBuffer *sb, uint64_t globalTrigger,
+                               Log::Encoder &encoder, bool &wrapAround,
+                               std::vector<StaticLogInfo> &shadowStaticInfo)
+{
+    const uint64_t size = NanoLogConfig::BACKTRACE_RING_SIZE;
+    BacktraceRing *ring = sb->backtraceRing;
+
+    if (backtraceScratch == nullptr) {
+        backtraceScratch = static_cast<char*>(malloc(2*size));
+        if (backtraceScratch == nullptr) {
+            perror("The NanoLog system was not able to allocate enough memory "
+                           "to support its operations. Quitting...\r\n");
+            std::exit(-1);
+        }
+    }
 
-        if (err != 0) {
-            fprintf(stderr, "LogCompressor's POSIX AIO failed with %d: %s\r\n",
-                    err, strerror(err));
-        } else if (ret < 0) {
-            perror("LogCompressor's Posix AIO Write operation failed");
+    // Output everything from the oldest pending request to the newest
+    uint64_t dumpRequestedAt = ring->dumpRequestedAt;
+    uint64_t lastRequest = std::max(dumpRequestedAt, globalTrigger);
+    uint64_t firstRequest = lastRequest;
+    if (dumpRequestedAt > ring->dumpHandledAt)
+        firstRequest = std::min(firstRequest, dumpRequestedAt);
+    if (globalTrigger > ring->dumpHandledAt)
+        firstRequest = std::min(firstRequest, globalTrigger);
+
+    uint64_t window = PerfUtils::Cycles::fromNanoseconds(
+                            NanoLogConfig::BACKTRACE_WINDOW_MS*1000000UL);
+    uint64_t windowStart = (firstRequest > window) ? firstRequest - window : 0;
+
+    // Messages at or after the tail read *after* the copy were not
+    // overwritten while copying.
+    char *copy = backtraceScratch;
+    uint64_t head = ring->head;
+    Fence::lfence();
+    memcpy(copy, ring->storage, size);
+    Fence::lfence();
+    uint64_t tail = ring->tail;
+    uint64_t position = std::max(tail, ring->dumpedUpTo);
+
+    // Gather the messages in the window contiguously for the encoder
+    char *gathered = backtraceScratch + size;
+    uint64_t gatheredBytes = 0;
+    while (position < head) {
+        uint64_t entrySize = BacktraceRing::getEntrySize(position, copy);
+        if (entrySize == 0)
+            break;
+
+        auto *entry = reinterpret_cast<Log::UncompressedEntry*>(
+                                                        copy + position % size);
+        if (entrySize >= sizeof(Log::UncompressedEntry)
+                && entry->fmtId != BacktraceRing::PADDING_ID) {
+            if (entry->timestamp > lastRequest)
+                break;
+
+            if (entry->timestamp >= windowStart) {
+                memcpy(gathered + gatheredBytes, entry, entrySize);
+                gatheredBytes += entrySize;
+            }
         }
-        ++numAioWritesCompleted;
-        hasOutstandingOperation = false;
 
-        if (syncStatus == WAITING_ON_AIO) {
-            syncStatus = SYNC_COMPLETED;
-            hintSyncCompleted.notify_one();
+        position += entrySize;
+    }
+
+    // Worst case assumption that none of the log messages compress and that
+    // each is as small as its header (see Encoder::encodeLogMsgs()), plus
+    // some slack for the BufferExtent and static strings.
+    if (3*gatheredBytes + 1024 > encoder.getFreeBytes())
+        return false;
+
+    uint64_t remaining = gatheredBytes;
+    while (remaining > 0) {
+#ifdef PREPROCESSOR_NANOLOG
+        long bytesRead = encoder.encodeLogMsgs(
+                gathered + (gatheredBytes - remaining),
+                remaining,
+                sb->getId(),
+                wrapAround,
+                &logsProcessed);
+#else
+        long bytesRead = encoder.encodeLogMsgs(
+                gathered + (gatheredBytes - remaining),
+                remaining,
+                sb->getId(),
+                wrapAround,
+                shadowStaticInfo,
+                &logsProcessed);
+#endif
+
+        // Log messages registered since the dictionary was last persisted
+        // can only be encoded in a later pass.
+        if (bytesRead == 0) {
+            if (remaining == gatheredBytes)
+                return false;
+            break;
+        }
+
+        wrapAround = false;
+        remaining -= bytesRead;
+        totalBytesRead += bytesRead;
+    }
+
+    ring->dumpedUpTo = position;
+    ring->dumpHandledAt = lastRequest;
+    return true;
+}
+
+/**
+ * Encodes the log messages staged in the threads' PriorityRings (see
+ * setPriorityLogLevel()). The caller must hold the bufferMutex.
+ *
+ * \param encoder
+ *      Encoder to compress the log messages into
+ * \param dictionary
+ *      Static information of the log messages known to the encoder
+ * \param[out] outputBufferFull
+ *      Set to true if the encoder ran out of space
+ *
+ * \return
+ *      Number of bytes consumed from the PriorityRings
+ */
+uint64_t
+RuntimeLogger::encodePriorityRings(Log::Encoder &encoder,
+                                   const std::vector<StaticLogInfo> &dictionary,
+                                   bool &outputBufferFull)
+{
+    uint64_t bytesConsumed = 0;
+    for (StagingBuffer *sb : threadBuffers) {
+        PriorityRing &ring = sb->priorityRing;
+        while (!ring.isEmpty()) {
+            uint64_t peekBytes = 0;
+            char *peekPosition = ring.peek(&peekBytes);
+            if (peekBytes == 0)
+                break;
+
+#ifdef PREPROCESSOR_NANOLOG
+            long bytesRead = encoder.encodeLogMsgs(peekPosition, peekBytes,
+                                                   sb->getId(), false,
+                                                   &logsProcessed);
+#else
+            long bytesRead = encoder.encodeLogMsgs(peekPosition, peekBytes,
+                                                   sb->getId(), false,
+                                                   dictionary,
+                                                   &logsProcessed);
+#endif
+
+            if (bytesRead == 0) {
+                outputBufferFull = true;
+                return bytesConsumed;
+            }
+
+            ring.consume(bytesRead);
+            totalBytesRead += bytesRead;
+            bytesConsumed += bytesRead;
+        }
+    }
+
+    return bytesConsumed;
+}
+
+/**
+ * Encodes the log messages available in a StagingBuffer in RELEASE_THRESHOLD
+ * chunks, releasing the space of each chunk back to the producer as soon as
+ * it's encoded. The bufferMutex is released while encoding.
+ *
+ * \param sb
+ *      StagingBuffer to encode the log messages of
+ * \param lock
+ *      Lock held on the bufferMutex
+ * \param encoder
+ *      Encoder to compress the log messages into
+ * \param[in/out] wrapAround
+ *      Whether the next BufferExtent starts a new pass through the
+ *      StagingBuffers; cleared once encoded
+ * \param shadowStaticInfo
+ *      Static information of the log messages known to the encoder
+ * \param[out] outputBufferFull
+ *      Set to true if the encoder ran out of space
+ * \param[in/out] bytesConsumed
+ *      Incremented by the number of bytes consumed from the StagingBuffer
+ *
+ * \return
+ *      true if there were log messages to encode
+ */
+bool
+RuntimeLogger::encodeStagingBuffer(StagingBuffer *sb,
+                                   std::unique_lock<std::mutex> &lock,
+                                   Log::Encoder &encoder, bool &wrapAround,
+                                   std::vector<StaticLogInfo> &shadowStaticInfo,
+                                   bool &outputBufferFull,
+                                   uint64_t &bytesConsumed)
+{
+    // Normally, we only look at what the producer has published, but if
+    // we're sync()-ing or if the producer has not answered the doorbell
+    // since the last pass (i.e. it's gone idle), we take the bytes it has
+    // yet to publish as well.
+    uint64_t peekBytes = 0;
+    bool forcePublication = (syncStatus != SYNC_COMPLETED) ||
+                            sb->publicationRequested;
+    char *peekPosition = sb->peek(&peekBytes, forcePublication);
+    if (peekBytes == 0)
+        return false;
+
+    uint64_t start = PerfUtils::Cycles::rdtsc();
+    lock.unlock();
+
+    // Record metrics on the peek size
+    size_t sizeOfDist = Util::arraySize(stagingBufferPeekDist);
+    size_t distIndex = (sizeOfDist*peekBytes)/NanoLogConfig::STAGING_BUFFER_SIZE;
+    ++(stagingBufferPeekDist[distIndex]);
+
+    // Encode the data in RELEASE_THRESHOLD chunks
+    uint32_t remaining = downCast<uint32_t>(peekBytes);
+    while (remaining > 0) {
+        long bytesToEncode = std::min(NanoLogConfig::RELEASE_THRESHOLD,
+                                      remaining);
+#ifdef PREPROCESSOR_NANOLOG
+        long bytesRead = encoder.encodeLogMsgs(
+                peekPosition + (peekBytes - remaining),
+                bytesToEncode,
+                sb->getId(),
+                wrapAround,
+                &logsProcessed);
+#else
+        long bytesRead = encoder.encodeLogMsgs(
+                peekPosition + (peekBytes - remaining),
+                bytesToEncode,
+                sb->getId(),
+                wrapAround,
+                shadowStaticInfo,
+                &logsProcessed);
+#endif
+
+        if (bytesRead == 0) {
+            outputBufferFull = true;
+            break;
         }
+
+        wrapAround = false;
+        remaining -= downCast<uint32_t>(bytesRead);
+        sb->consume(bytesRead);
+        totalBytesRead += bytesRead;
+        bytesConsumed += bytesRead;
     }
+
+    cyclesCompressing += PerfUtils::Cycles::rdtsc() - start;
+    lock.lock();
+    return true;
 }
 
 /**
@@ -362,7 +790,16 @@ RuntimeLogger::compressionThreadMain() {
     cycleAtThreadStart = cyclesAwakeStart;
 
     // Manages the state associated with compressing log messages
-    Log::Encoder encoder(compressingBuffer, NanoLogConfig::OUTPUT_BUFFER_SIZE);
+    Log::Encoder encoder(compressingBuffer, NanoLogConfig::OUTPUT_BUFFER_SIZE,
+                         false, false, timestampShift);
+    if (flightRecorder != nullptr) {
+        const size_t segmentSize = NanoLogConfig::FLIGHT_RECORDER_SEGMENT_SIZE;
+        encoder.restart(flightRecorder + currentSegment*segmentSize,
+                        segmentSize);
+    }
+
+    isCompressionThread = true;
+    activeEncoder = &encoder;
 
     // Indicates whether a compression operation failed or not due
     // to insufficient space in the outputBuffer
@@ -377,13 +814,25 @@ RuntimeLogger::compressionThreadMain() {
     // lookup
     std::vector<StaticLogInfo> shadowStaticInfo;
 
+    // StagingBuffers to compress ahead of the round-robin scan and their
+    // backlog in bytes (see Step 1 below)
+    std::vector<std::pair<uint64_t, StagingBuffer*>> urgentBuffers;
+
     // Each iteration of this loop scans for uncompressed log messages in the
     // thread buffers, compresses as much as possible, and outputs it to a file.
     // The loop will run so long as it's not shutdown or there's outstanding I/O
-    while (!compressionThreadShouldExit || encoder.getEncodedBytes() > 0
-                                        || hasOutstandingOperation)
+    while (!compressionThreadShouldExit || hasOutstandingOperation
+            || (flightRecorder == nullptr && encoder.getEncodedBytes() > 0))
     {
+        parkIfCrashing();
+        if (agentRegion != nullptr)
+            updateAgent();
+        else if (loggerId == 0 && pendingSignalSafeSites != nullptr)
+            registerSignalSafeSites();
+
         coreId = sched_getcpu();
+        ++compressionPasses;
+        uint64_t globalTrigger = backtraceTriggeredAt;
 
         // Indicates how many bytes we have consumed from the StagingBuffers
         // in a single iteration of the while above. A value of 0 means we
@@ -391,6 +840,10 @@ RuntimeLogger::compressionThreadMain() {
         // (either due to empty stagingBuffers or a full output encoder)
         uint64_t bytesConsumedThisIteration = 0;
 
+        // Indicates that log messages from the PriorityRings were encoded
+        // and should be written out without waiting for the StagingBuffers.
+        bool expedite = false;
+
         uint64_t start = PerfUtils::Cycles::rdtsc();
         // Step 1: Find buffers with entries and compress them
         {
@@ -398,84 +851,107 @@ RuntimeLogger::compressionThreadMain() {
             size_t i = lastStagingBufferChecked;
 
             // Output new dictionary entries, if necessary
-            if (nextInvocationIndexToBePersisted < invocationSites.size())
+            // (The log invocation sites are registered with the default
+            // Logger for all the Loggers.)
+            RuntimeLogger &registry = nanoLogSingleton;
+            if (nextInvocationIndexToBePersisted <
+                                            registry.invocationSites.size())
             {
-                std::unique_lock<std::mutex> lock (registrationMutex);
+                std::unique_lock<std::mutex> lock(registry.registrationMutex);
                 encoder.encodeNewDictionaryEntries(
                                                nextInvocationIndexToBePersisted,
-                                               invocationSites);
+                                               registry.invocationSites);
 
                 // update our shadow copy
                 for (uint64_t i = shadowStaticInfo.size();
                                     i < nextInvocationIndexToBePersisted; ++i)
                 {
-                    shadowStaticInfo.push_back(invocationSites.at(i));
+                    shadowStaticInfo.push_back(registry.invocationSites.at(i));
+                }
+            }
+
+            // The PriorityRings go ahead of the backlog in the StagingBuffers,
+            // which wait for the next pass if the former had log messages.
+            if (!outputBufferFull && priorityLogLevel != SILENT_LOG_LEVEL) {
+                uint64_t bytesConsumed = encodePriorityRings(encoder,
+                                                    shadowStaticInfo,
+                                                    outputBufferFull);
+                bytesConsumedThisIteration += bytesConsumed;
+                expedite = bytesConsumed > 0;
+            }
+
+            // StagingBuffers whose producers are blocked or whose backlog
+            // is about to block them go ahead of the round-robin scan below,
+            // fullest first, rather than waiting behind the others.
+            if (!expedite && !outputBufferFull && threadBuffers.size() > 1) {
+                urgentBuffers.clear();
+                for (StagingBuffer *sb : threadBuffers) {
+                    // Pending backtraces must precede the buffer's contents
+                    BacktraceRing *ring = sb->backtraceRing;
+                    if (ring != nullptr && ring->isDumpPending(globalTrigger))
+                        continue;
+
+                    uint64_t backlog = sb->getBacklog();
+                    if (sb->producerBlocked)
+                        urgentBuffers.emplace_back(~0UL, sb);
+                    else if (backlog >= NanoLogConfig::URGENT_BACKLOG_BYTES)
+                        urgentBuffers.emplace_back(backlog, sb);
+                }
+
+                std::sort(urgentBuffers.begin(), urgentBuffers.end(),
+                          std::greater<std::pair<uint64_t, StagingBuffer*>>());
+                for (auto &urgent : urgentBuffers) {
+                    if (outputBufferFull)
+                        break;
+
+                    encodeStagingBuffer(urgent.second, lock, encoder,
+                                        wrapAround, shadowStaticInfo,
+                                        outputBufferFull,
+                                        bytesConsumedThisIteration);
+                    ++numUrgentBuffersScheduled;
                 }
             }
 
             // Scan through the threadBuffers looking for log messages to
             // compress while the output buffer is not full.
-            while (!outputBufferFull && !threadBuffers.empty())
+            while (!expedite && !outputBufferFull && !threadBuffers.empty())
             {
-                uint64_t peekBytes = 0;
+                parkIfCrashing();
                 StagingBuffer *sb = threadBuffers[i];
-                char *peekPosition = sb->peek(&peekBytes);
 
-                // If there's work, unlock to perform it
-                if (peekBytes > 0) {
-                    uint64_t start = PerfUtils::Cycles::rdtsc();
+                // Output the BacktraceRing first since its log messages
+                // precede the ERROR that likely triggered it.
+                BacktraceRing *ring = sb->backtraceRing;
+                if (ring != nullptr && ring->isDumpPending(globalTrigger)) {
                     lock.unlock();
-
-                    // Record metrics on the peek size
-                    size_t sizeOfDist = Util::arraySize(stagingBufferPeekDist);
-                    size_t distIndex = (sizeOfDist*peekBytes)/
-                                            NanoLogConfig::STAGING_BUFFER_SIZE;
-                    ++(stagingBufferPeekDist[distIndex]);
-
-
-                    // Encode the data in RELEASE_THRESHOLD chunks
-                    uint32_t remaining = downCast<uint32_t>(peekBytes);
-                    while (remaining > 0) {
-                        long bytesToEncode = std::min(
-                                NanoLogConfig::RELEASE_THRESHOLD,
-                                remaining);
-#ifdef PREPROCESSOR_NANOLOG
-                        long bytesRead = encoder.encodeLogMsgs(
-                                peekPosition + (peekBytes - remaining),
-                                bytesToEncode,
-                                sb->getId(),
-                                wrapAround,
-                                &logsProcessed);
-#else
-                        long bytesRead = encoder.encodeLogMsgs(
-                                peekPosition + (peekBytes - remaining),
-                                bytesToEncode,
-                                sb->getId(),
-                                wrapAround,
-                                shadowStaticInfo,
-                                &logsProcessed);
-#endif
-
-
-                        if (bytesRead == 0) {
-                            lastStagingBufferChecked = i;
-                            outputBufferFull = true;
-                            break;
-                        }
-
-                        wrapAround = false;
-                        remaining -= downCast<uint32_t>(bytesRead);
-                        sb->consume(bytesRead);
-                        totalBytesRead += bytesRead;
-                        bytesConsumedThisIteration += bytesRead;
-                    }
+                    uint64_t start = PerfUtils::Cycles::rdtsc();
+                    outputBufferFull = !encodeBacktrace(sb, globalTrigger,
+                                                        encoder, wrapAround,
+                                                        shadowStaticInfo);
                     cyclesCompressing += PerfUtils::Cycles::rdtsc() - start;
                     lock.lock();
+
+                    if (outputBufferFull) {
+                        lastStagingBufferChecked = i;
+                        break;
+                    }
+                }
+
+                // If there's work, perform it
+                if (encodeStagingBuffer(sb, lock, encoder, wrapAround,
+                                        shadowStaticInfo, outputBufferFull,
+                                        bytesConsumedThisIteration)) {
+                    if (outputBufferFull)
+                        lastStagingBufferChecked = i;
                 } else {
+                    // If there's no work, ask the producer to publish whatever
+                    // it may be holding onto.
+                    sb->requestPublication();
+
                     // If there's no work, check if we're supposed to delete
                     // the stagingBuffer
                     if (sb->checkCanDelete()) {
-                        delete sb;
+                        freeStagingBuffer(sb);
 
                         threadBuffers.erase(threadBuffers.begin() + i);
                         if (threadBuffers.empty()) {
@@ -507,8 +983,12 @@ RuntimeLogger::compressionThreadMain() {
             cyclesScanningAndCompressing += PerfUtils::Cycles::rdtsc() - start;
         }
 
-        // If there's no data to output, go to sleep.
-        if (encoder.getEncodedBytes() == 0) {
+        // If there's no data to output, go to sleep. The flight recorder
+        // retains the encoded data, so it's only idle if there was no new data.
+        bool idle = (flightRecorder == nullptr)
+                        ? encoder.getEncodedBytes() == 0
+                        : bytesConsumedThisIteration == 0 && !outputBufferFull;
+        if (idle) {
             std::unique_lock<std::mutex> lock(condMutex);
 
             // If a sync was requested, we should make at least 1 more
@@ -535,17 +1015,13 @@ RuntimeLogger::compressionThreadMain() {
         }
 
         if (hasOutstandingOperation) {
-            if (aio_error(&aioCb) == EINPROGRESS) {
-                const struct aiocb *const aiocb_list[] = {&aioCb};
-                if (outputBufferFull) {
-                    // If the output buffer is full and we're not done,
-                    // wait for completion
+            if (isOutputInProgress()) {
+                if (outputBufferFull || expedite) {
+                    // If the output buffer is full and we're not done (or
+                    // it holds expedited log messages), wait for completion
                     cyclesActive += PerfUtils::Cycles::rdtsc() - cyclesAwakeStart;
-                    int err = aio_suspend(aiocb_list, 1, NULL);
+                    waitForOutput();
                     cyclesAwakeStart = PerfUtils::Cycles::rdtsc();
-                    if (err != 0)
-                        perror("LogCompressor's Posix AIO "
-                                       "suspend operation failed");
                 } else {
                     // If there's no new data, go to sleep.
                     if (bytesConsumedThisIteration == 0 &&
@@ -559,23 +1035,13 @@ RuntimeLogger::compressionThreadMain() {
                         cyclesAwakeStart = PerfUtils::Cycles::rdtsc();
                     }
 
-                    if (aio_error(&aioCb) == EINPROGRESS)
+                    if (isOutputInProgress())
                         continue;
                 }
             }
 
             // Finishing up the IO
-            int err = aio_error(&aioCb);
-            ssize_t ret = aio_return(&aioCb);
-
-            if (err != 0) {
-                fprintf(stderr, "LogCompressor's POSIX AIO failed"
-                        " with %d: %s\r\n", err, strerror(err));
-            } else if (ret < 0) {
-                perror("LogCompressor's Posix AIO Write failed");
-            }
-            ++numAioWritesCompleted;
-            hasOutstandingOperation = false;
+            completeOutput();
             cyclesDiskIO_upperBound += (start - cyclesAtLastAIOStart);
 
             // We've completed an AIO, check if we need to notify
@@ -588,6 +1054,37 @@ RuntimeLogger::compressionThreadMain() {
             }
         }
 
+        // The flight recorder replaces the output to the log file
+        if (flightRecorder != nullptr) {
+            if (outputBufferFull) {
+                rotateFlightRecorder(encoder);
+                outputBufferFull = false;
+            }
+
+            if (flightRecorderSignaled) {
+                flightRecorderSignaled = 0;
+                int fd = open(NanoLogConfig::FLIGHT_RECORDER_DUMP_FILE,
+                              O_WRONLY | O_CREAT | O_TRUNC, 0666);
+                if (fd < 0) {
+                    perror("NanoLog could not open the flight recorder "
+                           "dump file");
+                } else {
+                    writeFlightRecorder(fd, encoder.getEncodedBytes());
+                    close(fd);
+                }
+            }
+
+            if (flightRecorderDumpFd >= 0) {
+                std::unique_lock<std::mutex> lock(condMutex);
+                writeFlightRecorder(flightRecorderDumpFd,
+                                    encoder.getEncodedBytes());
+                flightRecorderDumpFd = -1;
+                hintDumpCompleted.notify_all();
+            }
+
+            continue;
+        }
+
         // If we reach this point in the code, it means that all AIO operations
         // have completed and the double buffer is now free. We'll check if
         // we need to start a new AIO.
@@ -595,27 +1092,10 @@ RuntimeLogger::compressionThreadMain() {
         if (bytesToWrite == 0)
             continue;
 
-        // Pad the output if necessary
-        if (NanoLogConfig::FILE_PARAMS & O_DIRECT) {
-            ssize_t bytesOver = bytesToWrite % 512;
-
-            if (bytesOver != 0) {
-                memset(compressingBuffer, 0, 512 - bytesOver);
-                bytesToWrite = bytesToWrite + 512 - bytesOver;
-                padBytesWritten += (512 - bytesOver);
-            }
-        }
-
-        aioCb.aio_fildes = outputFd;
-        aioCb.aio_buf = compressingBuffer;
-        aioCb.aio_nbytes = bytesToWrite;
-        totalBytesWritten += bytesToWrite;
+        if (expedite)
+            ++numExpeditedWrites;
 
-        cyclesAtLastAIOStart = PerfUtils::Cycles::rdtsc();
-        if (aio_write(&aioCb) == -1)
-            fprintf(stderr, "Error at aio_write(): %s\n", strerror(errno));
-
-        hasOutstandingOperation = true;
+        issueOutput(compressingBuffer, bytesToWrite);
 
         // Swap buffers
         encoder.swapBuffer(outputDoubleBuffer,
@@ -624,73 +1104,1235 @@ RuntimeLogger::compressionThreadMain() {
         outputBufferFull = false;
     }
 
+    // A restarted compression thread continues the flight recorder in the
+    // next segment rather than overwriting this one.
+    if (flightRecorder != nullptr)
+        rotateFlightRecorder(encoder);
+
+    // The helper thread is restarted along with the compression thread
+    if (blockStage != nullptr)
+        blockStage->stop();
+
+    activeEncoder = nullptr;
     cycleAtThreadStart = 0;
     cyclesActive += PerfUtils::Cycles::rdtsc() - cyclesAwakeStart;
 }
 
-// Documentation in NanoLog.h
+/**
+ * Starts the output of an output buffer to the log file through POSIX AIO
+ * (or synchronously where it's unavailable), or through the blockStage if a
+ * BlockCompression is set. The buffer shall not be modified until the
+ * output completes (see isOutputInProgress()).
+ *
+ * \param buffer
+ *      Output buffer to write
+ * \param length
+ *      Number of bytes in the output buffer
+ */
 void
-RuntimeLogger::setLogFile_internal(const char *filename) {
-    // Check if it exists and is readable/writeable
-    if (access(filename, F_OK) == 0 && access(filename, R_OK | W_OK) != 0) {
-        std::string err = "Unable to read/write from new log file: ";
-        err.append(filename);
-        throw std::ios_base::failure(err);
-    }
+RuntimeLogger::issueOutput(char *buffer, size_t length)
+{
+    if (blockCompression != NO_BLOCK_COMPRESSION) {
+        if (blockStage == nullptr)
+            blockStage = new BlockCompressionStage();
 
-    // Try to open the file
-    int newFd = open(filename, NanoLogConfig::FILE_PARAMS, 0666);
-    if (newFd < 0) {
-        std::string err = "Unable to open file new log file: '";
-        err.append(filename);
-        err.append("': ");
-        err.append(strerror(errno));
-        throw std::ios_base::failure(err);
+        cyclesAtLastAIOStart = PerfUtils::Cycles::rdtsc();
+        blockStage->submit(outputFd, buffer, length, BlockCodec::LZ);
+        outputToBlockStage = true;
+        hasOutstandingOperation = true;
+        return;
     }
 
-    // Everything seems okay, stop the background thread and change files
-    sync();
+    // Pad the output if necessary
+    if (NanoLogConfig::FILE_PARAMS & O_DIRECT) {
+        size_t bytesOver = length % 512;
 
-    // Stop the compression thread completely
-    {
-        std::lock_guard<std::mutex> lock(nanoLogSingleton.condMutex);
-        compressionThreadShouldExit = true;
-        workAdded.notify_all();
+        if (bytesOver != 0) {
+            memset(buffer, 0, 512 - bytesOver);
+            length = length + 512 - bytesOver;
+            padBytesWritten += (512 - bytesOver);
+        }
     }
 
-    if (compressionThread.joinable())
-        compressionThread.join();
+    totalBytesWritten += length;
 
-    if (outputFd > 0)
-        close(outputFd);
-    outputFd = newFd;
+    if (!aioAvailable) {
+        if (!writeSynchronously(buffer, length))
+            perror("NanoLog could not write the log file");
+    } else {
+        aioCb.aio_fildes = outputFd;
+        aioCb.aio_buf = buffer;
+        aioCb.aio_nbytes = length;
 
-    // Relaunch thread
-    nextInvocationIndexToBePersisted = 0; // Reset the dictionary
-    compressionThreadShouldExit = false;
-#ifndef BENCHMARK_DISCARD_ENTRIES_AT_STAGINGBUFFER
-    compressionThread = std::thread(&RuntimeLogger::compressionThreadMain, this);
-#endif
+        cyclesAtLastAIOStart = PerfUtils::Cycles::rdtsc();
+        if (aio_write(&aioCb) == -1)
+            fprintf(stderr, "Error at aio_write(): %s\n", strerror(errno));
+
+        hasOutstandingOperation = true;
+    }
 }
 
 /**
-* Set where the NanoLog should output its compressed log. If a previous
-* log file was specified, NanoLog will attempt to sync() the remaining log
-* entries before swapping files. For best practices, the output file shall
-* be set before the first invocation to log by the main thread as this
-* function is *not* thread safe.
-*
-* By default, the NanoLog will output to /tmp/compressedLog
-*
-* \param filename
-*      File for NanoLog to output the compress log
-*
-* \throw is_base::failure
-*      if the file cannot be opened or crated
-*/
-void
-RuntimeLogger::setLogFile(const char *filename) {
-    nanoLogSingleton.setLogFile_internal(filename);
+ * Returns true while the outstanding output operation started by
+ * issueOutput() is in progress. Only valid while hasOutstandingOperation.
+ */
+bool
+RuntimeLogger::isOutputInProgress()
+{
+    if (outputToBlockStage)
+        return blockStage->isBusy();
+
+    return aio_error(&aioCb) == EINPROGRESS;
+}
+
+/**
+ * Blocks until the outstanding output operation started by issueOutput()
+ * is no longer in progress.
+ */
+void
+RuntimeLogger::waitForOutput()
+{
+    if (outputToBlockStage) {
+        blockStage->wait();
+        return;
+    }
+
+    const struct aiocb *const aiocb_list[] = {&aioCb};
+    int err = aio_suspend(aiocb_list, 1, NULL);
+    if (err != 0)
+        perror("LogCompressor's Posix AIO suspend operation failed");
+}
+
+/**
+ * Reaps the outstanding output operation once it's no longer in progress,
+ * reporting its errors and accounting for the bytes it wrote.
+ */
+void
+RuntimeLogger::completeOutput()
+{
+    if (outputToBlockStage) {
+        if (blockStage->writeFailed)
+            perror("NanoLog could not write the compressed block");
+
+        totalBytesWritten += blockStage->bytesWritten;
+    } else {
+        int err = aio_error(&aioCb);
+        ssize_t ret = aio_return(&aioCb);
+
+        if (err != 0) {
+            fprintf(stderr, "LogCompressor's POSIX AIO failed"
+                    " with %d: %s\r\n", err, strerror(err));
+        } else if (ret < 0) {
+            perror("LogCompressor's Posix AIO Write failed");
+        }
+    }
+
+    ++numAioWritesCompleted;
+    hasOutstandingOperation = false;
+    outputToBlockStage = false;
+}
+
+// BlockCompressionStage constructor; the helper thread starts on submit()
+RuntimeLogger::BlockCompressionStage::BlockCompressionStage()
+    : writeFailed(false)
+    , bytesWritten(0)
+    , totalBytesIn(0)
+    , totalBytesOut(0)
+    , cyclesCompressing(0)
+    , numBlocks(0)
+    , numBlocksStored(0)
+    , thread()
+    , mutex()
+    , workAdded()
+    , workDone()
+    , busy(false)
+    , shouldExit(false)
+    , fd(-1)
+    , input(nullptr)
+    , inputLength(0)
+    , codec(BlockCodec::STORED)
+    , output(nullptr)
+{
+}
+
+// BlockCompressionStage destructor
+RuntimeLogger::BlockCompressionStage::~BlockCompressionStage()
+{
+    stop();
+
+    if (output) {
+        free(output);
+        output = nullptr;
+    }
+}
+
+/**
+ * Hands an output buffer to the helper thread to compress and write. The
+ * previous output buffer must have completed (i.e. isBusy() is false).
+ *
+ * \param fd
+ *      File descriptor to write the CompressedBlock to
+ * \param buffer
+ *      Output buffer to compress
+ * \param length
+ *      Number of bytes in the output buffer
+ * \param codec
+ *      Codec to compress the output buffer with
+ */
+void
+RuntimeLogger::BlockCompressionStage::submit(int fd, const char *buffer,
+                                             size_t length,
+                                             BlockCodec::Codec codec)
+{
+    assert(!isBusy());
+
+    if (output == nullptr) {
+        size_t outputSize = Log::maxCompressedBlockSize(
+                                NanoLogConfig::OUTPUT_BUFFER_SIZE) + 512;
+        int err = posix_memalign(reinterpret_cast<void **>(&output),
+                                 512, outputSize);
+        if (err) {
+            perror("The NanoLog system was not able to allocate enough memory "
+                           "to support its operations. Quitting...\r\n");
+            std::exit(-1);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    this->fd = fd;
+    this->input = buffer;
+    this->inputLength = length;
+    this->codec = codec;
+    busy.store(true, std::memory_order_release);
+
+    if (!thread.joinable()) {
+        shouldExit = false;
+        thread = std::thread(&BlockCompressionStage::threadMain, this);
+    }
+
+    workAdded.notify_one();
+}
+
+/**
+ * Blocks until the output buffer last submitted has been written.
+ */
+void
+RuntimeLogger::BlockCompressionStage::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (isBusy())
+        workDone.wait(lock);
+}
+
+/**
+ * Stops the helper thread once it has written the pending output buffer.
+ */
+void
+RuntimeLogger::BlockCompressionStage::stop()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        shouldExit = true;
+        workAdded.notify_one();
+    }
+
+    thread.join();
+}
+
+/**
+ * Main loop of the helper thread, which compresses each submitted output
+ * buffer into a CompressedBlock and writes it out synchronously.
+ */
+void
+RuntimeLogger::BlockCompressionStage::threadMain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        if (!isBusy()) {
+            if (shouldExit)
+                break;
+
+            workAdded.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+
+        uint64_t start = PerfUtils::Cycles::rdtsc();
+        size_t length = Log::compressBlock(input, inputLength, output, codec);
+        cyclesCompressing += PerfUtils::Cycles::rdtsc() - start;
+
+        auto *header = reinterpret_cast<Log::CompressedBlock*>(output);
+        if (header->codec == BlockCodec::STORED)
+            ++numBlocksStored;
+
+        // Pad the output if necessary
+        if (NanoLogConfig::FILE_PARAMS & O_DIRECT) {
+            size_t bytesOver = length % 512;
+
+            if (bytesOver != 0) {
+                memset(output + length, 0, 512 - bytesOver);
+                length = length + 512 - bytesOver;
+            }
+        }
+
+        writeFailed = !writeSynchronously(fd, output, length);
+        bytesWritten = length;
+        totalBytesIn += inputLength;
+        totalBytesOut += length;
+        ++numBlocks;
+
+        lock.lock();
+        busy.store(false, std::memory_order_release);
+        workDone.notify_all();
+    }
+}
+
+// Documentation in NanoLog.h
+void
+RuntimeLogger::setLogFile_internal(const char *filename) {
+    // The agent's compression thread has its own copy of the output file
+    if (agentRegion != nullptr)
+        throw std::ios_base::failure("Unable to change the log file after "
+                                     "the agent has started");
+
+    // Check if it exists and is readable/writeable
+    if (access(filename, F_OK) == 0 && access(filename, R_OK | W_OK) != 0) {
+        std::string err = "Unable to read/write from new log file: ";
+        err.append(filename);
+        throw std::ios_base::failure(err);
+    }
+
+    // Try to open the file
+    int newFd = open(filename, NanoLogConfig::FILE_PARAMS, 0666);
+    if (newFd < 0) {
+        std::string err = "Unable to open file new log file: '";
+        err.append(filename);
+        err.append("': ");
+        err.append(strerror(errno));
+        throw std::ios_base::failure(err);
+    }
+
+    // Everything seems okay, stop the background thread and change files
+    sync();
+
+    stopCompressionThread();
+
+    if (outputFd > 0)
+        close(outputFd);
+    outputFd = newFd;
+    logFilePath = filename;
+
+    startCompressionThread();
+}
+
+/**
+ * Stops the compression thread, so that its state can be changed. Callers
+ * should sync() beforehand to output the log messages staged so far.
+ */
+void
+RuntimeLogger::stopCompressionThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(condMutex);
+        compressionThreadShouldExit = true;
+        workAdded.notify_all();
+    }
+
+    if (compressionThread.joinable())
+        compressionThread.join();
+}
+
+/**
+ * Relaunches the compression thread stopped by stopCompressionThread(),
+ * which starts by persisting the dictionary again.
+ */
+void
+RuntimeLogger::startCompressionThread()
+{
+    nextInvocationIndexToBePersisted = 0; // Reset the dictionary
+    compressionThreadShouldExit = false;
+#ifndef BENCHMARK_DISCARD_ENTRIES_AT_STAGINGBUFFER
+    compressionThread = std::thread(&RuntimeLogger::compressionThreadMain, this);
+#endif
+}
+
+/**
+ * pthread_atfork() handler invoked before fork() that quiesces the runtime:
+ * the staged log messages of every Logger are output, the compression
+ * threads are stopped (the child would only inherit the calling thread) and
+ * the locks are acquired so that the child doesn't inherit them mid-update.
+ */
+void
+RuntimeLogger::handleForkPrepare()
+{
+    if (nanoLogSingleton.agentForking)
+        return;
+
+    loggersMutex.lock();
+    for (RuntimeLogger *logger : loggers) {
+        if (logger == nullptr)
+            continue;
+
+        logger->sync_internal();
+        logger->stopCompressionThread();
+
+        logger->bufferMutex.lock();
+        logger->registrationMutex.lock();
+        logger->condMutex.lock();
+    }
+}
+
+/**
+ * pthread_atfork() handler invoked in the parent after fork(), which
+ * resumes where handleForkPrepare() left off.
+ */
+void
+RuntimeLogger::handleForkParent()
+{
+    if (nanoLogSingleton.agentForking)
+        return;
+
+    for (RuntimeLogger *logger : loggers) {
+        if (logger == nullptr)
+            continue;
+
+        logger->condMutex.unlock();
+        logger->registrationMutex.unlock();
+        logger->bufferMutex.unlock();
+
+        if (logger->agentRegion == nullptr)
+            logger->startCompressionThread();
+    }
+    loggersMutex.unlock();
+}
+
+/**
+ * pthread_atfork() handler invoked in the child after fork().
+ */
+void
+RuntimeLogger::handleForkChild()
+{
+    if (nanoLogSingleton.agentForking)
+        return;
+
+    for (RuntimeLogger *logger : loggers) {
+        if (logger == nullptr)
+            continue;
+
+        logger->condMutex.unlock();
+        logger->registrationMutex.unlock();
+        logger->bufferMutex.unlock();
+
+        logger->resetAfterForkInChild();
+    }
+    loggersMutex.unlock();
+}
+
+/**
+ * Gives the child process a runtime of its own after fork(). The
+ * StagingBuffers inherited from the parent hold the parent's log messages
+ * (which the parent outputs) and belong to threads that don't exist in the
+ * child, so they're discarded and the child starts over with fresh
+ * StagingBuffers and buffer ids. The child shares the log invocation sites
+ * registered before the fork, and compresses its log messages with a
+ * compression thread of its own.
+ */
+void
+RuntimeLogger::resetAfterForkInChild()
+{
+    // Threads of the parent may have been waiting on these
+    new(&workAdded) std::condition_variable();
+    new(&hintSyncCompleted) std::condition_variable();
+    new(&hintDumpCompleted) std::condition_variable();
+
+    // Compression is no longer handed off to the parent's agent (if any)
+    agentRegion = nullptr;
+    agentPid = 0;
+
+    for (StagingBuffer *sb : threadBuffers)
+        delete sb;
+    threadBuffers.clear();
+    threadStagingBuffer() = nullptr;
+    nextBufferId = 0;
+    syncStatus = SYNC_COMPLETED;
+    aioAvailable = false;
+
+    if (emergencyBuffer != nullptr) {
+        StagingBuffer *sb = new StagingBuffer(nextBufferId++);
+        threadBuffers.push_back(sb);
+        emergencyBuffer = sb;
+        emergencyBufferInUse = 0;
+    }
+
+    // The flight recorder only retains the child's log messages
+    if (flightRecorder != nullptr) {
+        segmentLengths.assign(flightRecorderSegments, 0);
+        currentSegment = 0;
+    }
+
+    if (nanoLogSingleton.perProcessLogFiles) {
+        std::string filename = logFilePath + "." + std::to_string(getpid());
+        int newFd = open(filename.c_str(), outputFileFlags, 0666);
+        if (newFd < 0) {
+            fprintf(stderr, "NanoLog could not open the log file of the "
+                    "child process (\"%s\"): %s\r\n", filename.c_str(),
+                    strerror(errno));
+        } else {
+            close(outputFd);
+            outputFd = newFd;
+            logFilePath = filename;
+        }
+    }
+
+    startCompressionThread();
+
+    // The child's first log message shouldn't stall on the allocation
+    ensureStagingBufferAllocated();
+}
+
+// See documentation in NanoLog.h
+void
+RuntimeLogger::setPerProcessLogFiles(bool enabled) {
+    nanoLogSingleton.perProcessLogFiles = enabled;
+}
+
+/**
+ * Closes the flight recorder's current segment and starts a new one in place
+ * of the oldest segment. The new segment starts with a Checkpoint and the
+ * dictionary is re-encoded into it on the next pass, so that it can be
+ * decoded even after the segments before it are overwritten.
+ *
+ * \param encoder
+ *      Encoder of the compression thread, which encodes into the current
+ *      segment
+ */
+void
+RuntimeLogger::rotateFlightRecorder(Log::Encoder &encoder)
+{
+    const size_t segmentSize = NanoLogConfig::FLIGHT_RECORDER_SEGMENT_SIZE;
+    segmentLengths.at(currentSegment) = encoder.getEncodedBytes();
+
+    currentSegment = (currentSegment + 1) % flightRecorderSegments;
+    segmentLengths.at(currentSegment) = 0;
+    encoder.restart(flightRecorder + currentSegment*segmentSize, segmentSize);
+    nextInvocationIndexToBePersisted = 0;
+}
+
+/**
+ * Writes the segments of the flight recorder from oldest to newest to a file,
+ * which produces a compressed log that the Decoder can read. This should only
+ * be invoked by the compression thread.
+ *
+ * \param fd
+ *      File descriptor to write to
+ * \param currentSegmentBytes
+ *      Number of bytes encoded in the current segment so far
+ */
+void
+RuntimeLogger::writeFlightRecorder(int fd, size_t currentSegmentBytes)
+{
+    const size_t segmentSize = NanoLogConfig::FLIGHT_RECORDER_SEGMENT_SIZE;
+    for (uint32_t i = 1; i <= flightRecorderSegments; ++i) {
+        uint32_t segment = (currentSegment + i) % flightRecorderSegments;
+        size_t length = (segment == currentSegment) ? currentSegmentBytes
+                                                    : segmentLengths.at(segment);
+        const char *pos = flightRecorder + segment*segmentSize;
+
+        while (length > 0) {
+            ssize_t ret = write(fd, pos, length);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+
+                perror("NanoLog could not write the flight recorder dump");
+                return;
+            }
+
+            pos += ret;
+            length -= ret;
+        }
+    }
+}
+
+/**
+ * Signal handler for FLIGHT_RECORDER_DUMP_SIGNAL that asks the compression
+ * thread to dump the flight recorder to FLIGHT_RECORDER_DUMP_FILE.
+ */
+void
+RuntimeLogger::handleFlightRecorderSignal(int signal)
+{
+    flightRecorderSignaled = 1;
+}
+
+/**
+ * Internal implementation of setFlightRecorder() that restarts the
+ * compression thread in the new output mode (see setLogFile_internal()).
+ *
+ * \param bytes
+ *      Size of the flight recorder or 0 to output to the log file
+ */
+void
+RuntimeLogger::setFlightRecorder_internal(uint64_t bytes)
+{
+    if (agentRegion != nullptr) {
+        fprintf(stderr, "NanoLog: Unable to change the flight recorder after "
+                        "the agent has started\r\n");
+        return;
+    }
+
+    sync();
+
+    stopCompressionThread();
+
+    if (flightRecorder) {
+        free(flightRecorder);
+        flightRecorder = nullptr;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_DFL;
+
+    // At least two segments are needed to retain a full one while
+    // encoding into the other.
+    if (bytes > 0) {
+        const size_t segmentSize = NanoLogConfig::FLIGHT_RECORDER_SEGMENT_SIZE;
+        flightRecorderSegments = std::max<uint32_t>(2,
+                                    downCast<uint32_t>(bytes/segmentSize));
+        flightRecorder = static_cast<char*>(
+                                malloc(flightRecorderSegments*segmentSize));
+        if (flightRecorder == nullptr) {
+            perror("The NanoLog system was not able to allocate enough memory "
+                           "to support its operations. Quitting...\r\n");
+            std::exit(-1);
+        }
+
+        segmentLengths.assign(flightRecorderSegments, 0);
+        currentSegment = 0;
+        action.sa_handler = &RuntimeLogger::handleFlightRecorderSignal;
+        action.sa_flags = SA_RESTART;
+    }
+
+    sigaction(NanoLogConfig::FLIGHT_RECORDER_DUMP_SIGNAL, &action, nullptr);
+
+    startCompressionThread();
+}
+
+// See documentation in NanoLog.h
+void
+RuntimeLogger::setFlightRecorder(uint64_t bytes) {
+    nanoLogSingleton.setFlightRecorder_internal(bytes);
+}
+
+// See documentation in NanoLog.h
+void
+RuntimeLogger::dumpFlightRecorder(const char *path) {
+#ifdef BENCHMARK_DISCARD_ENTRIES_AT_STAGINGBUFFER
+    return;
+#endif
+
+    if (nanoLogSingleton.flightRecorder == nullptr) {
+        fprintf(stderr, "NanoLog Error: Cannot dump the flight recorder since "
+                        "it's not enabled (see setFlightRecorder()).\r\n");
+        return;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        std::string err = "Unable to open the flight recorder dump file: '";
+        err.append(path);
+        err.append("': ");
+        err.append(strerror(errno));
+        throw std::ios_base::failure(err);
+    }
+
+    // Include the log messages still in the StagingBuffers
+    sync();
+
+    {
+        std::unique_lock<std::mutex> lock(nanoLogSingleton.condMutex);
+        nanoLogSingleton.flightRecorderDumpFd = fd;
+        nanoLogSingleton.workAdded.notify_all();
+        while (nanoLogSingleton.flightRecorderDumpFd >= 0)
+            nanoLogSingleton.hintDumpCompleted.wait(lock);
+    }
+
+    close(fd);
+}
+
+/**
+ * Synchronously appends compressed log data to the log file, which is used
+ * where POSIX AIO cannot be (i.e. in fatal signal handlers and the agent).
+ *
+ * \param buffer
+ *      Compressed log data to write
+ * \param length
+ *      Number of bytes to write
+ *
+ * \return
+ *      true if all the bytes were written
+ */
+bool
+RuntimeLogger::writeSynchronously(const char *buffer, size_t length)
+{
+    return writeSynchronously(outputFd, buffer, length);
+}
+
+/**
+ * Synchronously appends data to a file, retrying partial writes.
+ *
+ * \param fd
+ *      File descriptor to write to
+ * \param buffer
+ *      Data to write
+ * \param length
+ *      Number of bytes to write
+ *
+ * \return
+ *      true if all the bytes were written
+ */
+bool
+RuntimeLogger::writeSynchronously(int fd, const char *buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t ret = write(fd, buffer, length);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        buffer += ret;
+        length -= ret;
+    }
+
+    return true;
+}
+
+/**
+ * Compresses the log messages left in the StagingBuffers and outputs them
+ * along with the compressed log that has yet to be written, from within a
+ * fatal signal handler. The compression thread is parked first so that its
+ * Encoder can be used without synchronization and all the output is written
+ * synchronously. In flight recorder mode, the log messages are encoded into
+ * the current segment and the flight recorder is dumped instead.
+ *
+ * This path avoids locks and only uses preallocated buffers (interning a
+ * new static string is the exception), but it gives up if the compression
+ * thread is the one that crashed or cannot be parked in time.
+ */
+void
+RuntimeLogger::drainOnCrash()
+{
+    // Stop recording the log messages of the threads still running
+    currentLogLevel = SILENT_LOG_LEVEL;
+    backtraceLogLevel = SILENT_LOG_LEVEL;
+
+    if (isCompressionThread || activeEncoder == nullptr)
+        return;
+
+    uint64_t deadline = PerfUtils::Cycles::rdtsc() +
+            PerfUtils::Cycles::fromSeconds(NanoLogConfig::CRASH_DRAIN_TIMEOUT_S);
+
+    crashDrainRequested = 1;
+    while (!compressionThreadParked) {
+        if (PerfUtils::Cycles::rdtsc() > deadline)
+            return;
+        sched_yield();
+    }
+
+    // Our output must follow the output already handed to POSIX AIO
+    while (hasOutstandingOperation && isOutputInProgress()) {
+        if (PerfUtils::Cycles::rdtsc() > deadline)
+            return;
+        sched_yield();
+    }
+
+    Log::Encoder &encoder = *activeEncoder;
+    const size_t outputSize = NanoLogConfig::OUTPUT_BUFFER_SIZE;
+    char *out;
+    size_t outLength;
+
+    if (flightRecorder == nullptr) {
+        encoder.swapBuffer(outputDoubleBuffer, outputSize, &out, &outLength);
+        std::swap(outputDoubleBuffer, compressingBuffer);
+        if (!writeSynchronously(out, outLength))
+            return;
+    }
+
+#ifndef PREPROCESSOR_NANOLOG
+    // Persist the log messages registered since the last pass
+    encoder.encodeNewDictionaryEntries(nextInvocationIndexToBePersisted,
+                                       invocationSites);
+#endif
+
+    // The PriorityRings are small, so they're drained first on a best
+    // effort basis (i.e. the output buffer could still be full).
+    bool outputBufferFull = false;
+    encodePriorityRings(encoder, invocationSites, outputBufferFull);
+
+    for (size_t i = 0; i < threadBuffers.size(); ++i) {
+        StagingBuffer *sb = threadBuffers[i];
+        bool flushed = false;
+
+        while (PerfUtils::Cycles::rdtsc() < deadline) {
+            uint64_t peekBytes = 0;
+            char *peekPosition = sb->peek(&peekBytes, true);
+            if (peekBytes == 0)
+                break;
+
+#ifdef PREPROCESSOR_NANOLOG
+            long bytesRead = encoder.encodeLogMsgs(peekPosition, peekBytes,
+                                                   sb->getId(), false,
+                                                   &logsProcessed);
+#else
+            long bytesRead = encoder.encodeLogMsgs(peekPosition, peekBytes,
+                                                   sb->getId(), false,
+                                                   invocationSites,
+                                                   &logsProcessed);
+#endif
+
+            if (bytesRead > 0) {
+                sb->consume(bytesRead);
+                flushed = false;
+                continue;
+            }
+
+            // Either the output buffer is full or the log message cannot be
+            // encoded (i.e. it's corrupt), in which case we skip the buffer.
+            if (flushed || flightRecorder != nullptr)
+                break;
+
+            encoder.swapBuffer(outputDoubleBuffer, outputSize, &out,
+                               &outLength);
+            std::swap(outputDoubleBuffer, compressingBuffer);
+            if (!writeSynchronously(out, outLength))
+                return;
+            flushed = true;
+        }
+    }
+
+    if (flightRecorder == nullptr) {
+        encoder.swapBuffer(outputDoubleBuffer, outputSize, &out, &outLength);
+        std::swap(outputDoubleBuffer, compressingBuffer);
+        writeSynchronously(out, outLength);
+        return;
+    }
+
+    int fd = open(NanoLogConfig::FLIGHT_RECORDER_DUMP_FILE,
+                  O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd >= 0) {
+        writeFlightRecorder(fd, encoder.getEncodedBytes());
+        close(fd);
+    }
+}
+
+/**
+ * Handler for the fatal signals (see setCrashHandler()) that drains the
+ * StagingBuffers before letting the signal take its default action.
+ *
+ * \param signal
+ *      Fatal signal received
+ */
+void
+RuntimeLogger::handleFatalSignal(int signal)
+{
+    // Only the first fatal signal drains; a fault while draining falls
+    // through to the default action.
+    if (crashSignal == 0) {
+        crashSignal = signal;
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = &RuntimeLogger::handleCrashDrainTimeout;
+        sigaction(SIGALRM, &action, nullptr);
+        alarm(NanoLogConfig::CRASH_DRAIN_TIMEOUT_S + 1);
+
+        nanoLogSingleton.drainOnCrash();
+    }
+
+    // The handler was installed with SA_RESETHAND, so the signal takes its
+    // default action (i.e. terminate with a core dump) once we return.
+    raise(signal);
+}
+
+/**
+ * Handler for the SIGALRM that bounds the time spent in handleFatalSignal(),
+ * i.e. when a write to a wedged disk blocks. It terminates the process with
+ * the original fatal signal.
+ *
+ * \param signal
+ *      SIGALRM
+ */
+void
+RuntimeLogger::handleCrashDrainTimeout(int signal)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_DFL;
+    sigaction(crashSignal, &action, nullptr);
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, crashSignal);
+    pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+    raise(crashSignal);
+}
+
+// See documentation in NanoLog.h
+void
+RuntimeLogger::setCrashHandler(bool enabled)
+{
+    static const int fatalSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL,
+                                       SIGABRT};
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    if (enabled) {
+        action.sa_handler = &RuntimeLogger::handleFatalSignal;
+        action.sa_flags = SA_RESETHAND;
+    } else {
+        action.sa_handler = SIG_DFL;
+    }
+
+    for (size_t i = 0; i < Util::arraySize(fatalSignals); ++i)
+        sigaction(fatalSignals[i], &action, nullptr);
+}
+
+/**
+ * Registers the NANO_LOG_SIGNAL_SAFE() sites queued since the last invocation
+ * and allocates the emergency StagingBuffer they log to. This is invoked by
+ * the compression thread (or the application once the agent has started).
+ */
+void
+RuntimeLogger::registerSignalSafeSites()
+{
+    SignalSafeSite *site = __sync_lock_test_and_set(&pendingSignalSafeSites,
+                                                    nullptr);
+    if (site == nullptr)
+        return;
+
+    if (emergencyBuffer == nullptr && agentRegion != nullptr) {
+        emergencyBuffer = allocateSharedStagingBuffer();
+    } else if (emergencyBuffer == nullptr) {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        StagingBuffer *sb = new StagingBuffer(nextBufferId++);
+        threadBuffers.push_back(sb);
+        emergencyBuffer = sb;
+    }
+
+    while (site != nullptr) {
+        SignalSafeSite *next = site->next;
+        registerInvocationSite_internal(site->logId, site->info);
+
+        Fence::sfence(); // The logId must be visible before the site is used
+        site->registered = true;
+        site = next;
+    }
+}
+
+/**
+ * Allocates a StagingBuffer for the current thread in the shared memory
+ * region of the agent and publishes it to the agent. If all the slots are
+ * in use, this waits for the agent to free one (i.e. after a thread exits).
+ *
+ * \return
+ *      The new StagingBuffer
+ */
+RuntimeLogger::StagingBuffer *
+RuntimeLogger::allocateSharedStagingBuffer()
+{
+    uint32_t bufferId;
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        bufferId = nextBufferId++;
+    }
+
+    bool warned = false;
+    while (true) {
+        for (uint32_t i = 0; i < NanoLogConfig::AGENT_MAX_THREADS; ++i) {
+            if (!__sync_bool_compare_and_swap(&agentRegion->slotStates[i],
+                                              AgentRegion::SLOT_FREE,
+                                              AgentRegion::SLOT_RESERVED))
+                continue;
+
+            StagingBuffer *sb = new(agentRegion->stagingBuffers[i])
+                                        StagingBuffer(bufferId);
+            Fence::sfence();
+            agentRegion->slotStates[i] = AgentRegion::SLOT_PUBLISHED;
+            return sb;
+        }
+
+        if (!warned) {
+            fprintf(stderr, "NanoLog: All %u StagingBuffers shared with the "
+                            "agent are in use; waiting for a thread to exit "
+                            "(see NanoLogConfig::AGENT_MAX_THREADS).\r\n",
+                    NanoLogConfig::AGENT_MAX_THREADS);
+            warned = true;
+        }
+        usleep(1000);
+    }
+}
+
+/**
+ * Frees a StagingBuffer after its thread has exited and its log messages
+ * have been compressed, returning it to the agent's shared memory region if
+ * that's where it was allocated.
+ *
+ * \param sb
+ *      StagingBuffer to free
+ */
+void
+RuntimeLogger::freeStagingBuffer(StagingBuffer *sb)
+{
+    char *slots = agentRegion ? agentRegion->stagingBuffers[0] : nullptr;
+    char *pos = reinterpret_cast<char*>(sb);
+    if (slots == nullptr || pos < slots ||
+            pos >= slots + sizeof(agentRegion->stagingBuffers)) {
+        delete sb;
+        return;
+    }
+
+    sb->~StagingBuffer();
+    Fence::sfence();
+    agentRegion->slotStates[(pos - slots)/sizeof(StagingBuffer)] =
+                                                    AgentRegion::SLOT_FREE;
+}
+
+/**
+ * Copies the static information of a newly registered log invocation site to
+ * the shared memory region so that the agent can compress its log messages.
+ * The caller must hold the registrationMutex.
+ *
+ * \param logId
+ *      Identifier assigned to the log invocation site
+ * \param info
+ *      Static information of the log invocation site
+ */
+void
+RuntimeLogger::publishInvocationSiteToAgent(int logId,
+                                            const StaticLogInfo &info)
+{
+    if (static_cast<uint32_t>(logId) >= NanoLogConfig::AGENT_MAX_LOG_SITES) {
+        fprintf(stderr, "NanoLog: More than %u log invocation sites were "
+                        "registered, which is more than the agent supports "
+                        "(see NanoLogConfig::AGENT_MAX_LOG_SITES).\r\n",
+                NanoLogConfig::AGENT_MAX_LOG_SITES);
+        std::exit(-1);
+    }
+
+    new(agentRegion->sites[logId]) StaticLogInfo(info);
+    Fence::sfence();
+    agentRegion->numSites = logId + 1;
+}
+
+/**
+ * Invoked by the agent at the start of every pass through the StagingBuffers
+ * to adopt the StagingBuffers and log invocation sites the application has
+ * created since, and to relay sync() requests and exits.
+ */
+void
+RuntimeLogger::updateAgent()
+{
+    for (uint32_t i = 0; i < NanoLogConfig::AGENT_MAX_THREADS; ++i) {
+        if (agentRegion->slotStates[i] != AgentRegion::SLOT_PUBLISHED)
+            continue;
+
+        Fence::lfence();
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        threadBuffers.push_back(reinterpret_cast<StagingBuffer*>(
+                                    agentRegion->stagingBuffers[i]));
+        agentRegion->slotStates[i] = AgentRegion::SLOT_ADOPTED;
+    }
+
+    uint32_t numSites = agentRegion->numSites;
+    if (invocationSites.size() < numSites) {
+        Fence::lfence();
+        std::lock_guard<std::mutex> lock(registrationMutex);
+        while (invocationSites.size() < numSites) {
+            invocationSites.push_back(*reinterpret_cast<StaticLogInfo*>(
+                            agentRegion->sites[invocationSites.size()]));
+        }
+    }
+
+    if (agentSyncPending && syncStatus == SYNC_COMPLETED) {
+        agentRegion->syncCompleted = agentSyncTarget;
+        agentSyncPending = false;
+
+        if (agentExiting)
+            compressionThreadShouldExit = true;
+    }
+
+    // The agent outputs everything before exiting, which includes when the
+    // application dies (and the agent is reparented).
+    if (!agentSyncPending && !compressionThreadShouldExit) {
+        agentExiting = agentRegion->shouldExit ||
+                            getppid() != agentParentPid;
+        agentSyncTarget = agentRegion->syncRequested;
+        if (agentSyncTarget > agentRegion->syncCompleted || agentExiting) {
+            agentSyncPending = true;
+            syncStatus = SYNC_REQUESTED;
+        }
+    }
+}
+
+/**
+ * Implements sync() in the application once the agent has started.
+ */
+void
+RuntimeLogger::syncWithAgent()
+{
+    uint64_t target = __sync_add_and_fetch(&agentRegion->syncRequested, 1);
+    while (agentRegion->syncCompleted < target) {
+        if (agentPid <= 0 || waitpid(agentPid, nullptr, WNOHANG) != 0) {
+            fprintf(stderr, "NanoLog: The agent process has exited; log "
+                            "messages can no longer be output.\r\n");
+            agentPid = 0;
+            return;
+        }
+
+        usleep(10);
+    }
+}
+
+/**
+ * Main function of the agent process.
+ */
+void
+RuntimeLogger::agentMain()
+{
+    // The application's StagingBuffers are private to it, and have
+    // been drained.
+    threadBuffers.clear();
+    syncStatus = SYNC_COMPLETED;
+    aioAvailable = false;
+    nextInvocationIndexToBePersisted = 0; // Reset the dictionary
+    compressionThreadShouldExit = false;
+
+    compressionThreadMain();
+
+    // Skip the destructors, which belong to the application
+    _exit(0);
+}
+
+/**
+ * Internal implementation of startAgent().
+ *
+ * \return
+ *      Process id of the agent
+ */
+int
+RuntimeLogger::startAgent_internal()
+{
+    if (agentRegion != nullptr)
+        return agentPid;
+
+    // Everything seems okay, stop the background thread and fork the agent
+    sync();
+    stopCompressionThread();
+
+    void *region = mmap(nullptr, sizeof(AgentRegion), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("NanoLog could not map the memory shared with the agent");
+        std::exit(-1);
+    }
+
+    // The BacktraceRings are allocated privately and would not be visible
+    backtraceLogLevel = SILENT_LOG_LEVEL;
+
+    agentRegion = static_cast<AgentRegion*>(region);
+    agentRegion->numSites = static_cast<uint32_t>(invocationSites.size());
+    agentParentPid = getpid();
+
+    pid_t pid;
+    {
+        // Ensure the child doesn't inherit locked mutexes
+        std::lock_guard<std::mutex> bufferLock(bufferMutex);
+        std::lock_guard<std::mutex> registrationLock(registrationMutex);
+        agentForking = true;
+        pid = fork();
+        agentForking = false;
+    }
+
+    if (pid < 0) {
+        perror("NanoLog could not fork the agent");
+        std::exit(-1);
+    }
+
+    if (pid == 0)
+        agentMain();
+
+    agentPid = pid;
+
+    // The log messages of the threads that have logged before (which should
+    // only be the caller) can no longer be output through their current
+    // StagingBuffers.
+    std::unique_lock<std::mutex> lock(bufferMutex);
+    for (StagingBuffer *sb : threadBuffers) {
+        if (sb != stagingBuffer && sb != emergencyBuffer) {
+            fprintf(stderr, "NanoLog: startAgent() should be invoked before "
+                            "other threads log; log messages of thread %u will "
+                            "not be output.\r\n", sb->getId());
+        }
+    }
+
+    if (stagingBuffer != nullptr) {
+        threadBuffers.erase(std::find(threadBuffers.begin(),
+                                      threadBuffers.end(), stagingBuffer));
+        delete stagingBuffer;
+        stagingBuffer = nullptr;
+    }
+
+    // Signal handlers must also log to the shared memory from now on
+    if (emergencyBuffer != nullptr) {
+        while (__sync_lock_test_and_set(&emergencyBufferInUse, 1))
+            sched_yield();
+
+        StagingBuffer *oldBuffer = emergencyBuffer;
+        threadBuffers.erase(std::find(threadBuffers.begin(),
+                                      threadBuffers.end(), oldBuffer));
+        lock.unlock();
+        emergencyBuffer = allocateSharedStagingBuffer();
+        __sync_lock_release(&emergencyBufferInUse);
+        delete oldBuffer;
+    } else {
+        lock.unlock();
+    }
+
+    registerSignalSafeSites();
+    return agentPid;
+}
+
+// See documentation in NanoLog.h
+int
+RuntimeLogger::startAgent() {
+    return nanoLogSingleton.startAgent_internal();
+}
+
+/**
+* Set where the NanoLog should output its compressed log. If a previous
+* log file was specified, NanoLog will attempt to sync() the remaining log
+* entries before swapping files. For best practices, the output file shall
+* be set before the first invocation to log by the main thread as this
+* function is *not* thread safe.
+*
+* By default, the NanoLog will output to /tmp/compressedLog
+*
+* \param filename
+*      File for NanoLog to output the compress log
+*
+* \throw is_base::failure
+*      if the file cannot be opened or crated
+*/
+void
+RuntimeLogger::setLogFile(const char *filename) {
+    nanoLogSingleton.setLogFile_internal(filename);
 }
 
 /**
@@ -709,6 +2351,38 @@ RuntimeLogger::setLogLevel(LogLevel logLevel) {
     nanoLogSingleton.currentLogLevel = logLevel;
 }
 
+// See documentation in NanoLog.h
+void
+RuntimeLogger::setBacktraceLogLevel(LogLevel logLevel) {
+    if (logLevel < 0)
+        logLevel = static_cast<LogLevel>(0);
+    else if (logLevel >= NUM_LOG_LEVELS)
+        logLevel = static_cast<LogLevel>(NUM_LOG_LEVELS - 1);
+    nanoLogSingleton.backtraceLogLevel = logLevel;
+}
+
+// See documentation in NanoLog.h
+void
+RuntimeLogger::setPriorityLogLevel(LogLevel logLevel) {
+    if (logLevel < 0)
+        logLevel = static_cast<LogLevel>(0);
+    else if (logLevel >= NUM_LOG_LEVELS)
+        logLevel = static_cast<LogLevel>(NUM_LOG_LEVELS - 1);
+    nanoLogSingleton.priorityLogLevel = logLevel;
+}
+
+// See documentation in NanoLog.h
+void
+RuntimeLogger::setBlockCompression(BlockCompression compression) {
+    nanoLogSingleton.blockCompression = compression;
+}
+
+// See documentation in NanoLog.h
+void
+RuntimeLogger::triggerBacktrace() {
+    nanoLogSingleton.backtraceTriggeredAt = PerfUtils::Cycles::rdtsc();
+}
+
 /**
 * Blocks until the NanoLog system is able to persist to disk the
 * pending log messages that occurred before this invocation. Note that this
@@ -718,14 +2392,87 @@ RuntimeLogger::setLogLevel(LogLevel logLevel) {
 */
 void
 RuntimeLogger::sync() {
+    nanoLogSingleton.sync_internal();
+}
+
+/**
+ * Implements sync() for this Logger.
+ */
+void
+RuntimeLogger::sync_internal() {
 #ifdef BENCHMARK_DISCARD_ENTRIES_AT_STAGINGBUFFER
     return;
 #endif
 
-    std::unique_lock<std::mutex> lock(nanoLogSingleton.condMutex);
-    nanoLogSingleton.syncStatus = SYNC_REQUESTED;
-    nanoLogSingleton.workAdded.notify_all();
-    nanoLogSingleton.hintSyncCompleted.wait(lock);
+    // The background thread will pick up the unpublished bytes of the other
+    // threads during the sync, but we can save it the trouble for our own.
+    StagingBuffer *sb = threadStagingBuffer();
+    if (sb != nullptr)
+        sb->publish();
+
+    if (agentRegion != nullptr) {
+        syncWithAgent();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(condMutex);
+    syncStatus = SYNC_REQUESTED;
+    workAdded.notify_all();
+    hintSyncCompleted.wait(lock);
+}
+
+// See documentation in NanoLog.h
+RuntimeLogger *
+RuntimeLogger::createLogger(const char *name, const char *filename,
+                            const LoggerOptions &options)
+{
+    std::lock_guard<std::mutex> lock(loggersMutex);
+    uint32_t loggerId = 0;
+    for (uint32_t i = 1; i < NanoLogConfig::MAX_LOGGERS; ++i) {
+        if (loggers[i] == nullptr) {
+            if (loggerId == 0)
+                loggerId = i;
+        } else if (loggers[i]->loggerName == name) {
+            fprintf(stderr, "NanoLog: A Logger named '%s' already "
+                            "exists\r\n", name);
+            return nullptr;
+        }
+    }
+
+    if (loggerId == 0) {
+        fprintf(stderr, "NanoLog: Unable to create the Logger '%s' since "
+                        "there are already %u Loggers (see "
+                        "NanoLogConfig::MAX_LOGGERS)\r\n",
+                name, NanoLogConfig::MAX_LOGGERS);
+        return nullptr;
+    }
+
+    int fd = open(filename, NanoLogConfig::FILE_PARAMS |
+                            (options.durable ? O_DSYNC : 0), 0666);
+    if (fd < 0) {
+        std::string err = "Unable to open file new log file: '";
+        err.append(filename);
+        err.append("': ");
+        err.append(strerror(errno));
+        throw std::ios_base::failure(err);
+    }
+
+    loggers[loggerId] = new RuntimeLogger(loggerId, name, filename, fd,
+                                          options);
+    return loggers[loggerId];
+}
+
+// See documentation in NanoLog.h
+RuntimeLogger *
+RuntimeLogger::getLogger(const char *name)
+{
+    std::lock_guard<std::mutex> lock(loggersMutex);
+    for (uint32_t i = 1; i < NanoLogConfig::MAX_LOGGERS; ++i) {
+        if (loggers[i] != nullptr && loggers[i]->loggerName == name)
+            return loggers[i];
+    }
+
+    return nullptr;
 }
 
 /**
@@ -740,9 +2487,9 @@ RuntimeLogger::sync() {
 *      Number of contiguous bytes to reserve.
 *
 * \param blocking
-*      Test parameter that indicates that the function should
-*      return with a nullptr rather than block when there's
-*      not enough space.
+*      Indicates that the function should return with a nullptr rather
+*      than block when there's not enough space (i.e. for tests and
+*      signal handlers).
 *
 * \return
 *      A pointer into storage[] that can be written to by the producer for
@@ -756,6 +2503,10 @@ RuntimeLogger::StagingBuffer::reserveSpaceInternal(size_t nbytes, bool blocking)
     uint64_t start = PerfUtils::Cycles::rdtsc();
 #endif
 
+    // The consumer can only free up space from bytes that it can see, so
+    // make sure everything reserved thus far has been published.
+    publish();
+
     // There's a subtle point here, all the checks for remaining
     // space are strictly < or >, not <= or => because if we allow
     // the record and print positions to overlap, we can't tell
@@ -782,6 +2533,7 @@ RuntimeLogger::StagingBuffer::reserveSpaceInternal(size_t nbytes, bool blocking)
                 Fence::sfence();
                 producerPos = storage;
                 minFreeSpace = cachedConsumerPos - producerPos;
+                publish();
             }
         } else {
             minFreeSpace = cachedConsumerPos - producerPos;
@@ -796,8 +2548,15 @@ RuntimeLogger::StagingBuffer::reserveSpaceInternal(size_t nbytes, bool blocking)
         // Needed to prevent infinite loops in tests
         if (!blocking && minFreeSpace <= nbytes)
             return nullptr;
+
+        // Let the consumer know that we're waiting on it
+        if (minFreeSpace <= nbytes && !producerBlocked)
+            producerBlocked = true;
     }
 
+    if (producerBlocked)
+        producerBlocked = false;
+
 #ifdef RECORD_PRODUCER_STATS
     uint64_t cyclesBlocked = PerfUtils::Cycles::rdtsc() - start;
     cyclesProducerBlocked += cyclesBlocked;
@@ -820,13 +2579,35 @@ RuntimeLogger::StagingBuffer::reserveSpaceInternal(size_t nbytes, bool blocking)
 *
 * \param[out] bytesAvailable
 *      Number of bytes consumable
+* \param includeUnpublished
+*      Publish on the producer's behalf the bytes it has finished writing
+*      but has yet to publish and include them in the return. This reads the
+*      producer's private position and thus should only be used when the
+*      producer is suspected to be idle or when all the log statements must
+*      be flushed (i.e. during a sync()).
 * \return
 *      Pointer to the consumable space
 */
 char *
-RuntimeLogger::StagingBuffer::peek(uint64_t *bytesAvailable) {
-    // Save a consistent copy of producerPos
-    char *cachedProducerPos = producerPos;
+RuntimeLogger::StagingBuffer::peek(uint64_t *bytesAvailable,
+                                   bool includeUnpublished) {
+    // Save a consistent copy of the producer's position
+    char *cachedProducerPos = publishedPos;
+
+    if (includeUnpublished) {
+        // Publish on the producer's behalf. The compare-and-swap ensures that
+        // we never move publishedPos backwards should the producer publish
+        // a newer position in the meantime, in which case we'll use that.
+        char *unpublishedPos = producerPos;
+        if (unpublishedPos != cachedProducerPos &&
+                !__sync_bool_compare_and_swap(&publishedPos, cachedProducerPos,
+                                              unpublishedPos))
+        {
+            unpublishedPos = publishedPos;
+        }
+
+        cachedProducerPos = unpublishedPos;
+    }
 
     if (cachedProducerPos < consumerPos) {
         Fence::lfence(); // Prevent reading new producerPos but old endOf...
@@ -843,4 +2624,50 @@ RuntimeLogger::StagingBuffer::peek(uint64_t *bytesAvailable) {
     return consumerPos;
 }
 
+/**
+* Peek at the contiguous log messages in the PriorityRing that have yet to be
+* consumed, skipping over the padding at the end of the ring. This should only
+* be invoked by the consumer.
+*
+* \param[out] bytesAvailable
+*      Number of bytes consumable
+* \return
+*      Pointer to the consumable space
+*/
+char *
+RuntimeLogger::PriorityRing::peek(uint64_t *bytesAvailable) {
+    const uint64_t size = NanoLogConfig::PRIORITY_RING_SIZE;
+    uint64_t cachedHead = head;
+    Fence::lfence(); // Read the messages only after the head
+
+    uint64_t position = tail;
+    while (position < cachedHead) {
+        uint64_t offset = position % size;
+        bool padding = size - offset < sizeof(Log::UncompressedEntry) ||
+                reinterpret_cast<Log::UncompressedEntry*>(storage + offset)
+                                    ->fmtId == BacktraceRing::PADDING_ID;
+
+        // The padding extends to the end of the ring and is skipped unless
+        // it ends the log messages peek()-ed thus far.
+        if (padding) {
+            if (position > tail)
+                break;
+
+            position += size - offset;
+            tail = position;
+            continue;
+        }
+
+        // The log messages can't be contiguous across the end of the ring
+        if (offset == 0 && position > tail)
+            break;
+
+        position += reinterpret_cast<Log::UncompressedEntry*>(storage + offset)
+                                                                ->entrySize;
+    }
+
+    *bytesAvailable = position - tail;
+    return storage + tail % size;
+}
+
 }; // namespace NanoLog Internal
\ No newline at end of file
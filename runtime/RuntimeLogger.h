@@ -18,7 +18,9 @@
 
 #include <aio.h>
 #include <cassert>
+#include <sys/types.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <string>
@@ -60,6 +62,9 @@ using namespace NanoLog;
             logId = static_cast<int32_t>(invocationSites.size());
             invocationSites.push_back(info);
 
+            if (agentRegion != nullptr)
+                publishInvocationSiteToAgent(logId, info);
+
 #ifdef ENABLE_DEBUG_PRINTING
             printf("Registered '%s' as id=%d\r\n", info.formatString, logId);
             printf("\tisParamString [%p] = ", info.isArgString);
@@ -122,23 +127,334 @@ using namespace NanoLog;
             stagingBuffer->finishReservation(nbytes);
         }
 
+        // Where reserveAlloc(nbytes, severity, lane) staged a log message
+        enum StagingLane {
+            STAGING_BUFFER_LANE,    // The thread's StagingBuffer
+            BACKTRACE_LANE,         // The thread's BacktraceRing
+            PRIORITY_LANE           // The thread's PriorityRing
+        };
+
+        /**
+         * Variant of reserveAlloc() for a log message of a given severity.
+         * Messages less severe than the log level but at least as severe as
+         * the backtrace log level are instead staged in the thread's
+         * BacktraceRing, where they will only be compressed if a backtrace
+         * is triggered. Messages at least as severe as the priority log level
+         * are staged in the thread's PriorityRing if they fit.
+         *
+         * \param nbytes
+         *      number of bytes to allocate
+         * \param severity
+         *      LogLevel of the log message
+         * \param[out] lane
+         *      Set to where the space was allocated; this must be passed to
+         *      the corresponding finishAlloc()
+         *
+         * \return
+         *      pointer to the allocated space or nullptr if the message
+         *      should be dropped
+         */
+        static inline char *
+        reserveAlloc(size_t nbytes, LogLevel severity, StagingLane &lane) {
+            if (severity <= nanoLogSingleton.currentLogLevel) {
+                // (Metrics are logged without a severity and never expedited)
+                lane = STAGING_BUFFER_LANE;
+                if (severity > nanoLogSingleton.priorityLogLevel
+                        || severity == SILENT_LOG_LEVEL)
+                    return reserveAlloc(nbytes);
+
+                if (stagingBuffer == nullptr)
+                    nanoLogSingleton.ensureStagingBufferAllocated();
+
+                char *writePos = stagingBuffer->priorityRing.reserve(nbytes);
+                if (writePos == nullptr)
+                    return stagingBuffer->reserveProducerSpace(nbytes);
+
+                lane = PRIORITY_LANE;
+                return writePos;
+            }
+
+            if (severity > nanoLogSingleton.backtraceLogLevel)
+                return nullptr;
+
+            if (stagingBuffer == nullptr)
+                nanoLogSingleton.ensureStagingBufferAllocated();
+
+            lane = BACKTRACE_LANE;
+            return stagingBuffer->reserveBacktraceSpace(nbytes);
+        }
+
+        /**
+         * Complement to reserveAlloc(nbytes, severity, lane). An ERROR
+         * log message additionally triggers a backtrace of the thread.
+         *
+         * \param nbytes
+         *      Number of bytes to make visible
+         * \param severity
+         *      LogLevel of the log message
+         * \param lane
+         *      Where reserveAlloc() allocated the space
+         */
+        static inline void
+        finishAlloc(size_t nbytes, LogLevel severity, StagingLane lane) {
+            if (lane == BACKTRACE_LANE) {
+                stagingBuffer->backtraceRing->finishReservation(nbytes);
+                return;
+            }
+
+            if (lane == PRIORITY_LANE)
+                stagingBuffer->priorityRing.finishReservation();
+            else
+                finishAlloc(nbytes);
+
+            if (severity == ERROR && stagingBuffer->backtraceRing != nullptr)
+                stagingBuffer->backtraceRing->requestDump();
+        }
+
+        /**
+         * Gives back the unused end of the space last reserved with
+         * reserveAlloc(nbytes, severity, lane) for a log message whose size
+         * was only bounded when it was reserved. This must be invoked before
+         * the corresponding finishAlloc(), which is passed the bytes used.
+         *
+         * \param unusedBytes
+         *      Number of bytes at the end of the reservation left unused
+         * \param lane
+         *      Where reserveAlloc() allocated the space
+         */
+        static inline void
+        trimAlloc(size_t unusedBytes, StagingLane lane) {
+            // StagingBuffer reservations are trimmed by finishing fewer bytes
+            if (lane == BACKTRACE_LANE)
+                stagingBuffer->backtraceRing->trimReservation(unusedBytes);
+            else if (lane == PRIORITY_LANE)
+                stagingBuffer->priorityRing.trimReservation(unusedBytes);
+        }
+
+        /**
+         * Log invocation site of a NANO_LOG_SIGNAL_SAFE(). Each is created
+         * during static initialization and queued for the compression thread
+         * to register, so that logging never has to register the site.
+         */
+        struct SignalSafeSite {
+            explicit SignalSafeSite(const StaticLogInfo &staticInfo)
+                : info(staticInfo)
+                , logId(UNASSIGNED_LOGID)
+                , registered(false)
+                , next(nullptr)
+            {
+                addSignalSafeSite(this);
+            }
+
+            // Static information of the log invocation site
+            StaticLogInfo info;
+
+            // Identifier assigned to the site; only valid once registered
+            int logId;
+
+            // Set once the site is registered and can be logged. This is
+            // false (zero-initialized) even before the constructor runs.
+            volatile bool registered;
+
+            // Next site waiting to be registered (see pendingSignalSafeSites)
+            SignalSafeSite *next;
+
+            DISALLOW_COPY_AND_ASSIGN(SignalSafeSite);
+        };
+
+        /**
+         * Queues a SignalSafeSite to be registered by the compression thread.
+         * This is lock-free, since it may run during static initialization
+         * in parallel with the compression thread.
+         *
+         * \param site
+         *      Log invocation site to queue
+         */
+        static inline void
+        addSignalSafeSite(SignalSafeSite *site) {
+            SignalSafeSite *head;
+            do {
+                head = pendingSignalSafeSites;
+                site->next = head;
+            } while (!__sync_bool_compare_and_swap(&pendingSignalSafeSites,
+                                                   head, site));
+        }
+
+        /**
+         * Variant of reserveAlloc() for NANO_LOG_SIGNAL_SAFE() that is
+         * async-signal-safe: it never allocates, locks or blocks. The space
+         * is reserved in the emergency StagingBuffer shared by all threads,
+         * since the thread's own StagingBuffer may be in the middle of an
+         * update by the code the signal interrupted. If the emergency buffer
+         * is in use (i.e. by another thread's signal handler) or full, the
+         * log message is dropped.
+         *
+         * \param nbytes
+         *      Number of bytes to reserve
+         * \param severity
+         *      LogLevel of the log message
+         *
+         * \return
+         *      Pointer to the space or nullptr if the message is dropped;
+         *      otherwise finishSignalSafeAlloc() must be invoked.
+         */
+        static inline char *
+        reserveSignalSafeAlloc(size_t nbytes, LogLevel severity) {
+            if (severity > nanoLogSingleton.currentLogLevel)
+                return nullptr;
+
+            StagingBuffer *sb = nanoLogSingleton.emergencyBuffer;
+            if (sb != nullptr && !__sync_lock_test_and_set(
+                                &nanoLogSingleton.emergencyBufferInUse, 1)) {
+                ++sb->numAllocations;
+                char *writePos = (nbytes < sb->minFreeSpace)
+                                    ? sb->producerPos
+                                    : sb->reserveSpaceInternal(nbytes, false);
+                if (writePos != nullptr)
+                    return writePos;
+
+                __sync_lock_release(&nanoLogSingleton.emergencyBufferInUse);
+            }
+
+            __sync_fetch_and_add(&nanoLogSingleton.signalSafeLogsDropped, 1);
+            return nullptr;
+        }
+
+        /**
+         * Complement to reserveSignalSafeAlloc() that makes the log message
+         * visible to the compression thread immediately, since the signal
+         * may be followed by the death of the process.
+         *
+         * \param nbytes
+         *      Number of bytes to make visible
+         */
+        static inline void
+        finishSignalSafeAlloc(size_t nbytes) {
+            StagingBuffer *sb = nanoLogSingleton.emergencyBuffer;
+            sb->finishReservation(nbytes);
+            sb->publish();
+            __sync_lock_release(&nanoLogSingleton.emergencyBufferInUse);
+        }
+
+        /**
+         * Records that a NANO_LOG_SIGNAL_SAFE() was dropped because its site
+         * has yet to be registered by the compression thread.
+         */
+        static inline void
+        dropSignalSafeLog() {
+            __sync_fetch_and_add(&nanoLogSingleton.signalSafeLogsDropped, 1);
+        }
+
+        /**
+         * Returns true if a log message of a given severity should be
+         * recorded by this Logger (see NANO_LOG_TO()).
+         *
+         * \param severity
+         *      LogLevel of the log message
+         */
+        inline bool
+        isInstanceRecorded(LogLevel severity) {
+            return severity <= currentLogLevel;
+        }
+
+        /**
+         * Variant of reserveAlloc() for a Logger created by createLogger(),
+         * which applies the Logger's OverflowPolicy when the calling thread's
+         * StagingBuffer is full.
+         *
+         * \param nbytes
+         *      Number of bytes to allocate
+         *
+         * \return
+         *      Pointer to the allocated space or nullptr if the log message
+         *      is dropped; otherwise finishInstanceAlloc() must be invoked.
+         */
+        inline char *
+        reserveInstanceAlloc(size_t nbytes) {
+            StagingBuffer *&sb = threadStagingBuffer();
+            if (sb == nullptr)
+                ensureStagingBufferAllocated();
+
+            if (overflowPolicy == BLOCK_ON_OVERFLOW)
+                return sb->reserveProducerSpace(nbytes);
+
+            ++sb->numAllocations;
+            char *writePos = (nbytes < sb->minFreeSpace)
+                                ? sb->producerPos
+                                : sb->reserveSpaceInternal(nbytes, false);
+            if (writePos == nullptr)
+                __sync_fetch_and_add(&logsDropped, 1);
+
+            return writePos;
+        }
+
+        /**
+         * Complement to reserveInstanceAlloc().
+         *
+         * \param nbytes
+         *      Number of bytes to make visible
+         */
+        inline void
+        finishInstanceAlloc(size_t nbytes) {
+            threadStagingBuffer()->finishReservation(nbytes);
+        }
+
+        static RuntimeLogger *createLogger(const char *name,
+                                           const char *filename,
+                                           const LoggerOptions &options);
+        static RuntimeLogger *getLogger(const char *name);
+        std::string getStats_internal();
+        void sync_internal();
+
         static std::string getStats();
         static std::string getHistograms();
         static void preallocate();
         static void setLogFile(const char *filename);
         static void setLogLevel(LogLevel logLevel);
+        static void setBacktraceLogLevel(LogLevel logLevel);
+        static void setPriorityLogLevel(LogLevel logLevel);
+        static void setBlockCompression(BlockCompression compression);
+        static void triggerBacktrace();
+        static void setFlightRecorder(uint64_t bytes);
+        static void dumpFlightRecorder(const char *path);
+        static void setCrashHandler(bool enabled);
+        static void setPerProcessLogFiles(bool enabled);
+        static int startAgent();
         static void sync();
 
         static inline LogLevel getLogLevel() {
             return nanoLogSingleton.currentLogLevel;
         }
 
+        static inline LogLevel getBacktraceLogLevel() {
+            return nanoLogSingleton.backtraceLogLevel;
+        }
+
+        /**
+         * Returns true if log messages of the given severity are recorded,
+         * either for output or in the threads' BacktraceRings.
+         *
+         * \param severity
+         *      LogLevel of the log message
+         */
+        static inline bool
+        isRecorded(LogLevel severity) {
+            return severity <= nanoLogSingleton.currentLogLevel
+                    || severity <= nanoLogSingleton.backtraceLogLevel;
+        }
+
         static inline int getCoreIdOfBackgroundThread() {
             return nanoLogSingleton.coreId;
         }
+
+        static inline uint32_t getCompressionPasses() {
+            return nanoLogSingleton.compressionPasses;
+        }
     PRIVATE:
 
         // Forward Declarations
+        class BacktraceRing;
+        class PriorityRing;
         class StagingBuffer;
         class StagingBufferDestroyer;
 
@@ -153,16 +469,126 @@ using namespace NanoLog;
         // background output thread.
         static RuntimeLogger nanoLogSingleton;
 
+        // The StagingBuffers of the thread for the Loggers created by
+        // createLogger(), indexed by loggerId (the default Logger uses
+        // stagingBuffer instead).
+        static __thread StagingBuffer *
+                        loggerStagingBuffers[NanoLogConfig::MAX_LOGGERS];
+
+        // All the Loggers indexed by loggerId; the first is nanoLogSingleton.
+        // Entries are only added, under loggersMutex.
+        static RuntimeLogger *loggers[NanoLogConfig::MAX_LOGGERS];
+        static std::mutex loggersMutex;
+
         RuntimeLogger();
 
+        RuntimeLogger(uint32_t loggerId, const char *name, const char *filename,
+                      int fd, const LoggerOptions &options);
+
+        static int openDefaultLogFile();
+
+        /**
+         * Returns the calling thread's StagingBuffer for this Logger.
+         */
+        inline StagingBuffer *&
+        threadStagingBuffer() {
+            return (loggerId == 0) ? stagingBuffer
+                                   : loggerStagingBuffers[loggerId];
+        }
+
         ~RuntimeLogger();
 
         void compressionThreadMain();
 
         void setLogFile_internal(const char *filename);
 
+        void stopCompressionThread();
+
+        void startCompressionThread();
+
+        static void handleForkPrepare();
+
+        static void handleForkParent();
+
+        static void handleForkChild();
+
+        void resetAfterForkInChild();
+
+        void setFlightRecorder_internal(uint64_t bytes);
+
+        void rotateFlightRecorder(Log::Encoder &encoder);
+
+        void writeFlightRecorder(int fd, size_t currentSegmentBytes);
+
+        static void handleFlightRecorderSignal(int signal);
+
+        static void handleFatalSignal(int signal);
+
+        static void handleCrashDrainTimeout(int signal);
+
+        void drainOnCrash();
+
+        int startAgent_internal();
+
+        void agentMain();
+
+        void updateAgent();
+
+        void syncWithAgent();
+
+        StagingBuffer *allocateSharedStagingBuffer();
+
+        void freeStagingBuffer(StagingBuffer *sb);
+
+        void publishInvocationSiteToAgent(int logId, const StaticLogInfo &info);
+
+        bool writeSynchronously(const char *buffer, size_t length);
+
+        static bool writeSynchronously(int fd, const char *buffer,
+                                       size_t length);
+
+        void registerSignalSafeSites();
+
+        /**
+         * Invoked by the compression thread at points where it holds no
+         * partially updated state to stop it for good once a fatal signal
+         * handler starts to drain the StagingBuffers.
+         */
+        inline void
+        parkIfCrashing() {
+            if (!crashDrainRequested)
+                return;
+
+            compressionThreadParked = 1;
+            while (true)
+                pause();
+        }
+
         void waitForAIO();
 
+        void issueOutput(char *buffer, size_t length);
+
+        bool isOutputInProgress();
+
+        void waitForOutput();
+
+        void completeOutput();
+
+        bool encodeStagingBuffer(StagingBuffer *sb,
+                                 std::unique_lock<std::mutex> &lock,
+                                 Log::Encoder &encoder, bool &wrapAround,
+                                 std::vector<StaticLogInfo> &shadowStaticInfo,
+                                 bool &outputBufferFull,
+                                 uint64_t &bytesConsumed);
+
+        uint64_t encodePriorityRings(Log::Encoder &encoder,
+                                const std::vector<StaticLogInfo> &dictionary,
+                                bool &outputBufferFull);
+
+        bool encodeBacktrace(StagingBuffer *sb, uint64_t globalTrigger,
+                             Log::Encoder &encoder, bool &wrapAround,
+                             std::vector<StaticLogInfo> &shadowStaticInfo);
+
         /**
          * Allocates thread-local structures if they weren't already allocated.
          * This is used by the generated C++ code to ensure it has space to
@@ -171,16 +597,19 @@ using namespace NanoLog;
          */
         inline void
         ensureStagingBufferAllocated() {
-            if (stagingBuffer == nullptr) {
+            StagingBuffer *&sb = threadStagingBuffer();
+            if (sb == nullptr && agentRegion != nullptr) {
+                sb = allocateSharedStagingBuffer();
+            } else if (sb == nullptr) {
                 std::unique_lock<std::mutex> guard(bufferMutex);
                 uint32_t bufferId = nextBufferId++;
 
                 // Unlocked for the expensive StagingBuffer allocation
                 guard.unlock();
-                stagingBuffer = new StagingBuffer(bufferId);
+                sb = new StagingBuffer(bufferId);
                 guard.lock();
 
-                threadBuffers.push_back(stagingBuffer);
+                threadBuffers.push_back(sb);
             }
         }
 
@@ -244,10 +673,163 @@ using namespace NanoLog;
         // compressingBuffer when the latter is passed to the POSIX AIO library.
         char *outputDoubleBuffer;
 
+        // Circular memory region of FLIGHT_RECORDER_SEGMENT_SIZE segments that
+        // the compressed log is output to instead of the log file while the
+        // flight recorder is enabled; nullptr otherwise.
+        char *flightRecorder;
+
+        // Number of segments in the flightRecorder
+        uint32_t flightRecorderSegments;
+
+        // Index of the segment the compression thread is encoding into
+        uint32_t currentSegment;
+
+        // Number of bytes encoded in each (closed) segment; 0 if unused
+        std::vector<size_t> segmentLengths;
+
+        // File descriptor that the compression thread should dump the
+        // flightRecorder to, or -1 if no dump was requested.
+        volatile int flightRecorderDumpFd;
+
+        // Signaled when the compression thread completes a dump
+        std::condition_variable hintDumpCompleted;
+
+        // Set by the FLIGHT_RECORDER_DUMP_SIGNAL handler to request a dump to
+        // FLIGHT_RECORDER_DUMP_FILE.
+        static volatile sig_atomic_t flightRecorderSignaled;
+
+        // Encoder of the running compression thread (nullptr if none), which
+        // the fatal signal handler continues to encode into after parking the
+        // thread.
+        Log::Encoder *activeEncoder;
+
+        // Set by the fatal signal handler to park the compression thread, and
+        // by the compression thread once it's parked (see parkIfCrashing()).
+        volatile sig_atomic_t crashDrainRequested;
+        volatile sig_atomic_t compressionThreadParked;
+
+        // Fatal signal being handled by handleFatalSignal(); 0 if none.
+        static volatile sig_atomic_t crashSignal;
+
+        // Identifies the compression thread, which cannot drain if it crashes
+        static __thread bool isCompressionThread;
+
+        // NANO_LOG_SIGNAL_SAFE() sites waiting to be registered by the
+        // compression thread. This is constant-initialized, so sites can be
+        // queued before the RuntimeLogger is constructed.
+        static SignalSafeSite *volatile pendingSignalSafeSites;
+
+        // StagingBuffer shared by all NANO_LOG_SIGNAL_SAFE() invocations,
+        // which is allocated when the first such site is registered.
+        StagingBuffer *volatile emergencyBuffer;
+
+        // Non-zero while a NANO_LOG_SIGNAL_SAFE() writes to emergencyBuffer
+        volatile int emergencyBufferInUse;
+
+        // Metric: Number of NANO_LOG_SIGNAL_SAFE() log messages dropped
+        volatile uint64_t signalSafeLogsDropped;
+
+        // Forward Declaration
+        struct AgentRegion;
+
+        // Shared memory region holding the StagingBuffers and log invocation
+        // sites once the compression is handed off to an agent process (see
+        // startAgent()); nullptr otherwise.
+        AgentRegion *agentRegion;
+
+        // Process id of the agent (in the application) or of the application
+        // (in the agent); 0 if there's no agent.
+        pid_t agentPid;
+        pid_t agentParentPid;
+
+        // Sync operation requested by the application that the agent is
+        // performing, and whether the agent should exit after it completes.
+        bool agentSyncPending;
+        uint64_t agentSyncTarget;
+        bool agentExiting;
+
+        // Set while startAgent() forks the agent, which bypasses the
+        // pthread_atfork() handlers (see handleForkPrepare()).
+        bool agentForking;
+
+        // Whether a child process outputs to a log file of its own after
+        // fork() (see setPerProcessLogFiles()), and the path of the current
+        // log file that it's derived from.
+        bool perProcessLogFiles;
+        std::string logFilePath;
+
+        // POSIX AIO doesn't survive fork() (the child doesn't inherit glibc's
+        // AIO threads), so the agent and forked children write the log file
+        // synchronously instead.
+        bool aioAvailable;
+
+        // Index of this Logger in loggers[] (0 for the default Logger) and
+        // the name it was created with.
+        uint32_t loggerId;
+        std::string loggerName;
+
+        // What the Logger does when a StagingBuffer is full (the default
+        // Logger always blocks).
+        OverflowPolicy overflowPolicy;
+
+        // Flags the log file is opened with (see LoggerOptions::durable)
+        int outputFileFlags;
+
+        // Number of least significant bits dropped from the timestamps of
+        // the log messages in the log file (see
+        // LoggerOptions::coarseTimestamps)
+        uint32_t timestampShift;
+
+        // Second compression stage applied to the output buffers before
+        // they're written (see setBlockCompression())
+        volatile BlockCompression blockCompression;
+
+        // Forward Declaration
+        class BlockCompressionStage;
+
+        // Compresses and writes the output buffers in place of POSIX AIO
+        // while a BlockCompression is set; it's allocated on first use.
+        BlockCompressionStage *blockStage;
+
+        // Indicates that the outstanding output operation (if any) was
+        // handed to the blockStage rather than to POSIX AIO
+        bool outputToBlockStage;
+
+        // Metric: Number of log messages dropped by the OverflowPolicy
+        volatile uint64_t logsDropped;
+
         // Minimum log level that RuntimeLogger will accept. Anything lower will
         // be dropped.
         LogLevel currentLogLevel;
 
+        // Least severe log level retained in the BacktraceRings; log messages
+        // between this and the currentLogLevel are only output when a
+        // backtrace is triggered.
+        LogLevel backtraceLogLevel;
+
+        // Least severe log level expedited through the PriorityRings
+        LogLevel priorityLogLevel;
+
+        // Metric: Number of writes issued early to output log messages
+        // from the PriorityRings
+        uint64_t numExpeditedWrites;
+
+        // Metric: Number of times a StagingBuffer was compressed ahead of
+        // the round-robin scan because of its backlog
+        uint64_t numUrgentBuffersScheduled;
+
+        // rdtsc() of the last time triggerBacktrace() was invoked; 0 if never.
+        volatile uint64_t backtraceTriggeredAt;
+
+        // Buffer used by the compression thread to copy the BacktraceRings
+        // and to gather the log messages of a backtrace.
+        char *backtraceScratch;
+
+        // Number of passes the compression thread has started through the
+        // StagingBuffers. The logging threads pre-aggregate metrics (i.e.
+        // NANO_METRIC_COUNTER) and log them at most once per pass.
+        volatile uint32_t compressionPasses;
+
         // Marks the rdtsc() when the current compression thread first started
         // running. A value of 0 indicates the compression thread is not running
         uint64_t cycleAtThreadStart;
@@ -304,6 +886,379 @@ using namespace NanoLog;
         // persisted to disk.
         uint32_t nextInvocationIndexToBePersisted;
 
+        /**
+         * Per-thread circular buffer that retains the most recent log messages
+         * that are less severe than the log level (i.e. DEBUG messages in
+         * production) in the same uncompressed format as the StagingBuffer.
+         * Unlike the StagingBuffer, the producer never blocks and instead
+         * overwrites the oldest log messages. The messages are only output
+         * when a backtrace is triggered, at which point the compression
+         * thread copies the ring and compresses the messages logged in the
+         * last BACKTRACE_WINDOW_MS.
+         *
+         * Log messages are never split across the end of the ring; if one
+         * doesn't fit, the rest of the ring is filled with a padding entry.
+         * Positions are byte offsets that increase monotonically, so the
+         * consumer can detect messages overwritten while it was copying.
+         */
+        class BacktraceRing {
+        public:
+            // fmtId of the entries that pad the end of the ring
+            static const uint32_t PADDING_ID = ~0U;
+
+            /**
+             * Reserves contiguous space for a log message, discarding the
+             * oldest log messages if necessary. The caller should invoke
+             * finishReservation() to make the message visible to the consumer.
+             *
+             * \param nbytes
+             *      Number of bytes to reserve
+             *
+             * \return
+             *      Pointer to the space or nullptr if the message is too large
+             *      to be retained
+             */
+            inline char *
+            reserve(size_t nbytes) {
+                const uint64_t size = NanoLogConfig::BACKTRACE_RING_SIZE;
+                if (nbytes > size/4)
+                    return nullptr;
+
+                uint64_t offset = head % size;
+                uint64_t padding = (size - offset < nbytes) ? size - offset : 0;
+                reservedHead = head + padding + nbytes;
+
+                // The consumer must see the advanced tail before the old
+                // messages are overwritten.
+                uint64_t newTail = tail;
+                while (reservedHead - newTail > size)
+                    newTail += getEntrySize(newTail);
+                tail = newTail;
+                Fence::sfence();
+
+                if (padding >= sizeof(Log::UncompressedEntry)) {
+                    auto *pad = reinterpret_cast<Log::UncompressedEntry*>(
+                                                        storage + offset);
+                    pad->fmtId = PADDING_ID;
+                    pad->timestamp = 0;
+                    pad->entrySize = static_cast<uint32_t>(padding);
+                }
+
+                return storage + (reservedHead - nbytes) % size;
+            }
+
+            /**
+             * Makes the log message reserve()-ed last visible to the consumer.
+             *
+             * \param nbytes
+             *      Number of bytes reserved
+             */
+            inline void
+            finishReservation(size_t nbytes) {
+                Fence::sfence(); // Ensures producer finishes writes before bump
+                head = reservedHead;
+            }
+
+            /**
+             * Shrinks the log message reserve()-ed last before it's made
+             * visible with finishReservation().
+             *
+             * \param unusedBytes
+             *      Number of bytes at the end of the reservation to give back
+             */
+            inline void
+            trimReservation(size_t unusedBytes) {
+                reservedHead -= unusedBytes;
+            }
+
+            /**
+             * Asks the compression thread to output the messages logged in
+             * the last BACKTRACE_WINDOW_MS (i.e. after an ERROR).
+             */
+            inline void
+            requestDump() {
+                dumpRequestedAt = PerfUtils::Cycles::rdtsc();
+            }
+
+            /**
+             * Returns true if a backtrace has been requested by the producer
+             * or triggered globally that the consumer has yet to output.
+             *
+             * \param globalTrigger
+             *      rdtsc() of the last triggerBacktrace()
+             */
+            inline bool
+            isDumpPending(uint64_t globalTrigger) {
+                return dumpRequestedAt > dumpHandledAt
+                        || globalTrigger > dumpHandledAt;
+            }
+
+            /**
+             * Returns the number of bytes of the entry at a position in the
+             * ring, which includes the implicit padding at the end of the
+             * ring if there's no space for an entry there.
+             *
+             * \param position
+             *      Position of the entry
+             * \param ring
+             *      Storage of the ring or a copy of it
+             */
+            static inline uint64_t
+            getEntrySize(uint64_t position,
+                         const char *ring) {
+                const uint64_t size = NanoLogConfig::BACKTRACE_RING_SIZE;
+                uint64_t offset = position % size;
+                if (size - offset < sizeof(Log::UncompressedEntry))
+                    return size - offset;
+
+                return reinterpret_cast<const Log::UncompressedEntry*>(
+                                                ring + offset)->entrySize;
+            }
+
+            inline uint64_t
+            getEntrySize(uint64_t position) {
+                return getEntrySize(position, storage);
+            }
+
+            BacktraceRing()
+                : head(0)
+                , tail(0)
+                , reservedHead(0)
+                , dumpRequestedAt(0)
+                , dumpHandledAt(PerfUtils::Cycles::rdtsc())
+                , dumpedUpTo(0)
+                , storage()
+            {}
+
+        PRIVATE:
+            // Position after the last log message visible to the consumer
+            volatile uint64_t head;
+
+            // Position of the oldest log message that has not been discarded
+            volatile uint64_t tail;
+
+            // Position after the log message being reserved by the producer
+            uint64_t reservedHead;
+
+            // rdtsc() of the last backtrace requested by the producer
+            volatile uint64_t dumpRequestedAt;
+
+            // rdtsc() of the latest backtrace output by the consumer. Triggers
+            // that predate the ring are considered handled.
+            uint64_t dumpHandledAt;
+
+            // Position up to which the consumer has output the log messages,
+            // which prevents back-to-back backtraces from duplicating them.
+            uint64_t dumpedUpTo;
+
+            // Backing store used to implement the ring
+            char storage[NanoLogConfig::BACKTRACE_RING_SIZE];
+
+            friend RuntimeLogger;
+
+            DISALLOW_COPY_AND_ASSIGN(BacktraceRing);
+        };
+
+        /**
+         * Small per-thread FIFO for the log messages at least as severe as the
+         * priority log level, which the compression thread drains ahead of
+         * the StagingBuffers so that they don't wait behind a backlog of less
+         * severe log messages. The messages are in the same uncompressed
+         * format as the StagingBuffer. Unlike the StagingBuffer, the producer
+         * never blocks; if a message doesn't fit, it's staged in the
+         * StagingBuffer instead.
+         *
+         * As in the BacktraceRing, log messages are never split across the
+         * end of the ring and positions are byte offsets that increase
+         * monotonically.
+         */
+        class PriorityRing {
+        public:
+            /**
+             * Reserves contiguous space for a log message. The caller should
+             * invoke finishReservation() to make the message visible to the
+             * consumer.
+             *
+             * \param nbytes
+             *      Number of bytes to reserve
+             *
+             * \return
+             *      Pointer to the space or nullptr if the message doesn't fit
+             */
+            inline char *
+            reserve(size_t nbytes) {
+                const uint64_t size = NanoLogConfig::PRIORITY_RING_SIZE;
+                if (nbytes > size/4)
+                    return nullptr;
+
+                uint64_t offset = head % size;
+                uint64_t padding = (size - offset < nbytes) ? size - offset : 0;
+                if (head + padding + nbytes - tail > size)
+                    return nullptr;
+
+                if (padding >= sizeof(Log::UncompressedEntry)) {
+                    auto *pad = reinterpret_cast<Log::UncompressedEntry*>(
+                                                        storage + offset);
+                    pad->fmtId = BacktraceRing::PADDING_ID;
+                    pad->timestamp = 0;
+                    pad->entrySize = static_cast<uint32_t>(padding);
+                }
+
+                reservedHead = head + padding + nbytes;
+                return storage + (reservedHead - nbytes) % size;
+            }
+
+            /**
+             * Makes the log message reserve()-ed last visible to the
+             * consumer. Unlike the StagingBuffer, this isn't batched.
+             */
+            inline void
+            finishReservation() {
+                Fence::sfence(); // Ensures producer finishes writes before bump
+                head = reservedHead;
+            }
+
+            /**
+             * Shrinks the log message reserve()-ed last before it's made
+             * visible with finishReservation().
+             *
+             * \param unusedBytes
+             *      Number of bytes at the end of the reservation to give back
+             */
+            inline void
+            trimReservation(size_t unusedBytes) {
+                reservedHead -= unusedBytes;
+            }
+
+            char *peek(uint64_t *bytesAvailable);
+
+            /**
+             * Frees the next nbytes returned by peek() back to the producer.
+             *
+             * \param nbytes
+             *      Number of bytes to return back to the producer
+             */
+            inline void
+            consume(uint64_t nbytes) {
+                Fence::lfence(); // Make sure consumer reads finish before bump
+                tail += nbytes;
+            }
+
+            /**
+             * Returns true if the consumer has consumed every log message.
+             */
+            inline bool
+            isEmpty() {
+                return tail == head;
+            }
+
+            PriorityRing()
+                : head(0)
+                , tail(0)
+                , reservedHead(0)
+                , storage()
+            {}
+
+        PRIVATE:
+            // Position after the last log message visible to the consumer
+            volatile uint64_t head;
+
+            // Position of the oldest log message the consumer has yet to
+            // consume; only updated by the consumer.
+            volatile uint64_t tail;
+
+            // Position after the log message being reserved by the producer
+            uint64_t reservedHead;
+
+            // Backing store used to implement the ring
+            char storage[NanoLogConfig::PRIORITY_RING_SIZE];
+
+            friend RuntimeLogger;
+
+            DISALLOW_COPY_AND_ASSIGN(PriorityRing);
+        };
+
+        /**
+         * Second compression stage that compresses the output buffers with a
+         * BlockCodec and writes them to the log file as CompressedBlocks on a
+         * helper thread, so that the compression thread can encode the next
+         * output buffer in the meantime. Like POSIX AIO, which it takes the
+         * place of, it processes one output buffer at a time and the buffer
+         * shall not be modified until it's done.
+         */
+        class BlockCompressionStage {
+        public:
+            BlockCompressionStage();
+            ~BlockCompressionStage();
+
+            void submit(int fd, const char *buffer, size_t length,
+                        BlockCodec::Codec codec);
+            void wait();
+            void stop();
+
+            /**
+             * Returns true while the output buffer last submitted is still
+             * being compressed or written.
+             */
+            inline bool
+            isBusy() const {
+                return busy.load(std::memory_order_acquire);
+            }
+
+            // Whether the write of the last output buffer failed
+            bool writeFailed;
+
+            // Number of bytes written for the last output buffer (including
+            // the framing and padding)
+            size_t bytesWritten;
+
+            // Metric: Number of bytes submitted and written, respectively
+            uint64_t totalBytesIn;
+            uint64_t totalBytesOut;
+
+            // Metric: Amount of time spent compressing the output buffers
+            uint64_t cyclesCompressing;
+
+            // Metric: Number of output buffers compressed, and of those, the
+            // number stored verbatim since compression didn't shrink them
+            uint64_t numBlocks;
+            uint64_t numBlocksStored;
+
+        PRIVATE:
+            void threadMain();
+
+            // Helper thread that compresses and writes the output buffers;
+            // it's started by the first submit() after a stop().
+            std::thread thread;
+
+            // Protects the hand-off of output buffers to the thread
+            std::mutex mutex;
+
+            // Signaled when an output buffer is submitted or the thread
+            // should stop, and when the thread is done with a buffer.
+            std::condition_variable workAdded;
+            std::condition_variable workDone;
+
+            // Whether an output buffer is pending (see isBusy())
+            std::atomic<bool> busy;
+
+            // Flag signaling the thread to exit
+            bool shouldExit;
+
+            // Output buffer to compress, the file it's written to and the
+            // codec it's compressed with.
+            int fd;
+            const char *input;
+            size_t inputLength;
+            BlockCodec::Codec codec;
+
+            // Dynamically allocated buffer that the CompressedBlocks are
+            // compressed into before being written.
+            char *output;
+
+            DISALLOW_COPY_AND_ASSIGN(BlockCompressionStage);
+        };
+
         /**
          * Implements a circular FIFO producer/consumer byte queue that is used
          * to hold the dynamic information of a NanoLog log statement (producer)
@@ -358,9 +1313,86 @@ using namespace NanoLog;
                 Fence::sfence(); // Ensures producer finishes writes before bump
                 minFreeSpace -= nbytes;
                 producerPos += nbytes;
+
+                // Only expose the new bytes to the consumer in batches to
+                // avoid bouncing publishedPos' cache line on every log.
+                unpublishedBytes += nbytes;
+                if (++unpublishedRecords >=
+                                NanoLogConfig::PUBLISH_THRESHOLD_RECORDS
+                        || unpublishedBytes >=
+                                NanoLogConfig::PUBLISH_THRESHOLD_BYTES
+                        || publicationRequested)
+                {
+                    publish();
+                }
             }
 
-            char *peek(uint64_t *bytesAvailable);
+            /**
+             * Makes all the bytes finishReservation()-ed thus far by the
+             * producer visible to the consumer. This should only be invoked
+             * by the producer thread.
+             */
+            inline void
+            publish() {
+                unpublishedBytes = 0;
+                unpublishedRecords = 0;
+                publishedPos = producerPos;
+
+                if (publicationRequested)
+                    publicationRequested = false;
+            }
+
+            /**
+             * Rings the StagingBuffer's doorbell, which asks the producer to
+             * publish its outstanding bytes on its next finishReservation()
+             * rather than waiting for the publication thresholds. This should
+             * only be invoked by the consumer.
+             */
+            inline void
+            requestPublication() {
+                if (!publicationRequested)
+                    publicationRequested = true;
+            }
+
+            char *peek(uint64_t *bytesAvailable,
+                       bool includeUnpublished = false);
+
+            /**
+             * Returns the number of bytes published by the producer that
+             * the consumer has yet to consume. The producer may publish
+             * more concurrently, so this is only a hint. This should only
+             * be invoked by the consumer.
+             */
+            inline uint64_t
+            getBacklog() {
+                char *cachedPublishedPos = publishedPos;
+                if (cachedPublishedPos >= consumerPos)
+                    return cachedPublishedPos - consumerPos;
+
+                // The producer has rolled over
+                Fence::lfence(); // Prevent reading new publishedPos but old end
+                return (endOfRecordedSpace - consumerPos)
+                        + (cachedPublishedPos - storage);
+            }
+
+            /**
+             * Reserves space in the thread's BacktraceRing (allocating it on
+             * first use) for a log message that should only be output if a
+             * backtrace is triggered.
+             *
+             * \param nbytes
+             *      Number of bytes to reserve
+             *
+             * \return
+             *      Pointer to the space or nullptr if the message is too large
+             */
+            inline char *
+            reserveBacktraceSpace(size_t nbytes) {
+                if (backtraceRing == nullptr)
+                    backtraceRing = new BacktraceRing();
+
+                return backtraceRing->reserve(nbytes);
+            }
 
             /**
              * Consumes the next nbytes in the StagingBuffer and frees it back
@@ -385,7 +1417,10 @@ using namespace NanoLog;
              */
             bool
             checkCanDelete() {
-                return shouldDeallocate && consumerPos == producerPos;
+                return shouldDeallocate && consumerPos == producerPos
+                        && priorityRing.isEmpty()
+                        && (backtraceRing == nullptr
+                                || !backtraceRing->isDumpPending(0));
             }
 
 
@@ -403,10 +1438,18 @@ using namespace NanoLog;
                     , numAllocations(0)
                     , cyclesProducerBlockedDist()
                     , cyclesIn10Ns(PerfUtils::Cycles::fromNanoseconds(10))
+                    , unpublishedBytes(0)
+                    , unpublishedRecords(0)
                     , cacheLineSpacer()
+                    , publishedPos(storage)
+                    , publicationRequested(false)
+                    , producerBlocked(false)
+                    , publicationSpacer()
                     , consumerPos(storage)
                     , shouldDeallocate(false)
                     , id(bufferId)
+                    , backtraceRing(nullptr)
+                    , priorityRing()
                     , storage() {
                 // Empty function, but causes the C++ runtime to instantiate the
                 // sbc thread_local (see documentation in function).
@@ -420,13 +1463,16 @@ using namespace NanoLog;
             }
 
             ~StagingBuffer() {
+                delete backtraceRing;
             }
 
         PRIVATE:
 
             char *reserveSpaceInternal(size_t nbytes, bool blocking = true);
 
-            // Position within storage[] where the producer may place new data
+            // Position within storage[] where the producer may place new data.
+            // This is private to the producer; the consumer should instead
+            // read publishedPos, except when the producer has gone idle.
             char *producerPos;
 
             // Marks the end of valid data for the consumer. Set by the producer
@@ -458,11 +1504,35 @@ using namespace NanoLog;
             // cyclesProducerBlockedDist distribution.
             uint64_t cyclesIn10Ns;
 
+            // Number of bytes and log statements finishReservation()-ed by
+            // the producer since the last time it published its position.
+            uint64_t unpublishedBytes;
+            uint32_t unpublishedRecords;
+
             // An extra cache-line to separate the variables that are primarily
             // updated/read by the producer (above) from the ones by the
             // consumer(below)
             char cacheLineSpacer[2*Util::BYTES_PER_CACHE_LINE];
 
+            // Position within storage[] up to which the producer has made
+            // its log statements visible to the consumer. This value is only
+            // updated by the producer (see publish()) and trails producerPos.
+            char* volatile publishedPos;
+
+            // Doorbell rung by the consumer to ask the producer to publish its
+            // outstanding bytes irrespective of the publication thresholds.
+            // It's only cleared by the producer.
+            volatile bool publicationRequested;
+
+            // Set by the producer while it waits for the consumer to free up
+            // space, which has the consumer compress this StagingBuffer first.
+            volatile bool producerBlocked;
+
+            // Separates the publication variables (above), which are rarely
+            // written, from the consumerPos (below), which the consumer
+            // updates frequently.
+            char publicationSpacer[2*Util::BYTES_PER_CACHE_LINE];
+
             // Position within the storage buffer where the consumer will consume
             // the next bytes from. This value is only updated by the consumer.
             char* volatile consumerPos;
@@ -477,6 +1547,15 @@ using namespace NanoLog;
             // similar to ThreadId, but is only assigned to threads that NANO_LOG).
             uint32_t id;
 
+            // Retains the thread's log messages that are less severe than
+            // the log level; it's allocated by the producer on first use.
+            BacktraceRing * volatile backtraceRing;
+
+            // Expedites the thread's log messages that are at least as severe
+            // as the priority log level. It's kept inline (unlike the
+            // BacktraceRing) so that it's shared with the agent as well.
+            PriorityRing priorityRing;
+
             // Backing store used to implement the circular queue
             char storage[NanoLogConfig::STAGING_BUFFER_SIZE];
 
@@ -511,12 +1590,61 @@ using namespace NanoLog;
 
             virtual ~StagingBufferDestroyer() {
                 if (stagingBuffer != nullptr) {
+                    stagingBuffer->publish();
                     stagingBuffer->shouldDeallocate = true;
                     stagingBuffer = nullptr;
                 }
+
+                for (StagingBuffer *&sb : loggerStagingBuffers) {
+                    if (sb != nullptr) {
+                        sb->publish();
+                        sb->shouldDeallocate = true;
+                        sb = nullptr;
+                    }
+                }
             }
         };
 
+        /**
+         * Layout of the shared memory region through which the application
+         * hands its log messages off to the agent process. The agent is
+         * forked from the application, so the pointers within the
+         * StagingBuffers and the StaticLogInfo (which reference static data
+         * in the executable) are valid in both processes.
+         */
+        struct AgentRegion {
+            // States of the StagingBuffer slots below
+            enum SlotState : uint32_t {
+                SLOT_FREE = 0,      // Unused or freed by the agent
+                SLOT_RESERVED,      // Being constructed by the application
+                SLOT_PUBLISHED,     // Ready to be adopted by the agent
+                SLOT_ADOPTED        // In the agent's threadBuffers
+            };
+
+            // Number of sync() operations requested by the application and
+            // the last one the agent has completed.
+            volatile uint64_t syncRequested;
+            volatile uint64_t syncCompleted;
+
+            // Set by the application when it exits
+            volatile uint32_t shouldExit;
+
+            // Number of log invocation sites published to the agent
+            volatile uint32_t numSites;
+
+            volatile uint32_t slotStates[NanoLogConfig::AGENT_MAX_THREADS];
+
+            // Storage for the StaticLogInfo of the log invocation sites
+            alignas(StaticLogInfo)
+            char sites[NanoLogConfig::AGENT_MAX_LOG_SITES]
+                      [sizeof(StaticLogInfo)];
+
+            // Storage for the StagingBuffers
+            alignas(StagingBuffer)
+            char stagingBuffers[NanoLogConfig::AGENT_MAX_THREADS]
+                               [sizeof(StagingBuffer)];
+        };
+
         DISALLOW_COPY_AND_ASSIGN(RuntimeLogger);
     };  // RuntimeLogger
 }; // Namespace NanoLogInternal